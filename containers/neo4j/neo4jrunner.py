@@ -71,3 +71,21 @@ class Neo4JRunner(ContainerRunner):
                 pass
 
         return False
+
+    def import_database(self, database: str, directory: str, arguments: List[str]) -> None:
+        """
+        Create the store of a database with 'neo4j-admin database import full'. The database must not exist, and has to
+        be created afterwards with 'CREATE DATABASE'.
+        :param database: The name of the database.
+        :param directory: The directory in the import directory that contains the files to import.
+        :param arguments: The arguments that list the files to import, e.g. '--nodes=Label=header.csv,data.csv'.
+        """
+        container = self._docker_client.containers.get(self._docker_container_name)
+        exit_code, output = container.exec_run(
+            ['neo4j-admin', 'database', 'import', 'full', '--overwrite-destination'] + arguments + [database],
+            user='neo4j',
+            workdir=f'/var/lib/neo4j/import/{directory}'
+        )
+
+        if exit_code != 0:
+            raise RuntimeError(f"Bulk import of database `{database}` failed:\n{output.decode(errors='replace')}")
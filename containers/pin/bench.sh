@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+#
+# Runs the benchmarks of all Pin tools in the container, and writes one JSON
+# report per tool to the results directory (default: bench/results).
+#
+# Usage: bench.sh [-b <baseline directory>] [-r <results directory>] [<tool>...]
+#
+# If a baseline is given, the results are compared against it, and the script
+# fails if a tool regressed. The pinballs of the workloads are cached in
+# bench/pinballs, so that consecutive runs replay the same executions.
+
+set -Eeuo pipefail
+
+cd "$( dirname "${BASH_SOURCE[0]}" )"
+
+BASELINE=""
+RESULTS="$PWD/bench/results"
+
+while getopts "b:r:" opt; do
+    case "$opt" in
+        b) BASELINE="$(realpath "$OPTARG")" ;;
+        r) RESULTS="$(realpath -m "$OPTARG")" ;;
+        *) echo "Usage: $0 [-b <baseline directory>] [-r <results directory>] [<tool>...]" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+TOOLS=("$@")
+
+if [[ ${#TOOLS[@]} -eq 0 ]]; then
+    # All tools that have a 'bench' target.
+    for cmakelists in sources/*/CMakeLists.txt; do
+        if grep -q "add_bench_target" "$cmakelists"; then
+            TOOLS+=("$(basename "$(dirname "$cmakelists")")")
+        fi
+    done
+fi
+
+mkdir -p "$RESULTS" bench/pinballs
+
+pushd container
+
+docker build .
+IMAGE_ID="$(docker build -q .)"
+
+popd
+
+# The workloads live elsewhere in the repository, so mount all of it.
+REPO="$(realpath ../..)"
+
+for tool in "${TOOLS[@]}"; do
+    echo "===================================================================="
+    echo "Benchmarking Pin tool: $tool"
+    echo "===================================================================="
+
+    docker run -i --rm -v "$REPO:/repo" -v "$RESULTS:/results" -w "/repo/containers/pin/sources/$tool" \
+        --entrypoint bash "$IMAGE_ID" -s <<EOF
+    set -e
+
+    mkdir -p /tmp/build
+    cmake -GNinja -B/tmp/build -DBENCH_OUTPUT_DIR=/results -DBENCH_PINBALL_DIR=/repo/containers/pin/bench/pinballs
+    ninja -C/tmp/build bench || status=\$?
+
+    chown -R $(id -u):$(id -g) /results /repo/containers/pin/bench/pinballs
+    exit \${status:-0}
+EOF
+done
+
+if [[ -n "$BASELINE" ]]; then
+    python3 bench/bench.py compare --baseline "$BASELINE" "$RESULTS"
+fi
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+"""Performance benchmarks for the Pin tools.
+
+The benchmarks replay fixed pinballs of a set of workloads under a Pin tool,
+and measure for every workload:
+
+- the wall time of the replay under the tool,
+- the wall time of the replay without a tool (the null tool), and the slowdown
+  of the tool relative to it,
+- the peak resident set size of the replay under the tool,
+- the total size of the output files written by the tool.
+
+The pinballs are recorded once and stored in a cache directory, so that every
+run replays exactly the same execution. Results are written as JSON, and can be
+compared against a stored baseline:
+
+    bench.py run --sde /sde/sde64 --tool libTool.so --name memory-buffer \\
+        --tool-args '-csv_prefix {output}/out' --output memory-buffer.json
+    bench.py compare --baseline baseline/ memory-buffer.json
+
+The 'compare' command exits with status 1 if a tool regressed on a workload.
+"""
+
+import argparse
+import json
+import os
+import shlex
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+from typing import Dict, List, NamedTuple, Optional, Tuple
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.abspath(os.path.join(BENCH_DIR, '..', '..', '..'))
+
+
+class Workload(NamedTuple):
+    name: str
+    # Path of the executable, or its file name in the pinball directory if it
+    # is built from 'source'.
+    executable: str
+    # Arguments of the executable. '{dir}' is replaced by the directory in
+    # which the pinball is recorded.
+    arguments: List[str]
+    # Source file to compile the executable from, if it is not prebuilt.
+    source: Optional[str] = None
+
+
+SEVENZIP = os.path.join(REPO_DIR, 'containers', 'pin', 'sources', 'memory-buffer', 'test', 'benchmarks', '7za-x64')
+
+WORKLOADS = [
+    Workload('memorycopy', os.path.join(REPO_DIR, 'demos', 'memorycopy', 'memorycopy.exe'), []),
+    Workload('triple-memcpy', os.path.join(REPO_DIR, 'demos', 'triple-memcpy', 'triple-memcpy.exe'), []),
+    # Compress the 7-Zip executable itself, which is large enough to be
+    # representative, and is always available.
+    Workload('7za', SEVENZIP, ['-mmt1', '-psecret', 'a', '{dir}/archive.7z', SEVENZIP]),
+    Workload('alloc-stress', 'alloc-stress', [], os.path.join(BENCH_DIR, 'workloads', 'alloc-stress.cpp')),
+]
+
+# Metrics that are compared against the baseline. Higher is worse for all of
+# them.
+COMPARED_METRICS = ['slowdown', 'peak_rss_kb', 'output_bytes']
+
+
+class Measurement(NamedTuple):
+    wall_time: float
+    peak_rss_kb: int
+
+
+def sde_nullapp(sde: str) -> str:
+    """Returns the path of the nullapp used to replay pinballs."""
+    sde_dir = os.path.dirname(os.path.abspath(sde))
+    return os.path.join(sde_dir, 'intel64', 'nullapp')
+
+
+def run_measured(command: List[str], cwd: str, timeout: Optional[float]) -> Measurement:
+    """Runs a command, and returns its wall time and peak RSS."""
+    start = time.perf_counter()
+    process = subprocess.Popen(command, cwd=cwd, stdout=subprocess.DEVNULL)
+
+    # Use wait4 instead of Popen.wait, so we get the resource usage of this
+    # process only, and not that of earlier children.
+    deadline = None if timeout is None else start + timeout
+
+    while True:
+        pid, status, rusage = os.wait4(process.pid, 0 if deadline is None else os.WNOHANG)
+
+        if pid != 0:
+            break
+
+        if time.perf_counter() > deadline:
+            process.kill()
+            os.wait4(process.pid, 0)
+            process.returncode = -1
+            raise TimeoutError(f'{command[0]} timed out after {timeout} seconds')
+
+        time.sleep(0.05)
+
+    wall_time = time.perf_counter() - start
+
+    # The process was reaped by wait4 already.
+    process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+
+    if process.returncode != 0:
+        raise RuntimeError(f"{' '.join(command)} failed with exit code {process.returncode}")
+
+    return Measurement(wall_time, rusage.ru_maxrss)
+
+
+def prepare_pinball(sde: str, workload: Workload, pinball_dir: str) -> str:
+    """Records the pinball of a workload, if it is not in the cache yet, and
+    returns its basename."""
+    directory = os.path.join(pinball_dir, workload.name)
+    basename = os.path.join(directory, 'pinball')
+
+    if os.path.exists(basename + '.address'):
+        return basename
+
+    print(f'Recording pinball for {workload.name}...', file=sys.stderr)
+
+    shutil.rmtree(directory, ignore_errors=True)
+    os.makedirs(directory)
+
+    executable = workload.executable
+
+    if workload.source is not None:
+        executable = os.path.join(directory, workload.executable)
+        subprocess.run(['g++', '-O2', '-pthread', workload.source, '-o', executable], check=True)
+
+    arguments = [argument.format(dir=directory) for argument in workload.arguments]
+
+    subprocess.run([sde, '-log', '-log:mt', '-log:basename', basename, '--', executable] + arguments,
+                   cwd=directory, stdout=subprocess.DEVNULL, check=True)
+
+    return basename
+
+
+def replay_command(sde: str, pinball: str, tool: Optional[str], tool_args: List[str]) -> List[str]:
+    command = [sde]
+
+    if tool is not None:
+        command += ['-t64', tool] + tool_args
+
+    return command + ['-replay', '-replay:basename', pinball, '-replay:addr_trans', '--', sde_nullapp(sde)]
+
+
+def directory_size(directory: str) -> int:
+    size = 0
+
+    for root, _, files in os.walk(directory):
+        size += sum(os.path.getsize(os.path.join(root, f)) for f in files)
+
+    return size
+
+
+def median_measurement(measurements: List[Measurement]) -> Measurement:
+    return Measurement(statistics.median(m.wall_time for m in measurements),
+                       max(m.peak_rss_kb for m in measurements))
+
+
+def run_benchmarks(args: argparse.Namespace) -> None:
+    workloads = [w for w in WORKLOADS if not args.workloads or w.name in args.workloads]
+    work_dir = os.path.abspath(args.work_dir or os.path.join(os.path.dirname(os.path.abspath(args.output)), 'work'))
+    results = []
+
+    for workload in workloads:
+        pinball = prepare_pinball(args.sde, workload, os.path.abspath(args.pinball_dir))
+        output_dir = os.path.join(work_dir, args.name, workload.name)
+        tool_args = [a.format(output=output_dir) for a in shlex.split(args.tool_args)]
+
+        null_runs = []
+        tool_runs = []
+
+        print(f'Benchmarking {args.name} on {workload.name}...', file=sys.stderr)
+
+        for _ in range(args.repeat):
+            null_runs.append(run_measured(replay_command(args.sde, pinball, None, []), os.path.dirname(pinball),
+                                          args.timeout))
+
+            # Start from an empty output directory, so the output size only
+            # includes the files of this run. The tool also runs in this
+            # directory, so files it writes in its working directory count too.
+            shutil.rmtree(output_dir, ignore_errors=True)
+            os.makedirs(output_dir)
+
+            tool_runs.append(run_measured(replay_command(args.sde, pinball, args.tool, tool_args), output_dir,
+                                          args.timeout))
+
+        null = median_measurement(null_runs)
+        tool = median_measurement(tool_runs)
+
+        results.append({
+            'workload': workload.name,
+            'wall_time': tool.wall_time,
+            'null_wall_time': null.wall_time,
+            'slowdown': tool.wall_time / null.wall_time,
+            'peak_rss_kb': tool.peak_rss_kb,
+            'output_bytes': directory_size(output_dir),
+        })
+
+        if not args.keep_output:
+            shutil.rmtree(output_dir, ignore_errors=True)
+
+    report = {
+        'tool': args.name,
+        'tool_args': args.tool_args,
+        'repeat': args.repeat,
+        'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S%z'),
+        'results': results,
+    }
+
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2)
+        f.write('\n')
+
+    print_report(report)
+
+
+def print_report(report: Dict) -> None:
+    print(f"{report['tool']}:")
+
+    for r in report['results']:
+        print(f"  {r['workload']:<16} {r['wall_time']:9.2f}s  slowdown {r['slowdown']:7.2f}x  "
+              f"peak RSS {r['peak_rss_kb'] / 1024:9.1f} MiB  output {r['output_bytes'] / 1024:11.1f} KiB")
+
+
+def load_reports(paths: List[str]) -> Dict[Tuple[str, str], Dict]:
+    """Loads the results of JSON reports, and of the JSON reports in
+    directories, indexed by (tool, workload)."""
+    results = {}
+
+    for path in paths:
+        if os.path.isdir(path):
+            files = sorted(os.path.join(path, f) for f in os.listdir(path) if f.endswith('.json'))
+        else:
+            files = [path]
+
+        for file in files:
+            with open(file) as f:
+                report = json.load(f)
+
+            for r in report['results']:
+                results[(report['tool'], r['workload'])] = r
+
+    return results
+
+
+def compare_benchmarks(args: argparse.Namespace) -> int:
+    baseline = load_reports([args.baseline])
+    current = load_reports(args.results)
+    regressions = 0
+
+    for key, result in sorted(current.items()):
+        tool, workload = key
+
+        if key not in baseline:
+            print(f'{tool} / {workload}: no baseline')
+            continue
+
+        for metric in COMPARED_METRICS:
+            old = baseline[key][metric]
+            new = result[metric]
+            change = (new - old) / old if old else 0.0
+
+            regressed = change > args.threshold
+            regressions += regressed
+
+            print(f"{tool} / {workload}: {metric} {old:.6g} -> {new:.6g} ({change:+.1%})"
+                  f"{'  REGRESSION' if regressed else ''}")
+
+    if regressions:
+        print(f'{regressions} regression(s) above {args.threshold:.0%}.')
+        return 1
+
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='Benchmark the Pin tools.')
+    subparsers = parser.add_subparsers(dest='command', required=True)
+
+    run_parser = subparsers.add_parser('run', help='Benchmark a Pin tool.')
+    run_parser.add_argument('--sde', required=True, help='Path of the sde or sde64 launcher.')
+    run_parser.add_argument('--tool', required=True, help='Path of the Pin tool.')
+    run_parser.add_argument('--name', required=True, help='Name of the tool in the report.')
+    run_parser.add_argument('--tool-args', default='',
+                            help="Arguments of the Pin tool. '{output}' is replaced by the output directory.")
+    run_parser.add_argument('--output', required=True, help='JSON file to write the results to.')
+    run_parser.add_argument('--pinball-dir', default=os.path.join(BENCH_DIR, 'pinballs'),
+                            help='Directory in which the pinballs are cached.')
+    run_parser.add_argument('--work-dir', help='Directory for the output of the tool.')
+    run_parser.add_argument('--workloads', nargs='*', help='Workloads to run (default: all).')
+    run_parser.add_argument('--repeat', type=int, default=3, help='Number of runs per workload (default: 3).')
+    run_parser.add_argument('--timeout', type=float, help='Timeout of a single run in seconds.')
+    run_parser.add_argument('--keep-output', action='store_true', help='Keep the output of the tool.')
+    run_parser.add_argument('--baseline', help='JSON report or directory of reports to compare against.')
+    run_parser.add_argument('--threshold', type=float, default=0.1,
+                            help='Relative increase that counts as a regression (default: 0.1).')
+
+    compare_parser = subparsers.add_parser('compare', help='Compare results against a baseline.')
+    compare_parser.add_argument('--baseline', required=True, help='JSON report or directory of reports.')
+    compare_parser.add_argument('--threshold', type=float, default=0.1,
+                                help='Relative increase that counts as a regression (default: 0.1).')
+    compare_parser.add_argument('results', nargs='+', help='JSON reports or directories of reports.')
+
+    args = parser.parse_args()
+
+    if args.command == 'run':
+        run_benchmarks(args)
+
+        if args.baseline is not None:
+            args.results = [args.output]
+            return compare_benchmarks(args)
+
+        return 0
+
+    return compare_benchmarks(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
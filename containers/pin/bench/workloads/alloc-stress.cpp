@@ -0,0 +1,62 @@
+// Synthetic multithreaded allocation stress workload for the benchmarks.
+//
+// Every thread keeps a pool of live heap buffers, and repeatedly replaces a
+// random one with a new buffer of a random size that is filled and copied
+// from another buffer. This exercises the malloc/free detection, the memory
+// buffer bookkeeping and the per-thread state of the tools.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <random>
+
+static const int NUM_THREADS = 4;
+static const int NUM_ITERATIONS = 5000;
+static const int POOL_SIZE = 64;
+static const std::size_t MAX_BUFFER_SIZE = 1024;
+
+static void *stress(void *arg) {
+  std::minstd_rand rng(static_cast<unsigned>(reinterpret_cast<long>(arg)));
+  std::uniform_int_distribution<std::size_t> size_dist(1, MAX_BUFFER_SIZE);
+  std::uniform_int_distribution<int> index_dist(0, POOL_SIZE - 1);
+
+  char *pool[POOL_SIZE] = {};
+  std::size_t sizes[POOL_SIZE] = {};
+  unsigned long checksum = 0;
+
+  for (int i = 0; i < NUM_ITERATIONS; ++i) {
+    const int index = index_dist(rng);
+    const int source = index_dist(rng);
+    const std::size_t size = size_dist(rng);
+
+    char *buffer = static_cast<char *>(std::malloc(size));
+    std::memset(buffer, i & 0xff, size);
+
+    if (pool[source] != nullptr)
+      std::memcpy(buffer, pool[source], std::min(size, sizes[source]));
+
+    checksum += static_cast<unsigned char>(buffer[size / 2]);
+
+    std::free(pool[index]);
+    pool[index] = buffer;
+    sizes[index] = size;
+  }
+
+  for (char *buffer : pool)
+    std::free(buffer);
+
+  return reinterpret_cast<void *>(checksum);
+}
+
+int main() {
+  pthread_t threads[NUM_THREADS];
+
+  for (long i = 0; i < NUM_THREADS; ++i)
+    pthread_create(&threads[i], nullptr, stress, reinterpret_cast<void *>(i + 1));
+
+  for (pthread_t thread : threads)
+    pthread_join(thread, nullptr);
+
+  return 0;
+}
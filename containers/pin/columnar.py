@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Reader for the columnar output format of the Pin tools.
+
+Pin tools that are run with '-output_format columnar' write their tables to
+'<prefix>.<table>.col' files instead of '<prefix>.<table>.csv'. The format is
+described in containers/pin/sources/common/src/table.h.
+
+The files are memory-mapped, and numeric columns are returned as numpy views on
+the mapping, so reading a table does not copy or parse its data. String columns
+are returned as indices in the dictionary of the table.
+
+This module can also be run as a script to convert a columnar file to the CSV
+file the Pin tool would have written:
+
+    columnar.py <prefix>.<table>.col <prefix>.<table>.csv
+"""
+
+import argparse
+import mmap
+import sys
+from typing import Dict, Iterator, List, Optional, TextIO
+
+import numpy as np
+
+MAGIC = b'TREXCOL1'
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('num_columns', '<u4'),
+    ('reserved', '<u4'),
+    ('num_rows', '<u8'),
+    ('dictionary_offset', '<u8'),
+])
+
+COLUMN_DTYPE = np.dtype([
+    ('name', 'S48'),
+    ('type', '<u4'),
+    ('flags', '<u4'),
+    ('data_offset', '<u8'),
+])
+
+TYPE_INT64 = 0
+TYPE_UINT64 = 1
+TYPE_DOUBLE = 2
+TYPE_STRING = 3
+
+COLUMN_TYPES = {
+    TYPE_INT64: np.dtype('<i8'),
+    TYPE_UINT64: np.dtype('<u8'),
+    TYPE_DOUBLE: np.dtype('<f8'),
+    TYPE_STRING: np.dtype('<u4'),
+}
+
+FLAG_QUOTED = 1
+
+
+class ColumnarTable:
+    """A table in the columnar format."""
+
+    def __init__(self, path: str):
+        with open(path, 'rb') as f:
+            self._buffer = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        header = np.frombuffer(self._buffer, HEADER_DTYPE, count=1)[0]
+
+        if header['magic'] != MAGIC:
+            raise ValueError(f"'{path}' is not a columnar table")
+
+        self.num_rows: int = int(header['num_rows'])
+
+        descriptors = np.frombuffer(self._buffer, COLUMN_DTYPE, count=int(header['num_columns']),
+                                    offset=HEADER_DTYPE.itemsize)
+
+        self.names: List[str] = [d['name'].decode() for d in descriptors]
+        self.types: Dict[str, int] = {}
+        self.quoted: Dict[str, bool] = {}
+        self._columns: Dict[str, np.ndarray] = {}
+
+        for name, descriptor in zip(self.names, descriptors):
+            column_type = int(descriptor['type'])
+
+            self.types[name] = column_type
+            self.quoted[name] = bool(descriptor['flags'] & FLAG_QUOTED)
+            self._columns[name] = np.frombuffer(self._buffer, COLUMN_TYPES[column_type], count=self.num_rows,
+                                                offset=int(descriptor['data_offset']))
+
+        # Read the dictionary.
+        dictionary_offset = int(header['dictionary_offset'])
+        num_strings = int(np.frombuffer(self._buffer, '<u8', count=1, offset=dictionary_offset)[0])
+
+        self._string_offsets = np.frombuffer(self._buffer, '<u8', count=num_strings + 1, offset=dictionary_offset + 8)
+        self._string_data_offset = dictionary_offset + 8 * (num_strings + 2)
+        self._strings: Optional[List[str]] = None
+
+    def __len__(self) -> int:
+        return self.num_rows
+
+    def __getitem__(self, name: str) -> np.ndarray:
+        """Returns the values of a column. For string columns, this returns the
+        indices of the strings in the dictionary."""
+        return self._columns[name]
+
+    @property
+    def dictionary(self) -> List[str]:
+        """The strings of the table, indexed by the values of string columns."""
+        if self._strings is None:
+            data = self._buffer[self._string_data_offset:self._string_data_offset + int(self._string_offsets[-1])]
+            offsets = self._string_offsets.tolist()
+
+            self._strings = [data[begin:end].decode() for begin, end in zip(offsets, offsets[1:])]
+
+        return self._strings
+
+    def strings(self, name: str) -> np.ndarray:
+        """Returns the values of a string column as an array of Python
+        strings."""
+        return np.array(self.dictionary, dtype=object)[self._columns[name]]
+
+    def rows(self) -> Iterator[Dict[str, object]]:
+        """Iterates over the rows of the table as dictionaries."""
+        columns = [self.strings(name) if self.types[name] == TYPE_STRING else self._columns[name].tolist()
+                   for name in self.names]
+
+        for values in zip(*columns):
+            yield dict(zip(self.names, values))
+
+    def to_csv(self, f: TextIO) -> None:
+        """Writes the table as the CSV file the Pin tool would have written."""
+        formatted = []
+
+        for name in self.names:
+            column_type = self.types[name]
+
+            if column_type == TYPE_STRING:
+                quote = '"' if self.quoted[name] else ''
+                dictionary = np.array([quote + s + quote for s in self.dictionary], dtype=object)
+                formatted.append(dictionary[self._columns[name]])
+            elif column_type == TYPE_DOUBLE:
+                # Matches the default formatting of doubles by std::ostream.
+                formatted.append([format(v, 'g') for v in self._columns[name].tolist()])
+            else:
+                formatted.append(self._columns[name].tolist())
+
+        f.write(','.join(self.names) + '\n')
+
+        for values in zip(*formatted):
+            f.write(','.join(map(str, values)) + '\n')
+
+    def close(self) -> None:
+        self._columns.clear()
+        self._string_offsets = None
+
+        # The mapping can only be closed if no views on it are left, otherwise
+        # it is closed when the last view is garbage collected.
+        try:
+            self._buffer.close()
+        except BufferError:
+            pass
+
+    def __enter__(self) -> 'ColumnarTable':
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='Convert the columnar output of a Pin tool to CSV',
+                                     epilog='example: columnar.py prefix.branches.col prefix.branches.csv')
+
+    parser.add_argument('input', help='Path to the columnar file')
+    parser.add_argument('output', help="Path to the CSV file, or '-' for standard output")
+
+    args = parser.parse_args()
+
+    with ColumnarTable(args.input) as table:
+        if args.output == '-':
+            table.to_csv(sys.stdout)
+        else:
+            with open(args.output, 'w', newline='') as f:
+                table.to_csv(f)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -55,6 +55,8 @@ fi
 /merge-debug-info.sh /lib/i386-linux-gnu/libc.so.6
 /merge-debug-info.sh /lib/x86_64-linux-gnu/libc.so.6
 
-# Patch all CSV files
-find /target -name '*.csv' | xargs -I{} sh -c '/patch-debug-info.py {} -o {}.patched && mv {}.patched {}'
+# Patch all CSV files, unless other containers may still be writing to /target
+if [[ -z "${NO_PATCH_DEBUG_INFO}" ]]; then
+  find /target -name '*.csv' | xargs -I{} sh -c '/patch-debug-info.py {} -o {}.patched && mv {}.patched {}'
+fi
 chown -R "$CHOWN_TO" /target
@@ -0,0 +1,23 @@
+#!/bin/bash
+set -e
+
+NAME=$1
+EXECUTABLE=$2
+CHOWN_TO=$3
+shift 3
+
+# /source_tools contains the sources of the tool
+# /target contains the output of the Pin tools, and receives the output of the tool
+if [ -d /host-tool-build ]; then
+  rm -rf /host-tool-build
+fi
+mkdir /host-tool-build
+cd /host-tool-build
+
+cmake "/source_tools/${NAME}"
+cmake --build .
+
+cd /target
+"/host-tool-build/${EXECUTABLE}" "$@"
+
+chown -R "$CHOWN_TO" /target
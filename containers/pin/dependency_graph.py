@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""In-memory dependency graph of the output of the data-dependencies Pin tool.
+
+This module loads the dependencies of '<prefix>.memory_dependencies' and
+'<prefix>.register_dependencies' (CSV or columnar) in the graph engine of
+containers/pin/sources/dependency-graph, through ctypes. It answers k-hop
+expansions and shortest path queries from many instructions at once, without
+importing the dependencies in Neo4j first.
+
+Build the engine on the host first:
+
+    cd containers/pin/sources/dependency-graph
+    mkdir build && cd build && cmake .. && cmake --build .
+
+Instructions are identified by (image_name, image_offset) tuples. Like the
+DEPENDS_ON relationships, the dependencies go from the reading instruction to
+the writing instruction it depends on.
+"""
+
+import ctypes
+import os
+from typing import Iterable, List, Optional, Sequence, Set, Tuple
+
+DEFAULT_LIBRARY = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'sources', 'dependency-graph', 'build',
+                               'libDependencyGraph.so')
+
+# The directions in which to follow the dependencies.
+DEPENDENCIES = 0
+DEPENDENTS = 1
+BOTH = 2
+
+NO_PATH = 0xffffffff
+
+Instruction = Tuple[str, int]
+
+_library = None
+
+
+def _load_library(path: str) -> ctypes.CDLL:
+    global _library
+
+    if _library is not None:
+        return _library
+
+    lib = ctypes.CDLL(path)
+    nodes_p = ctypes.POINTER(ctypes.POINTER(ctypes.c_uint32))
+    u32_p = ctypes.POINTER(ctypes.c_uint32)
+
+    lib.dg_load.restype = ctypes.c_void_p
+    lib.dg_load.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+    lib.dg_free.argtypes = [ctypes.c_void_p]
+    lib.dg_last_error.restype = ctypes.c_char_p
+    lib.dg_num_nodes.restype = ctypes.c_uint32
+    lib.dg_num_nodes.argtypes = [ctypes.c_void_p]
+    lib.dg_num_edges.restype = ctypes.c_uint64
+    lib.dg_num_edges.argtypes = [ctypes.c_void_p]
+    lib.dg_find_node.restype = ctypes.c_int64
+    lib.dg_find_node.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int64]
+    lib.dg_image_name.restype = ctypes.c_char_p
+    lib.dg_image_name.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.dg_image_offset.restype = ctypes.c_int64
+    lib.dg_image_offset.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.dg_expand.restype = ctypes.c_size_t
+    lib.dg_expand.argtypes = [ctypes.c_void_p, u32_p, ctypes.c_size_t, ctypes.c_uint32, ctypes.c_int, nodes_p]
+    lib.dg_distances.argtypes = [ctypes.c_void_p, u32_p, u32_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_uint32,
+                                 ctypes.c_uint32, u32_p]
+    lib.dg_shortest_path.restype = ctypes.c_size_t
+    lib.dg_shortest_path.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32, ctypes.c_int, ctypes.c_uint32,
+                                     nodes_p]
+    lib.dg_free_nodes.argtypes = [ctypes.POINTER(ctypes.c_uint32)]
+
+    _library = lib
+    return lib
+
+
+class DependencyGraph:
+    """The dependency graph of the output of the data-dependencies tool with the given prefix."""
+
+    def __init__(self, prefix: str, excluded_registers: Sequence[str] = (), memory: bool = True,
+                 registers: bool = True, library: Optional[str] = None):
+        self._lib = _load_library(library or DEFAULT_LIBRARY)
+        self._graph = self._lib.dg_load(prefix.encode(), int(memory), int(registers),
+                                        ','.join(excluded_registers).encode())
+
+        if not self._graph:
+            raise IOError(self._lib.dg_last_error().decode())
+
+    def __del__(self):
+        if getattr(self, '_graph', None):
+            self._lib.dg_free(self._graph)
+            self._graph = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.__del__()
+
+    @property
+    def num_nodes(self) -> int:
+        return self._lib.dg_num_nodes(self._graph)
+
+    @property
+    def num_edges(self) -> int:
+        return self._lib.dg_num_edges(self._graph)
+
+    def find_node(self, instruction: Instruction) -> int:
+        """Returns the node of an instruction, or -1 if it has no dependencies."""
+        return self._lib.dg_find_node(self._graph, instruction[0].encode(), instruction[1])
+
+    def instruction(self, node: int) -> Instruction:
+        """Returns the instruction of a node."""
+        return (self._lib.dg_image_name(self._graph, node).decode(), self._lib.dg_image_offset(self._graph, node))
+
+    def _nodes(self, instructions: Iterable[Instruction]):
+        nodes = [self.find_node(instruction) for instruction in instructions]
+        return (ctypes.c_uint32 * len(nodes))(*[node if node >= 0 else NO_PATH for node in nodes])
+
+    def _take_nodes(self, pointer, count: int) -> List[Instruction]:
+        try:
+            return [self.instruction(pointer[i]) for i in range(count)]
+        finally:
+            self._lib.dg_free_nodes(pointer)
+
+    def expand(self, seeds: Iterable[Instruction], max_depth: int, direction: int = DEPENDENCIES) -> Set[Instruction]:
+        """Returns the instructions at most 'max_depth' dependencies away from any of the seeds, including the seeds
+        that have dependencies."""
+        nodes = self._nodes(seeds)
+        result = ctypes.POINTER(ctypes.c_uint32)()
+        count = self._lib.dg_expand(self._graph, nodes, len(nodes), max_depth, direction, ctypes.byref(result))
+        return set(self._take_nodes(result, count))
+
+    def distances(self, pairs: Sequence[Tuple[Instruction, Instruction]], direction: int = DEPENDENCIES,
+                  max_length: int = NO_PATH, num_threads: int = 0) -> List[float]:
+        """Returns the length of the shortest path from the source to the target of each pair, or float('inf') if
+        there is no path of at most 'max_length' dependencies. The pairs are answered in parallel."""
+        sources = self._nodes(source for (source, _) in pairs)
+        targets = self._nodes(target for (_, target) in pairs)
+        distances = (ctypes.c_uint32 * len(pairs))()
+        self._lib.dg_distances(self._graph, sources, targets, len(pairs), direction, max_length, num_threads,
+                               distances)
+        return [float('inf') if distance == NO_PATH else int(distance) for distance in distances]
+
+    def distance(self, source: Instruction, target: Instruction, direction: int = DEPENDENCIES,
+                 max_length: int = NO_PATH) -> float:
+        """Returns the length of the shortest path from the source to the target, or float('inf')."""
+        return self.distances([(source, target)], direction, max_length, 1)[0]
+
+    def shortest_path(self, source: Instruction, target: Instruction, direction: int = DEPENDENCIES,
+                      max_length: int = NO_PATH) -> List[Instruction]:
+        """Returns the instructions on a shortest path from the source to the target, or an empty list."""
+        (source_node, target_node) = self._nodes([source, target])
+        result = ctypes.POINTER(ctypes.c_uint32)()
+        count = self._lib.dg_shortest_path(self._graph, source_node, target_node, direction, max_length,
+                                           ctypes.byref(result))
+        return self._take_nodes(result, count)
@@ -1,6 +1,8 @@
+import glob
 import os
+import re
 from enum import Enum
-from typing import Optional, Union, AnyStr
+from typing import Optional, Union, AnyStr, List, Tuple, Dict
 
 from docker import DockerClient
 from docker.models.containers import Container
@@ -217,3 +219,301 @@ class SDEReplayer(SDERunner):
         )
         self.built_plugin = True
         return plugin_compiled_path
+
+
+class SDEHostTool(SDERunner):
+    """
+    Run a tool that processes the output of Pin tools in the directory of a binary, such as bulk-import or
+    profile-merge. The tool is built from its sources in the SDE container, and runs in /target.
+    """
+
+    def __init__(self, docker_client: DockerClient, binary_path: str, tool_name: str, executable: str,
+                 arguments: List[str]):
+        super().__init__(docker_client, binary_path, "")
+        self.tool_name = tool_name
+        self.executable = executable
+        self.arguments = arguments
+
+    def run(self) -> Union[Container, AnyStr]:
+        self.build_container()
+        return self._docker_client.containers.run(
+            self._docker_image_name,
+            entrypoint="/host_tool.sh",
+            command=[self.tool_name, self.executable, get_uid_gid_string()] + self.arguments,
+            name=self._docker_container_name,
+            remove=True,
+            volumes=self._docker_volumes,
+            **self._docker_kwargs
+        )
+
+
+class SDEBulkImporter(SDEHostTool):
+    """
+    Convert the output of Pin tools in the directory of a binary to the input files of 'neo4j-admin database import',
+    using the bulk-import tool in the SDE container.
+    """
+
+    def __init__(self, docker_client: DockerClient, binary_path: str, arguments: List[str]):
+        super().__init__(docker_client, binary_path, "bulk-import", "BulkImport", arguments)
+
+    def run(self) -> Union[Container, AnyStr]:
+        print("Converting Pin tool output for bulk import")
+        return super().run()
+
+
+class SDEParallelReplayer(SDEReplayer):
+    """
+    Replay a pinball with a profiler in parallel. The pinball is split into regions of equal length with the PinPlay
+    relogger, the regions are replayed in concurrent containers, and their outputs are merged with the profile-merge
+    tool into the output of a replay of the whole pinball.
+    """
+
+    # The options that make a mergeable Pin tool write the output of a region to the given prefix. As only the first
+    # region sees the call to main(), the regions are analysed completely, and cut at main() instead.
+    REGION_TOOL_PARAMS = {
+        'basic-block-profiler': "-csv_prefix {prefix} -start_from_main 0 -end_after_main 0",
+        'branch-profiler': "-csv_prefix {prefix} -partial_output -start_from_main 0 -end_after_main 0",
+        'memory-instructions-profiler': "-csv_prefix {prefix} -partial_output -start_from_main 0 -end_after_main 0",
+        'ins-counter': "-o {prefix} -e 0",
+    }
+
+    # The options of a mergeable Pin tool that restrict the analysis to main(), and their defaults: whether it starts
+    # when main() is entered, and whether it ends when main() returns.
+    MAIN_TOOL_PARAMS = {
+        'basic-block-profiler': (("-start_from_main", True), ("-end_after_main", True)),
+        'branch-profiler': (("-start_from_main", True), ("-end_after_main", True)),
+        'memory-instructions-profiler': (("-start_from_main", True), ("-end_after_main", True)),
+        'ins-counter': (("-e", True), None),
+    }
+
+    def __init__(self, docker_client: DockerClient, binary_path: str, binary_params: str, tool_name: str,
+                 tool_params: str, output_prefix: str, num_regions: int,
+                 tool_architecture: PINArchitecture = PINArchitecture.IA32, timeout: Optional[int] = 0,
+                 recorder: Optional[SDERecorder] = None, stdin_input: Optional[str] = None):
+        """
+        :param tool_params: The options of the Pin tool, without the option that sets the output prefix.
+        :param output_prefix: The prefix of the merged output, e.g. the -csv_prefix of the tool. For ins-counter, this
+        is the name of the output file.
+        :param num_regions: The number of regions to replay in parallel.
+        """
+        if tool_name not in self.REGION_TOOL_PARAMS:
+            raise ValueError(f"The output of {tool_name} cannot be merged, so it cannot be replayed in parallel")
+
+        # The regions are cut at main() instead of passing these options, so the merged output covers the same
+        # instructions as a replay of the whole pinball.
+        start_param, end_param = self.MAIN_TOOL_PARAMS[tool_name]
+        tool_params, self.start_at_main = self._take_bool_param(tool_params, *start_param)
+        self.end_at_main_return = False
+        if end_param is not None:
+            tool_params, self.end_at_main_return = self._take_bool_param(tool_params, *end_param)
+
+        super().__init__(docker_client, binary_path, binary_params, tool_name, tool_params, tool_architecture,
+                         timeout, recorder, stdin_input)
+        self.output_prefix = output_prefix
+        self.num_regions = num_regions
+
+    @property
+    def regions_name(self) -> str:
+        window = {
+            (False, False): "",
+            (True, True): ".main",
+            (True, False): ".from_main",
+            (False, True): ".to_main_return",
+        }[(self.start_at_main, self.end_at_main_return)]
+        return f"{os.path.basename(self.pinball_path)}.regions{self.num_regions}{window}"
+
+    @property
+    def main_icounts_name(self) -> str:
+        return f"{os.path.basename(self.pinball_path)}.main-icounts"
+
+    def run(self) -> Union[Container, AnyStr]:
+        self.build_plugin(self.tool_architecture, self.tool_name)
+        if not self.recorder.has_recorded:
+            self.recorder.run()
+
+        regions = self.split_pinball()
+
+        print(f"Running replay for {self.tool_name} on {len(regions)} regions in parallel")
+        containers = []
+        prefixes = []
+        for index, region in enumerate(regions):
+            prefix = f"{self.output_prefix}.region{index}"
+            region_params = self.REGION_TOOL_PARAMS[self.tool_name].format(prefix=prefix)
+            sde_command = f"{self.path_to_sde} " \
+                          f"-t ../../compiled_tools/{self.full_pin_tool_name} {self.tool_params} {region_params} " \
+                          f"-replay -replay:basename {region} -replay:addr_trans " \
+                          f"-- {self.nullapp_path}"
+
+            # The containers share /target, so none of them may patch the CSV files in it while the others are still
+            # writing theirs. The outputs of the mergeable tools have no debug info to patch.
+            containers.append(self._docker_client.containers.run(
+                self._docker_image_name,
+                command=[sde_command, str(self.timeout), os.path.basename(self.binary_path), get_uid_gid_string()],
+                name=f"{self._docker_container_name}_region{index}",
+                detach=True,
+                environment={"NO_PATCH_DEBUG_INFO": "1"},
+                volumes=self._docker_volumes,
+                **self._docker_kwargs
+            ))
+            prefixes.append(prefix)
+
+        failed_regions = []
+        for index, container in enumerate(containers):
+            status = container.wait()
+            if status['StatusCode'] != 0:
+                print(container.logs().decode(errors='replace'))
+                failed_regions.append(index)
+            container.remove()
+
+        if failed_regions:
+            raise RuntimeError(f"Replay of regions {failed_regions} of {self.tool_name} failed")
+
+        print(f"Merging the output of {self.tool_name}")
+        result = SDEHostTool(self._docker_client, self.binary_path, "profile-merge", "ProfileMerge",
+                             [self.tool_name, self.output_prefix] + prefixes).run()
+
+        # Remove the outputs of the regions.
+        target_dir = os.path.dirname(os.path.abspath(self.binary_path))
+        for prefix in prefixes:
+            for path in glob.glob(os.path.join(target_dir, glob.escape(prefix))) + \
+                        glob.glob(os.path.join(target_dir, glob.escape(prefix) + '.*')):
+                os.remove(path)
+
+        return result
+
+    def split_pinball(self) -> List[str]:
+        """
+        Splits the pinball in regions with an equal number of instructions of the main thread. The region pinballs
+        are kept next to the pinball, so that other tools can reuse them.
+
+        :return: The basenames of the region pinballs in the container, in order.
+        """
+        target_dir = os.path.dirname(os.path.abspath(self.binary_path))
+        regions_dir = os.path.join(target_dir, self.regions_name)
+
+        regions = self._find_region_pinballs(regions_dir)
+        if len(regions) == self.num_regions:
+            print("Skip splitting pinball (regions already exist)")
+            return regions
+
+        # Write the regions in the PinPoints CSV format for -log:regions_in.
+        start, end = self._window(target_dir)
+        if end - start < self.num_regions:
+            raise RuntimeError(f"Cannot split {end - start} instructions into {self.num_regions} regions")
+        region_length = -(-(end - start) // self.num_regions)
+
+        os.makedirs(regions_dir, exist_ok=True)
+        with open(os.path.join(regions_dir, 'regions.csv'), 'w') as f:
+            f.write("# comment,thread-id,region-id,simulation-region-start-icount,simulation-region-end-icount,"
+                    "region-weight\n")
+            for index in range(self.num_regions):
+                region_start = start + index * region_length
+                region_end = min(region_start + region_length, end)
+                f.write(f"region{index},0,{index + 1},{region_start},{region_end},{1 / self.num_regions:.6f}\n")
+
+        print(f"Splitting instructions {start} to {end} of the pinball into {self.num_regions} regions of "
+              f"{region_length} instructions")
+        # Relog the pinball: replay it, and log the regions.
+        sde_command = f"{self.path_to_sde} " \
+                      f"-replay -replay:basename {self.pinball_path} -replay:addr_trans " \
+                      f"-log -log:mt -log:basename /target/{self.regions_name}/region " \
+                      f"-log:regions_in /target/{self.regions_name}/regions.csv " \
+                      f"-- {self.nullapp_path}"
+
+        self._docker_command = [
+            sde_command,
+            str(self.timeout),
+            os.path.basename(self.binary_path),
+            get_uid_gid_string()
+        ]
+        ContainerRunner.run(self)
+
+        regions = self._find_region_pinballs(regions_dir)
+        if len(regions) != self.num_regions:
+            raise RuntimeError(f"Splitting the pinball produced {len(regions)} instead of {self.num_regions} regions")
+
+        return regions
+
+    def _find_region_pinballs(self, regions_dir: str) -> List[str]:
+        # The relogger names region pinballs '<basename>_t<thread>r<region>_...'.
+        regions = []
+        for index in range(self.num_regions):
+            matches = glob.glob(os.path.join(regions_dir, f"region_t0r{index + 1}_*.text"))
+            if len(matches) != 1:
+                break
+            name = os.path.basename(matches[0])[:-len('.text')]
+            regions.append(f"/target/{self.regions_name}/{name}")
+
+        return regions
+
+    @staticmethod
+    def _take_bool_param(tool_params: str, name: str, default: bool) -> Tuple[str, bool]:
+        """
+        Removes a boolean option from the options of a Pin tool.
+
+        :return: The remaining options, and the value of the option, or its default if it is not set.
+        """
+        value = default
+        pattern = re.compile(rf'(^|\s){re.escape(name)}(\s+([^-\s]\S*))?(?=\s|$)')
+        match = pattern.search(tool_params)
+        while match is not None:
+            # Pin also accepts a boolean option without a value, which sets it.
+            value = match.group(3) is None or match.group(3).lower() not in ("0", "false")
+            tool_params = tool_params[:match.start()] + tool_params[match.end():]
+            match = pattern.search(tool_params)
+
+        return tool_params.strip(), value
+
+    def _window(self, target_dir: str) -> Tuple[int, int]:
+        """
+        Returns the instruction counts of the main thread at which the analysis of a replay of the whole pinball starts
+        and ends: when main() is entered and when it returns, or the start and end of the pinball.
+        """
+        total = self._instruction_count(target_dir)
+        if not self.start_at_main and not self.end_at_main_return:
+            return 0, total
+
+        icounts = self._main_icounts(target_dir)
+        if 'main_entry' not in icounts:
+            raise RuntimeError(f"Could not find the call of main() in the pinball; replay {self.tool_name} with "
+                               f"the options to analyse the whole pinball instead")
+
+        start = icounts['main_entry'] if self.start_at_main else 0
+        # The analysis does not end if main() does not return, e.g. when the program calls exit().
+        end = icounts.get('main_return', total) if self.end_at_main_return else total
+        return start, end
+
+    def _main_icounts(self, target_dir: str) -> Dict[str, int]:
+        # ins-counter finds the instruction counts of the main thread at main() in a light replay of the pinball.
+        path = os.path.join(target_dir, self.main_icounts_name)
+        if not os.path.exists(path):
+            print("Finding the instruction counts of main() in the pinball")
+            SDEReplayer(self._docker_client, self.binary_path, self.binary_params, "ins-counter",
+                        f"-main_icounts /target/{self.main_icounts_name}", self.tool_architecture, self.timeout,
+                        self.recorder).run()
+
+        icounts = {}
+        try:
+            with open(path) as f:
+                for line in f:
+                    name, _, count = line.strip().partition(',')
+                    if count.isdigit():
+                        icounts[name] = int(count)
+        except OSError:
+            raise RuntimeError(f"Could not read the instruction counts of main() from {path}")
+
+        return icounts
+
+    def _instruction_count(self, target_dir: str) -> int:
+        # The result file of the main thread contains its instruction count.
+        result_path = os.path.join(target_dir, f"{os.path.basename(self.pinball_path)}.0.result")
+        try:
+            with open(result_path) as f:
+                match = re.search(r'inscount:\s*(\d+)', f.read())
+        except OSError:
+            match = None
+
+        if match is None:
+            raise RuntimeError(f"Could not read the instruction count of the pinball from {result_path}")
+
+        return int(match.group(1))
@@ -1,15 +1,20 @@
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 
 #include "pin.H"
+#include "sampling.h"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_basic_blocks;
+// Table to write the basic blocks to.
+static std::unique_ptr<TableWriter> basic_blocks_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -38,6 +43,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.basic-blocks.csv.");
 
+// Option (-output_format) to set the format of the output file.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.basic-blocks.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -49,51 +61,58 @@ KNOB<bool>
     KnobEndAfterMain(KNOB_MODE_WRITEONCE, "pintool", "end_after_main", "1",
                      "When true, ends analysis after main() is finished");
 
+// Option (-sample_period) to only analyse a random sample of the executions.
+KNOB<UINT64> KnobSamplePeriod(
+    KNOB_MODE_WRITEONCE, "pintool", "sample_period", "1",
+    "Analyse 1 in <sample_period> basic block executions on average, chosen "
+    "at random. num_executions is then an estimate, and the output has the "
+    "columns num_executions_ci_low and num_executions_ci_high with its 95% "
+    "confidence interval. 1 analyses every execution.");
+
+// Option (-sample_seed) to set the seed of the random sampling.
+KNOB<UINT64> KnobSampleSeed(KNOB_MODE_WRITEONCE, "pintool", "sample_seed",
+                            "0", "Seed of the random sampling.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
 // The address of a basic block.
 struct BasicBlockAddress {
   BasicBlockAddress(ADDRINT address_begin, ADDRINT address_end)
-      : image_name("???"), section_name("???"), routine_name("???"),
-        image_offset_begin(-1), image_offset_end(-1), routine_offset_begin(-1),
+      : image_offset_begin(-1), image_offset_end(-1), routine_offset_begin(-1),
         routine_offset_end(-1) {
-    // Routine info.
-    RTN routine_begin = RTN_FindByAddress(address_begin);
-    if (!RTN_Valid(routine_begin)) {
-      return;
-    }
+    const SymbolLocation location = find_symbol(address_begin);
 
-    this->routine_name = RTN_Name(routine_begin);
-    auto routine_base = RTN_Address(routine_begin);
-    this->routine_offset_begin = address_begin - routine_base;
-    this->routine_offset_end = address_end - routine_base;
-
-    // Section info.
-    SEC section = RTN_Sec(routine_begin);
-    if (!SEC_Valid(section)) {
-      return;
-    }
-
-    this->section_name = SEC_Name(section);
+    this->image_name = location.image_name;
+    this->section_name = location.section_name;
+    this->routine_name = location.routine_name;
 
     // Image info.
-    IMG image = SEC_Img(section);
-    if (!IMG_Valid(image)) {
-      return;
+    if (location.image_offset != static_cast<ADDRINT>(-1)) {
+      this->image_offset_begin = location.image_offset;
+      this->image_offset_end =
+          address_end - (address_begin - location.image_offset);
     }
 
-    this->image_name = IMG_Name(image);
-    auto image_base = IMG_LowAddress(image);
-    this->image_offset_begin = address_begin - image_base;
-    this->image_offset_end = address_end - image_base;
+    // Routine info.
+    if (location.routine_offset != static_cast<ADDRINT>(-1)) {
+      this->routine_offset_begin = location.routine_offset;
+      this->routine_offset_end =
+          address_end - (address_begin - location.routine_offset);
+    }
   }
 
   // The name of the image this basic block belongs to.
-  std::string image_name;
+  NameId image_name;
 
   // The name of the section this basic block belongs to.
-  std::string section_name;
+  NameId section_name;
 
   // The name of the routine this basic block belongs to.
-  std::string routine_name;
+  NameId routine_name;
 
   // The offset of the basic block's begin relative to the base of the image.
   ADDRINT image_offset_begin;
@@ -122,37 +141,56 @@ struct BasicBlockInfo {
 static std::map<std::pair<ADDRINT, ADDRINT>, BasicBlockInfo> basic_block_infos;
 
 // Mutex for accessing basic_block_infos.
-static PIN_MUTEX basic_block_infos_lock;
+static StatMutex basic_block_infos_lock("basic_block_infos_lock");
+
+// Statistics for -tool_stats.
+static CallCounter main_called_calls("MainCalled");
+static CallCounter main_returned_calls("MainReturned");
+static CallCounter basic_block_before_calls("BasicBlockBefore");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_trace_timer("OnTrace");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize basic_block_infos_size("basic_block_infos");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
 
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
-// Run before every instruction.
-VOID InstructionBefore(ADDRINT instruction_pointer) {
-  // Check if main if reached yet.
-  if (instruction_pointer == main_address) {
-    log_file << "\nMain reached, setting global flag.\n";
-    main_reached = true;
-  }
+// Inlined check that runs before every call instruction. Returns whether this
+// is the first call to main().
+ADDRINT PIN_FAST_ANALYSIS_CALL CallsMain(ADDRINT target_address) {
+  return (end_address == INVALID_ADDRESS) & (target_address == main_address);
+}
 
-  // Check if main is finished.
-  if (instruction_pointer == end_address) {
-    log_file
-        << "\nInstruction after call to main reached, setting global flag.\n";
-    end_reached = true;
-  }
+// Runs at the first call to main().
+VOID MainCalled(ADDRINT next_instruction_pointer) {
+  main_called_calls.count();
+
+  log_file << "\nMain called, next ip = " << std::hex << std::showbase
+           << next_instruction_pointer << std::dec << "\n";
+  end_address = next_instruction_pointer;
+
+  log_file << "\nMain reached, setting global flag.\n";
+  main_reached = true;
 }
 
-// Runs before every call instruction.
-VOID InstructionCallBefore(ADDRINT target_address,
-                           ADDRINT next_instruction_pointer) {
-  // Check if this is the first call to main().
-  if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
-    log_file << "\nMain called, next ip = " << std::hex << std::showbase
-             << next_instruction_pointer << std::dec << "\n";
-    end_address = next_instruction_pointer;
-  }
+// Inlined check that runs before every return instruction. Returns whether it
+// returns from main().
+ADDRINT PIN_FAST_ANALYSIS_CALL ReturnsFromMain(ADDRINT target_address) {
+  return target_address == end_address;
+}
+
+// Runs when main() returns.
+VOID MainReturned() {
+  main_returned_calls.count();
+
+  log_file
+      << "\nInstruction after call to main reached, setting global flag.\n";
+  end_reached = true;
 }
 
 // Run at the start of __libc_start_main().
@@ -165,11 +203,13 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
 
 // Run before each basic block.
 VOID BasicBlockBefore(ADDRINT address_begin, ADDRINT address_end) {
+  basic_block_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Find the basic block info.
-  PIN_MutexLock(&basic_block_infos_lock);
+  basic_block_infos_lock.lock();
 
   auto it = basic_block_infos.find(std::make_pair(address_begin, address_end));
   if (it != basic_block_infos.end()) {
@@ -179,7 +219,7 @@ VOID BasicBlockBefore(ADDRINT address_begin, ADDRINT address_end) {
     assert(false && "Basic block not added to basic_block_infos!");
   }
 
-  PIN_MutexUnlock(&basic_block_infos_lock);
+  basic_block_infos_lock.unlock();
 }
 
 // =============================================================================
@@ -188,25 +228,43 @@ VOID BasicBlockBefore(ADDRINT address_begin, ADDRINT address_end) {
 
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
-  // Call InstructionBefore() before every instruction.
-  // Pass RIP as argument.
-  INS_InsertCall(instruction, IPOINT_BEFORE,
-                 reinterpret_cast<AFUNPTR>(InstructionBefore), IARG_INST_PTR,
-                 IARG_END);
+  ScopedStatTimer timer(on_instruction_timer);
 
-  // Call InstructionCallBefore() before every call instruction.
+  // Call MainCalled() if a call instruction is the first call to main(). It
+  // runs after the other analysis routines of the call, which is not part of
+  // main() yet.
   // Pass the target address (i.e. the address of the function being called) and
   // the address of the next instruction (i.e. the one following the call).
   if (INS_IsCall(instruction)) {
-    INS_InsertCall(instruction, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(InstructionCallBefore),
-                   IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
-                   INS_NextAddress(instruction), IARG_END);
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(CallsMain), IARG_CALL_ORDER,
+                     CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainCalled), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_ADDRINT,
+                       INS_NextAddress(instruction), IARG_END);
+  }
+
+  // Call MainReturned() if a return instruction returns from main(). It runs
+  // after the other analysis routines of the return, which is still part of
+  // main().
+  // Pass the return address.
+  if (INS_IsRet(instruction)) {
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(ReturnsFromMain),
+                     IARG_CALL_ORDER, CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainReturned), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_END);
   }
 }
 
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -228,6 +286,8 @@ VOID OnImageLoad(IMG image, VOID *v) {
 
 // Instrumentation routine run for every trace.
 VOID OnTrace(TRACE trace, VOID *v) {
+  ScopedStatTimer timer(on_trace_timer);
+
   // Iterate over all basic blocks in the trace.
   for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
     // Get the begin and end address of this basic block.
@@ -238,15 +298,20 @@ VOID OnTrace(TRACE trace, VOID *v) {
     ADDRINT address_end = INS_Address(bbl_tail) + INS_Size(bbl_tail);
 
     // Add an entry for this basic block to the basic_block_infos map.
-    PIN_MutexLock(&basic_block_infos_lock);
+    basic_block_infos_lock.lock();
     basic_block_infos.insert({std::make_pair(address_begin, address_end),
                               BasicBlockInfo(address_begin, address_end)});
-    PIN_MutexUnlock(&basic_block_infos_lock);
+    basic_block_infos_size.update(basic_block_infos.size());
+    basic_block_infos_lock.unlock();
 
-    // Call BasicBlockBefore() at the start of every basic block.
-    BBL_InsertCall(bbl, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(BasicBlockBefore), IARG_ADDRINT,
-                   address_begin, IARG_ADDRINT, address_end, IARG_END);
+    // Call BasicBlockBefore() at the start of every (sampled) basic block.
+    insert_sample_countdown(bbl);
+
+    IARGLIST args = IARGLIST_Alloc();
+    IARGLIST_AddArguments(args, IARG_ADDRINT, address_begin, IARG_ADDRINT,
+                          address_end, IARG_END);
+    insert_sampled_call(bbl, reinterpret_cast<AFUNPTR>(BasicBlockBefore),
+                        args);
   }
 }
 
@@ -269,56 +334,56 @@ std::string get_filename(const std::string &path) {
   }
 }
 
-// Dump the information for basic blocks in CSV format.
-void dump_csv_basic_blocks(
-    std::ofstream &ofs,
-    const std::map<std::pair<ADDRINT, ADDRINT>, BasicBlockInfo> &map) {
+// The columns of the basic blocks table.
+static const std::vector<TableColumn> BASIC_BLOCKS_COLUMNS = {
+    {"ip_begin", ColumnType::UINT64},
+    {"ip_end", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset_begin", ColumnType::INT64},
+    {"image_offset_end", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset_begin", ColumnType::INT64},
+    {"routine_offset_end", ColumnType::INT64},
+    {"num_executions", ColumnType::UINT64},
+};
 
-  // Print header.
-  ofs << "ip_begin,ip_end,image_name,full_image_name,section_name,image_offset_"
-         "begin,image_offset_end,routine_name,routine_offset_begin,routine_"
-         "offset_end,num_executions\n";
+// The additional columns of the basic blocks table when sampling.
+static const std::vector<TableColumn> SAMPLING_COLUMNS = {
+    {"num_executions_ci_low", ColumnType::UINT64},
+    {"num_executions_ci_high", ColumnType::UINT64},
+};
 
-  // Print data.
+// Dump the information for basic blocks.
+void dump_basic_blocks(
+    TableWriter &table,
+    const std::map<std::pair<ADDRINT, ADDRINT>, BasicBlockInfo> &map) {
+  // Print data. The offset columns are signed, so unknown offsets are -1.
   for (const auto &p : map) {
-    ofs << p.first.first                                    // ip_begin
-        << ',' << p.first.second                            // ip_end
-        << ',' << get_filename(p.second.address.image_name) // image_name
-        << ',' << p.second.address.image_name               // full_image_name
-        << ',' << p.second.address.section_name             // section_name
-        << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.image_offset_begin != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.image_offset_begin << ','; // image_offset_begin
-    else
-      ofs << -1 << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.image_offset_end != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.image_offset_end << ','; // image_offset_end
-    else
-      ofs << -1 << ',';
-
-    ofs << p.second.address.routine_name // routine_name
-        << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.routine_offset_begin != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.routine_offset_begin
-          << ','; // routine_offset_begin
-    else
-      ofs << -1 << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.routine_offset_end != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.routine_offset_end << ','; // routine_offset_end
-    else
-      ofs << -1 << ',';
-
-    ofs << p.second.num_executions; // num_executions
-
-    ofs << '\n';
+    const BasicBlockAddress &address = p.second.address;
+    const std::string &image_name = get_name(address.image_name);
+    const UINT64 num_executions = estimate_count(p.second.num_executions);
+
+    table << p.first.first                  // ip_begin
+          << p.first.second                 // ip_end
+          << get_filename(image_name)       // image_name
+          << image_name                     // full_image_name
+          << get_name(address.section_name) // section_name
+          << address.image_offset_begin     // image_offset_begin
+          << address.image_offset_end       // image_offset_end
+          << get_name(address.routine_name) // routine_name
+          << address.routine_offset_begin   // routine_offset_begin
+          << address.routine_offset_end     // routine_offset_end
+          << num_executions;                // num_executions
+
+    if (sampling_enabled()) {
+      UINT64 low, high;
+      estimate_confidence_interval(p.second.num_executions, low, high);
+
+      table << low   // num_executions_ci_low
+            << high; // num_executions_ci_high
+    }
   }
 }
 
@@ -328,11 +393,13 @@ void dump_csv_basic_blocks(
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
   // -----------------------
   // Machine parsable output
   // -----------------------
 
-  dump_csv_basic_blocks(csv_basic_blocks, basic_block_infos);
+  dump_basic_blocks(*basic_blocks_table, basic_block_infos);
 
   // -------
   // Cleanup
@@ -343,8 +410,14 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV file.
-  csv_basic_blocks.flush();
-  csv_basic_blocks.close();
+  basic_blocks_table->close();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -354,6 +427,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -380,6 +456,24 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
+  if (!init_sampling(KnobSamplePeriod.Value(), KnobSampleSeed.Value())) {
+    std::cerr << "Invalid sample period '" << KnobSamplePeriod.Value()
+              << "', or no register available for sampling.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
   if (!KnobStartFromMain.Value())
@@ -396,7 +490,14 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_basic_blocks.open((csv_prefix + ".basic-blocks.csv").c_str());
+  std::vector<TableColumn> columns = BASIC_BLOCKS_COLUMNS;
+
+  if (sampling_enabled())
+    columns.insert(columns.end(), SAMPLING_COLUMNS.begin(),
+                   SAMPLING_COLUMNS.end());
+
+  basic_blocks_table =
+      open_table(csv_prefix + ".basic-blocks", table_format, columns);
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
@@ -410,15 +511,19 @@ int main(int argc, char *argv[]) {
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&basic_block_infos_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
@@ -0,0 +1,40 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -sample_period 64 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// The block of hot_block() is executed 100000 times. Sampling 1 in 64 of them
+// should estimate that within a few percent, and the confidence interval should
+// contain the estimate.
+// RUN: python3 -c "import csv; \
+// RUN:   row = next(r for r in csv.DictReader(open('%t.log.basic-blocks.csv')) if r['routine_name'] == 'hot_block'); \
+// RUN:   n, low, high = (int(row[c]) for c in ('num_executions', 'num_executions_ci_low', 'num_executions_ci_high')); \
+// RUN:   assert 80000 <= n <= 120000, n; \
+// RUN:   assert low < n < high, (low, n, high)"
+
+// XFAIL: x86
+
+#include <cstdint>
+
+// Adds 1 to its argument, in a single basic block.
+extern "C" std::int64_t hot_block(std::int64_t n);
+
+asm(R"(
+    .section        .text
+    .intel_syntax   noprefix
+    .globl          hot_block
+    .type           hot_block, @function
+
+hot_block:
+    lea             rax, [rdi + 1]
+    ret
+)");
+
+int main(int argc, char *argv[]) {
+  std::int64_t n = 0;
+
+  for (int i = 0; i < 100000; ++i)
+    n = hot_block(n);
+
+  return n == 100000 ? 0 : 1;
+}
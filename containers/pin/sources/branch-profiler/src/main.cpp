@@ -1,15 +1,20 @@
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 
 #include "pin.H"
+#include "sampling.h"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_branches;
+// Table to write the branches to.
+static std::unique_ptr<TableWriter> branches_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -38,6 +43,20 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.branches.csv.");
 
+// Option (-output_format) to set the format of the output file.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.branches.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
+// Option (-partial_output) to write a partial output that can be merged.
+KNOB<bool> KnobPartialOutput(
+    KNOB_MODE_WRITEONCE, "pintool", "partial_output", "0",
+    "When true, writes <prefix>.branches.partial.csv instead, which also "
+    "contains the address of each branch. Use ProfileMerge to merge the "
+    "partial outputs of the regions of a pinball.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -49,15 +68,33 @@ KNOB<bool>
     KnobEndAfterMain(KNOB_MODE_WRITEONCE, "pintool", "end_after_main", "1",
                      "When true, ends analysis after main() is finished");
 
+// Option (-sample_period) to only analyse a random sample of the executions.
+KNOB<UINT64> KnobSamplePeriod(
+    KNOB_MODE_WRITEONCE, "pintool", "sample_period", "1",
+    "Analyse 1 in <sample_period> branch executions on average, chosen at "
+    "random. num_taken and num_not_taken are then estimates, and the output "
+    "has columns with their 95% confidence intervals. 1 analyses every "
+    "execution.");
+
+// Option (-sample_seed) to set the seed of the random sampling.
+KNOB<UINT64> KnobSampleSeed(KNOB_MODE_WRITEONCE, "pintool", "sample_seed",
+                            "0", "Seed of the random sampling.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
 // Address of a static instruction.
 struct StaticInstructionAddress {
-  StaticInstructionAddress() : image_name("???"), image_offset(-1) {}
+  StaticInstructionAddress() : image_name(UNKNOWN_NAME), image_offset(-1) {}
 
-  StaticInstructionAddress(const std::string &image_name, ADDRINT image_offset)
+  StaticInstructionAddress(NameId image_name, ADDRINT image_offset)
       : image_name(image_name), image_offset(image_offset) {}
 
-  std::string image_name; // Name of the image.
-  ADDRINT image_offset;   // Offset from the start of the image.
+  NameId image_name;    // Name of the image.
+  ADDRINT image_offset; // Offset from the start of the image.
 };
 
 // Maps a numerical instruction address (value of RIP) to a more readable
@@ -76,37 +113,56 @@ struct BranchInfo {
 static std::map<ADDRINT, BranchInfo> branch_infos;
 
 // Mutex for access to branch_infos.
-static PIN_MUTEX branch_infos_lock;
+static StatMutex branch_infos_lock("branch_infos_lock");
+
+// Statistics for -tool_stats.
+static CallCounter main_called_calls("MainCalled");
+static CallCounter main_returned_calls("MainReturned");
+static CallCounter branch_before_calls("BranchBefore");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_trace_timer("OnTrace");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize branch_infos_size("branch_infos");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
 
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
-// Run before every instruction.
-VOID InstructionBefore(ADDRINT instruction_pointer) {
-  // Check if main if reached yet.
-  if (instruction_pointer == main_address) {
-    log_file << "\nMain reached, setting global flag.\n";
-    main_reached = true;
-  }
+// Inlined check that runs before every call instruction. Returns whether this
+// is the first call to main().
+ADDRINT PIN_FAST_ANALYSIS_CALL CallsMain(ADDRINT target_address) {
+  return (end_address == INVALID_ADDRESS) & (target_address == main_address);
+}
 
-  // Check if main is finished.
-  if (instruction_pointer == end_address) {
-    log_file
-        << "\nInstruction after call to main reached, setting global flag.\n";
-    end_reached = true;
-  }
+// Runs at the first call to main().
+VOID MainCalled(ADDRINT next_instruction_pointer) {
+  main_called_calls.count();
+
+  log_file << "\nMain called, next ip = " << std::hex << std::showbase
+           << next_instruction_pointer << std::dec << "\n";
+  end_address = next_instruction_pointer;
+
+  log_file << "\nMain reached, setting global flag.\n";
+  main_reached = true;
 }
 
-// Runs before every call instruction.
-VOID InstructionCallBefore(ADDRINT target_address,
-                           ADDRINT next_instruction_pointer) {
-  // Check if this is the first call to main().
-  if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
-    log_file << "\nMain called, next ip = " << std::hex << std::showbase
-             << next_instruction_pointer << std::dec << "\n";
-    end_address = next_instruction_pointer;
-  }
+// Inlined check that runs before every return instruction. Returns whether it
+// returns from main().
+ADDRINT PIN_FAST_ANALYSIS_CALL ReturnsFromMain(ADDRINT target_address) {
+  return target_address == end_address;
+}
+
+// Runs when main() returns.
+VOID MainReturned() {
+  main_returned_calls.count();
+
+  log_file
+      << "\nInstruction after call to main reached, setting global flag.\n";
+  end_reached = true;
 }
 
 // Run at the start of __libc_start_main().
@@ -119,11 +175,13 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
 
 // Run before each branch.
 VOID BranchBefore(ADDRINT instruction_address, BOOL is_taken) {
+  branch_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Find the branch info.
-  PIN_MutexLock(&branch_infos_lock);
+  branch_infos_lock.lock();
 
   auto it = branch_infos.find(instruction_address);
   if (it != branch_infos.end()) {
@@ -136,7 +194,7 @@ VOID BranchBefore(ADDRINT instruction_address, BOOL is_taken) {
     assert(false && "Branch not added to branch_infos!");
   }
 
-  PIN_MutexUnlock(&branch_infos_lock);
+  branch_infos_lock.unlock();
 }
 
 // =============================================================================
@@ -145,25 +203,43 @@ VOID BranchBefore(ADDRINT instruction_address, BOOL is_taken) {
 
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
-  // Call InstructionBefore() before every instruction.
-  // Pass RIP as argument.
-  INS_InsertCall(instruction, IPOINT_BEFORE,
-                 reinterpret_cast<AFUNPTR>(InstructionBefore), IARG_INST_PTR,
-                 IARG_END);
+  ScopedStatTimer timer(on_instruction_timer);
 
-  // Call InstructionCallBefore() before every call instruction.
+  // Call MainCalled() if a call instruction is the first call to main(). It
+  // runs after the other analysis routines of the call, which is not part of
+  // main() yet.
   // Pass the target address (i.e. the address of the function being called) and
   // the address of the next instruction (i.e. the one following the call).
   if (INS_IsCall(instruction)) {
-    INS_InsertCall(instruction, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(InstructionCallBefore),
-                   IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
-                   INS_NextAddress(instruction), IARG_END);
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(CallsMain), IARG_CALL_ORDER,
+                     CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainCalled), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_ADDRINT,
+                       INS_NextAddress(instruction), IARG_END);
+  }
+
+  // Call MainReturned() if a return instruction returns from main(). It runs
+  // after the other analysis routines of the return, which is still part of
+  // main().
+  // Pass the return address.
+  if (INS_IsRet(instruction)) {
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(ReturnsFromMain),
+                     IARG_CALL_ORDER, CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainReturned), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_END);
   }
 }
 
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -185,6 +261,8 @@ VOID OnImageLoad(IMG image, VOID *v) {
 
 // Instrumentation routine run for every trace.
 VOID OnTrace(TRACE trace, VOID *v) {
+  ScopedStatTimer timer(on_trace_timer);
+
   // Iterate over all basic blocks in the trace.
   for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
     // Iterate over all instructions in the trace.
@@ -196,30 +274,29 @@ VOID OnTrace(TRACE trace, VOID *v) {
         ADDRINT ins_address = INS_Address(ins);
 
         // Get information of this instruction.
-        PIN_LockClient();
-        IMG image = IMG_FindByAddress(ins_address);
-
-        std::string image_name = IMG_Valid(image) ? IMG_Name(image) : "???";
-        ADDRINT image_offset = IMG_Valid(image)
-                                   ? (ins_address - IMG_LowAddress(image))
-                                   : static_cast<ADDRINT>(-1);
-
-        PIN_UnlockClient();
+        const SymbolLocation location = find_symbol(ins_address);
 
         // Add the static address of this instruction to the static instructions
         // map.
         staticInstructionAddresses.insert(std::make_pair(
-            ins_address, StaticInstructionAddress(image_name, image_offset)));
+            ins_address, StaticInstructionAddress(location.image_name,
+                                                  location.image_offset)));
 
         // Add entry to branch_infos map.
-        PIN_MutexLock(&branch_infos_lock);
+        branch_infos_lock.lock();
         branch_infos.insert(std::make_pair(ins_address, BranchInfo()));
-        PIN_MutexUnlock(&branch_infos_lock);
-
-        // Call BranchBefore() before every branch instruction.
-        INS_InsertCall(ins, IPOINT_BEFORE,
-                       reinterpret_cast<AFUNPTR>(BranchBefore), IARG_INST_PTR,
-                       IARG_BRANCH_TAKEN, IARG_END);
+        branch_infos_size.update(branch_infos.size());
+        branch_infos_lock.unlock();
+
+        // Call BranchBefore() before every (sampled) branch instruction.
+        insert_sample_countdown(ins, false);
+
+        IARGLIST args = IARGLIST_Alloc();
+        IARGLIST_AddArguments(args, IARG_INST_PTR, IARG_BRANCH_TAKEN,
+                              IARG_END);
+        insert_sampled_call(ins, IPOINT_BEFORE,
+                            reinterpret_cast<AFUNPTR>(BranchBefore), args,
+                            false);
       }
     }
   }
@@ -244,13 +321,36 @@ std::string get_filename(const std::string &path) {
   }
 }
 
-// Dump the information for branches in CSV format.
-void dump_csv_branches(std::ofstream &ofs,
-                       const std::map<ADDRINT, BranchInfo> &map) {
+// The columns of the branches table.
+static const std::vector<TableColumn> BRANCHES_COLUMNS = {
+    {"image_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"num_taken", ColumnType::UINT64},
+    {"num_not_taken", ColumnType::UINT64},
+};
+
+// The columns of the partial branches table. The address identifies a branch
+// across the regions of a pinball.
+static const std::vector<TableColumn> PARTIAL_BRANCHES_COLUMNS = {
+    {"ip", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"num_taken", ColumnType::UINT64},
+    {"num_not_taken", ColumnType::UINT64},
+};
+
+// The additional columns of the branches table when sampling.
+static const std::vector<TableColumn> SAMPLING_COLUMNS = {
+    {"num_taken_ci_low", ColumnType::UINT64},
+    {"num_taken_ci_high", ColumnType::UINT64},
+    {"num_not_taken_ci_low", ColumnType::UINT64},
+    {"num_not_taken_ci_high", ColumnType::UINT64},
+};
 
-  // Print header.
-  ofs << "image_name,image_offset,num_taken,num_not_taken\n";
-  // Print data.
+// Dump the information for branches.
+void dump_branches(TableWriter &table, const std::map<ADDRINT, BranchInfo> &map,
+                   bool partial) {
+  // Print data. The offset column is signed, so unknown offsets are -1.
   for (const auto &p : map) {
     // Grab the address of the branch.
     auto addr = p.first;
@@ -258,18 +358,25 @@ void dump_csv_branches(std::ofstream &ofs,
     // Get the address entry in the staticInstructionAddresses map.
     auto staticAddrEntry = staticInstructionAddresses[addr];
 
-    ofs << get_filename(staticAddrEntry.image_name); // image_name
+    if (partial)
+      table << addr; // ip
 
-    // Print "-1" for unknown offsets.
-    if (staticAddrEntry.image_offset != static_cast<ADDRINT>(-1))
-      ofs << ',' << staticAddrEntry.image_offset; // image_offset
-    else
-      ofs << ',' << -1; // image_offset
+    table << get_filename(get_name(staticAddrEntry.image_name)) // image_name
+          << staticAddrEntry.image_offset        // image_offset
+          << estimate_count(p.second.taken)      // num_taken
+          << estimate_count(p.second.not_taken); // num_not_taken
+
+    if (sampling_enabled()) {
+      UINT64 low, high;
 
-    ofs << ',' << p.second.taken      // num_taken
-        << ',' << p.second.not_taken; // num_not_taken
+      estimate_confidence_interval(p.second.taken, low, high);
+      table << low   // num_taken_ci_low
+            << high; // num_taken_ci_high
 
-    ofs << '\n';
+      estimate_confidence_interval(p.second.not_taken, low, high);
+      table << low   // num_not_taken_ci_low
+            << high; // num_not_taken_ci_high
+    }
   }
 }
 
@@ -279,11 +386,13 @@ void dump_csv_branches(std::ofstream &ofs,
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
   // -----------------------
   // Machine parsable output
   // -----------------------
 
-  dump_csv_branches(csv_branches, branch_infos);
+  dump_branches(*branches_table, branch_infos, KnobPartialOutput.Value());
 
   // -------
   // Cleanup
@@ -294,8 +403,14 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV file.
-  csv_branches.flush();
-  csv_branches.close();
+  branches_table->close();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -305,6 +420,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -331,6 +449,30 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
+  if (!init_sampling(KnobSamplePeriod.Value(), KnobSampleSeed.Value())) {
+    std::cerr << "Invalid sample period '" << KnobSamplePeriod.Value()
+              << "', or no register available for sampling.\n\n";
+    return Usage();
+  }
+
+  // Estimates cannot be merged exactly.
+  if (sampling_enabled() && KnobPartialOutput.Value()) {
+    std::cerr << "-partial_output cannot be combined with sampling.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
   if (!KnobStartFromMain.Value())
@@ -347,7 +489,19 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_branches.open((csv_prefix + ".branches.csv").c_str());
+  if (KnobPartialOutput.Value())
+    branches_table = open_table(csv_prefix + ".branches.partial",
+                                table_format, PARTIAL_BRANCHES_COLUMNS);
+  else if (sampling_enabled()) {
+    std::vector<TableColumn> columns = BRANCHES_COLUMNS;
+    columns.insert(columns.end(), SAMPLING_COLUMNS.begin(),
+                   SAMPLING_COLUMNS.end());
+
+    branches_table =
+        open_table(csv_prefix + ".branches", table_format, columns);
+  } else
+    branches_table = open_table(csv_prefix + ".branches", table_format,
+                                BRANCHES_COLUMNS);
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
@@ -361,15 +515,19 @@ int main(int argc, char *argv[]) {
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&branch_infos_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
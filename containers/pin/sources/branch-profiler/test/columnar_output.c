@@ -0,0 +1,24 @@
+// RUN: gcc %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t.csv -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: %sde %toolarg -csv_prefix %t.col -output_format columnar -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// The columnar output converts to the same CSV file.
+// RUN: columnar.py %t.col.branches.col %t.converted.csv
+// RUN: diff %t.csv.branches.csv %t.converted.csv
+
+// RUN: FileCheck %s < %t.converted.csv
+
+int main(int argc, char *argv[]) {
+  int n = 0;
+
+  for (int i = 0; i < 10; ++i) {
+    if (i % 3 == 0)
+      ++n;
+  }
+
+  return n;
+}
+
+// CHECK: image_name,image_offset,num_taken,num_not_taken
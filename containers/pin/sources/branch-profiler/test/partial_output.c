@@ -0,0 +1,21 @@
+// RUN: gcc %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -partial_output 1 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// Partial output keys each branch on its runtime address, so that the outputs
+// of several region replays can be merged.
+// RUN: FileCheck %s < %t.branches.partial.csv
+
+int main(int argc, char *argv[]) {
+  int n = 0;
+
+  for (int i = 0; i < 10; ++i) {
+    if (i % 3 == 0)
+      ++n;
+  }
+
+  return n;
+}
+
+// CHECK: ip,image_name,image_offset,num_taken,num_not_taken
@@ -0,0 +1,50 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -sample_period 64 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// The branch of hot_branch() is executed 100000 times, and taken for odd
+// arguments only. Sampling 1 in 64 of them should estimate both counts within a
+// few percent, and the confidence intervals should contain the estimates.
+// RUN: python3 -c "import csv; \
+// RUN:   addr = next(int(l.split()[0], 16) for l in open('%t.symbols') if l.split()[-1] == 'hot_branch'); \
+// RUN:   row = next(r for r in csv.DictReader(open('%t.branches.csv')) if int(r['image_offset']) == addr + 16); \
+// RUN:   counts = [(c,) + tuple(int(row[c + s]) for s in ('', '_ci_low', '_ci_high')) for c in ('num_taken', 'num_not_taken')]; \
+// RUN:   assert all(40000 <= n <= 60000 for c, n, low, high in counts), counts; \
+// RUN:   assert all(low < n < high for c, n, low, high in counts), counts"
+
+// XFAIL: x86
+
+#include <cstdint>
+
+// Adds 1 to its argument, branching on whether it is odd.
+extern "C" std::int64_t hot_branch(std::int64_t n);
+
+asm(R"(
+  .section        .text
+  .intel_syntax   noprefix
+  .globl          hot_branch
+  .type           hot_branch, @function
+
+.balign 16; hot_branch:
+.balign 16;     test            dil, 1
+.balign 16;     jnz             .odd
+
+.balign 16;     lea             rax, [rdi + 1]
+.balign 16;     ret
+
+.balign 16; .odd:
+.balign 16;     lea             rax, [rdi + 1]
+.balign 16;     ret
+)");
+
+int main(int argc, char *argv[]) {
+  std::int64_t n = 0;
+
+  for (int i = 0; i < 100000; ++i)
+    n = hot_branch(n);
+
+  return n == 100000 ? 0 : 1;
+}
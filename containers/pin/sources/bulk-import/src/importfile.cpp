@@ -0,0 +1,84 @@
+#include <limits>
+
+#include "importfile.h"
+
+namespace {
+
+// Write a quoted string, doubling the quotes in it.
+void write_quoted(std::ofstream &ofs, const std::string &value) {
+  ofs << '"';
+
+  for (const char c : value) {
+    if (c == '"')
+      ofs << '"';
+    ofs << c;
+  }
+
+  ofs << '"';
+}
+
+} // namespace
+
+ImportFile::ImportFile(const std::string &directory, const std::string &name,
+                       const std::vector<std::string> &header)
+    : header_file(name + ".header.csv"), data_file(name + ".csv"),
+      ofs((directory + "/" + data_file).c_str()) {
+  // Write doubles without losing precision.
+  ofs.precision(std::numeric_limits<double>::max_digits10);
+
+  std::ofstream header_ofs((directory + "/" + header_file).c_str());
+
+  for (std::size_t i = 0; i < header.size(); ++i)
+    header_ofs << (i == 0 ? "" : ",") << header[i];
+
+  header_ofs << '\n';
+  header_ofs.close();
+
+  header_written = !header_ofs.fail();
+}
+
+void ImportFile::write_separator() {
+  if (row_started)
+    ofs << ',';
+
+  row_started = true;
+}
+
+ImportFile &ImportFile::operator<<(const std::string &value) {
+  write_separator();
+  write_quoted(ofs, value);
+  return *this;
+}
+
+ImportFile &ImportFile::operator<<(std::int64_t value) {
+  write_separator();
+  ofs << value;
+  return *this;
+}
+
+ImportFile &ImportFile::operator<<(std::uint64_t value) {
+  write_separator();
+  ofs << value;
+  return *this;
+}
+
+ImportFile &ImportFile::operator<<(double value) {
+  write_separator();
+  ofs << value;
+  return *this;
+}
+
+ImportFile &ImportFile::empty() {
+  write_separator();
+  return *this;
+}
+
+void ImportFile::end_row() {
+  ofs << '\n';
+  row_started = false;
+}
+
+bool ImportFile::close() {
+  ofs.close();
+  return header_written && !ofs.fail();
+}
@@ -0,0 +1,53 @@
+#ifndef IMPORTFILE_H
+#define IMPORTFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes a node or relationship file for 'neo4j-admin database import'. The
+// header is written to '<directory>/<name>.header.csv', and the rows to
+// '<directory>/<name>.csv'.
+//
+// Header fields use the syntax of neo4j-admin, e.g. ':ID(Instruction)' or
+// 'image_offset:long'.
+class ImportFile {
+public:
+  ImportFile(const std::string &directory, const std::string &name,
+             const std::vector<std::string> &header);
+
+  // Write a value in the current row. Strings are always quoted.
+  ImportFile &operator<<(const std::string &value);
+  ImportFile &operator<<(std::int64_t value);
+  ImportFile &operator<<(std::uint64_t value);
+  ImportFile &operator<<(double value);
+
+  // Write an empty value in the current row, which neo4j-admin does not store
+  // as a property.
+  ImportFile &empty();
+
+  // Ends the current row.
+  void end_row();
+
+  // Closes the file. Returns false if it could not be written.
+  bool close();
+
+  // The names of the header and data files, relative to the directory.
+  const std::string header_file;
+  const std::string data_file;
+
+private:
+  // Write the separator before the current value.
+  void write_separator();
+
+  std::ofstream ofs;
+
+  // Whether a value has been written in the current row.
+  bool row_started = false;
+
+  // Whether the header file could be written.
+  bool header_written;
+};
+
+#endif
@@ -0,0 +1,563 @@
+// Converts the outputs of the Pin tools to the node and relationship files of
+// 'neo4j-admin database import', so that a fresh database can be bulk-loaded
+// instead of being filled with LOAD CSV queries.
+//
+// Instruction nodes are deduplicated across tools by (image_name,
+// image_offset). The resulting graph is the same as the one built by the
+// import queries of modules/data_dependencies.py and modules/memory_buffers.py.
+//
+// Usage: BulkImport [-data_dependencies <prefix>] [-memory_buffer <prefix>]
+//                   [-tag <tag>] <output directory>
+//
+// The output directory contains a header and a data file per node label and
+// relationship type, and 'import.args', which lists the corresponding
+// arguments of neo4j-admin, one per line.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "importfile.h"
+#include "inputtable.h"
+
+namespace {
+
+// =============================================================================
+// Graph
+// =============================================================================
+
+// An Instruction node.
+struct InstructionNode {
+  // Whether the node has an image name and offset. Nodes that are only known
+  // by their address do not.
+  bool has_location = false;
+
+  std::string image_name;
+  std::int64_t image_offset = -1;
+
+  // The properties from the memory-buffer tool.
+  bool has_details = false;
+
+  std::string ip;
+  std::string section_name;
+  std::string routine_name;
+  std::string mnem;
+  std::string operands;
+  std::string read_values;
+  std::string written_values;
+  double read_values_entropy = 0;
+  double written_values_entropy = 0;
+  std::int64_t num_bytes_read = 0;
+  std::int64_t num_bytes_written = 0;
+};
+
+// A SystemCall node.
+struct SystemCallNode {
+  std::string thread_id;
+  std::string syscall_id;
+  std::int64_t syscall_file_index = 0;
+};
+
+// Hash of the key of an instruction.
+struct LocationHash {
+  std::size_t
+  operator()(const std::pair<std::string, std::int64_t> &location) const {
+    return std::hash<std::string>()(location.first) ^
+           (std::hash<std::int64_t>()(location.second) * 31);
+  }
+};
+
+// The nodes that are shared between tools. Their identifiers are their index.
+struct Graph {
+  std::vector<InstructionNode> instructions;
+  std::vector<SystemCallNode> system_calls;
+
+  // Maps the key of every node to its identifier.
+  std::unordered_map<std::pair<std::string, std::int64_t>, std::uint64_t,
+                     LocationHash>
+      instruction_ids;
+  std::unordered_map<std::string, std::uint64_t> instruction_ids_by_ip;
+  std::map<std::pair<std::string, std::string>, std::uint64_t> system_call_ids;
+
+  // Returns the identifier of the instruction at the given location, creating
+  // the instruction if needed.
+  std::uint64_t get_instruction(const std::string &image_name,
+                                std::int64_t image_offset) {
+    auto result = instruction_ids.emplace(
+        std::make_pair(image_name, image_offset), instructions.size());
+
+    if (result.second) {
+      InstructionNode node;
+      node.has_location = true;
+      node.image_name = image_name;
+      node.image_offset = image_offset;
+      instructions.push_back(std::move(node));
+    }
+
+    return result.first->second;
+  }
+
+  // Returns the identifier of the instruction with the given address, creating
+  // the instruction if needed.
+  std::uint64_t get_instruction_by_ip(const std::string &ip) {
+    auto result = instruction_ids_by_ip.emplace(ip, instructions.size());
+
+    if (result.second) {
+      InstructionNode node;
+      node.ip = ip;
+      instructions.push_back(std::move(node));
+    }
+
+    return result.first->second;
+  }
+
+  // Returns the identifier of a system call, creating it if needed.
+  std::uint64_t get_system_call(const std::string &thread_id,
+                                const std::string &syscall_id) {
+    auto result = system_call_ids.emplace(std::make_pair(thread_id, syscall_id),
+                                          system_calls.size());
+
+    if (result.second) {
+      SystemCallNode node;
+      node.thread_id = thread_id;
+      node.syscall_id = syscall_id;
+      system_calls.push_back(std::move(node));
+    }
+
+    return result.first->second;
+  }
+};
+
+// =============================================================================
+// Helper functions
+// =============================================================================
+
+// Opens an input table. Prints an error if it cannot be opened.
+std::unique_ptr<InputTable> open_input(const std::string &path) {
+  std::unique_ptr<InputTable> table = open_input_table(path);
+
+  if (!table)
+    std::cerr << "Could not read '" << path << ".col' or '" << path
+              << ".csv'!\n";
+
+  return table;
+}
+
+// Looks up the columns with the given names in a table. Prints an error and
+// returns false if a column is missing.
+bool find_columns(const InputTable &table, const std::string &path,
+                  const std::vector<std::string> &names,
+                  std::vector<int> &columns) {
+  columns.clear();
+
+  for (const std::string &name : names) {
+    columns.push_back(table.find_column(name));
+
+    if (columns.back() < 0) {
+      std::cerr << "'" << path << "' has no column '" << name << "'!\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Closes an output file and adds it to the arguments of neo4j-admin. 'kind' is
+// either 'nodes' or 'relationships'.
+bool finish_file(ImportFile &file, const std::string &kind,
+                 const std::string &label,
+                 std::vector<std::string> &arguments) {
+  if (!file.close()) {
+    std::cerr << "Could not write '" << file.data_file << "'!\n";
+    return false;
+  }
+
+  arguments.push_back("--" + kind + "=" + label + "=" + file.header_file +
+                      "," + file.data_file);
+  return true;
+}
+
+// Calls 'callback' for every item in a list of items separated by ','.
+void for_each_item(const std::string &list,
+                   const std::function<void(const std::string &)> &callback) {
+  std::string::size_type begin = 0;
+
+  while (begin < list.size()) {
+    std::string::size_type end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+
+    if (end != begin)
+      callback(list.substr(begin, end - begin));
+
+    begin = end + 1;
+  }
+}
+
+// =============================================================================
+// Data dependencies
+// =============================================================================
+
+// Import the dependencies of <prefix>.memory_dependencies and
+// <prefix>.register_dependencies, and the system calls of
+// <prefix>.syscall_instructions.
+bool import_data_dependencies(const std::string &prefix,
+                              const std::string &tag,
+                              const std::string &directory, Graph &graph,
+                              std::vector<std::string> &arguments) {
+  for (const auto &kind : {std::make_pair("memory", "Memory"),
+                           std::make_pair("register", "Register")}) {
+    const std::string path = prefix + "." + kind.first + "_dependencies";
+    const std::string property = (kind.first == std::string("memory"))
+                                     ? "address"
+                                     : kind.first;
+
+    auto table = open_input(path);
+    std::vector<int> columns;
+
+    if (!table ||
+        !find_columns(*table, path,
+                      {"Write_img", "Write_off", kind.second, "Read_img",
+                       "Read_off"},
+                      columns))
+      return false;
+
+    ImportFile file(directory, std::string(kind.first) + "-dependencies",
+                    {":START_ID(Instruction)", ":END_ID(Instruction)",
+                     property, "tag"});
+
+    // The reading instruction depends on the writing instruction.
+    while (table->next_row()) {
+      const std::uint64_t write_id =
+          graph.get_instruction(table->get_string(columns[0]),
+                                table->get_int64(columns[1]));
+      const std::uint64_t read_id =
+          graph.get_instruction(table->get_string(columns[3]),
+                                table->get_int64(columns[4]));
+
+      file << read_id << write_id << table->get_string(columns[2]) << tag;
+      file.end_row();
+    }
+
+    if (!finish_file(file, "relationships", "DEPENDS_ON", arguments))
+      return false;
+  }
+
+  const std::string path = prefix + ".syscall_instructions";
+  auto table = open_input(path);
+  std::vector<int> columns;
+
+  if (!table ||
+      !find_columns(*table, path,
+                    {"image_name", "image_offset", "index", "thread_id",
+                     "syscall_id"},
+                    columns))
+    return false;
+
+  ImportFile file(directory, "invoked-by",
+                  {":START_ID(SystemCall)", ":END_ID(Instruction)"});
+
+  while (table->next_row()) {
+    const std::uint64_t syscall_id = graph.get_system_call(
+        table->get_string(columns[3]), table->get_string(columns[4]));
+    graph.system_calls[syscall_id].syscall_file_index =
+        table->get_int64(columns[2]);
+
+    const std::uint64_t instruction_id = graph.get_instruction(
+        table->get_string(columns[0]), table->get_int64(columns[1]));
+
+    file << syscall_id << instruction_id;
+    file.end_row();
+  }
+
+  return finish_file(file, "relationships", "INVOKED_BY", arguments);
+}
+
+// =============================================================================
+// Memory buffers
+// =============================================================================
+
+// The entropy columns of the buffers and regions tables.
+const std::vector<std::string> ENTROPY_COLUMNS = {
+    "average_spatial_entropy_bit_shannon",
+    "average_spatial_entropy_byte_shannon",
+    "average_spatial_entropy_byte_shannon_adapted",
+    "average_spatial_entropy_byte_num_different",
+    "average_spatial_entropy_byte_num_unique",
+    "average_spatial_entropy_bit_average",
+    "average_spatial_entropy_byte_average",
+    "average_temporal_entropy_bit_shannon",
+};
+
+// Import the instructions of <prefix>.instructions, and the memory buffers and
+// regions of <prefix>.buffers and <prefix>.regions.
+bool import_memory_buffers(const std::string &prefix,
+                           const std::string &directory, Graph &graph,
+                           std::vector<std::string> &arguments) {
+  // Load the instructions.
+  {
+    const std::string path = prefix + ".instructions";
+    auto table = open_input(path);
+    std::vector<int> columns;
+
+    if (!table ||
+        !find_columns(*table, path,
+                      {"ip", "image_name", "image_offset", "section_name",
+                       "routine_name", "opcode", "operands", "read_values",
+                       "written_values", "read_values_entropy",
+                       "written_values_entropy", "num_bytes_read",
+                       "num_bytes_written"},
+                      columns))
+      return false;
+
+    while (table->next_row()) {
+      const std::uint64_t id = graph.get_instruction(
+          table->get_string(columns[1]), table->get_int64(columns[2]));
+      InstructionNode &node = graph.instructions[id];
+
+      node.has_details = true;
+      node.ip = table->get_string(columns[0]);
+      node.section_name = table->get_string(columns[3]);
+      node.routine_name = table->get_string(columns[4]);
+      node.mnem = table->get_string(columns[5]);
+      node.operands = table->get_string(columns[6]);
+      node.read_values = table->get_string(columns[7]);
+      node.written_values = table->get_string(columns[8]);
+      node.read_values_entropy = table->get_double(columns[9]);
+      node.written_values_entropy = table->get_double(columns[10]);
+      node.num_bytes_read = table->get_int64(columns[11]);
+      node.num_bytes_written = table->get_int64(columns[12]);
+
+      graph.instruction_ids_by_ip[node.ip] = id;
+    }
+  }
+
+  // Load the buffers and regions, and link them to the instructions that read
+  // and write them.
+  for (const auto &kind : {std::make_pair("buffers", "MemoryBuffer"),
+                           std::make_pair("regions", "MemoryRegion")}) {
+    const std::string path = prefix + "." + kind.first;
+    const std::string label = kind.second;
+
+    std::vector<std::string> names = {"id",
+                                      "start_address",
+                                      "end_address",
+                                      "num_reads",
+                                      "num_writes",
+                                      "allocation_address",
+                                      "DEBUG_allocation_backtrace",
+                                      "DEBUG_annotation",
+                                      "read_ips",
+                                      "write_ips"};
+    names.insert(names.end(), ENTROPY_COLUMNS.begin(), ENTROPY_COLUMNS.end());
+
+    auto table = open_input(path);
+    std::vector<int> columns;
+
+    if (!table || !find_columns(*table, path, names, columns))
+      return false;
+
+    std::vector<std::string> header = {"id:ID(" + label + ")",
+                                       "start_address:long",
+                                       "end_address:long",
+                                       "num_reads:long",
+                                       "num_writes:long",
+                                       "allocation_address:long",
+                                       "DEBUG_allocation_backtrace",
+                                       "DEBUG_annotation"};
+    for (const std::string &name : ENTROPY_COLUMNS)
+      header.push_back(name + ":double");
+
+    const std::string name = std::string("memory-") + kind.first;
+    ImportFile nodes(directory, name, header);
+    ImportFile reads(directory, name + "-reads",
+                     {":START_ID(Instruction)", ":END_ID(" + label + ")"});
+    ImportFile writes(directory, name + "-writes",
+                      {":START_ID(Instruction)", ":END_ID(" + label + ")"});
+
+    while (table->next_row()) {
+      const std::string id = table->get_string(columns[0]);
+
+      nodes << id;
+
+      for (std::size_t i = 1; i <= 5; ++i)
+        nodes << table->get_int64(columns[i]);
+
+      nodes << table->get_string(columns[6]) << table->get_string(columns[7]);
+
+      for (std::size_t i = 10; i < columns.size(); ++i)
+        nodes << table->get_double(columns[i]);
+
+      nodes.end_row();
+
+      for_each_item(table->get_string(columns[8]),
+                    [&](const std::string &ip) {
+                      reads << graph.get_instruction_by_ip(ip) << id;
+                      reads.end_row();
+                    });
+
+      for_each_item(table->get_string(columns[9]),
+                    [&](const std::string &ip) {
+                      writes << graph.get_instruction_by_ip(ip) << id;
+                      writes.end_row();
+                    });
+    }
+
+    if (!finish_file(nodes, "nodes", label, arguments) ||
+        !finish_file(reads, "relationships", "READS_FROM", arguments) ||
+        !finish_file(writes, "relationships", "WRITES_TO", arguments))
+      return false;
+  }
+
+  return true;
+}
+
+// =============================================================================
+// Shared nodes
+// =============================================================================
+
+// Write the Instruction and SystemCall nodes.
+bool write_nodes(const Graph &graph, const std::string &directory,
+                 std::vector<std::string> &arguments) {
+  ImportFile instructions(
+      directory, "instructions",
+      {":ID(Instruction)", "image_name", "image_offset:long", "ip",
+       "section_name", "routine_name", "mnem", "operands", "read_values",
+       "written_values", "read_values_entropy:double",
+       "written_values_entropy:double", "num_bytes_read:long",
+       "num_bytes_written:long"});
+
+  for (std::uint64_t id = 0; id < graph.instructions.size(); ++id) {
+    const InstructionNode &node = graph.instructions[id];
+
+    instructions << id;
+
+    if (node.has_location)
+      instructions << node.image_name << node.image_offset;
+    else
+      instructions.empty().empty();
+
+    if (!node.ip.empty())
+      instructions << node.ip;
+    else
+      instructions.empty();
+
+    if (node.has_details) {
+      instructions << node.section_name << node.routine_name << node.mnem
+                   << node.operands << node.read_values << node.written_values
+                   << node.read_values_entropy << node.written_values_entropy
+                   << node.num_bytes_read << node.num_bytes_written;
+    } else {
+      for (int i = 0; i < 10; ++i)
+        instructions.empty();
+    }
+
+    instructions.end_row();
+  }
+
+  if (!finish_file(instructions, "nodes", "Instruction", arguments))
+    return false;
+
+  ImportFile system_calls(directory, "system-calls",
+                          {":ID(SystemCall)", "thread_id", "syscall_id",
+                           "syscall_file_index:long"});
+
+  for (std::uint64_t id = 0; id < graph.system_calls.size(); ++id) {
+    const SystemCallNode &node = graph.system_calls[id];
+
+    system_calls << id << node.thread_id << node.syscall_id
+                 << node.syscall_file_index;
+    system_calls.end_row();
+  }
+
+  return finish_file(system_calls, "nodes", "SystemCall", arguments);
+}
+
+int usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [-data_dependencies <prefix>] [-memory_buffer <prefix>] "
+               "[-tag <tag>] <output directory>\n";
+  return EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string data_dependencies_prefix;
+  std::string memory_buffer_prefix;
+  std::string tag;
+  std::string directory;
+
+  // Parse the arguments.
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    if (arg == "-data_dependencies" && i + 1 < argc) {
+      data_dependencies_prefix = argv[++i];
+    } else if (arg == "-memory_buffer" && i + 1 < argc) {
+      memory_buffer_prefix = argv[++i];
+    } else if (arg == "-tag" && i + 1 < argc) {
+      tag = argv[++i];
+    } else if (directory.empty() && !arg.empty() && arg[0] != '-') {
+      directory = arg;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (directory.empty())
+    return usage(argv[0]);
+
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "Could not create '" << directory << "'!\n";
+    return EXIT_FAILURE;
+  }
+
+  // Convert the outputs of the tools. Relationships are written as they are
+  // read, and the nodes they refer to are written at the end.
+  Graph graph;
+  std::vector<std::string> arguments;
+
+  if (!data_dependencies_prefix.empty() &&
+      !import_data_dependencies(data_dependencies_prefix, tag, directory,
+                                graph, arguments))
+    return EXIT_FAILURE;
+
+  if (!memory_buffer_prefix.empty() &&
+      !import_memory_buffers(memory_buffer_prefix, directory, graph,
+                             arguments))
+    return EXIT_FAILURE;
+
+  if (!write_nodes(graph, directory, arguments))
+    return EXIT_FAILURE;
+
+  // Write the arguments of neo4j-admin.
+  std::ofstream ofs((directory + "/import.args").c_str());
+
+  for (const std::string &argument : arguments)
+    ofs << argument << '\n';
+
+  ofs.close();
+
+  if (ofs.fail()) {
+    std::cerr << "Could not write '" << directory << "/import.args'!\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Wrote " << graph.instructions.size() << " instructions and "
+            << graph.system_calls.size() << " system calls to '" << directory
+            << "'.\n";
+
+  return EXIT_SUCCESS;
+}
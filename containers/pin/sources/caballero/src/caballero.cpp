@@ -1,8 +1,11 @@
 #include "pin.H"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
 #include <fstream>
 #include <iostream>
 #include <list>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <unordered_map>
@@ -25,6 +28,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.caballero.csv.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.caballero.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
 KNOB<double> KnobRatio(KNOB_MODE_WRITEONCE, "pintool", "r", "0.4",
                        "specify golden ratio");
 
@@ -34,16 +44,16 @@ KNOB<double> KnobRatio(KNOB_MODE_WRITEONCE, "pintool", "r", "0.4",
 
 // Struct used to keep information for one basic block.
 struct BasicBlock {
-  BasicBlock() : BasicBlock("???", -1, -1, -1, 0, 0) {}
+  BasicBlock() : BasicBlock(UNKNOWN_NAME, -1, -1, -1, 0, 0) {}
 
-  BasicBlock(const std::string &image_name, ADDRINT address_begin,
+  BasicBlock(NameId image_name, ADDRINT address_begin,
              ADDRINT address_end, ADDRINT address, int size,
              int caballero_count)
       : image_name(image_name), image_offset_begin(address_begin),
         image_offset_end(address_end), address(address), size(size),
         caballero_count(caballero_count) {}
 
-  std::string image_name;     // The image name of this basic block.
+  NameId image_name;          // The image name of this basic block.
   ADDRINT image_offset_begin; // The address of the first instruction of this
                               // basic block.
   ADDRINT image_offset_end;   // The end address of this basic block.
@@ -72,10 +82,10 @@ struct thread_data_t {
 float golden_ratio = 0.4;
 float min_total_caballero_count = golden_ratio * MIN_INTERVAL_SIZE;
 
-std::ofstream csv_basic_blocks;
+std::unique_ptr<TableWriter> basic_blocks_table;
 std::ofstream log_file;
 
-static PIN_MUTEX csv_basic_blocks_lock;
+static PIN_MUTEX basic_blocks_table_lock;
 static PIN_MUTEX log_file_lock;
 
 std::set<ADDRINT> golden_blocks;
@@ -83,6 +93,13 @@ std::map<ADDRINT, BasicBlock> basic_blocks;
 
 static PIN_MUTEX basic_blocks_lock;
 
+// The columns of the basic blocks table.
+static const std::vector<TableColumn> BASIC_BLOCKS_COLUMNS = {
+    {"image_name", ColumnType::STRING},
+    {"image_offset_begin", ColumnType::UINT64},
+    {"image_offset_end", ColumnType::UINT64},
+};
+
 // ======================================================================
 // Helper functions
 // ======================================================================
@@ -209,11 +226,12 @@ VOID updateStats(ADDRINT address, THREADID threadid) {
         golden_blocks.insert(i->address);
         PIN_ReleaseLock(&golden_blocks_lock);
 
-        PIN_MutexLock(&csv_basic_blocks_lock);
-        csv_basic_blocks << get_filename(i->image_name) << ',' // image_name
-                         << i->image_offset_begin << ',' // image_offset_begin
-                         << i->image_offset_end << '\n'; // image_offset_end
-        PIN_MutexUnlock(&csv_basic_blocks_lock);
+        PIN_MutexLock(&basic_blocks_table_lock);
+        TableWriter &table = *basic_blocks_table;
+        table << get_filename(get_name(i->image_name)) // image_name
+              << i->image_offset_begin                 // image_offset_begin
+              << i->image_offset_end;                  // image_offset_end
+        PIN_MutexUnlock(&basic_blocks_table_lock);
       }
     }
   }
@@ -242,11 +260,11 @@ VOID Trace(TRACE trace, VOID *v) {
       }
     }
 
-    IMG img = IMG_FindByAddress(bbl_addr);
+    const SymbolLocation location = find_symbol(bbl_addr);
 
-    if (IMG_Valid(img)) {
-      std::string image_name = IMG_Name(img);
-      ADDRINT image_base = IMG_LowAddress(img);
+    if (location.image_name != UNKNOWN_NAME) {
+      NameId image_name = location.image_name;
+      ADDRINT image_base = bbl_addr - location.image_offset;
 
       ADDRINT address_begin = INS_Address(BBL_InsHead(bbl));
       INS bbl_tail = BBL_InsTail(bbl);
@@ -275,8 +293,9 @@ VOID Fini(INT32 code, VOID *v) {
   log_file.flush();
   log_file.close();
 
-  csv_basic_blocks.flush();
-  csv_basic_blocks.close();
+  PIN_MutexLock(&basic_blocks_table_lock);
+  basic_blocks_table->close();
+  PIN_MutexUnlock(&basic_blocks_table_lock);
 }
 
 bool earlyFini(unsigned int a, int b, LEVEL_VM::CONTEXT *, bool c,
@@ -306,6 +325,18 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
   // Obtain  a key for TLS storage.
   tls_key = PIN_CreateThreadDataKey(NULL);
   if (tls_key == INVALID_TLS_KEY) {
@@ -328,9 +359,8 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_basic_blocks.open((csv_prefix + ".caballero.csv").c_str());
-
-  csv_basic_blocks << "image_name,image_offset_begin,image_offset_end\n";
+  basic_blocks_table = open_table(csv_prefix + ".caballero", table_format,
+                                  BASIC_BLOCKS_COLUMNS);
 
   // Intercept thread creation
   PIN_AddThreadStartFunction(ThreadStart, NULL);
@@ -346,7 +376,7 @@ int main(int argc, char *argv[]) {
   PIN_InterceptSignal(15, earlyFini, 0);
 
   // Initialise mutexes.
-  PIN_MutexInit(&csv_basic_blocks_lock);
+  PIN_MutexInit(&basic_blocks_table_lock);
   PIN_MutexInit(&log_file_lock);
   PIN_MutexInit(&basic_blocks_lock);
 
@@ -1,17 +1,26 @@
 #include <fstream>
 #include <iostream>
-#include <set>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "pin.H"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_call_targets;
+// Table to write the call targets to.
+static std::unique_ptr<TableWriter> call_targets_table;
+
+// Table to write the calling context tree to.
+static std::unique_ptr<TableWriter> cct_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -39,6 +48,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.call-targets.csv.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output files. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.<table>.col files instead. Use "
+    "containers/pin/columnar.py to read them.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -50,34 +66,220 @@ KNOB<bool>
     KnobEndAfterMain(KNOB_MODE_WRITEONCE, "pintool", "end_after_main", "1",
                      "When true, ends analysis after main() is finished");
 
+// Option (-cct) to build a calling context tree.
+KNOB<bool> KnobCct(KNOB_MODE_WRITEONCE, "pintool", "cct", "0",
+                   "When true, also builds a calling context tree, with the "
+                   "number of calls and the inclusive number of executed "
+                   "instructions per node. The tree is written to "
+                   "<prefix>.cct.csv.");
+
+// Option (-count_direct_calls) to count the calls of direct call instructions.
+KNOB<bool> KnobCountDirectCalls(
+    KNOB_MODE_WRITEONCE, "pintool", "count_direct_calls", "0",
+    "When true, counts the number of executions of direct call instructions. "
+    "Otherwise, their targets are recorded once at instrumentation time, and "
+    "their number of calls is reported as -1.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
 // Contains the information for each instruction.
 struct InstructionInfo {
-  InstructionInfo(const std::string &image_name, ADDRINT image_offset,
-                  const std::string &function_name)
+  InstructionInfo(NameId image_name, ADDRINT image_offset, NameId function_name)
       : image_name(image_name), image_offset(image_offset),
         function_name(function_name) {}
 
   // The name of the image this instruction belongs to.
-  std::string image_name;
+  NameId image_name;
 
   // The offset of the instruction relative to the base of the image.
   ADDRINT image_offset;
 
   // The function name of this instruction.
-  std::string function_name;
+  NameId function_name;
+};
+
+// Number of call targets that are stored inline in a call site, before it is
+// considered to be megamorphic.
+static constexpr std::size_t NUM_INLINE_CALL_TARGETS = 4;
+
+// A call target of a call instruction, with the number of calls to it.
+struct CallTarget {
+  // The address of the call target.
+  ADDRINT target_address;
+
+  // The number of calls to this target.
+  UINT64 num_calls;
+};
+
+// Call target that never matches, used to initialise the inline caches.
+static CallTarget no_call_target = {INVALID_ADDRESS, 0};
+
+// Contains the call targets of a call instruction.
+struct CallSite {
+  CallSite() : cache(&no_call_target), num_targets(0), counts_known(true) {}
+
+  // Returns the entry for the given call target, adding it if it does not
+  // exist yet. 'is_new' is set if the entry was added. The entries are never
+  // moved, so the returned pointer stays valid. call_sites_lock must be held
+  // when calling this function.
+  CallTarget *get_target(ADDRINT target_address, bool &is_new) {
+    for (std::size_t i = 0; i < num_targets; ++i) {
+      if (targets[i].target_address == target_address) {
+        is_new = false;
+        return &targets[i];
+      }
+    }
+
+    if (num_targets < NUM_INLINE_CALL_TARGETS) {
+      is_new = true;
+      targets[num_targets] = CallTarget{target_address, 0};
+      return &targets[num_targets++];
+    }
+
+    // Megamorphic call site.
+    auto result = megamorphic_targets.insert(
+        std::make_pair(target_address, CallTarget{target_address, 0}));
+    is_new = result.second;
+    return &result.first->second;
+  }
+
+  // The most recently seen call target. This is read without holding
+  // call_sites_lock by the inlined fast path of indirect calls.
+  CallTarget *cache;
+
+  // The first call targets of this call site.
+  CallTarget targets[NUM_INLINE_CALL_TARGETS];
+
+  // The number of valid entries in 'targets'.
+  std::size_t num_targets;
+
+  // The remaining call targets, once 'targets' is full.
+  std::map<ADDRINT, CallTarget> megamorphic_targets;
+
+  // False if a call target of this call site was recorded at instrumentation
+  // time without counting its calls.
+  bool counts_known;
 };
 
-// Maps the address of a call instruction to the set of callees.
-static std::map<ADDRINT, std::set<ADDRINT>> call_instruction_infos;
+// Maps the address of a call instruction to its call targets.
+static std::map<ADDRINT, std::unique_ptr<CallSite>> call_sites;
+
+// Mutex for accessing call_sites, and the call targets of each call site.
+static StatMutex call_sites_lock("call_sites_lock");
 
-// Mutex for accessing call_instruction_infos.
-static PIN_MUTEX call_instruction_infos_lock;
+// 1 if the analysis is active, i.e. main() was reached and has not returned
+// yet, 0 otherwise. This is an ADDRINT rather than a bool so the inlined
+// analysis routines can add it to the call counters without branching.
+static ADDRINT analysis_active = 0;
 
-// Maps the address of an instruction to its instruction info.
+// Maps the address of a call instruction or call target to its instruction
+// info.
 static std::map<ADDRINT, InstructionInfo> static_instruction_infos;
 
 // Mutex for accessing static_instruction_infos.
-static PIN_MUTEX static_instruction_infos_lock;
+static StatMutex static_instruction_infos_lock("static_instruction_infos_lock");
+
+// Node in the calling context tree. Every node corresponds to a (call
+// instruction, call target) pair in the context of its parent node.
+struct CctNode {
+  CctNode(ADDRINT call_address, ADDRINT target_address)
+      : call_address(call_address), target_address(target_address),
+        num_calls(0), num_instructions(0) {}
+
+  // Returns the child for the given call instruction and target, adding it
+  // if it does not exist yet. 'is_new' is set if the child was added.
+  CctNode *get_child(ADDRINT call_address, ADDRINT target_address,
+                     bool &is_new) {
+    for (const auto &child : children) {
+      if (child->call_address == call_address &&
+          child->target_address == target_address) {
+        is_new = false;
+        return child.get();
+      }
+    }
+
+    is_new = true;
+    children.emplace_back(new CctNode(call_address, target_address));
+    return children.back().get();
+  }
+
+  // The address of the call instruction.
+  ADDRINT call_address;
+
+  // The address of the call target.
+  ADDRINT target_address;
+
+  // The number of calls in this context.
+  UINT64 num_calls;
+
+  // The number of instructions executed in this context, including those in
+  // callees.
+  UINT64 num_instructions;
+
+  // The callees in this context.
+  std::vector<std::unique_ptr<CctNode>> children;
+};
+
+// Entry on the shadow stack of a thread.
+struct StackFrame {
+  // The node of the calling context tree of this call.
+  CctNode *node;
+
+  // The address that this call returns to.
+  ADDRINT return_address;
+
+  // The number of instructions executed by the thread at the time of the call.
+  UINT64 instructions_at_entry;
+};
+
+// Contains the calling context information for each thread.
+struct ThreadData {
+  explicit ThreadData(THREADID thread_id)
+      : thread_id(thread_id), root(INVALID_ADDRESS, INVALID_ADDRESS),
+        num_instructions(0) {}
+
+  // Pin's ID of the thread.
+  THREADID thread_id;
+
+  // The root of the calling context tree of this thread.
+  CctNode root;
+
+  // Shadow stack of the calls in progress.
+  std::vector<StackFrame> stack;
+
+  // The number of instructions executed by this thread.
+  UINT64 num_instructions;
+};
+
+// Key for accessing TLS storage in the threads.
+static TLS_KEY tls_key = INVALID_TLS_KEY;
+
+// The calling context information of all threads, including those that have
+// exited already.
+static std::vector<std::unique_ptr<ThreadData>> thread_datas;
+
+// Mutex for accessing thread_datas.
+static StatMutex thread_datas_lock("thread_datas_lock");
+
+// Statistics for -tool_stats. The inlined fast paths are not counted, as that
+// would keep Pin from inlining them.
+static CallCounter instruction_call_before_calls("InstructionCallBefore");
+static CallCounter main_returned_calls("MainReturned");
+static CallCounter instruction_ret_before_calls("InstructionRetBefore");
+static CallCounter basic_block_before_calls("BasicBlockBefore");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_trace_timer("OnTrace");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize call_sites_size("call_sites");
+static PeakSize static_instruction_infos_size("static_instruction_infos");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
 
 // =============================================================================
 // Helper functions
@@ -98,51 +300,212 @@ std::string get_filename(const std::string &path) {
   }
 }
 
+// Add the instruction info for the instruction at the given address to
+// static_instruction_infos, if it is not present already.
+void AddInstructionInfo(ADDRINT ins_addr) {
+  static_instruction_infos_lock.lock();
+
+  if (static_instruction_infos.find(ins_addr) ==
+      static_instruction_infos.end()) {
+    const SymbolLocation location = find_symbol(ins_addr);
+
+    static_instruction_infos.insert(std::make_pair(
+        ins_addr, InstructionInfo(location.image_name, location.image_offset,
+                                  location.routine_name)));
+    static_instruction_infos_size.update(static_instruction_infos.size());
+  }
+
+  static_instruction_infos_lock.unlock();
+}
+
+// Pop the top frame of the shadow stack, and attribute the instructions that
+// were executed since the call to its node.
+void PopStackFrame(ThreadData *thread_data) {
+  const StackFrame &frame = thread_data->stack.back();
+  frame.node->num_instructions +=
+      thread_data->num_instructions - frame.instructions_at_entry;
+  thread_data->stack.pop_back();
+}
+
+// Returns the call site of the call instruction at the given address, adding it
+// if it does not exist yet. call_sites_lock must be held when calling this
+// function.
+CallSite *GetCallSite(ADDRINT ins_addr) {
+  auto &site = call_sites[ins_addr];
+
+  if (!site)
+    site.reset(new CallSite());
+
+  call_sites_size.update(call_sites.size());
+
+  return site.get();
+}
+
+// Record a call of a call site to the given target, and make the target the
+// cached target of the call site. 'is_new' is set if the target was seen for the
+// first time.
+void RecordCallTarget(CallSite *site, ADDRINT target_address, bool &is_new) {
+  call_sites_lock.lock();
+
+  CallTarget *target = site->get_target(target_address, is_new);
+  ++target->num_calls;
+  site->cache = target;
+
+  call_sites_lock.unlock();
+}
+
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
-// Run before every instruction.
-VOID InstructionBefore(ADDRINT instruction_pointer) {
-  // Check if main if reached yet.
-  if (instruction_pointer == main_address) {
+// Runs before every call instruction until main() is called, and before every
+// call instruction in calling context tree mode. Once main() is called, it is
+// only the slow path of indirect calls whose target is not cached.
+VOID InstructionCallBefore(THREADID thread_id, CallSite *site,
+                           ADDRINT instruction_address, ADDRINT target_address,
+                           ADDRINT next_instruction_pointer) {
+  instruction_call_before_calls.count();
+
+  // Check if this is the first call to main().
+  const bool calls_main =
+      (end_address == INVALID_ADDRESS) && (target_address == main_address);
+
+  if (calls_main) {
+    log_file << "\nMain called, next ip = " << std::hex << std::showbase
+             << next_instruction_pointer << std::dec << "\n";
+    end_address = next_instruction_pointer;
+  }
+
+  if (main_reached && !end_reached) {
+    if (KnobCct.Value()) {
+      // Descend into the calling context tree.
+      ThreadData *thread_data =
+          static_cast<ThreadData *>(PIN_GetThreadData(tls_key, thread_id));
+
+      CctNode *parent = thread_data->stack.empty()
+                            ? &thread_data->root
+                            : thread_data->stack.back().node;
+
+      bool is_new;
+      CctNode *node =
+          parent->get_child(instruction_address, target_address, is_new);
+      ++node->num_calls;
+
+      thread_data->stack.push_back(StackFrame{
+          node, next_instruction_pointer, thread_data->num_instructions});
+
+      if (is_new)
+        AddInstructionInfo(target_address);
+    } else {
+      bool is_new;
+      RecordCallTarget(site, target_address, is_new);
+
+      if (is_new)
+        AddInstructionInfo(target_address);
+    }
+  }
+
+  // Analysis starts in main(), i.e. after its call instruction.
+  if (calls_main) {
     log_file << "\nMain reached, setting global flag.\n";
     main_reached = true;
+    analysis_active = 1;
+
+    // The code instrumented so far only uses this routine, as the call to
+    // main() had to be detected. Discard it, so that it is instrumented again
+    // with the fast paths.
+    if (!KnobCct.Value())
+      PIN_RemoveInstrumentation();
   }
+}
+
+// Inlined fast path that runs before every indirect call instruction once
+// main() is called. Counts the call if its target is the cached target of the
+// call site, and returns whether the slow path has to be run otherwise.
+ADDRINT PIN_FAST_ANALYSIS_CALL IndirectCallCacheMiss(CallSite *site,
+                                                      ADDRINT target_address) {
+  CallTarget *cache = site->cache;
+  const ADDRINT hit = (cache->target_address == target_address);
+  cache->num_calls += hit & analysis_active;
+  return !hit;
+}
+
+// Inlined routine that runs before every direct call instruction once main() is
+// called, if direct calls are counted.
+VOID PIN_FAST_ANALYSIS_CALL DirectCallBefore(CallTarget *target) {
+  target->num_calls += analysis_active;
+}
+
+// Inlined check that runs before every return instruction, if no calling
+// context tree is built. Returns whether the instruction returns from main().
+ADDRINT PIN_FAST_ANALYSIS_CALL ReturnsFromMain(ADDRINT target_address) {
+  return target_address == end_address;
+}
+
+// Runs when main() returns, if no calling context tree is built.
+VOID MainReturned() {
+  main_returned_calls.count();
+
+  log_file
+      << "\nInstruction after call to main reached, setting global flag.\n";
+
+  end_reached = true;
+  analysis_active = 0;
+}
+
+// Runs before every return instruction in calling context tree mode.
+VOID InstructionRetBefore(THREADID thread_id, ADDRINT target_address) {
+  instruction_ret_before_calls.count();
 
   // Check if main is finished.
-  if (instruction_pointer == end_address) {
+  const bool returns_from_main = (target_address == end_address);
+
+  if (returns_from_main) {
     log_file
         << "\nInstruction after call to main reached, setting global flag.\n";
-    end_reached = true;
   }
-}
 
-// Runs before every call instruction.
-VOID InstructionCallBefore(ADDRINT instruction_address, ADDRINT target_address,
-                           ADDRINT next_instruction_pointer) {
-  // Check if this is the first call to main().
-  if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
-    log_file << "\nMain called, next ip = " << std::hex << std::showbase
-             << next_instruction_pointer << std::dec << "\n";
-    end_address = next_instruction_pointer;
+  if (!main_reached || end_reached) {
+    end_reached = end_reached || returns_from_main;
+    return;
   }
 
-  if (!main_reached || end_reached)
-    return;
+  ThreadData *thread_data =
+      static_cast<ThreadData *>(PIN_GetThreadData(tls_key, thread_id));
+  auto &stack = thread_data->stack;
 
-  // Find the call instruction info.
-  PIN_MutexLock(&call_instruction_infos_lock);
+  // Find the frame this instruction returns to. Frames above it are popped as
+  // well, as their callees did not return normally (e.g. because of longjmp()
+  // or tail calls). If there is no such frame, the corresponding call happened
+  // before analysis started, and the shadow stack is left untouched.
+  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+    if (it->return_address == target_address) {
+      const std::size_t depth = stack.rend() - it - 1;
 
-  auto it = call_instruction_infos.find(instruction_address);
-  if (it != call_instruction_infos.end()) {
-    it->second.insert(target_address);
-  } else {
-    assert(false &&
-           "Call instruction info not added to call_instruction_infos!");
+      while (stack.size() > depth)
+        PopStackFrame(thread_data);
+
+      break;
+    }
+  }
+
+  // Unwind the entire stack when main() returns.
+  if (returns_from_main) {
+    while (!stack.empty())
+      PopStackFrame(thread_data);
+
+    end_reached = true;
   }
+}
+
+// Runs before every basic block in calling context tree mode.
+VOID PIN_FAST_ANALYSIS_CALL BasicBlockBefore(THREADID thread_id,
+                                             UINT32 num_instructions) {
+  basic_block_before_calls.count();
 
-  PIN_MutexUnlock(&call_instruction_infos_lock);
+  ThreadData *thread_data =
+      static_cast<ThreadData *>(PIN_GetThreadData(tls_key, thread_id));
+  thread_data->num_instructions += num_instructions;
 }
 
 // Run at the start of __libc_start_main().
@@ -159,47 +522,118 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
 
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
-  // Call InstructionBefore() before every instruction.
-  // Pass RIP as argument.
-  INS_InsertCall(instruction, IPOINT_BEFORE,
-                 reinterpret_cast<AFUNPTR>(InstructionBefore), IARG_INST_PTR,
-                 IARG_END);
-
-  ADDRINT ins_addr = INS_Address(instruction);
-  IMG img = IMG_FindByAddress(ins_addr);
-  RTN rtn = RTN_FindByAddress(ins_addr);
-
-  std::string image_name = (IMG_Valid(img) ? IMG_Name(img) : "???");
-  ADDRINT image_offset = (IMG_Valid(img) ? ins_addr - IMG_LowAddress(img) : -1);
-  std::string function_name = (RTN_Valid(rtn) ? RTN_Name(rtn) : "???");
-
-  // Add an entry for this instruction to the static_instruction_infos map.
-  PIN_MutexLock(&static_instruction_infos_lock);
-  static_instruction_infos.insert(std::make_pair(
-      ins_addr, InstructionInfo(image_name, image_offset, function_name)));
-  PIN_MutexUnlock(&static_instruction_infos_lock);
+  ScopedStatTimer timer(on_instruction_timer);
 
   // Check for call instructions.
   if (INS_IsCall(instruction)) {
-    // Add an entry for this instruction to the call_instruction_infos map.
-    PIN_MutexLock(&call_instruction_infos_lock);
-    call_instruction_infos.insert(
-        std::make_pair(ins_addr, std::set<ADDRINT>()));
-    PIN_MutexUnlock(&call_instruction_infos_lock);
-
-    // Call InstructionCallBefore() before every call instruction.
-    // Pass the instruction address (i.e. the address of the call), the target
-    // address (i.e. the address of the function being called) and the address
-    // of the next instruction (i.e. the one following the call).
-    INS_InsertCall(instruction, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(InstructionCallBefore),
-                   IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
-                   INS_NextAddress(instruction), IARG_END);
+    ADDRINT ins_addr = INS_Address(instruction);
+
+    // Only call instructions and their targets need instruction info.
+    AddInstructionInfo(ins_addr);
+
+    // Add an entry for this instruction to the call_sites map.
+    call_sites_lock.lock();
+    CallSite *site = GetCallSite(ins_addr);
+    call_sites_lock.unlock();
+
+    // The fast paths are used once main() is called, and only if no calling
+    // context tree is built.
+    const bool use_fast_path =
+        !KnobCct.Value() && (end_address != INVALID_ADDRESS);
+
+    if (!use_fast_path) {
+      // Call InstructionCallBefore() before every call instruction.
+      // Pass the thread ID, the call site, the instruction address (i.e. the
+      // address of the call), the target address (i.e. the address of the
+      // function being called) and the address of the next instruction (i.e.
+      // the one following the call).
+      INS_InsertCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(InstructionCallBefore),
+                     IARG_THREAD_ID, IARG_PTR, site, IARG_INST_PTR,
+                     IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
+                     INS_NextAddress(instruction), IARG_END);
+    } else if (INS_IsDirectControlFlow(instruction)) {
+      // The target of direct calls is known now.
+      const ADDRINT target_address =
+          INS_DirectControlFlowTargetAddress(instruction);
+
+      if (KnobCountDirectCalls.Value()) {
+        call_sites_lock.lock();
+        bool is_new;
+        CallTarget *target = site->get_target(target_address, is_new);
+        call_sites_lock.unlock();
+
+        AddInstructionInfo(target_address);
+
+        // Call DirectCallBefore() before every direct call instruction.
+        // Pass the call target entry, whose counter is incremented.
+        INS_InsertCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(DirectCallBefore),
+                       IARG_FAST_ANALYSIS_CALL, IARG_PTR, target, IARG_END);
+      } else if (main_reached && !end_reached) {
+        // Record the target once, without counting its calls.
+        call_sites_lock.lock();
+        bool is_new;
+        site->get_target(target_address, is_new);
+        site->counts_known = false;
+        call_sites_lock.unlock();
+
+        AddInstructionInfo(target_address);
+      }
+    } else {
+      // Call IndirectCallCacheMiss() before every indirect call instruction,
+      // and InstructionCallBefore() if the target is not cached.
+      // Pass the call site and the target address.
+      INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(IndirectCallCacheMiss),
+                       IARG_FAST_ANALYSIS_CALL, IARG_PTR, site,
+                       IARG_BRANCH_TARGET_ADDR, IARG_END);
+      INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                         reinterpret_cast<AFUNPTR>(InstructionCallBefore),
+                         IARG_THREAD_ID, IARG_PTR, site, IARG_INST_PTR,
+                         IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
+                         INS_NextAddress(instruction), IARG_END);
+    }
+  }
+
+  if (INS_IsRet(instruction)) {
+    if (KnobCct.Value()) {
+      // Call InstructionRetBefore() before every return instruction, to detect
+      // the end of main() and to maintain the shadow stacks.
+      // Pass the thread ID and the return address.
+      INS_InsertCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(InstructionRetBefore),
+                     IARG_THREAD_ID, IARG_BRANCH_TARGET_ADDR, IARG_END);
+    } else {
+      // Call MainReturned() if a return instruction returns from main().
+      // Pass the return address.
+      INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(ReturnsFromMain),
+                       IARG_FAST_ANALYSIS_CALL, IARG_BRANCH_TARGET_ADDR,
+                       IARG_END);
+      INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                         reinterpret_cast<AFUNPTR>(MainReturned), IARG_END);
+    }
+  }
+}
+
+// Instrumentation routine run for every trace in calling context tree mode.
+VOID OnTrace(TRACE trace, VOID *v) {
+  ScopedStatTimer timer(on_trace_timer);
+
+  // Count the number of executed instructions per thread.
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    BBL_InsertCall(bbl, IPOINT_BEFORE,
+                   reinterpret_cast<AFUNPTR>(BasicBlockBefore),
+                   IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_UINT32,
+                   BBL_NumIns(bbl), IARG_END);
   }
 }
 
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -223,21 +657,42 @@ VOID OnImageLoad(IMG image, VOID *v) {
 // Machine-parsable output routines
 // =============================================================================
 
-// Dump the information for call instructions in CSV format.
-void dump_csv_call_instructions(
-    std::ofstream &ofs, const std::map<ADDRINT, std::set<ADDRINT>> &map,
-    const std::map<ADDRINT, InstructionInfo> &instruction_info_map) {
+// Returns a reference to debug information of an instruction, which is
+// resolved when the output is imported.
+std::string debug_reference(const std::string &image_name, ADDRINT offset,
+                            const char *field) {
+  std::ostringstream oss;
+  oss << "$DEBUG(" << image_name << ',' << offset << ',' << field << ')';
+  return oss.str();
+}
 
-  // Print header.
-  ofs << "image_name,image_offset,DEBUG_filename,DEBUG_line,DEBUG_column,"
-         "target_image_name,target_image_offset,target_function_name,DEBUG_"
-         "target_filename,DEBUG_target_line,DEBUG_target_column\n";
+// The columns of the call targets table.
+static const std::vector<TableColumn> CALL_TARGETS_COLUMNS = {
+    {"image_name", ColumnType::STRING, true},
+    {"image_offset", ColumnType::INT64},
+    {"DEBUG_filename", ColumnType::STRING},
+    {"DEBUG_line", ColumnType::STRING},
+    {"DEBUG_column", ColumnType::STRING},
+    {"target_image_name", ColumnType::STRING, true},
+    {"target_image_offset", ColumnType::INT64},
+    {"target_function_name", ColumnType::STRING},
+    {"DEBUG_target_filename", ColumnType::STRING},
+    {"DEBUG_target_line", ColumnType::STRING},
+    {"DEBUG_target_column", ColumnType::STRING},
+    {"num_calls", ColumnType::INT64},
+};
 
-  // Print data.
+// Dump the information for call instructions. 'map' maps the address of each
+// call instruction to its call targets and their number of calls, which is -1
+// if unknown.
+void dump_call_instructions(
+    TableWriter &table, const std::map<ADDRINT, std::map<ADDRINT, INT64>> &map,
+    const std::map<ADDRINT, InstructionInfo> &instruction_info_map) {
+  // Print data. The offset columns are signed, so unknown offsets are -1.
   for (const auto &p : map) {
     for (const auto &callee : p.second) {
       auto call_info_it = instruction_info_map.find(p.first);
-      auto callee_info_it = instruction_info_map.find(callee);
+      auto callee_info_it = instruction_info_map.find(callee.first);
 
       assert((call_info_it != instruction_info_map.end()) &&
              "Missing instruction info for call instruction!");
@@ -247,54 +702,197 @@ void dump_csv_call_instructions(
       const auto &call_info = call_info_it->second;
       const auto &callee_info = callee_info_it->second;
 
-      ofs << '"' << get_filename(call_info.image_name) << '"'; // image_name
-
-      // Print "-1" for unknown offsets.
-      if (call_info.image_offset != static_cast<ADDRINT>(-1))
-        ofs << ',' << call_info.image_offset; // image_offset
-      else
-        ofs << ',' << -1;
-
-      ofs << ',' << "$DEBUG(" << call_info.image_name << ","
-          << call_info.image_offset << ",filename)" // DEBUG_filename
-          << ',' << "$DEBUG(" << call_info.image_name << ","
-          << call_info.image_offset << ",line)" // DEBUG_line
-          << ',' << "$DEBUG(" << call_info.image_name << ","
-          << call_info.image_offset << ",column)"; // DEBUG_column
-
-      ofs << ',' << '"' << get_filename(callee_info.image_name)
-          << '"'; // target_image_name
-
-      if (callee_info.image_offset != static_cast<ADDRINT>(-1))
-        ofs << ',' << callee_info.image_offset; // target_image_offset
-      else
-        ofs << ',' << -1;
-
-      ofs << ',' << callee_info.function_name // target_function_name
-          << ',' << "$DEBUG(" << callee_info.image_name << ","
-          << callee_info.image_offset << ",filename)" // DEBUG_target_filename
-          << ',' << "$DEBUG(" << callee_info.image_name << ","
-          << callee_info.image_offset << ",line)" // DEBUG_target_line
-          << ',' << "$DEBUG(" << callee_info.image_name << ","
-          << callee_info.image_offset << ",column)"; // DEBUG_target_column
-
-      ofs << '\n';
+      const std::string &call_image_name = get_name(call_info.image_name);
+      const std::string &callee_image_name = get_name(callee_info.image_name);
+
+      const ADDRINT call_offset = call_info.image_offset;
+      const ADDRINT callee_offset = callee_info.image_offset;
+
+      table << get_filename(call_image_name) // image_name
+            << call_offset                   // image_offset
+            << debug_reference(call_image_name, call_offset,
+                               "filename") // DEBUG_filename
+            << debug_reference(call_image_name, call_offset,
+                               "line") // DEBUG_line
+            << debug_reference(call_image_name, call_offset,
+                               "column"); // DEBUG_column
+
+      table << get_filename(callee_image_name)     // target_image_name
+            << callee_offset                       // target_image_offset
+            << get_name(callee_info.function_name) // target_function_name
+            << debug_reference(callee_image_name, callee_offset,
+                               "filename") // DEBUG_target_filename
+            << debug_reference(callee_image_name, callee_offset,
+                               "line") // DEBUG_target_line
+            << debug_reference(callee_image_name, callee_offset,
+                               "column"); // DEBUG_target_column
+
+      table << callee.second; // num_calls
     }
   }
 }
 
+// The columns of the calling context tree table.
+static const std::vector<TableColumn> CCT_COLUMNS = {
+    {"id", ColumnType::INT64},
+    {"parent_id", ColumnType::INT64},
+    {"thread_id", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING, true},
+    {"image_offset", ColumnType::INT64},
+    {"target_image_name", ColumnType::STRING, true},
+    {"target_image_offset", ColumnType::INT64},
+    {"target_function_name", ColumnType::STRING},
+    {"num_calls", ColumnType::UINT64},
+    {"num_instructions", ColumnType::UINT64},
+};
+
+// Dump a calling context tree node and its descendants. Nodes are numbered in
+// depth-first order, using 'next_id'.
+void dump_cct_node(
+    TableWriter &table, const CctNode &node, long parent_id,
+    THREADID thread_id, long &next_id,
+    const std::map<ADDRINT, InstructionInfo> &instruction_info_map) {
+  const long id = next_id++;
+
+  const auto call_info_it = instruction_info_map.find(node.call_address);
+  const auto callee_info_it = instruction_info_map.find(node.target_address);
+
+  assert((call_info_it != instruction_info_map.end()) &&
+         "Missing instruction info for call instruction!");
+  assert((callee_info_it != instruction_info_map.end()) &&
+         "Missing instruction info for callee!");
+
+  const auto &call_info = call_info_it->second;
+  const auto &callee_info = callee_info_it->second;
+
+  table << id << parent_id << thread_id;
+
+  // The offset columns are signed, so unknown offsets are -1.
+  table << get_filename(get_name(call_info.image_name))
+        << call_info.image_offset;
+
+  table << get_filename(get_name(callee_info.image_name))
+        << callee_info.image_offset << get_name(callee_info.function_name);
+
+  table << node.num_calls << node.num_instructions;
+
+  for (const auto &child : node.children) {
+    dump_cct_node(table, *child, id, thread_id, next_id, instruction_info_map);
+  }
+}
+
+// Dump the calling context trees of all threads.
+void dump_cct(TableWriter &table,
+              const std::vector<std::unique_ptr<ThreadData>> &threads,
+              const std::map<ADDRINT, InstructionInfo> &instruction_info_map) {
+  // Print data. The children of the root of every thread have parent ID -1.
+  long next_id = 0;
+
+  for (const auto &thread_data : threads) {
+    for (const auto &child : thread_data->root.children) {
+      dump_cct_node(table, *child, -1, thread_data->thread_id, next_id,
+                    instruction_info_map);
+    }
+  }
+}
+
+// Add the (call instruction, call target) pairs of a calling context tree node
+// and its descendants to 'call_targets', with their number of calls.
+void collect_call_targets(
+    const CctNode &node,
+    std::map<ADDRINT, std::map<ADDRINT, INT64>> &call_targets) {
+  call_targets[node.call_address][node.target_address] += node.num_calls;
+
+  for (const auto &child : node.children)
+    collect_call_targets(*child, call_targets);
+}
+
+// Add the call targets of all call sites to 'call_targets', with their number
+// of calls.
+void collect_call_targets(
+    const std::map<ADDRINT, std::unique_ptr<CallSite>> &sites,
+    std::map<ADDRINT, std::map<ADDRINT, INT64>> &call_targets) {
+  for (const auto &p : sites) {
+    const CallSite &site = *p.second;
+
+    auto add_target = [&](const CallTarget &target) {
+      // Counted targets without calls were only seen at instrumentation time.
+      if (site.counts_known && target.num_calls == 0)
+        return;
+
+      call_targets[p.first][target.target_address] =
+          site.counts_known ? static_cast<INT64>(target.num_calls) : -1;
+    };
+
+    for (std::size_t i = 0; i < site.num_targets; ++i)
+      add_target(site.targets[i]);
+
+    for (const auto &q : site.megamorphic_targets)
+      add_target(q.second);
+  }
+}
+
 // =============================================================================
 // Other routines
 // =============================================================================
 
+// Run when a thread starts.
+VOID OnThreadStart(THREADID thread_id, CONTEXT *ctx, INT32 flags, VOID *v) {
+  ThreadData *thread_data = new ThreadData(thread_id);
+
+  if (!PIN_SetThreadData(tls_key, thread_data, thread_id)) {
+    std::cerr << "PIN_SetThreadData failed!\n" << std::endl;
+    PIN_ExitProcess(1);
+  }
+
+  // Keep the thread data after the thread exits, for the output.
+  thread_datas_lock.lock();
+  thread_datas.emplace_back(thread_data);
+  thread_datas_lock.unlock();
+}
+
+// Run when a thread exits.
+VOID OnThreadFini(THREADID thread_id, const CONTEXT *ctx, INT32 code,
+                  VOID *v) {
+  ThreadData *thread_data =
+      static_cast<ThreadData *>(PIN_GetThreadData(tls_key, thread_id));
+
+  // Calls that are still in progress end here.
+  while (!thread_data->stack.empty())
+    PopStackFrame(thread_data);
+}
+
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
   // -----------------------
   // Machine parsable output
   // -----------------------
 
-  dump_csv_call_instructions(csv_call_targets, call_instruction_infos,
-                             static_instruction_infos);
+  // Maps every call instruction to its call targets and their number of calls.
+  std::map<ADDRINT, std::map<ADDRINT, INT64>> call_targets;
+
+  if (KnobCct.Value()) {
+    // Calls that are still in progress end here.
+    for (const auto &thread_data : thread_datas) {
+      while (!thread_data->stack.empty())
+        PopStackFrame(thread_data.get());
+    }
+
+    dump_cct(*cct_table, thread_datas, static_instruction_infos);
+
+    // The call targets are the edges in the calling context trees.
+    for (const auto &thread_data : thread_datas) {
+      for (const auto &child : thread_data->root.children)
+        collect_call_targets(*child, call_targets);
+    }
+  } else {
+    collect_call_targets(call_sites, call_targets);
+  }
+
+  dump_call_instructions(*call_targets_table, call_targets,
+                         static_instruction_infos);
 
   // -------
   // Cleanup
@@ -304,9 +902,18 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.flush();
   log_file.close();
 
-  // Flush and close the CSV file.
-  csv_call_targets.flush();
-  csv_call_targets.close();
+  // Flush and close the CSV files.
+  call_targets_table->close();
+
+  if (KnobCct.Value())
+    cct_table->close();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -316,6 +923,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -342,10 +952,24 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
-  if (!KnobStartFromMain.Value())
+  if (!KnobStartFromMain.Value()) {
     main_reached = true;
+    analysis_active = 1;
+  }
 
   // Open output file.
   log_file.open(KnobOutputFile.Value().c_str());
@@ -358,27 +982,52 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_call_targets.open((csv_prefix + ".call-targets.csv").c_str());
+  call_targets_table = open_table(csv_prefix + ".call-targets", table_format,
+                                  CALL_TARGETS_COLUMNS);
+
+  if (KnobCct.Value())
+    cct_table = open_table(csv_prefix + ".cct", table_format, CCT_COLUMNS);
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
 
+  if (KnobCct.Value()) {
+    // Initialise thread-local storage for the shadow stacks.
+    tls_key = PIN_CreateThreadDataKey(nullptr);
+    if (tls_key == INVALID_TLS_KEY) {
+      std::cerr << "Maximum amount of allocated TLS keys reached!"
+                << std::endl;
+      PIN_ExitProcess(1);
+      return EXIT_FAILURE;
+    }
+
+    // Register trace callback to count executed instructions.
+    TRACE_AddInstrumentFunction(OnTrace, nullptr);
+
+    // Register thread start and end callbacks.
+    PIN_AddThreadStartFunction(OnThreadStart, nullptr);
+    PIN_AddThreadFiniFunction(OnThreadFini, nullptr);
+  }
+
   // Register image load callback.
   IMG_AddInstrumentFunction(OnImageLoad, nullptr);
 
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&call_instruction_infos_lock);
-  PIN_MutexInit(&static_instruction_infos_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
@@ -0,0 +1,48 @@
+// RUN: gcc -g %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -count_direct_calls 1 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: patch-debug-info.py <%t.call-targets.csv >%t.call-targets.patched.csv
+// RUN: mv %t.call-targets.patched.csv %t.call-targets.csv
+// RUN: pretty-print-csvs.py --prefix=%t > %t.out
+
+// RUN: FileCheck %s <%t.out -DFILE=%s
+
+void f1(void) {}
+void f2(void) {}
+void f3(void) {}
+void f4(void) {}
+void f5(void) {}
+void f6(void) {}
+
+void leaf(void) {}
+
+// The call site in call() has more targets than are stored inline, so the
+// last two are stored as megamorphic targets.
+void call(void (*f)(void)) {
+  // CHECK: Call:       [[FILE]]:[[#@LINE+7]]:[[#]]
+  // CHECK: Callee 1/6: f1 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 3)
+  // CHECK: Callee 2/6: f2 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 1)
+  // CHECK: Callee 3/6: f3 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 1)
+  // CHECK: Callee 4/6: f4 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 1)
+  // CHECK: Callee 5/6: f5 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 1)
+  // CHECK: Callee 6/6: f6 ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 2)
+  f();
+}
+
+int main() {
+  // CHECK: Call:       [[FILE]]:[[#@LINE+3]]:[[#]]
+  // CHECK: Callee 1/1: leaf ([[FILE]]:[[#]]:[[#]]) ({{.*}}) (calls: 10)
+  for (int i = 0; i < 10; ++i)
+    leaf();
+
+  call(f1);
+  call(f1);
+  call(f2);
+  call(f3);
+  call(f4);
+  call(f5);
+  call(f6);
+  call(f6);
+  call(f1);
+}
@@ -0,0 +1,36 @@
+// RUN: gcc -g %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -cct 1 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: patch-debug-info.py <%t.call-targets.csv >%t.call-targets.patched.csv
+// RUN: mv %t.call-targets.patched.csv %t.call-targets.csv
+// RUN: pretty-print-csvs.py --prefix=%t --cct > %t.out
+
+// RUN: FileCheck %s <%t.out -DFILE=%s
+
+void leaf(void) {}
+
+void mid(int n) {
+  // CHECK: Call:       [[FILE]]:[[#@LINE+3]]:[[#]]
+  // CHECK: Callee 1/1: leaf ([[FILE]]:[[#]]:[[#]])
+  for (int i = 0; i < n; ++i)
+    leaf();
+}
+
+int main() {
+  // Every call site in main() gets its own node in the calling context tree,
+  // even if the callee is the same.
+  mid(2);
+  mid(3);
+  leaf();
+
+  return 0;
+}
+
+// CHECK:      CALLING CONTEXT TREE
+// CHECK:      Thread 0:
+// CHECK-NEXT:   mid ({{.*}}, calls: 1, instructions: [[#]])
+// CHECK-NEXT:     leaf ({{.*}}, calls: 2, instructions: [[#]])
+// CHECK-NEXT:   mid ({{.*}}, calls: 1, instructions: [[#]])
+// CHECK-NEXT:     leaf ({{.*}}, calls: 3, instructions: [[#]])
+// CHECK-NEXT:   leaf ({{.*}}, calls: 1, instructions: [[#]])
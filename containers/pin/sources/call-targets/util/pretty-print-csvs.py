@@ -9,6 +9,7 @@ parser = argparse.ArgumentParser(description = 'Helper script to print the conte
 
 parser.add_argument('--prefix', help='Prefix path of the CSV file', required=True)
 parser.add_argument('--log_file', help='Path to the log file', required=False, default='')
+parser.add_argument('--cct', help='Also print the calling context tree', action='store_true')
 
 args = parser.parse_args()
 
@@ -24,7 +25,7 @@ if log_file != '':
 
 def print_call_targets(csv_file):
     CallInstruction = namedtuple("CallInstruction", ["image_name", "image_offset", "filename", "line", "column"])
-    Callee = namedtuple("Callee", ["image_name", "image_offset", "function_name", "filename", "line", "column"])
+    Callee = namedtuple("Callee", ["image_name", "image_offset", "function_name", "filename", "line", "column", "num_calls"])
 
     reader = csv.DictReader(csv_file)
     data = defaultdict(list)
@@ -41,7 +42,8 @@ def print_call_targets(csv_file):
                         function_name = row['target_function_name'],
                         filename = row['DEBUG_target_filename'],
                         line = row['DEBUG_target_line'],
-                        column = row['DEBUG_target_column'])
+                        column = row['DEBUG_target_column'],
+                        num_calls = row['num_calls'])
 
         data[call_inst].append(callee)
 
@@ -49,7 +51,35 @@ def print_call_targets(csv_file):
         print("{0:20}{1}".format("Call:", f"{call_inst.filename}:{call_inst.line}:{call_inst.column} ({call_inst.image_name}+{hex(int(call_inst.image_offset))})"))
 
         for i, callee in enumerate(callees):
-            print("{0:20}{1}".format(f"Callee {i+1}/{len(callees)}:", f"{callee.function_name} ({callee.filename}:{callee.line}:{callee.column}) ({callee.image_name}+{hex(int(callee.image_offset))})"))
+            # The number of calls is unknown (-1) for uncounted direct calls.
+            num_calls = f" (calls: {callee.num_calls})" if callee.num_calls != '-1' else ''
+            print("{0:20}{1}".format(f"Callee {i+1}/{len(callees)}:", f"{callee.function_name} ({callee.filename}:{callee.line}:{callee.column}) ({callee.image_name}+{hex(int(callee.image_offset))}){num_calls}"))
+
+        print()
+
+def print_cct(csv_file):
+    reader = csv.DictReader(csv_file)
+    children = defaultdict(list)
+    threads = []
+
+    for row in reader:
+        children[row['parent_id']].append(row)
+
+        if row['parent_id'] == '-1' and row['thread_id'] not in threads:
+            threads.append(row['thread_id'])
+
+    def print_node(node, depth):
+        print("{0}{1} ({2}+{3}, calls: {4}, instructions: {5})".format('  ' * depth, node['target_function_name'], node['target_image_name'], hex(int(node['target_image_offset'])), node['num_calls'], node['num_instructions']))
+
+        for child in children[node['id']]:
+            print_node(child, depth + 1)
+
+    for thread_id in threads:
+        print(f"Thread {thread_id}:")
+
+        for node in children['-1']:
+            if node['thread_id'] == thread_id:
+                print_node(node, 1)
 
         print()
 
@@ -61,3 +91,13 @@ print()
 
 with open(prefix + '.call-targets.csv') as f:
     print_call_targets(f)
+
+# Print calling context tree
+if args.cct:
+    print()
+    print('CALLING CONTEXT TREE')
+    print('====================')
+    print()
+
+    with open(prefix + '.cct.csv') as f:
+        print_cct(f)
@@ -0,0 +1,64 @@
+# Adds a 'bench' target that replays the benchmark workloads under a Pin tool
+# and writes the results to ${BENCH_OUTPUT_DIR}/<tool directory>.json. See
+# containers/pin/bench/bench.py.
+#
+#   add_bench_target(<tool target> [TOOL_ARGS <arguments>...])
+#
+# In TOOL_ARGS, '{output}' is replaced by the directory for the tool's output.
+# If BENCH_BASELINE is set to a JSON report or a directory of reports, the
+# results are compared against it, and the target fails on a regression.
+
+set(BENCH_OUTPUT_DIR "${CMAKE_BINARY_DIR}/bench" CACHE PATH "Directory for the benchmark results.")
+set(BENCH_PINBALL_DIR "" CACHE PATH "Directory in which the benchmark pinballs are cached.")
+set(BENCH_BASELINE "" CACHE PATH "Benchmark results to compare against.")
+set(BENCH_REPEAT 3 CACHE STRING "Number of runs per benchmark workload.")
+
+find_program(PYTHON3 NAMES python3)
+
+set(BENCH_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/../../bench/bench.py")
+
+function(add_bench_target TOOL)
+    cmake_parse_arguments(BENCH "" "" "TOOL_ARGS" ${ARGN})
+
+    if(NOT PYTHON3)
+        message(WARNING "'bench' target disabled: python3 was not found.")
+        return()
+    endif()
+
+    # The benchmark workloads are x64 executables.
+    if(NOT Pin_TARGET_ARCH STREQUAL "x64")
+        message(STATUS "'bench' target disabled: benchmarks require Pin_TARGET_ARCH x64.")
+        return()
+    endif()
+
+    get_filename_component(BENCH_NAME "${CMAKE_CURRENT_SOURCE_DIR}" NAME)
+    string(REPLACE ";" " " BENCH_TOOL_ARGS "${BENCH_TOOL_ARGS}")
+
+    set(BENCH_COMMAND
+        ${PYTHON3} ${BENCH_SCRIPT} run
+        --sde ${SDE_ROOT_DIR}/sde64
+        --tool $<TARGET_FILE:${TOOL}>
+        --name ${BENCH_NAME}
+        --tool-args "${BENCH_TOOL_ARGS}"
+        --output ${BENCH_OUTPUT_DIR}/${BENCH_NAME}.json
+        --work-dir ${CMAKE_BINARY_DIR}/bench-work
+        --repeat ${BENCH_REPEAT}
+    )
+
+    if(BENCH_PINBALL_DIR)
+        list(APPEND BENCH_COMMAND --pinball-dir ${BENCH_PINBALL_DIR})
+    endif()
+
+    if(BENCH_BASELINE)
+        list(APPEND BENCH_COMMAND --baseline ${BENCH_BASELINE})
+    endif()
+
+    add_custom_target(bench
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${BENCH_OUTPUT_DIR}
+        COMMAND ${BENCH_COMMAND}
+        USES_TERMINAL
+        VERBATIM
+    )
+
+    add_dependencies(bench ${TOOL})
+endfunction()
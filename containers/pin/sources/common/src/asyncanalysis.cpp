@@ -0,0 +1,306 @@
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "asyncanalysis.h"
+#include "toolstats.h"
+
+namespace {
+
+// The maximum number of full buffers queued for an analysis thread.
+constexpr std::size_t MAX_QUEUED_BUFFERS = 64;
+
+// A buffer of records.
+struct RecordBuffer {
+  explicit RecordBuffer(std::size_t size) : data(size), used(0) {}
+
+  std::vector<unsigned char> data;
+
+  // The number of bytes of data that contain records.
+  std::size_t used;
+};
+
+// The queue of full buffers of an analysis thread.
+struct AnalysisQueue {
+  AnalysisQueue() {
+    PIN_MutexInit(&lock);
+    PIN_SemaphoreInit(&buffers_queued);
+  }
+
+  ~AnalysisQueue() {
+    PIN_SemaphoreFini(&buffers_queued);
+    PIN_MutexFini(&lock);
+  }
+
+  // Mutex for buffers and free_buffers.
+  PIN_MUTEX lock;
+
+  // Set when a buffer is queued, cleared by the analysis thread when it finds
+  // the queue empty.
+  PIN_SEMAPHORE buffers_queued;
+
+  // The full buffers, in the order in which they were handed off.
+  std::deque<std::unique_ptr<RecordBuffer>> buffers;
+
+  // Analysed buffers that can be reused.
+  std::vector<std::unique_ptr<RecordBuffer>> free_buffers;
+
+  // Unique ID of the analysis thread.
+  PIN_THREAD_UID thread_uid;
+};
+
+// The buffers of an application thread, one per analysis thread.
+struct ThreadData {
+  std::vector<std::unique_ptr<RecordBuffer>> buffers;
+
+  // The effective addresses of the memory operands that are written by the
+  // current instruction.
+  ADDRINT write_addresses[MAX_ASYNC_WRITE_ADDRESSES] = {};
+};
+
+// The size of new buffers.
+std::size_t initial_buffer_size = 0;
+
+// Analyses the records of a buffer.
+AnalyseRecordsFunction analyse_records = nullptr;
+
+// The queues of the analysis threads, indexed by shard.
+std::vector<std::unique_ptr<AnalysisQueue>> analysis_queues;
+
+// Set when the analysis threads have to stop.
+std::atomic<bool> analysis_threads_stop(false);
+
+// Key for accessing the ThreadData of a thread.
+TLS_KEY tls_key = INVALID_TLS_KEY;
+
+// The buffers of the application threads that are running.
+std::vector<std::unique_ptr<ThreadData>> thread_datas;
+
+// Mutex for accessing thread_datas.
+StatMutex thread_datas_lock("thread_datas_lock");
+
+// Statistics for -tool_stats.
+CallCounter hand_off_buffer_calls("HandOffBuffer");
+
+// Returns the ThreadData of an application thread.
+ThreadData *GetThreadData(THREADID thread_id) {
+  return static_cast<ThreadData *>(PIN_GetThreadData(tls_key, thread_id));
+}
+
+// Analyses the records in a buffer. Must only be called by the analysis thread
+// of the buffer's shard, or after it stopped.
+void AnalyseBuffer(const RecordBuffer &buffer) {
+  analyse_records(buffer.data.data(), buffer.used);
+}
+
+// Queue a full buffer for the analysis thread of a shard, and return an empty
+// buffer to replace it.
+std::unique_ptr<RecordBuffer>
+HandOffBuffer(unsigned int shard, std::unique_ptr<RecordBuffer> full) {
+  hand_off_buffer_calls.count();
+
+  AnalysisQueue &queue = *analysis_queues[shard];
+
+  // Wait for the analysis thread if it is too far behind.
+  for (;;) {
+    PIN_MutexLock(&queue.lock);
+
+    if (queue.buffers.size() < MAX_QUEUED_BUFFERS ||
+        analysis_threads_stop.load())
+      break;
+
+    PIN_MutexUnlock(&queue.lock);
+    PIN_Sleep(1);
+  }
+
+  queue.buffers.push_back(std::move(full));
+  PIN_SemaphoreSet(&queue.buffers_queued);
+
+  std::unique_ptr<RecordBuffer> empty;
+
+  if (!queue.free_buffers.empty()) {
+    empty = std::move(queue.free_buffers.back());
+    queue.free_buffers.pop_back();
+  }
+
+  PIN_MutexUnlock(&queue.lock);
+
+  if (!empty)
+    empty.reset(new RecordBuffer(initial_buffer_size));
+
+  empty->used = 0;
+  return empty;
+}
+
+// Internal thread that analyses the buffers of a shard.
+VOID AnalysisThread(VOID *arg) {
+  AnalysisQueue &queue = *static_cast<AnalysisQueue *>(arg);
+
+  for (;;) {
+    std::unique_ptr<RecordBuffer> buffer;
+
+    PIN_MutexLock(&queue.lock);
+
+    if (!queue.buffers.empty()) {
+      buffer = std::move(queue.buffers.front());
+      queue.buffers.pop_front();
+    } else {
+      // Cleared under the lock, so a buffer that is queued after this is not
+      // missed.
+      PIN_SemaphoreClear(&queue.buffers_queued);
+    }
+
+    PIN_MutexUnlock(&queue.lock);
+
+    if (buffer) {
+      AnalyseBuffer(*buffer);
+
+      PIN_MutexLock(&queue.lock);
+      queue.free_buffers.push_back(std::move(buffer));
+      PIN_MutexUnlock(&queue.lock);
+      continue;
+    }
+
+    if (analysis_threads_stop.load() || PIN_IsProcessExiting())
+      break;
+
+    PIN_SemaphoreTimedWait(&queue.buffers_queued, 100);
+  }
+}
+
+// Callback that is called when a thread starts.
+VOID OnThreadStart(THREADID thread_id, CONTEXT *ctx, INT32 flags, VOID *v) {
+  ThreadData *thread_data = new ThreadData();
+
+  for (std::size_t i = 0; i < analysis_queues.size(); ++i)
+    thread_data->buffers.emplace_back(new RecordBuffer(initial_buffer_size));
+
+  if (!PIN_SetThreadData(tls_key, thread_data, thread_id)) {
+    std::cerr << "PIN_SetThreadData failed!\n" << std::endl;
+    PIN_ExitProcess(1);
+  }
+
+  thread_datas_lock.lock();
+  thread_datas.emplace_back(thread_data);
+  thread_datas_lock.unlock();
+}
+
+// Callback that is called when a thread exits.
+VOID OnThreadFini(THREADID thread_id, const CONTEXT *ctx, INT32 code,
+                  VOID *v) {
+  ThreadData *thread_data = GetThreadData(thread_id);
+
+  PIN_SetThreadData(tls_key, nullptr, thread_id);
+
+  // Hand off the remaining records, and free the thread data.
+  for (unsigned int shard = 0; shard < thread_data->buffers.size(); ++shard)
+    HandOffBuffer(shard, std::move(thread_data->buffers[shard]));
+
+  thread_datas_lock.lock();
+
+  for (auto it = thread_datas.begin(); it != thread_datas.end(); ++it) {
+    if (it->get() == thread_data) {
+      thread_datas.erase(it);
+      break;
+    }
+  }
+
+  thread_datas_lock.unlock();
+}
+
+// Stops the analysis threads, unless they were stopped already.
+void StopAnalysisThreads() {
+  if (analysis_threads_stop.exchange(true))
+    return;
+
+  for (const auto &queue : analysis_queues) {
+    PIN_SemaphoreSet(&queue->buffers_queued);
+    PIN_WaitForThreadTermination(queue->thread_uid, PIN_INFINITE_TIMEOUT,
+                                 nullptr);
+  }
+}
+
+// Run before the application exits, while the internal threads still exist.
+// The remaining buffers are analysed in finish_async_analysis().
+VOID OnPrepareForFinish(VOID *v) { StopAnalysisThreads(); }
+
+} // namespace
+
+bool init_async_analysis(unsigned int num_threads, std::size_t buffer_size,
+                         AnalyseRecordsFunction analyse) {
+  if (num_threads == 0)
+    return false;
+
+  tls_key = PIN_CreateThreadDataKey(nullptr);
+  if (tls_key == INVALID_TLS_KEY)
+    return false;
+
+  initial_buffer_size = buffer_size;
+  analyse_records = analyse;
+
+  for (unsigned int i = 0; i < num_threads; ++i)
+    analysis_queues.emplace_back(new AnalysisQueue());
+
+  PIN_AddThreadStartFunction(OnThreadStart, nullptr);
+  PIN_AddThreadFiniFunction(OnThreadFini, nullptr);
+  PIN_AddPrepareForFiniFunction(OnPrepareForFinish, nullptr);
+
+  for (const auto &queue : analysis_queues) {
+    if (PIN_SpawnInternalThread(AnalysisThread, queue.get(), 0,
+                                &queue->thread_uid) == INVALID_THREADID)
+      return false;
+  }
+
+  return true;
+}
+
+unsigned int async_analysis_threads() { return analysis_queues.size(); }
+
+void finish_async_analysis() {
+  StopAnalysisThreads();
+
+  for (const auto &queue : analysis_queues) {
+    PIN_MutexLock(&queue->lock);
+
+    for (const auto &buffer : queue->buffers)
+      AnalyseBuffer(*buffer);
+
+    queue->buffers.clear();
+    PIN_MutexUnlock(&queue->lock);
+  }
+
+  thread_datas_lock.lock();
+
+  for (const auto &thread_data : thread_datas) {
+    for (auto &buffer : thread_data->buffers) {
+      AnalyseBuffer(*buffer);
+      buffer->used = 0;
+    }
+  }
+
+  thread_datas_lock.unlock();
+}
+
+unsigned char *reserve_async_record(THREADID thread_id, unsigned int shard,
+                                    std::size_t record_size) {
+  std::unique_ptr<RecordBuffer> &buffer =
+      GetThreadData(thread_id)->buffers[shard];
+
+  if (buffer->used + record_size > buffer->data.size()) {
+    buffer = HandOffBuffer(shard, std::move(buffer));
+
+    // Some instructions, e.g. XSAVE, access more memory than fits in a buffer.
+    if (record_size > buffer->data.size())
+      buffer->data.resize(record_size);
+  }
+
+  unsigned char *record = &buffer->data[buffer->used];
+  buffer->used += record_size;
+  return record;
+}
+
+ADDRINT *async_write_addresses(THREADID thread_id) {
+  return GetThreadData(thread_id)->write_addresses;
+}
@@ -0,0 +1,98 @@
+#ifndef ASYNCANALYSIS_H
+#define ASYNCANALYSIS_H
+
+#include <cstddef>
+
+#include "pin.H"
+
+// Asynchronous analysis, for tools whose analysis of an event is too expensive
+// to run in the application threads, e.g. updating the sets of values that an
+// instruction read or wrote.
+//
+// Application threads only append a record of every event to a buffer. Every
+// internal analysis thread analyses the records of a fixed subset (shard) of
+// the profiled objects, e.g. instructions, so it never needs a lock to update
+// them. Each application thread therefore has one buffer per analysis thread,
+// which it hands off to that thread when it is full. When too many full buffers
+// are queued for an analysis thread, application threads wait for it to catch
+// up, so the memory usage stays bounded.
+//
+// A record is a struct Record with a member 'size', followed by the 'size'
+// bytes of a value, padded to a multiple of 8 bytes. sizeof(Record) must be a
+// multiple of 8 as well. Tools append records with append_async_record(), and
+// analyse them with a routine ANALYSE(const Record &, const unsigned char *),
+// which runs in the analysis thread of the record's shard:
+//
+//   init_async_analysis(num_threads, buffer_size,
+//                       analyse_async_records<Record, ANALYSE>);
+//
+// Must only be used in tools that call finish_async_analysis() from their Fini
+// function, before they write the profile.
+
+// The maximum number of written memory operands per instruction whose
+// effective address can be remembered with async_write_addresses().
+static constexpr UINT32 MAX_ASYNC_WRITE_ADDRESSES = 16;
+
+// Analyses the records in the first 'used' bytes of a buffer.
+typedef void (*AnalyseRecordsFunction)(const unsigned char *data,
+                                       std::size_t used);
+
+// Starts 'num_threads' analysis threads, which analyse buffers of
+// 'buffer_size' bytes with 'analyse'. Must be called from main(), before the
+// application is started. Returns false if it is not possible.
+bool init_async_analysis(unsigned int num_threads, std::size_t buffer_size,
+                         AnalyseRecordsFunction analyse);
+
+// Returns the number of analysis threads, and therefore of shards.
+unsigned int async_analysis_threads();
+
+// Stops the analysis threads, if the application did not exit normally, and
+// analyses the records that are left. Must be called from a Fini function, or
+// from a signal handler that writes the profile.
+void finish_async_analysis();
+
+// Reserves 'record_size' bytes in the buffer of a shard of the current thread,
+// and returns them.
+unsigned char *reserve_async_record(THREADID thread_id, unsigned int shard,
+                                    std::size_t record_size);
+
+// Returns the effective addresses that the current thread remembers for the
+// written memory operands of the current instruction. The written value is only
+// available after the instruction, when IARG_MEMORYOP_EA is not valid.
+ADDRINT *async_write_addresses(THREADID thread_id);
+
+// Returns the size of a record with a value of 'size' bytes.
+template <typename Record> std::size_t async_record_size(std::size_t size) {
+  return sizeof(Record) + ((size + 7) & ~std::size_t(7));
+}
+
+// Appends a record with a value of 'size' bytes to the buffer of a shard of the
+// current thread. Returns the record, of which only 'size' is filled in.
+template <typename Record>
+Record *append_async_record(THREADID thread_id, unsigned int shard,
+                            std::size_t size) {
+  auto *record = reinterpret_cast<Record *>(reserve_async_record(
+      thread_id, shard, async_record_size<Record>(size)));
+  record->size = size;
+  return record;
+}
+
+// Returns where the value of a record is stored.
+template <typename Record> unsigned char *async_record_value(Record *record) {
+  return reinterpret_cast<unsigned char *>(record + 1);
+}
+
+// Analyses every record in the first 'used' bytes of a buffer with ANALYSE.
+template <typename Record,
+          void (*ANALYSE)(const Record &record, const unsigned char *value)>
+void analyse_async_records(const unsigned char *data, std::size_t used) {
+  for (std::size_t offset = 0; offset < used;) {
+    const auto *record = reinterpret_cast<const Record *>(data + offset);
+
+    ANALYSE(*record, reinterpret_cast<const unsigned char *>(record + 1));
+
+    offset += async_record_size<Record>(record->size);
+  }
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+
+#include "inputtable.h"
+
+int InputTable::find_column(const std::string &name) const {
+  auto it = std::find(column_names.begin(), column_names.end(), name);
+  return (it != column_names.end()) ? it - column_names.begin() : -1;
+}
+
+// =============================================================================
+// CsvInputTable
+// =============================================================================
+
+CsvInputTable::CsvInputTable(std::ifstream ifs) : ifs(std::move(ifs)) {
+  std::string line;
+
+  if (std::getline(this->ifs, line))
+    column_names = split_line(line);
+}
+
+std::vector<std::string> CsvInputTable::split_line(const std::string &line) {
+  std::vector<std::string> result(1);
+  bool quoted = false;
+
+  for (std::size_t i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+
+    if (c == '"') {
+      // A doubled quote in a quoted value is an escaped quote.
+      if (quoted && i + 1 < line.size() && line[i + 1] == '"') {
+        result.back() += '"';
+        ++i;
+      } else {
+        quoted = !quoted;
+      }
+    } else if (c == ',' && !quoted) {
+      result.emplace_back();
+    } else {
+      result.back() += c;
+    }
+  }
+
+  return result;
+}
+
+bool CsvInputTable::next_row() {
+  std::string line;
+
+  do {
+    if (!std::getline(ifs, line))
+      return false;
+  } while (line.empty());
+
+  values = split_line(line);
+  values.resize(column_names.size());
+
+  return true;
+}
+
+std::string CsvInputTable::get_string(int column) const {
+  return values[column];
+}
+
+std::int64_t CsvInputTable::get_int64(int column) const {
+  // Values are parsed as unsigned first, so that addresses above 2^63 do not
+  // overflow.
+  const std::string &value = values[column];
+
+  if (!value.empty() && value[0] == '-')
+    return std::strtoll(value.c_str(), nullptr, 10);
+
+  return static_cast<std::int64_t>(std::strtoull(value.c_str(), nullptr, 10));
+}
+
+double CsvInputTable::get_double(int column) const {
+  return std::strtod(values[column].c_str(), nullptr);
+}
+
+// =============================================================================
+// ColumnarInputTable
+// =============================================================================
+
+std::unique_ptr<ColumnarInputTable>
+ColumnarInputTable::parse(std::vector<char> data) {
+  std::unique_ptr<ColumnarInputTable> table(new ColumnarInputTable());
+  table->data = std::move(data);
+
+  const std::vector<char> &contents = table->data;
+
+  // Check that a range of the file exists.
+  auto in_file = [&contents](std::uint64_t offset, std::uint64_t size) {
+    return offset <= contents.size() && size <= contents.size() - offset;
+  };
+
+  // Read the header.
+  ColumnarHeader header;
+
+  if (!in_file(0, sizeof(header)))
+    return nullptr;
+
+  std::memcpy(&header, contents.data(), sizeof(header));
+
+  if (!std::equal(std::begin(header.magic), std::end(header.magic),
+                  COLUMNAR_MAGIC))
+    return nullptr;
+
+  table->num_rows = header.num_rows;
+
+  // Read the column descriptors.
+  for (std::uint32_t i = 0; i < header.num_columns; ++i) {
+    const std::uint64_t offset =
+        sizeof(ColumnarHeader) + i * sizeof(ColumnarColumnDescriptor);
+    ColumnarColumnDescriptor descriptor;
+
+    if (!in_file(offset, sizeof(descriptor)))
+      return nullptr;
+
+    std::memcpy(&descriptor, contents.data() + offset, sizeof(descriptor));
+
+    const ColumnType type = static_cast<ColumnType>(descriptor.type);
+    const std::uint64_t width = (type == ColumnType::STRING)
+                                    ? sizeof(std::uint32_t)
+                                    : sizeof(std::uint64_t);
+
+    if (descriptor.type > static_cast<std::uint32_t>(ColumnType::STRING) ||
+        !in_file(descriptor.data_offset, header.num_rows * width))
+      return nullptr;
+
+    table->column_names.emplace_back(
+        descriptor.name, strnlen(descriptor.name, sizeof(descriptor.name)));
+    table->column_types.push_back(type);
+    table->column_offsets.push_back(descriptor.data_offset);
+  }
+
+  // Read the dictionary.
+  std::uint64_t num_strings;
+
+  if (!in_file(header.dictionary_offset, sizeof(num_strings)))
+    return nullptr;
+
+  std::memcpy(&num_strings, contents.data() + header.dictionary_offset,
+              sizeof(num_strings));
+
+  const std::uint64_t offsets_offset =
+      header.dictionary_offset + sizeof(num_strings);
+
+  if (num_strings >= contents.size() ||
+      !in_file(offsets_offset, (num_strings + 1) * sizeof(std::uint64_t)))
+    return nullptr;
+
+  std::vector<std::uint64_t> offsets(num_strings + 1);
+  std::memcpy(offsets.data(), contents.data() + offsets_offset,
+              offsets.size() * sizeof(offsets[0]));
+
+  const std::uint64_t strings_offset =
+      offsets_offset + offsets.size() * sizeof(offsets[0]);
+
+  if (!in_file(strings_offset, offsets.back()))
+    return nullptr;
+
+  for (std::uint64_t i = 0; i < num_strings; ++i) {
+    if (offsets[i] > offsets[i + 1])
+      return nullptr;
+
+    table->strings.emplace_back(contents.data() + strings_offset + offsets[i],
+                                offsets[i + 1] - offsets[i]);
+  }
+
+  return table;
+}
+
+bool ColumnarInputTable::next_row() { return ++current_row < num_rows; }
+
+std::uint64_t ColumnarInputTable::get_bits(int column) const {
+  std::uint64_t bits;
+  std::memcpy(&bits,
+              data.data() + column_offsets[column] +
+                  current_row * sizeof(bits),
+              sizeof(bits));
+  return bits;
+}
+
+std::string ColumnarInputTable::get_string(int column) const {
+  std::ostringstream oss;
+
+  switch (column_types[column]) {
+  case ColumnType::INT64:
+    oss << static_cast<std::int64_t>(get_bits(column));
+    break;
+  case ColumnType::UINT64:
+    oss << get_bits(column);
+    break;
+  case ColumnType::DOUBLE:
+    oss << get_double(column);
+    break;
+  case ColumnType::STRING: {
+    std::uint32_t index;
+    std::memcpy(&index,
+                data.data() + column_offsets[column] +
+                    current_row * sizeof(index),
+                sizeof(index));
+    return (index < strings.size()) ? strings[index] : std::string();
+  }
+  }
+
+  return oss.str();
+}
+
+std::int64_t ColumnarInputTable::get_int64(int column) const {
+  switch (column_types[column]) {
+  case ColumnType::INT64:
+  case ColumnType::UINT64:
+    return static_cast<std::int64_t>(get_bits(column));
+  case ColumnType::DOUBLE:
+    return static_cast<std::int64_t>(get_double(column));
+  case ColumnType::STRING:
+  default:
+    return std::strtoll(get_string(column).c_str(), nullptr, 10);
+  }
+}
+
+double ColumnarInputTable::get_double(int column) const {
+  switch (column_types[column]) {
+  case ColumnType::INT64:
+    return static_cast<double>(static_cast<std::int64_t>(get_bits(column)));
+  case ColumnType::UINT64:
+    return static_cast<double>(get_bits(column));
+  case ColumnType::DOUBLE: {
+    const std::uint64_t bits = get_bits(column);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  case ColumnType::STRING:
+  default:
+    return std::strtod(get_string(column).c_str(), nullptr);
+  }
+}
+
+// =============================================================================
+// Opening tables
+// =============================================================================
+
+std::unique_ptr<InputTable> open_input_table(const std::string &path) {
+  std::ifstream col_ifs(path + ".col", std::ios::binary);
+
+  if (col_ifs) {
+    std::vector<char> data((std::istreambuf_iterator<char>(col_ifs)),
+                           std::istreambuf_iterator<char>());
+    return ColumnarInputTable::parse(std::move(data));
+  }
+
+  std::ifstream csv_ifs(path + ".csv");
+
+  if (csv_ifs)
+    return std::unique_ptr<InputTable>(new CsvInputTable(std::move(csv_ifs)));
+
+  return nullptr;
+}
@@ -0,0 +1,96 @@
+#ifndef INPUTTABLE_H
+#define INPUTTABLE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "table.h"
+
+// Reads a table written by a Pin tool, either as CSV or in the columnar
+// format. Values are read row by row, and can be read as strings, as they
+// appear in the CSV output, or as numbers.
+class InputTable {
+public:
+  virtual ~InputTable() = default;
+
+  // Returns the index of the column with the given name, or -1 if the table
+  // has no such column.
+  int find_column(const std::string &name) const;
+
+  // Moves to the next row. Returns false if there are no rows left.
+  virtual bool next_row() = 0;
+
+  // Returns a value of the current row.
+  virtual std::string get_string(int column) const = 0;
+  virtual std::int64_t get_int64(int column) const = 0;
+  virtual double get_double(int column) const = 0;
+
+protected:
+  // The names of the columns.
+  std::vector<std::string> column_names;
+};
+
+// Reads a CSV table. Quoted values may contain commas, and quotes in quoted
+// values are escaped by doubling them.
+class CsvInputTable : public InputTable {
+public:
+  explicit CsvInputTable(std::ifstream ifs);
+
+  bool next_row() override;
+  std::string get_string(int column) const override;
+  std::int64_t get_int64(int column) const override;
+  double get_double(int column) const override;
+
+private:
+  // Splits a line in its values.
+  static std::vector<std::string> split_line(const std::string &line);
+
+  std::ifstream ifs;
+
+  // The values of the current row.
+  std::vector<std::string> values;
+};
+
+// Reads a table in the columnar format. The file is read in memory at once.
+class ColumnarInputTable : public InputTable {
+public:
+  // Parses the contents of a columnar file. Returns nullptr if the contents are
+  // not a valid columnar table.
+  static std::unique_ptr<ColumnarInputTable> parse(std::vector<char> data);
+
+  bool next_row() override;
+  std::string get_string(int column) const override;
+  std::int64_t get_int64(int column) const override;
+  double get_double(int column) const override;
+
+private:
+  ColumnarInputTable() = default;
+
+  // Returns the raw 8-byte value of a numeric column in the current row.
+  std::uint64_t get_bits(int column) const;
+
+  // The contents of the file.
+  std::vector<char> data;
+
+  // The types and data offsets of the columns.
+  std::vector<ColumnType> column_types;
+  std::vector<std::uint64_t> column_offsets;
+
+  // The strings in the dictionary.
+  std::vector<std::string> strings;
+
+  std::uint64_t num_rows = 0;
+
+  // The index of the current row. It wraps around to 0 at the first call to
+  // next_row().
+  std::uint64_t current_row = -1;
+};
+
+// Opens the table '<path>.col' if it exists, and '<path>.csv' otherwise.
+// Returns nullptr if neither can be read.
+std::unique_ptr<InputTable> open_input_table(const std::string &path);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef OPERANDVALUE_H
+#define OPERANDVALUE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "pin.H"
+
+// Analysis routines that are specialized for the size of a memory operand.
+//
+// Most memory operands are 1, 2, 4, 8, 16, 32 or 64 bytes. An analysis routine
+// that takes the size as a template parameter SIZE can copy the value of the
+// operand into a fixed-size array on its stack, and loop over its bytes with a
+// bound that is known at compile time, rather than allocating a buffer and
+// looping over a size that is passed at run time. SIZE 0 is the generic
+// instantiation, for all other sizes, e.g. 10-byte x87 operands or XSAVE.
+//
+// The instantiation is chosen at instrumentation time:
+//
+//   template <std::size_t SIZE>
+//   VOID MemoryRead(ADDRINT address, ADDRINT size) {
+//     OperandValue<SIZE> value(address, size);
+//
+//     for (std::size_t i = 0; i < value.size(); ++i)
+//       ++byte_counts[value.data()[i]];
+//   }
+//
+//   INS_InsertCall(ins, IPOINT_BEFORE, SIZED_ROUTINE(MemoryRead, size),
+//                  IARG_MEMORYOP_EA, mem_op, IARG_ADDRINT, size, IARG_END);
+//
+// The size is still passed, so that the generic instantiation can use it.
+
+// A copy of the value of a memory operand of SIZE bytes, stored inline.
+template <std::size_t SIZE> class OperandValue {
+public:
+  // Copies the value at 'address'. 'size' must be SIZE.
+  OperandValue(ADDRINT address, ADDRINT size) {
+    PIN_SafeCopy(value, reinterpret_cast<const VOID *>(address), SIZE);
+  }
+
+  const unsigned char *data() const { return value; }
+
+  static constexpr std::size_t size() { return SIZE; }
+
+private:
+  unsigned char value[SIZE];
+};
+
+// A copy of the value of a memory operand of any size.
+template <> class OperandValue<0> {
+public:
+  // Copies the 'size' bytes at 'address'.
+  OperandValue(ADDRINT address, ADDRINT size) : value(size) {
+    PIN_SafeCopy(value.data(), reinterpret_cast<const VOID *>(address), size);
+  }
+
+  const unsigned char *data() const { return value.data(); }
+
+  std::size_t size() const { return value.size(); }
+
+private:
+  std::vector<unsigned char> value;
+};
+
+// Returns the routine among the instantiations that is specialized for a
+// memory operand of 'size' bytes, or the generic instantiation if there is
+// none. Use SIZED_ROUTINE() rather than calling this directly.
+inline AFUNPTR select_sized_routine(ADDRINT size, AFUNPTR generic,
+                                    AFUNPTR size_1, AFUNPTR size_2,
+                                    AFUNPTR size_4, AFUNPTR size_8,
+                                    AFUNPTR size_16, AFUNPTR size_32,
+                                    AFUNPTR size_64) {
+  switch (size) {
+  case 1:
+    return size_1;
+  case 2:
+    return size_2;
+  case 4:
+    return size_4;
+  case 8:
+    return size_8;
+  case 16:
+    return size_16;
+  case 32:
+    return size_32;
+  case 64:
+    return size_64;
+  default:
+    return generic;
+  }
+}
+
+// Returns the instantiation of the analysis routine template 'routine' for a
+// memory operand of 'size' bytes, as an AFUNPTR.
+#define SIZED_ROUTINE(routine, size)                                           \
+  select_sized_routine((size), reinterpret_cast<AFUNPTR>(routine<0>),          \
+                       reinterpret_cast<AFUNPTR>(routine<1>),                  \
+                       reinterpret_cast<AFUNPTR>(routine<2>),                  \
+                       reinterpret_cast<AFUNPTR>(routine<4>),                  \
+                       reinterpret_cast<AFUNPTR>(routine<8>),                  \
+                       reinterpret_cast<AFUNPTR>(routine<16>),                 \
+                       reinterpret_cast<AFUNPTR>(routine<32>),                 \
+                       reinterpret_cast<AFUNPTR>(routine<64>))
+
+#endif
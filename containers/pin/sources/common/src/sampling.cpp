@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+
+#include "sampling.h"
+
+namespace {
+
+// The sampling state of a thread. A tool register holds a pointer to it, so
+// the inlined countdown does not need to look it up.
+struct ThreadSampleState {
+  // The number of events until the next sample, including that sample.
+  ADDRINT remaining;
+
+  // Whether the last event was sampled.
+  ADDRINT sampled;
+
+  // State of the random number generator.
+  UINT64 random;
+};
+
+UINT64 period = 1;
+
+UINT64 seed = 0;
+
+// The tool register that holds the ThreadSampleState of a thread.
+REG state_register = REG_INVALID();
+
+// SplitMix64, to derive the random state of a thread from the seed.
+UINT64 split_mix(UINT64 x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Draws the number of events until the next sample, which is geometrically
+// distributed with mean 'period'.
+ADDRINT next_interval(ThreadSampleState *state) {
+  // xorshift64*
+  state->random ^= state->random >> 12;
+  state->random ^= state->random << 25;
+  state->random ^= state->random >> 27;
+  const UINT64 r = state->random * 0x2545f4914f6cdd1dULL;
+
+  // Uniform in (0, 1].
+  const double u = static_cast<double>((r >> 11) + 1) * 0x1.0p-53;
+
+  const double p = 1.0 / static_cast<double>(period);
+
+  return 1 + static_cast<ADDRINT>(std::log(u) / std::log1p(-p));
+}
+
+// Inlined routine that counts down an event. Returns whether it is sampled.
+ADDRINT PIN_FAST_ANALYSIS_CALL SampleCountdown(ThreadSampleState *state) {
+  state->sampled = (--state->remaining == 0);
+  return state->sampled;
+}
+
+// Runs after a sampled event was counted down, to start the next countdown.
+VOID StartNextCountdown(ThreadSampleState *state) {
+  state->remaining = next_interval(state);
+}
+
+// Inlined routine that returns whether the last event was sampled.
+ADDRINT PIN_FAST_ANALYSIS_CALL IsSampled(ThreadSampleState *state) {
+  return state->sampled;
+}
+
+VOID OnSampleThreadStart(THREADID thread_id, CONTEXT *ctx, INT32 flags,
+                         VOID *v) {
+  ThreadSampleState *state = new ThreadSampleState();
+  state->random = split_mix(seed ^ split_mix(thread_id)) | 1;
+  state->remaining = next_interval(state);
+  state->sampled = 0;
+
+  PIN_SetContextReg(ctx, state_register, reinterpret_cast<ADDRINT>(state));
+}
+
+VOID OnSampleThreadFini(THREADID thread_id, const CONTEXT *ctx, INT32 code,
+                        VOID *v) {
+  delete reinterpret_cast<ThreadSampleState *>(
+      PIN_GetContextReg(ctx, state_register));
+}
+
+} // namespace
+
+bool init_sampling(UINT64 sample_period, UINT64 sample_seed) {
+  if (sample_period == 0)
+    return false;
+
+  period = sample_period;
+  seed = sample_seed;
+
+  if (period == 1)
+    return true;
+
+  state_register = PIN_ClaimToolRegister();
+
+  if (!REG_valid(state_register))
+    return false;
+
+  PIN_AddThreadStartFunction(OnSampleThreadStart, nullptr);
+  PIN_AddThreadFiniFunction(OnSampleThreadFini, nullptr);
+
+  return true;
+}
+
+bool sampling_enabled() { return period > 1; }
+
+UINT64 sample_period() { return period; }
+
+void insert_sample_countdown(INS ins, bool predicated) {
+  if (!sampling_enabled())
+    return;
+
+  const auto insert_if = predicated ? INS_InsertIfPredicatedCall
+                                    : INS_InsertIfCall;
+  const auto insert_then = predicated ? INS_InsertThenPredicatedCall
+                                      : INS_InsertThenCall;
+
+  insert_if(ins, IPOINT_BEFORE, reinterpret_cast<AFUNPTR>(SampleCountdown),
+            IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, state_register, IARG_END);
+  insert_then(ins, IPOINT_BEFORE,
+              reinterpret_cast<AFUNPTR>(StartNextCountdown), IARG_REG_VALUE,
+              state_register, IARG_END);
+}
+
+void insert_sample_countdown(BBL bbl) {
+  if (!sampling_enabled())
+    return;
+
+  BBL_InsertIfCall(bbl, IPOINT_BEFORE,
+                   reinterpret_cast<AFUNPTR>(SampleCountdown),
+                   IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, state_register,
+                   IARG_END);
+  BBL_InsertThenCall(bbl, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(StartNextCountdown),
+                     IARG_REG_VALUE, state_register, IARG_END);
+}
+
+void insert_sampled_call(INS ins, IPOINT ipoint, AFUNPTR routine,
+                         IARGLIST args, bool predicated) {
+  if (sampling_enabled()) {
+    const auto insert_if = predicated ? INS_InsertIfPredicatedCall
+                                      : INS_InsertIfCall;
+    const auto insert_then = predicated ? INS_InsertThenPredicatedCall
+                                        : INS_InsertThenCall;
+
+    insert_if(ins, ipoint, reinterpret_cast<AFUNPTR>(IsSampled),
+              IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, state_register,
+              IARG_END);
+    insert_then(ins, ipoint, routine, IARG_IARGLIST, args, IARG_END);
+  } else if (predicated) {
+    INS_InsertPredicatedCall(ins, ipoint, routine, IARG_IARGLIST, args,
+                             IARG_END);
+  } else {
+    INS_InsertCall(ins, ipoint, routine, IARG_IARGLIST, args, IARG_END);
+  }
+
+  IARGLIST_Free(args);
+}
+
+void insert_sampled_call(BBL bbl, AFUNPTR routine, IARGLIST args) {
+  if (sampling_enabled()) {
+    BBL_InsertIfCall(bbl, IPOINT_BEFORE, reinterpret_cast<AFUNPTR>(IsSampled),
+                     IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, state_register,
+                     IARG_END);
+    BBL_InsertThenCall(bbl, IPOINT_BEFORE, routine, IARG_IARGLIST, args,
+                       IARG_END);
+  } else {
+    BBL_InsertCall(bbl, IPOINT_BEFORE, routine, IARG_IARGLIST, args,
+                   IARG_END);
+  }
+
+  IARGLIST_Free(args);
+}
+
+UINT64 estimate_count(UINT64 samples) { return samples * period; }
+
+void estimate_confidence_interval(UINT64 samples, UINT64 &low, UINT64 &high) {
+  if (!sampling_enabled()) {
+    low = high = samples;
+    return;
+  }
+
+  const double p = 1.0 / static_cast<double>(period);
+
+  if (samples == 0) {
+    // The largest number of events for which not sampling any of them has a
+    // probability of at least 5%.
+    low = 0;
+    high = static_cast<UINT64>(std::log(0.05) / std::log1p(-p));
+    return;
+  }
+
+  // The number of samples is binomially distributed. Use the normal
+  // approximation, and never go below the number of events that were seen.
+  const double k = static_cast<double>(samples);
+  const double estimate = k / p;
+  const double margin = 1.96 * std::sqrt(k * (1.0 - p)) / p;
+
+  low = std::max(samples, static_cast<UINT64>(
+                              std::max(0.0, std::floor(estimate - margin))));
+  high = static_cast<UINT64>(std::ceil(estimate + margin));
+}
@@ -0,0 +1,60 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "pin.H"
+
+// Sampling of dynamic events, e.g. executions of basic blocks, for exploratory
+// runs that do not need exact counts.
+//
+// Every event is sampled independently with probability 1/period. Each thread
+// counts down the events until its next sample in an inlined analysis routine,
+// so events that are not sampled only cost a decrement. The length of each
+// countdown is drawn from a geometric distribution, so the samples cannot alias
+// with the period of a loop, as they could with a fixed interval.
+//
+// Tools instrument an event with insert_sample_countdown(), followed by
+// insert_sampled_call() for each analysis routine of the event, which then only
+// runs if the event is sampled. Without sampling, insert_sampled_call() inserts
+// a plain call.
+//
+// A count of k sampled events estimates k * period events. Use
+// estimate_count() and estimate_confidence_interval() to write the estimates.
+
+// Starts sampling 1 in 'period' events, on average. A period of 1 disables
+// sampling. The seed makes the samples reproducible. Must be called from
+// main(), before the application is started. Returns false if sampling is not
+// possible.
+bool init_sampling(UINT64 period, UINT64 seed);
+
+// Returns whether sampling is enabled.
+bool sampling_enabled();
+
+// Returns the sampling period, which is 1 if sampling is disabled.
+UINT64 sample_period();
+
+// Inserts the countdown of an event before an instruction. If 'predicated' is
+// true, the event only occurs if the instruction is executed, as with
+// INS_InsertPredicatedCall().
+void insert_sample_countdown(INS ins, bool predicated = true);
+
+// Inserts the countdown of an event before a basic block.
+void insert_sample_countdown(BBL bbl);
+
+// Inserts a call of an analysis routine, which only runs if the last event of
+// the thread was sampled. Takes ownership of the arguments.
+void insert_sampled_call(INS ins, IPOINT ipoint, AFUNPTR routine,
+                         IARGLIST args, bool predicated = true);
+
+// Inserts a call of an analysis routine before a basic block, which only runs
+// if the last event of the thread was sampled. Takes ownership of the
+// arguments.
+void insert_sampled_call(BBL bbl, AFUNPTR routine, IARGLIST args);
+
+// Returns the estimated number of events, given the number of sampled events.
+UINT64 estimate_count(UINT64 samples);
+
+// Computes the 95% confidence interval of the number of events, given the
+// number of sampled events.
+void estimate_confidence_interval(UINT64 samples, UINT64 &low, UINT64 &high);
+
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+namespace {
+
+// A range of addresses with a name, i.e. a section or a routine.
+struct NamedRange {
+  ADDRINT low_address;
+  ADDRINT high_address; // Exclusive.
+  NameId name;
+};
+
+// The symbol tables of a loaded image.
+struct ImageTable {
+  // The full path of the image.
+  NameId name;
+
+  // The address that image offsets are relative to.
+  ADDRINT low_address;
+
+  // The sections and routines of the image, sorted by address.
+  std::vector<NamedRange> sections;
+  std::vector<NamedRange> routines;
+};
+
+// A mapped region of an image. Images can consist of several regions.
+struct ImageRegion {
+  ADDRINT low_address;
+  ADDRINT high_address; // Inclusive.
+  const ImageTable *image;
+};
+
+// The regions of all loaded images, sorted by address. Snapshots are never
+// modified after they are published, so they can be read without locking.
+struct Snapshot {
+  std::vector<ImageRegion> regions;
+};
+
+// The current snapshot.
+std::atomic<const Snapshot *> current_snapshot(nullptr);
+
+// The image tables and snapshots. Images that are unloaded and snapshots that
+// are replaced are kept alive, as other threads may still be reading them.
+std::vector<std::unique_ptr<ImageTable>> image_tables;
+std::vector<std::unique_ptr<Snapshot>> snapshots;
+
+// Mutex for modifying the image tables and snapshots.
+PIN_MUTEX tables_lock;
+
+// Interned names are stored in chunks that are never moved, so that they can
+// be read without locking.
+constexpr std::size_t NAME_CHUNK_SIZE = 4096;
+constexpr std::size_t MAX_NAME_CHUNKS = 4096;
+
+std::atomic<std::string *> name_chunks[MAX_NAME_CHUNKS];
+
+// Maps every interned name to its identifier.
+std::unordered_map<std::string, NameId> name_ids;
+
+// Mutex for interning names.
+PIN_MUTEX names_lock;
+
+// Sort ranges by address.
+bool operator<(const NamedRange &a, const NamedRange &b) {
+  return a.low_address < b.low_address;
+}
+
+// Returns the range that contains the given address, or nullptr if there is
+// none.
+const NamedRange *find_range(const std::vector<NamedRange> &ranges,
+                             ADDRINT address) {
+  auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), address,
+      [](ADDRINT a, const NamedRange &r) { return a < r.low_address; });
+
+  if (it == ranges.begin())
+    return nullptr;
+
+  --it;
+  return (address < it->high_address) ? &*it : nullptr;
+}
+
+// Publish a new snapshot with the regions of the given images. tables_lock must
+// be held when calling this function.
+void publish_snapshot(std::vector<ImageRegion> regions) {
+  std::sort(regions.begin(), regions.end(),
+            [](const ImageRegion &a, const ImageRegion &b) {
+              return a.low_address < b.low_address;
+            });
+
+  std::unique_ptr<Snapshot> snapshot(new Snapshot());
+  snapshot->regions = std::move(regions);
+
+  current_snapshot.store(snapshot.get(), std::memory_order_release);
+  snapshots.push_back(std::move(snapshot));
+}
+
+// Returns the regions of the current snapshot. tables_lock must be held when
+// calling this function.
+std::vector<ImageRegion> current_regions() {
+  const Snapshot *snapshot = current_snapshot.load(std::memory_order_relaxed);
+  return snapshot ? snapshot->regions : std::vector<ImageRegion>();
+}
+
+// Image load callback that builds the symbol tables of the image.
+VOID OnSymbolsImageLoad(IMG img, VOID *v) {
+  std::unique_ptr<ImageTable> table(new ImageTable());
+
+  table->name = intern_name(IMG_Name(img));
+  table->low_address = IMG_LowAddress(img);
+
+  for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec)) {
+    if (SEC_Address(sec) != 0) {
+      table->sections.push_back(
+          NamedRange{SEC_Address(sec), SEC_Address(sec) + SEC_Size(sec),
+                     intern_name(SEC_Name(sec))});
+    }
+
+    for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn)) {
+      table->routines.push_back(
+          NamedRange{RTN_Address(rtn), RTN_Address(rtn) + RTN_Size(rtn),
+                     intern_name(RTN_Name(rtn))});
+    }
+  }
+
+  std::sort(table->sections.begin(), table->sections.end());
+  std::sort(table->routines.begin(), table->routines.end());
+
+  PIN_MutexLock(&tables_lock);
+
+  std::vector<ImageRegion> regions = current_regions();
+
+  for (UINT32 i = 0; i < IMG_NumRegions(img); ++i) {
+    regions.push_back(ImageRegion{IMG_RegionLowAddress(img, i),
+                                  IMG_RegionHighAddress(img, i),
+                                  table.get()});
+  }
+
+  image_tables.push_back(std::move(table));
+  publish_snapshot(std::move(regions));
+
+  PIN_MutexUnlock(&tables_lock);
+}
+
+// Image unload callback that removes the symbol tables of the image.
+VOID OnSymbolsImageUnload(IMG img, VOID *v) {
+  const ADDRINT low_address = IMG_LowAddress(img);
+
+  PIN_MutexLock(&tables_lock);
+
+  std::vector<ImageRegion> regions = current_regions();
+  regions.erase(std::remove_if(regions.begin(), regions.end(),
+                               [low_address](const ImageRegion &r) {
+                                 return r.image->low_address == low_address;
+                               }),
+                regions.end());
+
+  publish_snapshot(std::move(regions));
+
+  PIN_MutexUnlock(&tables_lock);
+}
+
+} // namespace
+
+void init_symbols() {
+  PIN_MutexInit(&tables_lock);
+  PIN_MutexInit(&names_lock);
+
+  // Make sure the unknown name gets identifier 0.
+  intern_name("???");
+
+  IMG_AddInstrumentFunction(OnSymbolsImageLoad, nullptr);
+  IMG_AddUnloadFunction(OnSymbolsImageUnload, nullptr);
+}
+
+SymbolLocation find_symbol(ADDRINT address) {
+  SymbolLocation location;
+
+  const Snapshot *snapshot = current_snapshot.load(std::memory_order_acquire);
+  if (snapshot == nullptr)
+    return location;
+
+  // Find the image region.
+  const auto &regions = snapshot->regions;
+  auto it = std::upper_bound(
+      regions.begin(), regions.end(), address,
+      [](ADDRINT a, const ImageRegion &r) { return a < r.low_address; });
+
+  if (it == regions.begin() || address > (--it)->high_address)
+    return location;
+
+  const ImageTable &image = *it->image;
+  location.image_name = image.name;
+  location.image_offset = address - image.low_address;
+
+  // Find the section and routine.
+  if (const NamedRange *section = find_range(image.sections, address))
+    location.section_name = section->name;
+
+  if (const NamedRange *routine = find_range(image.routines, address)) {
+    location.routine_name = routine->name;
+    location.routine_offset = address - routine->low_address;
+  }
+
+  return location;
+}
+
+const std::string &get_name(NameId id) {
+  return name_chunks[id / NAME_CHUNK_SIZE].load(
+      std::memory_order_acquire)[id % NAME_CHUNK_SIZE];
+}
+
+NameId intern_name(const std::string &name) {
+  PIN_MutexLock(&names_lock);
+
+  auto it = name_ids.find(name);
+  if (it != name_ids.end()) {
+    const NameId id = it->second;
+    PIN_MutexUnlock(&names_lock);
+    return id;
+  }
+
+  const NameId id = name_ids.size();
+  assert(id < NAME_CHUNK_SIZE * MAX_NAME_CHUNKS && "Too many names!");
+
+  std::string *chunk =
+      name_chunks[id / NAME_CHUNK_SIZE].load(std::memory_order_relaxed);
+
+  if (chunk == nullptr) {
+    chunk = new std::string[NAME_CHUNK_SIZE];
+    name_chunks[id / NAME_CHUNK_SIZE].store(chunk, std::memory_order_relaxed);
+  }
+
+  chunk[id % NAME_CHUNK_SIZE] = name;
+
+  // Publish the name before its identifier can be used by other threads.
+  name_chunks[id / NAME_CHUNK_SIZE].store(chunk, std::memory_order_release);
+  name_ids.emplace(name, id);
+
+  PIN_MutexUnlock(&names_lock);
+
+  return id;
+}
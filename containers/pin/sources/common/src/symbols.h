@@ -0,0 +1,58 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <string>
+
+#include "pin.H"
+
+// Symbol resolution shared by the Pin tools.
+//
+// The ranges of the images, sections and routines are collected once when an
+// image is loaded, and stored in sorted tables. Looking up an address is then
+// a binary search that does not need the client lock, so it can be done from
+// analysis routines as well as from instrumentation routines.
+//
+// Names are interned, so that a location only consists of a few integers.
+
+// Identifier of an interned name.
+typedef UINT32 NameId;
+
+// Identifier of the name "???", which is used for unknown names.
+static constexpr NameId UNKNOWN_NAME = 0;
+
+// The location of an address in the loaded images.
+struct SymbolLocation {
+  // The full path of the image the address belongs to.
+  NameId image_name = UNKNOWN_NAME;
+
+  // The name of the section the address belongs to.
+  NameId section_name = UNKNOWN_NAME;
+
+  // The name of the routine the address belongs to.
+  NameId routine_name = UNKNOWN_NAME;
+
+  // The offset of the address relative to the base of the image, or -1 if the
+  // address is not in an image.
+  ADDRINT image_offset = static_cast<ADDRINT>(-1);
+
+  // The offset of the address relative to the start of the routine, or -1 if
+  // the address is not in a routine.
+  ADDRINT routine_offset = static_cast<ADDRINT>(-1);
+};
+
+// Registers the image load and unload callbacks that maintain the symbol
+// tables. Must be called from main() after PIN_InitSymbols(), and before any
+// other image load callback is registered, so that the tables are up to date
+// in the image load callbacks of the tool.
+void init_symbols();
+
+// Returns the location of an address.
+SymbolLocation find_symbol(ADDRINT address);
+
+// Returns the interned name with the given identifier.
+const std::string &get_name(NameId id);
+
+// Interns a name, and returns its identifier.
+NameId intern_name(const std::string &name);
+
+#endif
@@ -0,0 +1,408 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "table.h"
+
+namespace {
+
+// Round an offset up to a multiple of 8 bytes.
+std::uint64_t align(std::uint64_t offset) { return (offset + 7) & ~7ULL; }
+
+// Write zero bytes until the given offset is reached.
+void pad(std::ofstream &ofs, std::uint64_t &offset, std::uint64_t target) {
+  static const char zeros[8] = {};
+
+  assert(target - offset <= sizeof(zeros));
+  ofs.write(zeros, target - offset);
+  offset = target;
+}
+
+} // namespace
+
+void append_decimal(std::string &out, std::uint64_t value) {
+  char digits[20];
+  std::size_t count = 0;
+
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  while (count > 0)
+    out += digits[--count];
+}
+
+void append_decimal(std::string &out, std::int64_t value) {
+  if (value < 0) {
+    out += '-';
+    // Negate in unsigned arithmetic, so that the minimum value does not
+    // overflow.
+    append_decimal(out, -static_cast<std::uint64_t>(value));
+  } else {
+    append_decimal(out, static_cast<std::uint64_t>(value));
+  }
+}
+
+void append_hex_byte(std::string &out, unsigned char byte) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  out += HEX_DIGITS[byte >> 4];
+  out += HEX_DIGITS[byte & 0xf];
+}
+
+bool parse_table_format(const std::string &name, TableFormat &format) {
+  if (name == "csv") {
+    format = TableFormat::CSV;
+  } else if (name == "columnar") {
+    format = TableFormat::COLUMNAR;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// =============================================================================
+// TableWriter
+// =============================================================================
+
+TableWriter::TableWriter(std::vector<TableColumn> columns)
+    : columns(std::move(columns)) {
+  assert(!this->columns.empty() && "A table needs at least one column!");
+}
+
+TableWriter &TableWriter::operator<<(double value) {
+  if (closed)
+    return *this;
+
+  assert(columns[current_column].type == ColumnType::DOUBLE &&
+         "Column does not contain doubles!");
+
+  write_double(value);
+  next_column();
+
+  return *this;
+}
+
+TableWriter &TableWriter::operator<<(const std::string &value) {
+  write_string_value(value.data(), value.size());
+  return *this;
+}
+
+TableWriter &TableWriter::operator<<(const char *value) {
+  write_string_value(value, std::strlen(value));
+  return *this;
+}
+
+bool TableWriter::close() {
+  if (closed)
+    return true;
+
+  assert(current_column == 0 && "Incomplete row!");
+
+  closed = true;
+  return finish();
+}
+
+void TableWriter::write_integer(std::int64_t value) {
+  switch (columns[current_column].type) {
+  case ColumnType::INT64:
+    write_int64(value);
+    break;
+  case ColumnType::UINT64:
+    write_uint64(static_cast<std::uint64_t>(value));
+    break;
+  case ColumnType::DOUBLE:
+    write_double(static_cast<double>(value));
+    break;
+  case ColumnType::STRING:
+    assert(false && "Column does not contain integers!");
+    break;
+  }
+
+  next_column();
+}
+
+void TableWriter::write_integer(std::uint64_t value) {
+  switch (columns[current_column].type) {
+  case ColumnType::INT64:
+    write_int64(static_cast<std::int64_t>(value));
+    break;
+  case ColumnType::UINT64:
+    write_uint64(value);
+    break;
+  case ColumnType::DOUBLE:
+    write_double(static_cast<double>(value));
+    break;
+  case ColumnType::STRING:
+    assert(false && "Column does not contain integers!");
+    break;
+  }
+
+  next_column();
+}
+
+void TableWriter::write_string_value(const char *value, std::size_t size) {
+  if (closed)
+    return;
+
+  assert(columns[current_column].type == ColumnType::STRING &&
+         "Column does not contain strings!");
+
+  write_string(value, size);
+  next_column();
+}
+
+void TableWriter::next_column() {
+  if (++current_column == columns.size()) {
+    end_row();
+    current_column = 0;
+    ++num_rows;
+  }
+}
+
+// =============================================================================
+// CsvTableWriter
+// =============================================================================
+
+CsvTableWriter::CsvTableWriter(const std::string &path,
+                               std::vector<TableColumn> columns)
+    : TableWriter(std::move(columns)),
+      fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+  buffer.reserve(BUFFER_SIZE + BUFFER_SIZE / 4);
+
+  // Print header.
+  for (std::size_t i = 0; i < this->columns.size(); ++i) {
+    if (i != 0)
+      buffer += ',';
+
+    buffer += this->columns[i].name;
+  }
+
+  buffer += '\n';
+}
+
+CsvTableWriter::~CsvTableWriter() {
+  if (fd >= 0) {
+    flush();
+    ::close(fd);
+  }
+}
+
+bool CsvTableWriter::finish() {
+  if (fd < 0)
+    return false;
+
+  flush();
+
+  const bool closed_ok = (::close(fd) == 0);
+  fd = -1;
+
+  return !failed && closed_ok;
+}
+
+void CsvTableWriter::flush() {
+  const char *data = buffer.data();
+  std::size_t remaining = buffer.size();
+
+  while (remaining > 0 && !failed) {
+    const ssize_t written = write(fd, data, remaining);
+
+    if (written <= 0) {
+      failed = true;
+      break;
+    }
+
+    data += written;
+    remaining -= written;
+  }
+
+  buffer.clear();
+}
+
+void CsvTableWriter::write_separator() {
+  if (current_column != 0)
+    buffer += ',';
+}
+
+void CsvTableWriter::write_int64(std::int64_t value) {
+  write_separator();
+  append_decimal(buffer, value);
+}
+
+void CsvTableWriter::write_uint64(std::uint64_t value) {
+  write_separator();
+  append_decimal(buffer, value);
+}
+
+void CsvTableWriter::write_double(double value) {
+  write_separator();
+
+  // The default format of an std::ostream.
+  char text[32];
+  const int length = std::snprintf(text, sizeof(text), "%g", value);
+  buffer.append(text, length);
+}
+
+void CsvTableWriter::write_string(const char *value, std::size_t size) {
+  write_separator();
+
+  if (columns[current_column].quoted) {
+    buffer += '"';
+    buffer.append(value, size);
+    buffer += '"';
+  } else {
+    buffer.append(value, size);
+  }
+}
+
+void CsvTableWriter::end_row() {
+  buffer += '\n';
+
+  if (buffer.size() >= BUFFER_SIZE)
+    flush();
+}
+
+// =============================================================================
+// ColumnarTableWriter
+// =============================================================================
+
+ColumnarTableWriter::ColumnarTableWriter(const std::string &path,
+                                         std::vector<TableColumn> columns)
+    : TableWriter(std::move(columns)), path(path),
+      numeric_data(this->columns.size()), string_data(this->columns.size()) {
+  for (const auto &column : this->columns) {
+    assert(column.name.size() <= COLUMNAR_MAX_NAME_LENGTH &&
+           "Column name is too long!");
+  }
+}
+
+void ColumnarTableWriter::write_int64(std::int64_t value) {
+  numeric_data[current_column].push_back(static_cast<std::uint64_t>(value));
+}
+
+void ColumnarTableWriter::write_uint64(std::uint64_t value) {
+  numeric_data[current_column].push_back(value);
+}
+
+void ColumnarTableWriter::write_double(double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  numeric_data[current_column].push_back(bits);
+}
+
+void ColumnarTableWriter::write_string(const char *value, std::size_t size) {
+  std::string key(value, size);
+  auto it = string_ids.find(key);
+
+  if (it == string_ids.end()) {
+    it = string_ids.emplace(std::move(key), strings.size()).first;
+    strings.push_back(&it->first);
+  }
+
+  string_data[current_column].push_back(it->second);
+}
+
+bool ColumnarTableWriter::finish() {
+  // Compute the layout of the file.
+  std::vector<ColumnarColumnDescriptor> descriptors(columns.size());
+  std::uint64_t offset = sizeof(ColumnarHeader) +
+                         columns.size() * sizeof(ColumnarColumnDescriptor);
+
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    auto &descriptor = descriptors[i];
+
+    std::memset(&descriptor, 0, sizeof(descriptor));
+    std::strncpy(descriptor.name, columns[i].name.c_str(),
+                 COLUMNAR_MAX_NAME_LENGTH);
+    descriptor.type = static_cast<std::uint32_t>(columns[i].type);
+    descriptor.flags = columns[i].quoted ? COLUMNAR_FLAG_QUOTED : 0;
+
+    offset = align(offset);
+    descriptor.data_offset = offset;
+
+    const std::size_t width = (columns[i].type == ColumnType::STRING)
+                                  ? sizeof(std::uint32_t)
+                                  : sizeof(std::uint64_t);
+    offset += num_rows * width;
+  }
+
+  ColumnarHeader header;
+  std::memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+  header.num_columns = columns.size();
+  header.reserved = 0;
+  header.num_rows = num_rows;
+  header.dictionary_offset = align(offset);
+
+  // Write the header and column descriptors.
+  std::ofstream ofs(path.c_str(), std::ios::binary);
+
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(descriptors.data()),
+            descriptors.size() * sizeof(ColumnarColumnDescriptor));
+
+  offset = sizeof(ColumnarHeader) +
+           columns.size() * sizeof(ColumnarColumnDescriptor);
+
+  // Write the column data.
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    pad(ofs, offset, descriptors[i].data_offset);
+
+    if (columns[i].type == ColumnType::STRING) {
+      const auto &data = string_data[i];
+      ofs.write(reinterpret_cast<const char *>(data.data()),
+                data.size() * sizeof(data[0]));
+      offset += data.size() * sizeof(data[0]);
+    } else {
+      const auto &data = numeric_data[i];
+      ofs.write(reinterpret_cast<const char *>(data.data()),
+                data.size() * sizeof(data[0]));
+      offset += data.size() * sizeof(data[0]);
+    }
+  }
+
+  // Write the dictionary.
+  pad(ofs, offset, header.dictionary_offset);
+
+  const std::uint64_t num_strings = strings.size();
+  ofs.write(reinterpret_cast<const char *>(&num_strings), sizeof(num_strings));
+
+  std::uint64_t string_offset = 0;
+  ofs.write(reinterpret_cast<const char *>(&string_offset),
+            sizeof(string_offset));
+
+  for (const std::string *s : strings) {
+    string_offset += s->size();
+    ofs.write(reinterpret_cast<const char *>(&string_offset),
+              sizeof(string_offset));
+  }
+
+  for (const std::string *s : strings)
+    ofs.write(s->data(), s->size());
+
+  ofs.close();
+  return !ofs.fail();
+}
+
+// =============================================================================
+// Opening tables
+// =============================================================================
+
+std::unique_ptr<TableWriter> open_table(const std::string &path,
+                                        TableFormat format,
+                                        std::vector<TableColumn> columns) {
+  switch (format) {
+  case TableFormat::COLUMNAR:
+    return std::unique_ptr<TableWriter>(
+        new ColumnarTableWriter(path + ".col", std::move(columns)));
+  case TableFormat::CSV:
+  default:
+    return std::unique_ptr<TableWriter>(
+        new CsvTableWriter(path + ".csv", std::move(columns)));
+  }
+}
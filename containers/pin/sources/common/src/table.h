@@ -0,0 +1,252 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Tabular output shared by the Pin tools.
+//
+// A table is written row by row, by writing the values of each row in column
+// order. It can be written as CSV, or in a columnar binary format that can be
+// memory-mapped by the Python reader in containers/pin/columnar.py.
+//
+// The columnar format consists of (all integers are little-endian):
+//
+//   Header (32 bytes):
+//     char     magic[8]            "TREXCOL1"
+//     uint32   num_columns
+//     uint32   reserved
+//     uint64   num_rows
+//     uint64   dictionary_offset
+//
+//   Column descriptors (num_columns x 64 bytes):
+//     char     name[48]            NUL-padded
+//     uint32   type                See ColumnType.
+//     uint32   flags               See COLUMNAR_FLAG_*.
+//     uint64   data_offset
+//
+//   Column data, starting at data_offset and aligned to 8 bytes:
+//     num_rows values of 8 bytes, or of 4 bytes for string columns. Strings are
+//     stored as indices in the dictionary.
+//
+//   Dictionary, starting at dictionary_offset:
+//     uint64   num_strings
+//     uint64   offsets[num_strings + 1]   Relative to the start of 'data'.
+//     char     data[]
+
+// Magic bytes at the start of a columnar file.
+static constexpr char COLUMNAR_MAGIC[8] = {'T', 'R', 'E', 'X',
+                                           'C', 'O', 'L', '1'};
+
+// Maximum length of a column name in the columnar format.
+static constexpr std::size_t COLUMNAR_MAX_NAME_LENGTH = 47;
+
+// Column flag set if the values of the column are quoted in CSV output, so that
+// the CSV output can be reproduced.
+static constexpr std::uint32_t COLUMNAR_FLAG_QUOTED = 1;
+
+// Header of a columnar file.
+struct ColumnarHeader {
+  char magic[8];
+  std::uint32_t num_columns;
+  std::uint32_t reserved;
+  std::uint64_t num_rows;
+  std::uint64_t dictionary_offset;
+};
+
+static_assert(sizeof(ColumnarHeader) == 32, "Unexpected header size!");
+
+// Descriptor of a column in a columnar file.
+struct ColumnarColumnDescriptor {
+  char name[COLUMNAR_MAX_NAME_LENGTH + 1];
+  std::uint32_t type;
+  std::uint32_t flags;
+  std::uint64_t data_offset;
+};
+
+static_assert(sizeof(ColumnarColumnDescriptor) == 64,
+              "Unexpected column descriptor size!");
+
+// The type of the values of a column.
+enum class ColumnType : std::uint32_t {
+  INT64 = 0,
+  UINT64 = 1,
+  DOUBLE = 2,
+  STRING = 3,
+};
+
+// The description of a column.
+struct TableColumn {
+  // The name of the column.
+  std::string name;
+
+  // The type of the values of the column.
+  ColumnType type;
+
+  // Whether values are quoted in CSV output.
+  bool quoted = false;
+};
+
+// The format of a table.
+enum class TableFormat {
+  CSV,
+  COLUMNAR,
+};
+
+// Parses the name of a table format, i.e. 'csv' or 'columnar'. Returns false
+// if the name is invalid.
+bool parse_table_format(const std::string &name, TableFormat &format);
+
+// Append the decimal representation of an integer to a string, as it would be
+// written by an std::ostream, but without the overhead of a stream.
+void append_decimal(std::string &out, std::uint64_t value);
+void append_decimal(std::string &out, std::int64_t value);
+
+// Append the two lowercase hexadecimal digits of a byte to a string.
+void append_hex_byte(std::string &out, unsigned char byte);
+
+// Writes a table. Values are written in column order, and a row ends after a
+// value has been written for each column.
+class TableWriter {
+public:
+  explicit TableWriter(std::vector<TableColumn> columns);
+  virtual ~TableWriter() = default;
+
+  TableWriter(const TableWriter &) = delete;
+  TableWriter &operator=(const TableWriter &) = delete;
+
+  // Write a value in the current column. Integers can be written in integer
+  // and double columns, and are converted to the type of the column.
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value, TableWriter &>::type
+  operator<<(T value) {
+    if (closed)
+      return *this;
+
+    if (std::is_signed<T>::value)
+      write_integer(static_cast<std::int64_t>(value));
+    else
+      write_integer(static_cast<std::uint64_t>(value));
+
+    return *this;
+  }
+
+  TableWriter &operator<<(double value);
+  TableWriter &operator<<(const std::string &value);
+  TableWriter &operator<<(const char *value);
+
+  // Finishes writing the table, and closes the output file. Returns false if
+  // the file could not be written. Values written after the table has been
+  // closed are ignored.
+  bool close();
+
+protected:
+  // Writes the remainder of the output file, and closes it.
+  virtual bool finish() = 0;
+
+  // Write a value in the current column, converted to the type of the column.
+  virtual void write_int64(std::int64_t value) = 0;
+  virtual void write_uint64(std::uint64_t value) = 0;
+  virtual void write_double(double value) = 0;
+  virtual void write_string(const char *value, std::size_t size) = 0;
+
+  // Called after the last value of a row has been written.
+  virtual void end_row() {}
+
+  // The columns of the table.
+  const std::vector<TableColumn> columns;
+
+  // The column of the next value.
+  std::size_t current_column = 0;
+
+  // The number of complete rows.
+  std::uint64_t num_rows = 0;
+
+  // Whether the table has been closed.
+  bool closed = false;
+
+private:
+  void write_integer(std::int64_t value);
+  void write_integer(std::uint64_t value);
+  void write_string_value(const char *value, std::size_t size);
+
+  // Moves to the next column, and to the next row after the last column.
+  void next_column();
+};
+
+// Writes a table as CSV.
+//
+// The rows are formatted into a large buffer, without streams, and the buffer
+// is written to the file with a single write() call whenever it is full.
+class CsvTableWriter : public TableWriter {
+public:
+  CsvTableWriter(const std::string &path, std::vector<TableColumn> columns);
+  ~CsvTableWriter() override;
+
+protected:
+  bool finish() override;
+  void write_int64(std::int64_t value) override;
+  void write_uint64(std::uint64_t value) override;
+  void write_double(double value) override;
+  void write_string(const char *value, std::size_t size) override;
+  void end_row() override;
+
+private:
+  // The size of the buffer that is written at once.
+  static constexpr std::size_t BUFFER_SIZE = 1 << 20;
+
+  // Write the separator before the current column.
+  void write_separator();
+
+  // Write the buffer to the file, and empty it.
+  void flush();
+
+  // The output file, or -1 if it could not be opened.
+  int fd;
+
+  // The formatted rows that have not been written yet.
+  std::string buffer;
+
+  // Whether writing to the file failed.
+  bool failed = false;
+};
+
+// Writes a table in the columnar format. The table is kept in memory until it
+// is closed.
+class ColumnarTableWriter : public TableWriter {
+public:
+  ColumnarTableWriter(const std::string &path,
+                      std::vector<TableColumn> columns);
+
+protected:
+  bool finish() override;
+  void write_int64(std::int64_t value) override;
+  void write_uint64(std::uint64_t value) override;
+  void write_double(double value) override;
+  void write_string(const char *value, std::size_t size) override;
+
+private:
+  // The path of the output file.
+  const std::string path;
+
+  // The values of each column. Numeric values are stored as their bit pattern,
+  // strings as their index in the dictionary.
+  std::vector<std::vector<std::uint64_t>> numeric_data;
+  std::vector<std::vector<std::uint32_t>> string_data;
+
+  // The strings in the dictionary, and their indices.
+  std::vector<const std::string *> strings;
+  std::unordered_map<std::string, std::uint32_t> string_ids;
+};
+
+// Opens a table for writing. The file extension ('.csv' or '.col') is appended
+// to the given path.
+std::unique_ptr<TableWriter> open_table(const std::string &path,
+                                        TableFormat format,
+                                        std::vector<TableColumn> columns);
+
+#endif
@@ -0,0 +1,128 @@
+#include <fstream>
+
+#include "toolstats.h"
+
+bool tool_stats_enabled = false;
+
+namespace {
+
+// The registered statistics. They are prepended when constructed, and put in
+// order of construction by enable_tool_stats(). The heads are
+// constant-initialized, so statistics can be registered from the constructors
+// of globals in any translation unit.
+CallCounter *first_call_counter = nullptr;
+StatMutex *first_mutex = nullptr;
+StatTimer *first_timer = nullptr;
+PeakSize *first_peak_size = nullptr;
+
+// Reverses a list of statistics, linked by the given member.
+template <typename T> T *reversed(T *first, T *T::*next_member) {
+  T *result = nullptr;
+
+  while (first != nullptr) {
+    T *next = first->*next_member;
+    first->*next_member = result;
+    result = first;
+    first = next;
+  }
+
+  return result;
+}
+
+// Writes a JSON string. Statistic names are identifiers, so nothing needs to be
+// escaped.
+void write_name(std::ofstream &ofs, const char *name) {
+  ofs << '"' << name << '"';
+}
+
+} // namespace
+
+void enable_tool_stats() {
+  // All statistics are globals, which are constructed by now. Write them in
+  // order of construction.
+  first_call_counter = reversed(first_call_counter, &CallCounter::next);
+  first_mutex = reversed(first_mutex, &StatMutex::next);
+  first_timer = reversed(first_timer, &StatTimer::next);
+  first_peak_size = reversed(first_peak_size, &PeakSize::next);
+
+  tool_stats_enabled = true;
+}
+
+CallCounter::CallCounter(const char *name) : name(name) {
+  next = first_call_counter;
+  first_call_counter = this;
+}
+
+StatMutex::StatMutex(const char *name) : name(name) {
+  PIN_MutexInit(&mutex);
+
+  next = first_mutex;
+  first_mutex = this;
+}
+
+StatMutex::~StatMutex() { PIN_MutexFini(&mutex); }
+
+StatTimer::StatTimer(const char *name) : name(name) {
+  next = first_timer;
+  first_timer = this;
+}
+
+PeakSize::PeakSize(const char *name) : name(name) {
+  next = first_peak_size;
+  first_peak_size = this;
+}
+
+bool write_tool_stats(const std::string &path) {
+  std::ofstream ofs(path.c_str());
+  const char *separator;
+
+  ofs << "{\n  \"analysis_calls\": {";
+  separator = "\n";
+
+  for (const CallCounter *c = first_call_counter; c != nullptr; c = c->next) {
+    ofs << separator << "    ";
+    write_name(ofs, c->name);
+    ofs << ": " << c->calls.load(std::memory_order_relaxed);
+    separator = ",\n";
+  }
+
+  ofs << "\n  },\n  \"locks\": {";
+  separator = "\n";
+
+  for (const StatMutex *m = first_mutex; m != nullptr; m = m->next) {
+    ofs << separator << "    ";
+    write_name(ofs, m->name);
+    ofs << ": {\"acquisitions\": " << m->acquisitions
+        << ", \"contended\": " << m->contentions << '}';
+    separator = ",\n";
+  }
+
+  ofs << "\n  },\n  \"timers\": {";
+  separator = "\n";
+
+  for (const StatTimer *t = first_timer; t != nullptr; t = t->next) {
+    const double seconds =
+        std::chrono::duration_cast<std::chrono::duration<double>>(t->time)
+            .count();
+
+    ofs << separator << "    ";
+    write_name(ofs, t->name);
+    ofs << ": {\"calls\": " << t->calls << ", \"seconds\": " << seconds << '}';
+    separator = ",\n";
+  }
+
+  ofs << "\n  },\n  \"peak_sizes\": {";
+  separator = "\n";
+
+  for (const PeakSize *p = first_peak_size; p != nullptr; p = p->next) {
+    ofs << separator << "    ";
+    write_name(ofs, p->name);
+    ofs << ": " << p->peak;
+    separator = ",\n";
+  }
+
+  ofs << "\n  }\n}\n";
+  ofs.close();
+
+  return !ofs.fail();
+}
@@ -0,0 +1,156 @@
+#ifndef TOOLSTATS_H
+#define TOOLSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "pin.H"
+
+// Statistics about the Pin tool itself, to find out where the time of a slow
+// replay goes.
+//
+// Tools declare the statistics as globals, and update them from their
+// instrumentation and analysis routines:
+//
+// - CallCounter counts the calls of an analysis routine.
+// - StatMutex is a PIN_MUTEX that counts its acquisitions, and how many of them
+//   had to wait because another thread held the mutex.
+// - StatTimer measures the time spent in a routine, e.g. in the instrumentation
+//   routines or in writing the output.
+// - PeakSize records the largest size a container reached.
+//
+// Statistics are only collected after enable_tool_stats() is called, which
+// tools do if their -tool_stats option is set. When disabled, every update is
+// a single test of a global flag. write_tool_stats() writes the statistics as
+// JSON.
+
+// Whether statistics are collected.
+extern bool tool_stats_enabled;
+
+// Starts collecting statistics. Must be called from main(), before the
+// application is started.
+void enable_tool_stats();
+
+// Writes the statistics to a JSON file. Returns false if the file could not be
+// written.
+bool write_tool_stats(const std::string &path);
+
+// Counts the calls of an analysis routine. Safe to use from multiple threads.
+class CallCounter {
+public:
+  explicit CallCounter(const char *name);
+
+  void count() {
+    if (tool_stats_enabled)
+      calls.fetch_add(1, std::memory_order_relaxed);
+  }
+
+private:
+  friend void enable_tool_stats();
+  friend bool write_tool_stats(const std::string &path);
+
+  const char *name;
+  std::atomic<UINT64> calls{0};
+  CallCounter *next;
+};
+
+// A PIN_MUTEX that counts its acquisitions, and the acquisitions that found
+// the mutex locked by another thread.
+class StatMutex {
+public:
+  explicit StatMutex(const char *name);
+  ~StatMutex();
+
+  void lock() {
+    if (!tool_stats_enabled) {
+      PIN_MutexLock(&mutex);
+      return;
+    }
+
+    const bool contended = !PIN_MutexTryLock(&mutex);
+
+    if (contended)
+      PIN_MutexLock(&mutex);
+
+    // The counters are protected by the mutex itself.
+    ++acquisitions;
+    contentions += contended;
+  }
+
+  void unlock() { PIN_MutexUnlock(&mutex); }
+
+private:
+  friend void enable_tool_stats();
+  friend bool write_tool_stats(const std::string &path);
+
+  const char *name;
+  PIN_MUTEX mutex;
+  UINT64 acquisitions = 0;
+  UINT64 contentions = 0;
+  StatMutex *next;
+};
+
+// Accumulates the time spent in a routine. Use ScopedStatTimer to measure it.
+// Not safe to use from multiple threads at the same time, which is fine for
+// instrumentation routines and Fini, as Pin serializes them.
+class StatTimer {
+public:
+  explicit StatTimer(const char *name);
+
+private:
+  friend class ScopedStatTimer;
+  friend void enable_tool_stats();
+  friend bool write_tool_stats(const std::string &path);
+
+  const char *name;
+  UINT64 calls = 0;
+  std::chrono::steady_clock::duration time{0};
+  StatTimer *next;
+};
+
+// Adds the time until it goes out of scope to a StatTimer.
+class ScopedStatTimer {
+public:
+  explicit ScopedStatTimer(StatTimer &timer) : timer(timer) {
+    if (tool_stats_enabled)
+      start = std::chrono::steady_clock::now();
+  }
+
+  ~ScopedStatTimer() {
+    if (tool_stats_enabled) {
+      ++timer.calls;
+      timer.time += std::chrono::steady_clock::now() - start;
+    }
+  }
+
+  ScopedStatTimer(const ScopedStatTimer &) = delete;
+  ScopedStatTimer &operator=(const ScopedStatTimer &) = delete;
+
+private:
+  StatTimer &timer;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Records the peak size of a container. Update it after inserting into the
+// container, under the lock that protects the container.
+class PeakSize {
+public:
+  explicit PeakSize(const char *name);
+
+  void update(std::size_t size) {
+    if (tool_stats_enabled && size > peak)
+      peak = size;
+  }
+
+private:
+  friend void enable_tool_stats();
+  friend bool write_tool_stats(const std::string &path);
+
+  const char *name;
+  std::size_t peak = 0;
+  PeakSize *next;
+};
+
+#endif
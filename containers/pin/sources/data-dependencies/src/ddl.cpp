@@ -1,11 +1,16 @@
 #include "pin.H"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 #include <algorithm>
+#include <bitset>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <set>
 #include <utility>
 
@@ -13,7 +18,11 @@
 #include <sys/syscall.h>
 
 #include "create_map.h"
+#include "dependency_runs.h"
+#include "operandvalue.h"
 #include "pretty_print_operand.h"
+#include "taint_shadow.h"
+#include "virtual_instruction_table.h"
 
 using std::cerr;
 using std::endl;
@@ -44,6 +53,13 @@ KNOB<std::string>
                   "file will be of the form <prefix>.memory_dependencies.csv "
                   "and <prefix>.register_dependencies.csv.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output files. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.<table>.col files instead. Use "
+    "containers/pin/columnar.py to read them.");
+
 // Option (-shortcuts) to calculate shortcut dependencies instead of normal
 // dependencies.
 KNOB<bool> KnobShortcuts(
@@ -89,9 +105,110 @@ KNOB<bool> KnobIgnoreRbpStackMemory(
     "instruction, AND that address falls within the stack region, as indicated "
     "by memory mappings.");
 
+// Option (-libc_summaries) to apply the effect of libc routines such as
+// memcpy() on memory at once, instead of instrumenting their instructions.
+KNOB<bool> KnobLibcSummaries(
+    KNOB_MODE_WRITEONCE, "pintool", "libc_summaries", "0",
+    "When true, do not instrument the instructions of memcpy(), memmove(), "
+    "mempcpy(), memset(), strcpy(), stpcpy(), strncpy() and stpncpy(), but "
+    "apply their effect on memory at once when they are called. The call "
+    "instruction then reads the source and writes the destination.");
+
+// Option (-max_dependencies_memory) to bound the memory used to keep the found
+// dependencies.
+KNOB<UINT64> KnobMaxDependenciesMemory(
+    KNOB_MODE_WRITEONCE, "pintool", "max_dependencies_memory", "0",
+    "When set, bound the memory used to keep the found dependencies to about "
+    "this many MiB. Once they reach it, they are written to sorted run files "
+    "<prefix>.<table>.run<N>, which are merged into the output at the end. "
+    "When 0, all dependencies are kept in memory.");
+
+// Option (-taint) to only track which instructions use data derived from the
+// system calls in -syscall_file.
+KNOB<bool> KnobTaint(
+    KNOB_MODE_WRITEONCE, "pintool", "taint", "0",
+    "When true, do not record dependencies, but keep a taint bit for every "
+    "byte of memory and every register, set by the system calls in "
+    "-syscall_file, and write the instructions that read tainted data to "
+    "<prefix>.tainted_instructions.csv.");
+
+// Option (-scope_image) that determines the images to record dependencies in.
+KNOB<std::string> KnobScopeImage(
+    KNOB_MODE_APPEND, "pintool", "scope_image", "",
+    "The name of an image to record dependencies in. Note that you can repeat "
+    "this option multiple times to specify multiple images. Also see: "
+    "-range_image.");
+
+// Option (-range_image) that determines the image name of ranges of
+// instructions to record dependencies in.
+KNOB<std::string> KnobRangeImage(
+    KNOB_MODE_APPEND, "pintool", "range_image", "",
+    "The name of the image of the instruction range. Both the beginning and "
+    "end of the range are instructions in this image. Note that you can repeat "
+    "this option multiple times to specify multiple ranges. Also see: "
+    "-range_begin_offset and -range_end_offset.");
+
+// Option (-range_begin_offset) that determines the image offset of the begin
+// instruction of instruction ranges to record dependencies in.
+KNOB<ADDRINT> KnobRangeBeginOffset(
+    KNOB_MODE_APPEND, "pintool", "range_begin_offset", "",
+    "The offset of the beginning instruction of the instruction range. Note "
+    "that you can repeat this option multiple times to specify multiple "
+    "ranges. Also see: -range_image and -range_end_offset.");
+
+// Option (-range_end_offset) that determines the image offset of the
+// beyond-the-end instruction of instruction ranges to record dependencies in.
+KNOB<ADDRINT> KnobRangeEndOffset(
+    KNOB_MODE_APPEND, "pintool", "range_end_offset", "",
+    "The offset of the beyond-the-end instruction of the instruction range. "
+    "Note that you can repeat this option multiple times to specify multiple "
+    "ranges. Also see: -range_image and -range_begin_offset.");
+
+// Option (-ranges_file) that contains the path to a file that determines which
+// instruction ranges to record dependencies in.
+KNOB<std::string> KnobRangesFile(
+    KNOB_MODE_WRITEONCE, "pintool", "ranges_file", "",
+    "Set the file containing the instruction ranges to record dependencies "
+    "in. Each line in this file represents a range and should contain the "
+    "image name, begin offset, and range offset separated by whitespace. This "
+    "option is an alternative for -range_image, -range_begin_offset, and "
+    "-range_end_offset when you want to specify more instruction ranges than "
+    "allowed by the maximum argument length.");
+
+// Option (-epoch_syscalls) to start a new epoch every N system calls.
+KNOB<UINT64> KnobEpochSyscalls(
+    KNOB_MODE_WRITEONCE, "pintool", "epoch_syscalls", "0",
+    "When set, start a new epoch of dependencies every this many system "
+    "calls. See -epoch_marker.");
+
+// Option (-epoch_tracked_syscalls) to start a new epoch at every system call
+// in -syscall_file.
+KNOB<bool> KnobEpochTrackedSyscalls(
+    KNOB_MODE_WRITEONCE, "pintool", "epoch_tracked_syscalls", "0",
+    "When true, start a new epoch of dependencies at every system call in "
+    "-syscall_file. See -epoch_marker.");
+
+// Option (-epoch_marker) to start a new epoch at every call to a routine.
+KNOB<std::string> KnobEpochMarker(
+    KNOB_MODE_APPEND, "pintool", "epoch_marker", "",
+    "The name of a routine, such as MATE_FRAMEWORK_DEBUG_ANNOTATE_MEMORY, "
+    "that starts a new epoch of dependencies every time it is called. Note "
+    "that you can repeat this option multiple times. The dependencies of "
+    "epoch N are written to <prefix>.epochN.<table>.csv, and the epochs to "
+    "<prefix>.epochs.csv.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
 
+// Size in bytes of the largest register that a mov-like instruction can load.
+static constexpr ADDRINT MAX_REGISTER_SIZE = 64;
+
 // Stores the address of the application's main() function.
 static ADDRINT main_address = INVALID_ADDRESS;
 
@@ -105,25 +222,103 @@ static bool main_reached = false;
 static bool end_reached = false;
 
 // File streams to write the CSV output to.
-static ofstream memoryDependenciesFile;
-static ofstream registerDependenciesFile;
-static ofstream syscallsFile;
+static std::unique_ptr<TableWriter> memoryDependenciesFile;
+static std::unique_ptr<TableWriter> registerDependenciesFile;
+static std::unique_ptr<TableWriter> syscallsFile;
+static std::unique_ptr<TableWriter> taintedInstructionsFile;
+static std::unique_ptr<TableWriter> epochsFile;
+
+// The prefix and the format of the output files.
+static std::string csvPrefix;
+static TableFormat tableFormat;
+
+// The columns of the output files.
+static const std::vector<TableColumn> registerDependenciesColumns = {
+    {"Write_img", ColumnType::STRING, true},
+    {"Write_off", ColumnType::INT64},
+    {"Register", ColumnType::STRING},
+    {"Read_img", ColumnType::STRING, true},
+    {"Read_off", ColumnType::INT64},
+};
+
+static const std::vector<TableColumn> memoryDependenciesColumns = {
+    {"Write_img", ColumnType::STRING, true},
+    {"Write_off", ColumnType::INT64},
+    {"Memory", ColumnType::UINT64},
+    {"Read_img", ColumnType::STRING, true},
+    {"Read_off", ColumnType::INT64},
+};
+
+static const std::vector<TableColumn> syscallsColumns = {
+    {"image_name", ColumnType::STRING, true},
+    {"image_offset", ColumnType::INT64},
+    {"index", ColumnType::UINT64},
+    {"thread_id", ColumnType::UINT64},
+    {"syscall_id", ColumnType::UINT64},
+};
+
+static const std::vector<TableColumn> epochsColumns = {
+    {"epoch", ColumnType::UINT64},
+    {"cause", ColumnType::STRING},
+    {"image_name", ColumnType::STRING, true},
+    {"image_offset", ColumnType::INT64},
+    {"thread_id", ColumnType::UINT64},
+};
+
+static const std::vector<TableColumn> taintedInstructionsColumns = {
+    {"image_name", ColumnType::STRING, true},
+    {"image_offset", ColumnType::INT64},
+    {"count", ColumnType::UINT64},
+};
+
+// Represents an instruction range, i.e. the set of instructions inside an
+// image, and with an offset in the interval [begin, end[.
+struct InstructionRange {
+  InstructionRange(const std::string &image_name, ADDRINT begin_offset,
+                   ADDRINT end_offset)
+      : image_name(image_name), begin_offset(begin_offset),
+        end_offset(end_offset) {}
+
+  std::string image_name; // The name of the image of begin and end.
+  ADDRINT begin_offset;   // The offset of the begin instruction.
+  ADDRINT end_offset;     // The offset of the end instruction.
+
+  bool operator<(const InstructionRange &other) const {
+    if (this->image_name != other.image_name) {
+      return this->image_name < other.image_name;
+    }
+
+    if (this->begin_offset != other.begin_offset) {
+      return this->begin_offset < other.begin_offset;
+    }
+
+    return this->end_offset < other.end_offset;
+  }
+};
+
+// The instruction ranges to record dependencies in. If empty, dependencies are
+// recorded in all code.
+static std::set<InstructionRange> instructionRanges;
 
 // Address of a static instruction.
 struct StaticInstructionAddress {
-  StaticInstructionAddress() : image_name("???"), image_offset(-1) {}
+  StaticInstructionAddress() : image_name(UNKNOWN_NAME), image_offset(-1) {}
 
-  StaticInstructionAddress(const std::string &image_name, ADDRINT image_offset)
+  StaticInstructionAddress(NameId image_name, ADDRINT image_offset)
       : image_name(image_name), image_offset(image_offset) {}
 
-  std::string image_name; // Name of the image.
-  ADDRINT image_offset;   // Offset from the start of the image.
+  NameId image_name;    // Name of the image.
+  ADDRINT image_offset; // Offset from the start of the image.
 };
 
 // Maps a numerical instruction address (value of RIP) to a more readable
 // version of the address (image name + offset).
 static std::map<ADDRINT, StaticInstructionAddress> staticInstructionAddresses;
 
+// Maps the name of each image in staticInstructionAddresses to its filename,
+// so that the filename is not computed again for every row of the output.
+static std::map<NameId, std::string> imageFilenames;
+
 // Maps each (thread, register) pair to the address of the instruction that last
 // wrote to that register in that thread.
 static std::map<std::pair<THREADID, REG>, ADDRINT> lastRegisterWrite;
@@ -146,30 +341,222 @@ static std::map<ADDRINT, ADDRINT> lastMemoryWrite;
 static std::map<ADDRINT, std::set<std::pair<ADDRINT, ADDRINT>>>
     memoryDependencies;
 
+// Approximate size in bytes of a dependency in registerDependencies or
+// memoryDependencies: a node of a std::set, and the overhead of the allocator.
+static constexpr UINT64 DEPENDENCY_SIZE = 64;
+
+// The maximum number of dependencies of each kind that are kept in memory, or
+// 0 to keep all of them, for -max_dependencies_memory.
+static UINT64 maxDependenciesInMemory = 0;
+
+// The number of dependencies in registerDependencies and memoryDependencies.
+static UINT64 registerDependenciesCount = 0;
+static UINT64 memoryDependenciesCount = 0;
+
+// The run files that the dependencies are spilled to, with
+// -max_dependencies_memory.
+static std::unique_ptr<DependencyRuns> registerDependencyRuns;
+static std::unique_ptr<DependencyRuns> memoryDependencyRuns;
+
+// The taint bit of every byte of memory, for -taint.
+static TaintShadow taintShadow;
+
+// The taint state of a thread, for -taint. Only the thread itself uses it
+// until Fini(), so it needs no lock.
+struct TaintThreadData {
+  // The registers that hold tainted data, indexed by full register.
+  std::bitset<REG_LAST> registers;
+
+  // Whether the instruction that the thread is executing has read tainted
+  // data.
+  bool instruction_tainted = false;
+
+  // Maps each instruction that read tainted data in this thread to the number
+  // of times it did.
+  std::map<ADDRINT, UINT64> tainted_instructions;
+};
+
+// Key for the TaintThreadData of every thread, for -taint. Initialised once in
+// main().
+static TLS_KEY taintTlsKey = INVALID_TLS_KEY;
+
+// The TaintThreadData of every thread that was started, for -taint. Kept
+// until Fini(), which adds up their counts.
+static std::vector<std::unique_ptr<TaintThreadData>> taintThreadDatas;
+
+// Maps each instruction that read tainted data to the number of times it did,
+// for -taint. Only holds the calls of summarized routines until Fini().
+static std::map<ADDRINT, UINT64> taintedInstructions;
+
+// Mutex for taintShadow, taintThreadDatas and taintedInstructions.
+static StatMutex taintLock("taintLock");
+
+// An access to a register or memory by out-of-scope code, when scoping.
+struct ExternalAccess {
+  enum Kind : UINT8 { RegisterRead, RegisterWrite, MemoryRead, MemoryWrite };
+
+  Kind kind;
+
+  // The full register, or the address of the memory.
+  ADDRINT location;
+
+  // The number of bytes of memory.
+  ADDRINT size;
+};
+
+// The state of out-of-scope code on a thread, when scoping. Only the thread
+// itself uses it until Fini(), so it needs no lock.
+//
+// Out-of-scope code takes no lock: it only appends its accesses to a buffer.
+// They are applied to the last writers, under registerLock and memoryLock, when
+// the thread runs in-scope code again, or when the buffer is full.
+struct ExternalThreadData {
+  explicit ExternalThreadData(THREADID threadID) : thread_id(threadID) {}
+
+  // Returns the instruction that out-of-scope code writes on behalf of: the
+  // innermost in-scope call that did not return yet, or INVALID_ADDRESS.
+  ADDRINT writer() const {
+    return calls.empty() ? INVALID_ADDRESS : calls.back().second;
+  }
+
+  THREADID thread_id;
+
+  // The in-scope calls that did not return yet, as pairs of the location of
+  // their return address on the stack and their address. The innermost call
+  // is last. An in-scope routine that is called from out-of-scope code, such
+  // as a qsort() comparator, restores the call that out-of-scope code writes
+  // on behalf of when it returns.
+  std::vector<std::pair<ADDRINT, ADDRINT>> calls;
+
+  // Whether the thread may have run out-of-scope code since it last ran
+  // in-scope code, i.e. whether it left in-scope code through a call or a
+  // return. Read by an inlined analysis routine, hence an ADDRINT.
+  ADDRINT left_scope = 0;
+
+  // The accesses of out-of-scope code that were not applied yet, in order.
+  std::vector<ExternalAccess> accesses;
+
+  // The registers that out-of-scope code read and wrote since the thread last
+  // ran in-scope code. Reading them again adds no dependencies, and writing
+  // them again does not change their last writer.
+  std::bitset<REG_LAST> registers_read;
+  std::bitset<REG_LAST> registers_written;
+};
+
+// Maximal number of accesses of out-of-scope code on a thread that are
+// buffered before they are applied.
+static constexpr size_t MAX_EXTERNAL_ACCESSES = 4096;
+
+// Whether out-of-scope code writes on behalf of in-scope calls, i.e. when
+// scoping without -taint. Initialised once in main().
+static bool externalWritersEnabled = false;
+
+// The tool register that holds the ExternalThreadData of every thread, when
+// scoping. Initialised once in main().
+static REG externalStateRegister = REG_INVALID();
+
+// Key for the ExternalThreadData of every thread, when scoping, for the
+// callbacks that do not get the tool register. Initialised once in main().
+static TLS_KEY externalTlsKey = INVALID_TLS_KEY;
+
+// The ExternalThreadData of every thread that was started, when scoping. Kept
+// until Fini(), which applies their remaining accesses.
+static std::vector<std::unique_ptr<ExternalThreadData>> externalThreadDatas;
+
+// Mutex for externalThreadDatas.
+static StatMutex externalThreadDatasLock("externalThreadDatasLock");
+
+// Whether the dependencies are partitioned in epochs.
+static bool epochsEnabled = false;
+
+// The current epoch. Its dependencies are the ones in registerDependencies and
+// memoryDependencies.
+static UINT64 epoch = 0;
+
+// The number of system calls since main() was reached, for -epoch_syscalls.
+static UINT64 epochSyscallCount = 0;
+
+// Mutex for epoch and epochsFile.
+static StatMutex epochLock("epochLock");
+
 // Mutex for the register-related data structures.
-static PIN_MUTEX registerLock;
+static StatMutex registerLock("registerLock");
 
 // Mutex for the memory-related data structures.
-static PIN_MUTEX memoryLock;
+static StatMutex memoryLock("memoryLock");
 
 // Mutex for sysCallInstructions.
-static PIN_MUTEX sysCallInstructionsLock;
+static StatMutex sysCallInstructionsLock("sysCallInstructionsLock");
 
 // Mutex for sysCallIdMap.
-static PIN_MUTEX sysCallIdMapLock;
+static StatMutex sysCallIdMapLock("sysCallIdMapLock");
 
 // Mutex for staticInstructionAddresses.
-static PIN_MUTEX staticInstructionAddressesLock;
+static StatMutex
+    staticInstructionAddressesLock("staticInstructionAddressesLock");
 
 // Mutex for initialStackPointers.
-static PIN_MUTEX initialStackPointersLock;
+static StatMutex initialStackPointersLock("initialStackPointersLock");
 
-// Map to reuse virtual instructions with the same set of predecessors.
-static std::map<std::set<std::pair<ADDRINT, ADDRINT>>, ADDRINT>
-    virtualInstructionsMap;
+// Table to reuse virtual instructions with the same predecessors.
+static VirtualInstructionTable virtualInstructions;
 
 static ADDRINT virtualInstructionCounter = 0;
 
+// The epoch in which the predecessors of each virtual instruction were last
+// added to the dependencies, indexed by the number of the virtual instruction.
+// Protected by staticInstructionAddressesLock, like virtualInstructions.
+static std::vector<UINT64> virtualInstructionEpochs;
+
+// The kinds of libc routines that -libc_summaries applies a summary for.
+enum class LibcSummary {
+  NONE,
+  MEMORY_COPY,        // memcpy(dst, src, size)
+  MEMORY_SET,         // memset(dst, value, size)
+  STRING_COPY,        // strcpy(dst, src)
+  STRING_COPY_BOUNDED // strncpy(dst, src, size)
+};
+
+// Maps the names of the libc routines to their summaries.
+// clang-format off
+static const std::map<std::string, LibcSummary> libcSummaries =
+    create_map<std::string, LibcSummary>
+
+    ("memcpy", LibcSummary::MEMORY_COPY)
+    ("memmove", LibcSummary::MEMORY_COPY)
+    ("mempcpy", LibcSummary::MEMORY_COPY)
+    ("memset", LibcSummary::MEMORY_SET)
+    ("strcpy", LibcSummary::STRING_COPY)
+    ("stpcpy", LibcSummary::STRING_COPY)
+    ("strncpy", LibcSummary::STRING_COPY_BOUNDED)
+    ("stpncpy", LibcSummary::STRING_COPY_BOUNDED)
+
+    ;
+// clang-format on
+
+// Maps the start address of each summarized routine to its end address. Only
+// used during instrumentation, which Pin serializes.
+static std::map<ADDRINT, ADDRINT> summarizedRoutines;
+
+// A call instruction that may call a summarized routine.
+struct CallSite {
+  ADDRINT address; // Address of the call instruction.
+  bool in_scope;   // Whether dependencies are recorded for the call.
+};
+
+// Maps the address following each call instruction to that call instruction,
+// to find the call site of a summarized routine from its return address. Only
+// filled with -libc_summaries.
+static std::map<ADDRINT, CallSite> callSites;
+
+// Mutex for callSites.
+static StatMutex callSitesLock("callSitesLock");
+
+// The full registers that a summarized routine may write: the caller-saved
+// registers of the calling convention, which include the one that holds the
+// return value. Initialised once in main().
+static std::vector<REG> summaryClobberedRegisters;
+
 // Map containing the operand overrides for each mov-like instruction. See the
 // documentation of AddWriteAnalysisCalls for more information.
 static const std::map<OPCODE, std::map<UINT32, UINT32>> movOperandMap =
@@ -292,6 +679,53 @@ static std::map<SyscallInfo, ADDRINT> sysCallInstructions;
 // Keep track of how many times we executed any system call in each tread.
 static std::map<THREADID, unsigned int> sysCallIdMap;
 
+// Statistics for -tool_stats.
+static CallCounter instructionBeforeCalls("InstructionBefore");
+static CallCounter instructionCallBeforeCalls("InstructionCallBefore");
+static CallCounter libcStartMainBeforeCalls("LibcStartMainBefore");
+static CallCounter registerWriteBeforeCalls("RegisterWriteBefore");
+static CallCounter
+    registerWriteBeforeMovRegToRegCalls("RegisterWriteBeforeMovRegToReg");
+static CallCounter
+    registerWriteBeforeMovMemToRegCalls("RegisterWriteBeforeMovMemToReg");
+static CallCounter registerReadBeforeCalls("RegisterReadBefore");
+static CallCounter memoryWriteBeforeCalls("MemoryWriteBefore");
+static CallCounter
+    memoryWriteBeforeMovRegToMemCalls("MemoryWriteBeforeMovRegToMem");
+static CallCounter
+    memoryWriteBeforeMovMemToMemCalls("MemoryWriteBeforeMovMemToMem");
+static CallCounter memoryReadBeforeCalls("MemoryReadBefore");
+static CallCounter memoryCopySummaryCalls("MemoryCopySummary");
+static CallCounter memorySetSummaryCalls("MemorySetSummary");
+static CallCounter stringCopySummaryCalls("StringCopySummary");
+static CallCounter
+    stringCopyBoundedSummaryCalls("StringCopyBoundedSummary");
+static CallCounter epochMarkerBeforeCalls("EpochMarkerBefore");
+static CallCounter scopeEnterBeforeCalls("ScopeEnterBefore");
+static CallCounter scopeCallBeforeCalls("ScopeCallBefore");
+static CallCounter scopeReturnBeforeCalls("ScopeReturnBefore");
+static CallCounter externalRegisterReadCalls("ExternalRegisterRead");
+static CallCounter externalMemoryReadCalls("ExternalMemoryRead");
+static CallCounter externalRegisterWriteCalls("ExternalRegisterWrite");
+static CallCounter externalMemoryWriteCalls("ExternalMemoryWrite");
+static CallCounter taintRegisterReadCalls("TaintRegisterRead");
+static CallCounter taintMemoryReadCalls("TaintMemoryRead");
+static CallCounter taintRegisterWriteCalls("TaintRegisterWrite");
+static CallCounter taintMemoryWriteCalls("TaintMemoryWrite");
+static CallCounter taintInstructionAfterCalls("TaintInstructionAfter");
+static StatTimer onInstructionTimer("OnInstruction");
+static StatTimer finiTimer("Fini");
+static PeakSize lastRegisterWriteSize("lastRegisterWrite");
+static PeakSize lastMemoryWriteSize("lastMemoryWrite");
+static PeakSize registerDependenciesSize("registerDependencies");
+static PeakSize memoryDependenciesSize("memoryDependencies");
+static PeakSize staticInstructionAddressesSize("staticInstructionAddresses");
+static PeakSize taintShadowSize("taintShadow");
+static StatTimer epochTimer("Epoch");
+
+// Path of the -tool_stats output, if enabled.
+static std::string toolStatsPath;
+
 // =============================================================================
 // Helper functions
 // =============================================================================
@@ -311,12 +745,562 @@ std::string get_filename(const std::string &path) {
   }
 }
 
+// Get the filename of an image, given its name. The caller must hold
+// staticInstructionAddressesLock.
+const std::string &get_image_filename(NameId image_name) {
+  auto it = imageFilenames.find(image_name);
+
+  if (it == imageFilenames.end()) {
+    it = imageFilenames
+             .insert(std::make_pair(image_name,
+                                    get_filename(get_name(image_name))))
+             .first;
+  }
+
+  return it->second;
+}
+
+// Write the dependencies of one kind to a new run file, and remove them from
+// memory. If the run file cannot be written, all dependencies are kept in
+// memory from now on.
+template <typename Map>
+void spill_dependencies(Map &dependencies, UINT64 &count, DependencyRuns &runs,
+                        PeakSize &size) {
+  size.update(dependencies.size());
+
+  if (!runs.write_run(dependencies)) {
+    std::cerr << "Could not write a run file of dependencies, keeping them in "
+                 "memory instead.\n";
+    maxDependenciesInMemory = 0;
+    return;
+  }
+
+  dependencies.clear();
+  count = 0;
+}
+
+// Add a dependency through a register. The caller must hold registerLock.
+void add_register_dependency(ADDRINT ip_read, REG reg, ADDRINT ip_write) {
+  if (!registerDependencies[ip_read]
+           .insert(std::make_pair(reg, ip_write))
+           .second)
+    return;
+
+  if (++registerDependenciesCount == maxDependenciesInMemory) {
+    spill_dependencies(registerDependencies, registerDependenciesCount,
+                       *registerDependencyRuns, registerDependenciesSize);
+  }
+}
+
+// Add a dependency through a memory address. The caller must hold memoryLock.
+void add_memory_dependency(ADDRINT ip_read, ADDRINT memLoc, ADDRINT ip_write) {
+  if (!memoryDependencies[ip_read]
+           .insert(std::make_pair(memLoc, ip_write))
+           .second)
+    return;
+
+  if (++memoryDependenciesCount == maxDependenciesInMemory) {
+    spill_dependencies(memoryDependencies, memoryDependenciesCount,
+                       *memoryDependencyRuns, memoryDependenciesSize);
+  }
+}
+
+// Applies the buffered accesses of out-of-scope code on a thread: the external
+// writer depends on the last writers of the registers and memory it reads,
+// unless out-of-scope code wrote them on its behalf, and becomes the last
+// writer of the registers and memory it writes.
+void apply_external_accesses(ExternalThreadData &data) {
+  if (data.accesses.empty())
+    return;
+
+  const ADDRINT externalWriter = data.writer();
+
+  registerLock.lock();
+  memoryLock.lock();
+
+  for (const ExternalAccess &access : data.accesses) {
+    const auto reg = std::make_pair(data.thread_id, (REG)access.location);
+    const ADDRINT memLoc = access.location;
+
+    switch (access.kind) {
+    case ExternalAccess::RegisterRead: {
+      auto it = lastRegisterWrite.find(reg);
+      if ((it != lastRegisterWrite.end()) && (it->second != externalWriter))
+        add_register_dependency(externalWriter, reg.second, it->second);
+      break;
+    }
+
+    case ExternalAccess::RegisterWrite:
+      if (externalWriter != INVALID_ADDRESS)
+        lastRegisterWrite[reg] = externalWriter;
+      else
+        lastRegisterWrite.erase(reg);
+      break;
+
+    case ExternalAccess::MemoryRead:
+      for (auto it = lastMemoryWrite.lower_bound(memLoc);
+           (it != lastMemoryWrite.end()) && (it->first < memLoc + access.size);
+           ++it) {
+        if (it->second != externalWriter)
+          add_memory_dependency(externalWriter, it->first, it->second);
+      }
+      break;
+
+    case ExternalAccess::MemoryWrite:
+      if (externalWriter != INVALID_ADDRESS) {
+        for (ADDRINT writtenAddr = memLoc; writtenAddr < memLoc + access.size;
+             ++writtenAddr) {
+          lastMemoryWrite[writtenAddr] = externalWriter;
+        }
+      } else {
+        lastMemoryWrite.erase(
+            lastMemoryWrite.lower_bound(memLoc),
+            lastMemoryWrite.lower_bound(memLoc + access.size));
+      }
+      break;
+    }
+  }
+
+  lastRegisterWriteSize.update(lastRegisterWrite.size());
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+
+  memoryLock.unlock();
+  registerLock.unlock();
+
+  data.accesses.clear();
+}
+
+// Buffers an access of out-of-scope code on a thread, and applies the buffer
+// if it is full.
+inline void add_external_access(ExternalThreadData &data,
+                                ExternalAccess::Kind kind, ADDRINT location,
+                                ADDRINT size) {
+  data.accesses.push_back({kind, location, size});
+
+  if (data.accesses.size() >= MAX_EXTERNAL_ACCESSES)
+    apply_external_accesses(data);
+}
+
+// Applies the buffered accesses of out-of-scope code on a thread, before the
+// last writers are used by anything else than out-of-scope code of the thread.
+void apply_external_accesses(THREADID threadID) {
+  if (!externalWritersEnabled)
+    return;
+
+  apply_external_accesses(*static_cast<ExternalThreadData *>(
+      PIN_GetThreadData(externalTlsKey, threadID)));
+}
+
+// Returns the instruction that out-of-scope code on a thread writes on behalf
+// of, or INVALID_ADDRESS if there is none. Applies the buffered accesses of
+// out-of-scope code on the thread first.
+ADDRINT get_external_writer(THREADID threadID) {
+  if (!externalWritersEnabled)
+    return INVALID_ADDRESS;
+
+  ExternalThreadData &data = *static_cast<ExternalThreadData *>(
+      PIN_GetThreadData(externalTlsKey, threadID));
+
+  apply_external_accesses(data);
+
+  return data.writer();
+}
+
+// Call 'callback' with every dependency of one kind, in order. If some
+// dependencies were spilled to run files, the runs are merged with the
+// dependencies that are still in memory.
+template <typename Map, typename Callback>
+void for_each_dependency(Map &dependencies, DependencyRuns *runs,
+                         Callback callback) {
+  if (runs && !runs->empty()) {
+    if (!runs->merge(dependencies, callback)) {
+      std::cerr << "ERROR: Could not merge the run files of dependencies. The "
+                   "output is incomplete, and the run files are kept.\n";
+    }
+
+    return;
+  }
+
+  for (const auto &instructionEntry : dependencies) {
+    for (const auto &dependency : instructionEntry.second) {
+      callback(DependencyRecord{instructionEntry.first,
+                                static_cast<ADDRINT>(dependency.first),
+                                dependency.second});
+    }
+  }
+}
+
+// Write the dependencies of the current epoch to the output files, and remove
+// them from memory. The caller must hold registerLock and memoryLock.
+void write_dependencies() {
+  registerDependenciesSize.update(registerDependencies.size());
+  memoryDependenciesSize.update(memoryDependencies.size());
+
+  staticInstructionAddressesLock.lock();
+
+  // Write register dependencies to CSV file. The offset columns are signed, so
+  // unknown offsets are written as -1.
+  for_each_dependency(
+      registerDependencies, registerDependencyRuns.get(),
+      [](const DependencyRecord &dependency) {
+        const StaticInstructionAddress &address_read =
+            staticInstructionAddresses[dependency.read];
+        const StaticInstructionAddress &address_write =
+            staticInstructionAddresses[dependency.write];
+        REG reg = static_cast<REG>(dependency.location);
+
+        *registerDependenciesFile
+            << get_image_filename(address_write.image_name) // Write_img
+            << address_write.image_offset                   // Write_off
+            << REG_StringShort(reg)                         // Register
+            << get_image_filename(address_read.image_name)  // Read_img
+            << address_read.image_offset;                   // Read_off
+      });
+
+  // Write memory dependencies to CSV file.
+  for_each_dependency(
+      memoryDependencies, memoryDependencyRuns.get(),
+      [](const DependencyRecord &dependency) {
+        const StaticInstructionAddress &address_read =
+            staticInstructionAddresses[dependency.read];
+        const StaticInstructionAddress &address_write =
+            staticInstructionAddresses[dependency.write];
+
+        *memoryDependenciesFile
+            << get_image_filename(address_write.image_name) // Write_img
+            << address_write.image_offset                   // Write_off
+            << dependency.location                          // Memory
+            << get_image_filename(address_read.image_name)  // Read_img
+            << address_read.image_offset;                   // Read_off
+      });
+
+  staticInstructionAddressesLock.unlock();
+
+  registerDependencies.clear();
+  memoryDependencies.clear();
+  registerDependenciesCount = 0;
+  memoryDependenciesCount = 0;
+}
+
+// Open the dependency files of the current epoch.
+void open_dependency_files() {
+  std::string prefix = csvPrefix;
+
+  if (epochsEnabled)
+    prefix += ".epoch" + std::to_string(epoch);
+
+  memoryDependenciesFile = open_table(prefix + ".memory_dependencies",
+                                      tableFormat, memoryDependenciesColumns);
+  registerDependenciesFile =
+      open_table(prefix + ".register_dependencies", tableFormat,
+                 registerDependenciesColumns);
+}
+
+// Record the start of the current epoch in the epochs file. The caller must
+// hold epochLock.
+void write_epoch(const std::string &cause, ADDRINT ip, THREADID threadID) {
+  // The first epoch does not start at an instruction.
+  const SymbolLocation location =
+      (ip != INVALID_ADDRESS) ? find_symbol(ip) : SymbolLocation();
+
+  *epochsFile << epoch                                       // epoch
+              << cause                                       // cause
+              << get_filename(get_name(location.image_name)) // image_name
+              << location.image_offset                       // image_offset
+              << threadID;                                   // thread_id
+}
+
+// End the current epoch, and start the next one, because of the instruction at
+// 'ip' on a thread. The dependencies of the current epoch are written to its
+// output files, and freed.
+void start_next_epoch(const std::string &cause, ADDRINT ip,
+                      THREADID threadID) {
+  if (!main_reached || end_reached)
+    return;
+
+  ScopedStatTimer timer(epochTimer);
+
+  // The accesses of out-of-scope code on the thread belong to the current
+  // epoch. Those of other threads are applied when they run in-scope code.
+  apply_external_accesses(threadID);
+
+  registerLock.lock();
+  memoryLock.lock();
+  epochLock.lock();
+
+  write_dependencies();
+  memoryDependenciesFile->close();
+  registerDependenciesFile->close();
+
+  ++epoch;
+  open_dependency_files();
+  write_epoch(cause, ip, threadID);
+
+  epochLock.unlock();
+  memoryLock.unlock();
+  registerLock.unlock();
+}
+
+// Get the taint of the registers of a thread, for -taint.
+TaintThreadData &get_taint_thread_data(THREADID threadID) {
+  return *static_cast<TaintThreadData *>(
+      PIN_GetThreadData(taintTlsKey, threadID));
+}
+
+// Returns whether dependencies are recorded for the instruction at a location,
+// according to -scope_image and the instruction ranges.
+bool is_in_scope(const SymbolLocation &location) {
+  if (instructionRanges.empty())
+    return true;
+
+  std::string image_name = get_filename(get_name(location.image_name));
+  ADDRINT image_offset = location.image_offset;
+
+  for (const auto &range : instructionRanges) {
+    if ((image_name == range.image_name) &&
+        (range.begin_offset <= image_offset) &&
+        (image_offset < range.end_offset))
+      return true;
+  }
+
+  return false;
+}
+
+// Get the summary for a routine, given its name. Besides the names in
+// libcSummaries, this also recognises the implementations that glibc selects
+// through IFUNC symbols, such as __memmove_avx_unaligned_erms. The _chk
+// variants are not summarized, since they fall through or jump to one of these
+// implementations after checking their arguments.
+LibcSummary get_libc_summary(const std::string &name) {
+  if (name.find("_chk") != std::string::npos)
+    return LibcSummary::NONE;
+
+  std::string base_name = name;
+
+  if (base_name.compare(0, 2, "__") == 0) {
+    base_name = base_name.substr(2);
+    base_name = base_name.substr(0, base_name.find('_'));
+  }
+
+  auto it = libcSummaries.find(base_name);
+
+  return (it != libcSummaries.end()) ? it->second : LibcSummary::NONE;
+}
+
+// Check whether an instruction lies in a summarized routine.
+bool is_in_summarized_routine(ADDRINT address) {
+  auto it = summarizedRoutines.upper_bound(address);
+
+  if (it == summarizedRoutines.begin())
+    return false;
+
+  --it;
+
+  return address < it->second;
+}
+
+// Get the instruction that a call of a summarized routine on a thread writes on
+// behalf of, given the address it returns to: the call instruction if it is in
+// scope, or otherwise the external writer of the thread, which may be
+// INVALID_ADDRESS. Returns false if the call instruction was not instrumented,
+// which happens for calls from within a summarized routine.
+bool get_summary_writer(THREADID threadID, ADDRINT return_address,
+                        ADDRINT &writer, bool &in_scope) {
+  callSitesLock.lock();
+
+  auto it = callSites.find(return_address);
+  const bool found = (it != callSites.end());
+
+  if (found) {
+    writer = it->second.address;
+    in_scope = it->second.in_scope;
+  }
+
+  callSitesLock.unlock();
+
+  if (found && !in_scope)
+    writer = get_external_writer(threadID);
+
+  return found;
+}
+
+// Returns the full registers that a summarized routine may write, for
+// summaryClobberedRegisters.
+std::vector<REG> get_caller_saved_registers() {
+#ifdef TARGET_IA32E
+  const std::vector<REG> general_purpose_registers = {
+      REG_RAX, REG_RCX, REG_RDX, REG_RSI, REG_RDI,
+      REG_R8,  REG_R9,  REG_R10, REG_R11};
+  const int vector_register_count = 16;
+#else
+  const std::vector<REG> general_purpose_registers = {REG_EAX, REG_ECX,
+                                                      REG_EDX};
+  const int vector_register_count = 8;
+#endif
+
+  std::set<REG> registers;
+
+  for (REG reg : general_purpose_registers)
+    registers.insert(REG_FullRegName(reg));
+
+  registers.insert(REG_FullRegName(REG_GFLAGS));
+
+  for (int i = 0; i < vector_register_count; ++i) {
+    registers.insert(REG_FullRegName(static_cast<REG>(REG_XMM0 + i)));
+    registers.insert(REG_FullRegName(static_cast<REG>(REG_YMM0 + i)));
+  }
+
+  return std::vector<REG>(registers.begin(), registers.end());
+}
+
+// Apply the effect of a summarized routine on the registers of a thread: the
+// writer becomes the last writer of the registers that the routine may write,
+// such as the returned pointer in %rax. If the writer is INVALID_ADDRESS, they
+// have no last writer. With -taint, they are untainted, since they only hold
+// pointers and sizes once the routine returns.
+void summarize_register_writes(THREADID threadID, ADDRINT writer) {
+  if (KnobTaint.Value()) {
+    TaintThreadData &thread_data = get_taint_thread_data(threadID);
+
+    for (REG reg : summaryClobberedRegisters)
+      thread_data.registers.reset(reg);
+
+    return;
+  }
+
+  registerLock.lock();
+
+  for (REG reg : summaryClobberedRegisters) {
+    if (writer != INVALID_ADDRESS)
+      lastRegisterWrite[std::make_pair(threadID, reg)] = writer;
+    else
+      lastRegisterWrite.erase(std::make_pair(threadID, reg));
+  }
+
+  lastRegisterWriteSize.update(lastRegisterWrite.size());
+
+  registerLock.unlock();
+}
+
+// Get the number of bytes that strcpy() copies from a string, including the
+// terminating null character, but at most max_size.
+ADDRINT get_string_copy_size(ADDRINT src, ADDRINT max_size) {
+  char buffer[64];
+  ADDRINT size = 0;
+
+  while (size < max_size) {
+    const size_t chunk_size =
+        std::min<ADDRINT>(sizeof(buffer), max_size - size);
+    const size_t copied =
+        PIN_SafeCopy(buffer, reinterpret_cast<VOID *>(src + size), chunk_size);
+
+    for (size_t i = 0; i < copied; ++i) {
+      if (buffer[i] == '\0')
+        return size + i + 1;
+    }
+
+    size += copied;
+
+    // The rest of the string is not readable.
+    if (copied < chunk_size)
+      break;
+  }
+
+  return size;
+}
+
+// Apply the effect of a summarized routine that sets the bytes [dst, dst +
+// size) on the memory map: the writer becomes their last writer. If the writer
+// is INVALID_ADDRESS, they have no last writer, as for out-of-scope code. The
+// caller must hold memoryLock.
+void summarize_memory_set(ADDRINT writer, ADDRINT dst, ADDRINT size) {
+  // With -taint, the set bytes hold constant data.
+  if (KnobTaint.Value()) {
+    taintLock.lock();
+    taintShadow.set(dst, size, false);
+    taintLock.unlock();
+    return;
+  }
+
+  if (writer == INVALID_ADDRESS) {
+    lastMemoryWrite.erase(lastMemoryWrite.lower_bound(dst),
+                          lastMemoryWrite.lower_bound(dst + size));
+    return;
+  }
+
+  for (ADDRINT writtenAddr = dst; writtenAddr < dst + size; ++writtenAddr) {
+    lastMemoryWrite[writtenAddr] = writer;
+  }
+
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+}
+
+// Apply the effect of a summarized routine that copies the bytes [src, src +
+// size) to [dst, dst + size) on the memory map. With -shortcuts, the copied
+// bytes keep their last writers, as with a mov-like instruction. Otherwise,
+// the writer depends on the last writers of the source, and becomes the last
+// writer of the destination. The ranges may overlap, as for memmove(). The
+// caller must hold memoryLock.
+//
+// The writer is the call site if 'in_scope' is set, or else the external
+// writer, which does not depend on the bytes that out-of-scope code wrote on
+// its behalf.
+void summarize_memory_copy(ADDRINT writer, bool in_scope, ADDRINT dst,
+                           ADDRINT src, ADDRINT size) {
+  // With -taint, the copied bytes keep their taint, and the call site reads
+  // tainted data if the source holds any. Out-of-scope call sites are not
+  // counted.
+  if (KnobTaint.Value()) {
+    taintLock.lock();
+
+    if (in_scope && taintShadow.any(src, size))
+      ++taintedInstructions[writer];
+
+    taintShadow.copy(dst, src, size);
+    taintLock.unlock();
+    return;
+  }
+
+  // Only visit the bytes of the source that were written, since the copied
+  // ranges can be large.
+  auto first = lastMemoryWrite.lower_bound(src);
+  auto last = lastMemoryWrite.lower_bound(src + size);
+
+  if (!KnobShortcuts.Value()) {
+    if (writer != INVALID_ADDRESS) {
+      for (auto it = first; it != last; ++it) {
+        if (in_scope || (it->second != writer))
+          add_memory_dependency(writer, it->first, it->second);
+      }
+    }
+
+    summarize_memory_set(writer, dst, size);
+    return;
+  }
+
+  // Collect the last writers of the source before updating the destination.
+  // The bytes of the destination whose source has no last writer have none
+  // either.
+  std::vector<std::pair<ADDRINT, ADDRINT>> lastWrites(first, last);
+
+  lastMemoryWrite.erase(lastMemoryWrite.lower_bound(dst),
+                        lastMemoryWrite.lower_bound(dst + size));
+
+  for (const auto &lastWrite : lastWrites) {
+    lastMemoryWrite[dst + (lastWrite.first - src)] = lastWrite.second;
+  }
+
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+}
+
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
 // Run before every instruction.
 VOID InstructionBefore(ADDRINT instruction_pointer) {
+  instructionBeforeCalls.count();
+
   // Check if main if reached yet.
   if (instruction_pointer == main_address) {
     std::cerr << "\nMain reached, setting global flag.\n";
@@ -334,6 +1318,8 @@ VOID InstructionBefore(ADDRINT instruction_pointer) {
 // Runs before every call instruction.
 VOID InstructionCallBefore(ADDRINT target_address,
                            ADDRINT next_instruction_pointer) {
+  instructionCallBeforeCalls.count();
+
   // Check if this is the first call to main().
   if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
     std::cerr << "\nMain called, next ip = " << std::hex << std::showbase
@@ -344,6 +1330,8 @@ VOID InstructionCallBefore(ADDRINT target_address,
 
 // Run at the start of __libc_start_main().
 VOID LibcStartMainBefore(THREADID, ADDRINT main_addr) {
+  libcStartMainBeforeCalls.count();
+
   std::cerr << "\n__libc_start_main(main = " << std::hex << std::showbase
             << main_addr << std::dec << ", ...)\n";
 
@@ -353,17 +1341,20 @@ VOID LibcStartMainBefore(THREADID, ADDRINT main_addr) {
 // Run before every write to a register, excluding those handled by the next
 // couple of functions.
 VOID RegisterWriteBefore(THREADID threadID, ADDRINT ip, ADDRINT reg_) {
+  registerWriteBeforeCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
   REG reg = (REG)reg_;
 
-  PIN_MutexLock(&registerLock);
+  registerLock.lock();
 
   // Update register map.
   lastRegisterWrite[std::make_pair(threadID, reg)] = ip;
+  lastRegisterWriteSize.update(lastRegisterWrite.size());
 
-  PIN_MutexUnlock(&registerLock);
+  registerLock.unlock();
 }
 
 // Run before every write to a register that is:
@@ -372,13 +1363,15 @@ VOID RegisterWriteBefore(THREADID threadID, ADDRINT ip, ADDRINT reg_) {
 // i.e. mov dst_reg, src_reg
 VOID RegisterWriteBeforeMovRegToReg(THREADID threadID, ADDRINT ip,
                                     ADDRINT dst_reg_, ADDRINT src_reg_) {
+  registerWriteBeforeMovRegToRegCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
   REG src_reg = (REG)src_reg_;
   REG dst_reg = (REG)dst_reg_;
 
-  PIN_MutexLock(&registerLock);
+  registerLock.lock();
 
   // Update register map.
   if (lastRegisterWrite.count(std::make_pair(threadID, src_reg))) {
@@ -386,7 +1379,9 @@ VOID RegisterWriteBeforeMovRegToReg(THREADID threadID, ADDRINT ip,
         lastRegisterWrite[std::make_pair(threadID, src_reg)];
   }
 
-  PIN_MutexUnlock(&registerLock);
+  lastRegisterWriteSize.update(lastRegisterWrite.size());
+
+  registerLock.unlock();
 }
 
 // Run before every write to a register that is:
@@ -396,84 +1391,110 @@ VOID RegisterWriteBeforeMovRegToReg(THREADID threadID, ADDRINT ip,
 VOID RegisterWriteBeforeMovMemToReg(THREADID threadID, ADDRINT ip,
                                     ADDRINT dst_reg_, ADDRINT src_memLoc,
                                     ADDRINT src_size) {
+  registerWriteBeforeMovMemToRegCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
   REG dst_reg = (REG)dst_reg_;
 
-  PIN_MutexLock(&registerLock);
-  PIN_MutexLock(&memoryLock);
+  registerLock.lock();
+  memoryLock.lock();
 
   // Update register map.
 
-  // Keep track of (memory_address, instruction_address) of the last writes.
-  std::set<std::pair<ADDRINT, ADDRINT>> lastWrites;
-  std::set<ADDRINT> lastWriteInstructions;
+  // Keep track of (memory_address, instruction_address) of the last writes,
+  // which are sorted by memory address, and whether they all come from the
+  // same instruction.
+  assert((src_size <= MAX_REGISTER_SIZE) && "Register too large!");
+
+  LastWrite lastWrites[MAX_REGISTER_SIZE];
+  size_t lastWritesCount = 0;
+  bool singleInstruction = true;
 
   for (ADDRINT readAddr = src_memLoc; readAddr < src_memLoc + src_size;
        ++readAddr) {
-    if (lastMemoryWrite.count(readAddr)) {
-      lastWriteInstructions.insert(lastMemoryWrite[readAddr]);
-      lastWrites.insert(std::pair(readAddr, lastMemoryWrite[readAddr]));
+    auto it = lastMemoryWrite.find(readAddr);
+    if (it != lastMemoryWrite.end()) {
+      if ((lastWritesCount > 0) && (lastWrites[0].second != it->second))
+        singleInstruction = false;
+
+      lastWrites[lastWritesCount++] = LastWrite(readAddr, it->second);
     }
   }
 
-  if (lastWriteInstructions.size() == 0)
+  if (lastWritesCount == 0)
     ; // Nothing to do, as we haven't found an instruction that wrote to the
       // read memory location.
-  else if (lastWriteInstructions.size() == 1)
+  else if (singleInstruction)
     // Simple case: we found one instruction that wrote to the read memory
     // location.
-    lastRegisterWrite[std::make_pair(threadID, dst_reg)] =
-        *lastWriteInstructions.cbegin();
+    lastRegisterWrite[std::make_pair(threadID, dst_reg)] = lastWrites[0].second;
   else {
     // Complex case: we found more than one instruction that wrote to the read
     // memory location. In this case, we add a virtual "merge" node, which
     // merges these instructions into one. That is to say, this "merge" node has
     // as predecessors all those found instructions, and as successor(s) the
     // instruction(s) that read from the loaded-to register later on.
-    PIN_MutexLock(&staticInstructionAddressesLock);
+    staticInstructionAddressesLock.lock();
 
     // Try to reuse virtual instructions.
-    ADDRINT virtualInsId;
+    bool inserted;
+    ADDRINT &virtualInsIdRef =
+        virtualInstructions.lookup(lastWrites, lastWritesCount, inserted);
 
-    if (virtualInstructionsMap.count(lastWrites)) {
-      virtualInsId = virtualInstructionsMap[lastWrites];
-    } else {
-      virtualInsId = static_cast<ADDRINT>(-1) - virtualInstructionCounter;
+    if (inserted) {
+      virtualInsIdRef = static_cast<ADDRINT>(-1) - virtualInstructionCounter;
 
       staticInstructionAddresses.insert(std::make_pair(
-          virtualInsId, StaticInstructionAddress("virtual-instructions",
-                                                 virtualInstructionCounter)));
-      virtualInstructionsMap[lastWrites] = virtualInsId;
+          virtualInsIdRef,
+          StaticInstructionAddress(intern_name("virtual-instructions"),
+                                   virtualInstructionCounter)));
+      virtualInstructionEpochs.push_back(epoch);
       ++virtualInstructionCounter;
     }
 
-    PIN_MutexUnlock(&staticInstructionAddressesLock);
+    ADDRINT virtualInsId = virtualInsIdRef;
+
+    // A virtual instruction that was created in an earlier epoch needs its
+    // predecessors in the current epoch too, so that every epoch can be loaded
+    // on its own.
+    UINT64 &virtualInsEpoch =
+        virtualInstructionEpochs[static_cast<ADDRINT>(-1) - virtualInsId];
+    const bool addPredecessors = inserted || (virtualInsEpoch != epoch);
+    virtualInsEpoch = epoch;
+
+    staticInstructionAddressesLock.unlock();
 
     // Add predecessors, i.e. make sure that this virtual instruction depends on
-    // all the instructions we found.
-    for (const auto &lastWrite : lastWrites) {
-      memoryDependencies[virtualInsId].insert(lastWrite);
+    // all the instructions we found. This only needs to happen once per epoch.
+    if (addPredecessors) {
+      for (size_t i = 0; i < lastWritesCount; ++i)
+        add_memory_dependency(virtualInsId, lastWrites[i].first,
+                              lastWrites[i].second);
     }
 
     lastRegisterWrite[std::make_pair(threadID, dst_reg)] = virtualInsId;
   }
 
-  PIN_MutexUnlock(&memoryLock);
-  PIN_MutexUnlock(&registerLock);
+  lastRegisterWriteSize.update(lastRegisterWrite.size());
+
+  memoryLock.unlock();
+  registerLock.unlock();
 }
 
 // Run after every read from a register.
 VOID RegisterReadBefore(THREADID threadID, ADDRINT ip, ADDRINT reg_,
                         ADDRINT rbpMemLoc, ADDRINT rspValue) {
+  registerReadBeforeCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
   REG reg = (REG)reg_;
 
-  PIN_MutexLock(&registerLock);
-  PIN_MutexLock(&initialStackPointersLock);
+  registerLock.lock();
+  initialStackPointersLock.lock();
 
   bool skipRegRead = false;
 
@@ -491,116 +1512,438 @@ VOID RegisterReadBefore(THREADID threadID, ADDRINT ip, ADDRINT reg_,
       ADDRINT ip_write = it->second;
 
       // Add register dependency.
-      registerDependencies[ip_read].insert(std::make_pair(reg, ip_write));
+      add_register_dependency(ip_read, reg, ip_write);
+    }
+  }
+
+  initialStackPointersLock.unlock();
+  registerLock.unlock();
+}
+
+// Run before every write to memory of SIZE bytes, excluding those handled by
+// the next couple of functions.
+template <std::size_t SIZE>
+VOID MemoryWriteBefore(ADDRINT ip, ADDRINT memLoc, ADDRINT size) {
+  memoryWriteBeforeCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  // Let the loop below have a constant bound (see operandvalue.h).
+  if (SIZE != 0)
+    size = SIZE;
+
+  memoryLock.lock();
+
+  // Update memory map for every byte written.
+  for (ADDRINT writtenAddr = memLoc; writtenAddr < memLoc + size;
+       ++writtenAddr) {
+    lastMemoryWrite[writtenAddr] = ip;
+  }
+
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+
+  memoryLock.unlock();
+}
+
+// Run before every write to memory that is:
+// 1) part of a mov-like instruction...
+// 2) ... where the source is a register.
+// i.e. mov [memloc], src_reg
+VOID MemoryWriteBeforeMovRegToMem(THREADID threadID, ADDRINT ip,
+                                  ADDRINT dst_memLoc, ADDRINT dst_size,
+                                  ADDRINT src_reg_) {
+  memoryWriteBeforeMovRegToMemCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  REG src_reg = (REG)src_reg_;
+
+  registerLock.lock();
+  memoryLock.lock();
+
+  if (lastRegisterWrite.count(std::make_pair(threadID, src_reg))) {
+    // Find instruction that last wrote to src_reg.
+    auto instruction_source =
+        lastRegisterWrite[std::make_pair(threadID, src_reg)];
+
+    // Update memory map for every byte written.
+    for (ADDRINT writtenAddr = dst_memLoc; writtenAddr < dst_memLoc + dst_size;
+         ++writtenAddr) {
+      lastMemoryWrite[writtenAddr] = instruction_source;
+    }
+  }
+
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+
+  memoryLock.unlock();
+  registerLock.unlock();
+}
+
+// Run before every write to memory that is:
+// 1) part of a mov-like instruction...
+// 2) ... where the source is a memory location.
+// i.e. mov [memloc_src], [memLoc_dst]
+VOID MemoryWriteBeforeMovMemToMem(ADDRINT ip, ADDRINT dst_memLoc,
+                                  ADDRINT dst_size, ADDRINT src_memLoc,
+                                  ADDRINT src_size) {
+  memoryWriteBeforeMovMemToMemCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  assert((dst_size == src_size) && "Sizes must match!");
+
+  memoryLock.lock();
+
+  // Update memory map for every byte written.
+  for (ADDRINT writtenAddr = dst_memLoc, readAddr = src_memLoc;
+       (writtenAddr < dst_memLoc + dst_size) &&
+       (readAddr < src_memLoc + src_size);
+       ++writtenAddr, ++readAddr) {
+    if (lastMemoryWrite.count(readAddr)) {
+      lastMemoryWrite[writtenAddr] = lastMemoryWrite[readAddr];
     }
   }
 
-  PIN_MutexUnlock(&initialStackPointersLock);
-  PIN_MutexUnlock(&registerLock);
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+
+  memoryLock.unlock();
+}
+
+// Run before every read from memory of SIZE bytes.
+template <std::size_t SIZE>
+VOID MemoryReadBefore(ADDRINT ip, ADDRINT memLoc, ADDRINT size) {
+  memoryReadBeforeCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  // Let the loop below have a constant bound (see operandvalue.h).
+  if (SIZE != 0)
+    size = SIZE;
+
+  memoryLock.lock();
+
+  ADDRINT ip_read = ip;
+
+  // Iterate over all addresses read by this instruction.
+  for (ADDRINT readAddr = memLoc; readAddr < memLoc + size; ++readAddr) {
+    auto it = lastMemoryWrite.find(readAddr);
+    if (it != lastMemoryWrite.end()) {
+      ADDRINT ip_write = it->second;
+
+      // Add memory dependency.
+      add_memory_dependency(ip_read, readAddr, ip_write);
+    }
+  }
+
+  memoryLock.unlock();
+}
+
+// Run at the start of a summarized memcpy(), memmove() or mempcpy().
+VOID MemoryCopySummary(THREADID threadID, ADDRINT return_ip, ADDRINT dst,
+                       ADDRINT src, ADDRINT size) {
+  memoryCopySummaryCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  // Calls from within another summarized routine are covered by its summary.
+  ADDRINT writer;
+  bool in_scope;
+  if (!get_summary_writer(threadID, return_ip, writer, in_scope))
+    return;
+
+  summarize_register_writes(threadID, writer);
+
+  memoryLock.lock();
+  summarize_memory_copy(writer, in_scope, dst, src, size);
+  memoryLock.unlock();
+}
+
+// Run at the start of a summarized memset().
+VOID MemorySetSummary(THREADID threadID, ADDRINT return_ip, ADDRINT dst,
+                      ADDRINT size) {
+  memorySetSummaryCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  ADDRINT writer;
+  bool in_scope;
+  if (!get_summary_writer(threadID, return_ip, writer, in_scope))
+    return;
+
+  summarize_register_writes(threadID, writer);
+
+  memoryLock.lock();
+  summarize_memory_set(writer, dst, size);
+  memoryLock.unlock();
+}
+
+// Run at the start of a summarized strcpy() or stpcpy().
+VOID StringCopySummary(THREADID threadID, ADDRINT return_ip, ADDRINT dst,
+                       ADDRINT src) {
+  stringCopySummaryCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  ADDRINT writer;
+  bool in_scope;
+  if (!get_summary_writer(threadID, return_ip, writer, in_scope))
+    return;
+
+  summarize_register_writes(threadID, writer);
+
+  ADDRINT size = get_string_copy_size(src, static_cast<ADDRINT>(-1));
+
+  memoryLock.lock();
+  summarize_memory_copy(writer, in_scope, dst, src, size);
+  memoryLock.unlock();
+}
+
+// Run at the start of a summarized strncpy() or stpncpy(). These copy the
+// string, and pad the destination with null characters up to the given size.
+VOID StringCopyBoundedSummary(THREADID threadID, ADDRINT return_ip,
+                              ADDRINT dst, ADDRINT src, ADDRINT size) {
+  stringCopyBoundedSummaryCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  ADDRINT writer;
+  bool in_scope;
+  if (!get_summary_writer(threadID, return_ip, writer, in_scope))
+    return;
+
+  summarize_register_writes(threadID, writer);
+
+  ADDRINT copy_size = get_string_copy_size(src, size);
+
+  memoryLock.lock();
+  summarize_memory_copy(writer, in_scope, dst, src, copy_size);
+  summarize_memory_set(writer, dst + copy_size, size - copy_size);
+  memoryLock.unlock();
+}
+
+// Run at the start of every routine in -epoch_marker.
+VOID EpochMarkerBefore(THREADID threadID, ADDRINT return_ip) {
+  epochMarkerBeforeCalls.count();
+
+  start_next_epoch("marker", return_ip, threadID);
+}
+
+// Pops the in-scope calls that returned from a thread, given the location of
+// the return address of a call or return: the calls whose return address is at
+// or below it.
+void pop_returned_calls(ExternalThreadData &data, ADDRINT location) {
+  while (!data.calls.empty() && (data.calls.back().first <= location))
+    data.calls.pop_back();
+}
+
+// Inlined routine that returns whether a thread may have run out-of-scope code
+// since it last ran in-scope code, when scoping.
+ADDRINT PIN_FAST_ANALYSIS_CALL LeftScope(ExternalThreadData *data) {
+  return data->left_scope;
+}
+
+// Run before an instruction in scope, when scoping, if the thread may have run
+// out-of-scope code since it last ran in-scope code. Applies the accesses of
+// that out-of-scope code.
+VOID ScopeEnterBefore(ExternalThreadData *data) {
+  scopeEnterBeforeCalls.count();
+
+  apply_external_accesses(*data);
+
+  data->registers_read.reset();
+  data->registers_written.reset();
+  data->left_scope = 0;
+}
+
+// Run before every call instruction in scope, when scoping. Out-of-scope code
+// that runs next writes on behalf of this call, until it returns.
+// 'stack_pointer' is the stack pointer before the call.
+VOID ScopeCallBefore(ExternalThreadData *data, ADDRINT ip,
+                     ADDRINT stack_pointer) {
+  scopeCallBeforeCalls.count();
+
+  // The call pushes its return address below the stack pointer. Calls whose
+  // return address is at or below it returned already, e.g. calls of
+  // out-of-scope code, which returns without being instrumented.
+  const ADDRINT location = stack_pointer - sizeof(ADDRINT);
+
+  pop_returned_calls(*data, location);
+  data->calls.emplace_back(location, ip);
+  data->left_scope = 1;
+}
+
+// Run before every return instruction in scope, when scoping. Out-of-scope
+// code that runs next writes on behalf of the innermost in-scope call that did
+// not return yet, if any: that of the out-of-scope code that called this
+// routine, or none if in-scope code called it. 'stack_pointer' points to the
+// return address.
+VOID ScopeReturnBefore(ExternalThreadData *data, ADDRINT stack_pointer) {
+  scopeReturnBeforeCalls.count();
+
+  pop_returned_calls(*data, stack_pointer);
+  data->left_scope = 1;
+}
+
+// Run before every read from a register by out-of-scope code. The external
+// writer depends on the last writer of the register, unless out-of-scope code
+// wrote it on its behalf.
+VOID ExternalRegisterRead(ExternalThreadData *data, ADDRINT reg_) {
+  externalRegisterReadCalls.count();
+
+  if (!main_reached || end_reached || (data->writer() == INVALID_ADDRESS))
+    return;
+
+  REG reg = (REG)reg_;
+
+  if (data->registers_read[reg] || data->registers_written[reg])
+    return;
+
+  data->registers_read.set(reg);
+  add_external_access(*data, ExternalAccess::RegisterRead, reg_, 0);
+}
+
+// Run before every read from memory by out-of-scope code. The external writer
+// depends on the last writers of the bytes, unless out-of-scope code wrote
+// them on its behalf.
+VOID ExternalMemoryRead(ExternalThreadData *data, ADDRINT memLoc,
+                        ADDRINT size) {
+  externalMemoryReadCalls.count();
+
+  if (!main_reached || end_reached || (data->writer() == INVALID_ADDRESS))
+    return;
+
+  add_external_access(*data, ExternalAccess::MemoryRead, memLoc, size);
 }
 
-// Run before every write to memory, excluding those handled by the next couple
-// of functions.
-VOID MemoryWriteBefore(ADDRINT ip, ADDRINT memLoc, ADDRINT size) {
+// Run before every write to a register by out-of-scope code. No dependencies
+// are recorded, but the register is written by the external writer.
+VOID ExternalRegisterWrite(ExternalThreadData *data, ADDRINT reg_) {
+  externalRegisterWriteCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  PIN_MutexLock(&memoryLock);
+  REG reg = (REG)reg_;
 
-  // Update memory map for every byte written.
-  for (ADDRINT writtenAddr = memLoc; writtenAddr < memLoc + size;
-       ++writtenAddr) {
-    lastMemoryWrite[writtenAddr] = ip;
-  }
+  if (data->registers_written[reg])
+    return;
 
-  PIN_MutexUnlock(&memoryLock);
+  data->registers_written.set(reg);
+  add_external_access(*data, ExternalAccess::RegisterWrite, reg_, 0);
 }
 
-// Run before every write to memory that is:
-// 1) part of a mov-like instruction...
-// 2) ... where the source is a register.
-// i.e. mov [memloc], src_reg
-VOID MemoryWriteBeforeMovRegToMem(THREADID threadID, ADDRINT ip,
-                                  ADDRINT dst_memLoc, ADDRINT dst_size,
-                                  ADDRINT src_reg_) {
+// Run before every write to memory by out-of-scope code. No dependencies are
+// recorded, but the bytes are written by the external writer.
+VOID ExternalMemoryWrite(ExternalThreadData *data, ADDRINT memLoc,
+                         ADDRINT size) {
+  externalMemoryWriteCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  REG src_reg = (REG)src_reg_;
+  add_external_access(*data, ExternalAccess::MemoryWrite, memLoc, size);
+}
 
-  PIN_MutexLock(&registerLock);
-  PIN_MutexLock(&memoryLock);
+// Run before every read from a register, with -taint.
+VOID TaintRegisterRead(THREADID threadID, ADDRINT reg_) {
+  taintRegisterReadCalls.count();
 
-  if (lastRegisterWrite.count(std::make_pair(threadID, src_reg))) {
-    // Find instruction that last wrote to src_reg.
-    auto instruction_source =
-        lastRegisterWrite[std::make_pair(threadID, src_reg)];
+  if (!main_reached || end_reached)
+    return;
 
-    // Update memory map for every byte written.
-    for (ADDRINT writtenAddr = dst_memLoc; writtenAddr < dst_memLoc + dst_size;
-         ++writtenAddr) {
-      lastMemoryWrite[writtenAddr] = instruction_source;
-    }
-  }
+  TaintThreadData &thread_data = get_taint_thread_data(threadID);
 
-  PIN_MutexUnlock(&memoryLock);
-  PIN_MutexUnlock(&registerLock);
+  if (thread_data.registers.test(reg_))
+    thread_data.instruction_tainted = true;
 }
 
-// Run before every write to memory that is:
-// 1) part of a mov-like instruction...
-// 2) ... where the source is a memory location.
-// i.e. mov [memloc_src], [memLoc_dst]
-VOID MemoryWriteBeforeMovMemToMem(ADDRINT ip, ADDRINT dst_memLoc,
-                                  ADDRINT dst_size, ADDRINT src_memLoc,
-                                  ADDRINT src_size) {
+// Run before every read from memory, with -taint.
+VOID TaintMemoryRead(THREADID threadID, ADDRINT memLoc, ADDRINT size) {
+  taintMemoryReadCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  assert((dst_size == src_size) && "Sizes must match!");
+  taintLock.lock();
+  const bool tainted = taintShadow.any(memLoc, size);
+  taintLock.unlock();
 
-  PIN_MutexLock(&memoryLock);
+  if (tainted)
+    get_taint_thread_data(threadID).instruction_tainted = true;
+}
 
-  // Update memory map for every byte written.
-  for (ADDRINT writtenAddr = dst_memLoc, readAddr = src_memLoc;
-       (writtenAddr < dst_memLoc + dst_size) &&
-       (readAddr < src_memLoc + src_size);
-       ++writtenAddr, ++readAddr) {
-    if (lastMemoryWrite.count(readAddr)) {
-      lastMemoryWrite[writtenAddr] = lastMemoryWrite[readAddr];
-    }
-  }
+// Run before every write to a register, with -taint. The register holds
+// tainted data if the instruction read any. A write to part of the register
+// keeps the taint of the rest of it.
+VOID TaintRegisterWrite(THREADID threadID, ADDRINT reg_, BOOL partial) {
+  taintRegisterWriteCalls.count();
+
+  if (!main_reached || end_reached)
+    return;
 
-  PIN_MutexUnlock(&memoryLock);
+  TaintThreadData &thread_data = get_taint_thread_data(threadID);
+
+  if (thread_data.instruction_tainted)
+    thread_data.registers.set(reg_);
+  else if (!partial)
+    thread_data.registers.reset(reg_);
 }
 
-// Run before every read from memory.
-VOID MemoryReadBefore(ADDRINT ip, ADDRINT memLoc, ADDRINT size) {
+// Run before every write to memory, with -taint. The written bytes hold
+// tainted data if the instruction read any.
+VOID TaintMemoryWrite(THREADID threadID, ADDRINT memLoc, ADDRINT size) {
+  taintMemoryWriteCalls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  PIN_MutexLock(&memoryLock);
+  const bool tainted = get_taint_thread_data(threadID).instruction_tainted;
 
-  ADDRINT ip_read = ip;
+  taintLock.lock();
+  taintShadow.set(memLoc, size, tainted);
+  taintLock.unlock();
+}
 
-  // Iterate over all addresses read by this instruction.
-  for (ADDRINT readAddr = memLoc; readAddr < memLoc + size; ++readAddr) {
-    auto it = lastMemoryWrite.find(readAddr);
-    if (it != lastMemoryWrite.end()) {
-      ADDRINT ip_write = it->second;
+// Run after the other analysis calls of every instruction, with -taint.
+// Counts the instruction if it read tainted data and is in scope.
+VOID TaintInstructionAfter(THREADID threadID, ADDRINT ip, BOOL in_scope) {
+  taintInstructionAfterCalls.count();
 
-      // Add memory dependency.
-      memoryDependencies[ip_read].insert(std::make_pair(readAddr, ip_write));
-    }
-  }
+  if (!main_reached || end_reached)
+    return;
+
+  TaintThreadData &thread_data = get_taint_thread_data(threadID);
 
-  PIN_MutexUnlock(&memoryLock);
+  if (thread_data.instruction_tainted) {
+    if (in_scope)
+      ++thread_data.tainted_instructions[ip];
+
+    thread_data.instruction_tainted = false;
+  }
 }
 
 // =============================================================================
 // Instrumentation routines
 // =============================================================================
 
+// Returns whether an instruction is "xor reg, reg" or "pxor reg, reg", which
+// sets the register to zero regardless of its value.
+bool is_zeroing_idiom(INS ins) {
+  return ((INS_Opcode(ins) == XED_ICLASS_XOR) ||
+          (INS_Opcode(ins) == XED_ICLASS_PXOR)) &&
+         (INS_OperandCount(ins) >= 2) && (INS_OperandIsReg(ins, 0)) &&
+         (INS_OperandIsReg(ins, 1)) &&
+         (INS_OperandReg(ins, 0) == INS_OperandReg(ins, 1));
+}
+
 // Adds the default analysis calls for register and memory reads for an
 // instruction.
 VOID AddReadAnalysisCalls(INS ins) {
@@ -618,16 +1961,9 @@ VOID AddReadAnalysisCalls(INS ins) {
     // NOTE: Canonicalise %al, %ah, %eax etc. to %rax using REG_FullRegName.
     REG fullReg = REG_FullRegName(INS_RegR(ins, i));
 
-    // Special case "xor reg, reg" to not introduce a dependency.
-    if ((INS_Opcode(ins) == XED_ICLASS_XOR) && (INS_OperandCount(ins) >= 2) &&
-        (INS_OperandIsReg(ins, 0)) && (INS_OperandIsReg(ins, 1)) &&
-        (INS_OperandReg(ins, 0) == INS_OperandReg(ins, 1)))
-      continue;
-
-    // Special case "pxor reg, reg" to not introduce a dependency.
-    if ((INS_Opcode(ins) == XED_ICLASS_PXOR) && (INS_OperandCount(ins) >= 2) &&
-        (INS_OperandIsReg(ins, 0)) && (INS_OperandIsReg(ins, 1)) &&
-        (INS_OperandReg(ins, 0) == INS_OperandReg(ins, 1)))
+    // Special case "xor reg, reg" and "pxor reg, reg" to not introduce a
+    // dependency.
+    if (is_zeroing_idiom(ins))
       continue;
 
     // Ignore %rsp and %rip if requested by the user.
@@ -683,7 +2019,8 @@ VOID AddReadAnalysisCalls(INS ins) {
     // calls, because otherwise we may run into problems with instructions
     // such as 'add eax, 1'.
     if (INS_MemoryOperandIsRead(ins, memOp)) {
-      INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)MemoryReadBefore,
+      INS_InsertPredicatedCall(ins, IPOINT_BEFORE,
+                               SIZED_ROUTINE(MemoryReadBefore, size),
                                IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
                                IARG_ADDRINT, size, IARG_CALL_ORDER,
                                CALL_ORDER_FIRST, IARG_END);
@@ -846,22 +2183,171 @@ VOID AddWriteAnalysisCalls(
                                            overrides.overrideMemToMem[memOp]),
             IARG_CALL_ORDER, CALL_ORDER_FIRST + 1, IARG_END);
       } else {
+        const ADDRINT size = INS_MemoryOperandSize(ins, memOp);
+
         INS_InsertPredicatedCall(
-            ins, IPOINT_BEFORE, (AFUNPTR)MemoryWriteBefore, IARG_INST_PTR,
-            IARG_MEMORYOP_EA, memOp, IARG_ADDRINT,
-            (ADDRINT)INS_MemoryOperandSize(ins, memOp), IARG_CALL_ORDER,
-            CALL_ORDER_FIRST + 1, IARG_END);
+            ins, IPOINT_BEFORE, SIZED_ROUTINE(MemoryWriteBefore, size),
+            IARG_INST_PTR, IARG_MEMORYOP_EA, memOp, IARG_ADDRINT, size,
+            IARG_CALL_ORDER, CALL_ORDER_FIRST + 1, IARG_END);
       }
     }
   }
 }
 
+// Adds the analysis calls for -taint for an instruction. These propagate the
+// taint from the registers and memory it reads to the registers and memory it
+// writes, and count the instruction if it read tainted data and is in scope.
+// Out-of-scope code propagates the taint as well.
+VOID AddTaintAnalysisCalls(INS ins, bool in_scope) {
+  // Ignore NOP instructions, since they don't read/write from their operands.
+  if (KnobIgnoreNops.Value() && INS_IsNop(ins))
+    return;
+
+  // Zeroing idioms do not read their register, see AddReadAnalysisCalls().
+  if (!is_zeroing_idiom(ins)) {
+    for (UINT32 i = 0; i < INS_MaxNumRRegs(ins); ++i) {
+      REG fullReg = REG_FullRegName(INS_RegR(ins, i));
+
+      // Ignore %rsp and %rip if requested by the user.
+      if (KnobIgnoreRsp.Value() && fullReg == REG_STACK_PTR)
+        continue;
+
+      if (KnobIgnoreRip.Value() && fullReg == REG_INST_PTR)
+        continue;
+
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)TaintRegisterRead,
+                     IARG_THREAD_ID, IARG_ADDRINT, (ADDRINT)fullReg,
+                     IARG_CALL_ORDER, CALL_ORDER_FIRST, IARG_END);
+    }
+  }
+
+  for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+    if (INS_MemoryOperandIsRead(ins, memOp)) {
+      INS_InsertPredicatedCall(
+          ins, IPOINT_BEFORE, (AFUNPTR)TaintMemoryRead, IARG_THREAD_ID,
+          IARG_MEMORYOP_EA, memOp, IARG_ADDRINT,
+          (ADDRINT)INS_MemoryOperandSize(ins, memOp), IARG_CALL_ORDER,
+          CALL_ORDER_FIRST, IARG_END);
+    }
+  }
+
+  for (UINT32 i = 0; i < INS_MaxNumWRegs(ins); ++i) {
+    REG reg = INS_RegW(ins, i);
+    REG fullReg = REG_FullRegName(reg);
+
+    if (KnobIgnoreRsp.Value() && fullReg == REG_STACK_PTR)
+      continue;
+
+    if (KnobIgnoreRip.Value() && fullReg == REG_INST_PTR)
+      continue;
+
+    // Writes to %al, %ah and %ax keep the rest of %rax, while writes to %eax
+    // clear it.
+    BOOL partial = REG_is_gr(fullReg) && (REG_Size(reg) < 4);
+
+    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)TaintRegisterWrite,
+                   IARG_THREAD_ID, IARG_ADDRINT, (ADDRINT)fullReg, IARG_BOOL,
+                   partial, IARG_CALL_ORDER, CALL_ORDER_FIRST + 1, IARG_END);
+  }
+
+  for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+    if (INS_MemoryOperandIsWritten(ins, memOp)) {
+      INS_InsertPredicatedCall(
+          ins, IPOINT_BEFORE, (AFUNPTR)TaintMemoryWrite, IARG_THREAD_ID,
+          IARG_MEMORYOP_EA, memOp, IARG_ADDRINT,
+          (ADDRINT)INS_MemoryOperandSize(ins, memOp), IARG_CALL_ORDER,
+          CALL_ORDER_FIRST + 1, IARG_END);
+    }
+  }
+
+  INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)TaintInstructionAfter,
+                 IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL, in_scope,
+                 IARG_CALL_ORDER, CALL_ORDER_FIRST + 2, IARG_END);
+}
+
+// Adds the analysis calls for an instruction that is out of scope. These
+// buffer the registers and memory it reads and writes, so that the external
+// writer later depends on the last writers of those it reads, and becomes the
+// last writer of those it writes.
+VOID AddExternalAnalysisCalls(INS ins) {
+  if (KnobIgnoreNops.Value() && INS_IsNop(ins))
+    return;
+
+  // Zeroing idioms do not read their register, see AddReadAnalysisCalls().
+  if (!is_zeroing_idiom(ins)) {
+    for (UINT32 i = 0; i < INS_MaxNumRRegs(ins); ++i) {
+      REG fullReg = REG_FullRegName(INS_RegR(ins, i));
+
+      if (KnobIgnoreRsp.Value() && fullReg == REG_STACK_PTR)
+        continue;
+
+      if (KnobIgnoreRip.Value() && fullReg == REG_INST_PTR)
+        continue;
+
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ExternalRegisterRead,
+                     IARG_REG_VALUE, externalStateRegister, IARG_ADDRINT,
+                     (ADDRINT)fullReg, IARG_CALL_ORDER, CALL_ORDER_FIRST,
+                     IARG_END);
+    }
+  }
+
+  for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+    if (INS_MemoryOperandIsRead(ins, memOp)) {
+      INS_InsertPredicatedCall(
+          ins, IPOINT_BEFORE, (AFUNPTR)ExternalMemoryRead, IARG_REG_VALUE,
+          externalStateRegister, IARG_MEMORYOP_EA, memOp, IARG_ADDRINT,
+          (ADDRINT)INS_MemoryOperandSize(ins, memOp), IARG_CALL_ORDER,
+          CALL_ORDER_FIRST, IARG_END);
+    }
+  }
+
+  for (UINT32 i = 0; i < INS_MaxNumWRegs(ins); ++i) {
+    REG fullReg = REG_FullRegName(INS_RegW(ins, i));
+
+    if (KnobIgnoreRsp.Value() && fullReg == REG_STACK_PTR)
+      continue;
+
+    if (KnobIgnoreRip.Value() && fullReg == REG_INST_PTR)
+      continue;
+
+    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ExternalRegisterWrite,
+                   IARG_REG_VALUE, externalStateRegister, IARG_ADDRINT,
+                   (ADDRINT)fullReg, IARG_CALL_ORDER, CALL_ORDER_FIRST + 1,
+                   IARG_END);
+  }
+
+  for (UINT32 memOp = 0; memOp < INS_MemoryOperandCount(ins); memOp++) {
+    if (INS_MemoryOperandIsWritten(ins, memOp)) {
+      INS_InsertPredicatedCall(
+          ins, IPOINT_BEFORE, (AFUNPTR)ExternalMemoryWrite, IARG_REG_VALUE,
+          externalStateRegister, IARG_MEMORYOP_EA, memOp, IARG_ADDRINT,
+          (ADDRINT)INS_MemoryOperandSize(ins, memOp), IARG_CALL_ORDER,
+          CALL_ORDER_FIRST + 1, IARG_END);
+    }
+  }
+}
+
 // Pin calls this function every time a new instruction is encountered
 VOID OnInstruction(INS ins, VOID *) {
+  ScopedStatTimer timer(onInstructionTimer);
+
+  // The instructions of summarized routines are not instrumented, see
+  // AddLibcSummaries().
+  if (KnobLibcSummaries.Value() &&
+      is_in_summarized_routine(INS_Address(ins)))
+    return;
+
   // Call InstructionBefore() before every instruction.
   INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)InstructionBefore, IARG_INST_PTR,
                  IARG_END);
 
+  // Get the address of this instruction.
+  ADDRINT ins_address = INS_Address(ins);
+
+  // Get information of this instruction.
+  const SymbolLocation location = find_symbol(ins_address);
+  const bool in_scope = is_in_scope(location);
+
   // Call InstructionCallBefore() before every call instruction.
   // Pass the target address (i.e. the address of the function being called)
   // and the address of the next instruction (i.e. the one following the
@@ -870,29 +2356,64 @@ VOID OnInstruction(INS ins, VOID *) {
     INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)InstructionCallBefore,
                    IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT, INS_NextAddress(ins),
                    IARG_END);
-  }
-
-  // Get the address of this instruction.
-  ADDRINT ins_address = INS_Address(ins);
 
-  // Get information of this instruction.
-  PIN_LockClient();
-  IMG image = IMG_FindByAddress(ins_address);
+    // Remember the call site, in case it calls a summarized routine. Calls
+    // from out-of-scope code are summarized on behalf of the external writer.
+    if (KnobLibcSummaries.Value()) {
+      callSitesLock.lock();
+      callSites[INS_NextAddress(ins)] = CallSite{INS_Address(ins), in_scope};
+      callSitesLock.unlock();
+    }
+  }
 
-  std::string image_name = IMG_Valid(image) ? IMG_Name(image) : "???";
-  ADDRINT image_offset = IMG_Valid(image)
-                             ? (ins_address - IMG_LowAddress(image))
-                             : static_cast<ADDRINT>(-1);
+  // Out-of-scope code writes on behalf of the innermost call from in-scope
+  // code. Its accesses are applied before the next in-scope instruction, which
+  // runs before any other analysis routine of that instruction.
+  if (externalWritersEnabled && in_scope) {
+    INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)LeftScope,
+                     IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE,
+                     externalStateRegister, IARG_CALL_ORDER, CALL_ORDER_FIRST,
+                     IARG_END);
+    INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR)ScopeEnterBefore,
+                       IARG_REG_VALUE, externalStateRegister, IARG_CALL_ORDER,
+                       CALL_ORDER_FIRST, IARG_END);
+
+    if (INS_IsCall(ins)) {
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ScopeCallBefore,
+                     IARG_REG_VALUE, externalStateRegister, IARG_INST_PTR,
+                     IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+    } else if (INS_IsRet(ins)) {
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ScopeReturnBefore,
+                     IARG_REG_VALUE, externalStateRegister, IARG_REG_VALUE,
+                     REG_STACK_PTR, IARG_END);
+    }
+  }
 
-  PIN_UnlockClient();
+  // Only add the static address of out-of-scope instructions that can be
+  // the writer of a dependency, i.e. system calls in -syscall_file.
+  if (in_scope || INS_IsSyscall(ins)) {
+    staticInstructionAddressesLock.lock();
+    // Add the static address of this instruction to the static instructions
+    // map.
+    staticInstructionAddresses.insert(std::make_pair(
+        ins_address, StaticInstructionAddress(location.image_name,
+                                              location.image_offset)));
+
+    staticInstructionAddressesLock.unlock();
+  }
 
-  PIN_MutexLock(&staticInstructionAddressesLock);
-  // Add the static address of this instruction to the static instructions
-  // map.
-  staticInstructionAddresses.insert(std::make_pair(
-      ins_address, StaticInstructionAddress(image_name, image_offset)));
+  // With -taint, only the taint is propagated, and no dependencies are
+  // recorded.
+  if (KnobTaint.Value()) {
+    AddTaintAnalysisCalls(ins, in_scope);
+    return;
+  }
 
-  PIN_MutexUnlock(&staticInstructionAddressesLock);
+  // Out-of-scope code only propagates the external writer.
+  if (!in_scope) {
+    AddExternalAnalysisCalls(ins);
+    return;
+  }
 
   // Add read calls for all instructions.
   AddReadAnalysisCalls(ins);
@@ -945,8 +2466,81 @@ VOID OnInstruction(INS ins, VOID *) {
   }
 }
 
+// Instruments the routines of an image that have a summary, for
+// -libc_summaries. Instead of instrumenting their instructions, which would
+// update the memory map byte by byte, every call applies the effect of the
+// routine on the memory map at once.
+VOID AddLibcSummaries(IMG img) {
+  for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec)) {
+    for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn)) {
+      // The resolver of an IFUNC symbol only selects an implementation.
+      if (SYM_IFuncResolver(RTN_Sym(rtn)))
+        continue;
+
+      LibcSummary summary = get_libc_summary(RTN_Name(rtn));
+      if (summary == LibcSummary::NONE)
+        continue;
+
+      if (KnobVerbose.Value()) {
+        std::cerr << "[DEBUG] [LIBC_SUMMARIES] Routine: " << RTN_Name(rtn)
+                  << "\n";
+      }
+
+      RTN_Open(rtn);
+
+      switch (summary) {
+      case LibcSummary::MEMORY_COPY:
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)MemoryCopySummary,
+                       IARG_THREAD_ID, IARG_RETURN_IP,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2, IARG_END);
+        break;
+      case LibcSummary::MEMORY_SET:
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)MemorySetSummary,
+                       IARG_THREAD_ID, IARG_RETURN_IP,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2, IARG_END);
+        break;
+      case LibcSummary::STRING_COPY:
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)StringCopySummary,
+                       IARG_THREAD_ID, IARG_RETURN_IP,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1, IARG_END);
+        break;
+      case LibcSummary::STRING_COPY_BOUNDED:
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)StringCopyBoundedSummary,
+                       IARG_THREAD_ID, IARG_RETURN_IP,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2, IARG_END);
+        break;
+      case LibcSummary::NONE:
+        break;
+      }
+
+      RTN_Close(rtn);
+
+      summarizedRoutines[RTN_Address(rtn)] = RTN_Address(rtn) + RTN_Size(rtn);
+    }
+  }
+}
+
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG img, VOID *) {
+  if (KnobLibcSummaries.Value())
+    AddLibcSummaries(img);
+
+  for (unsigned int i = 0; i < KnobEpochMarker.NumberOfValues(); ++i) {
+    RTN marker_rtn = RTN_FindByName(img, KnobEpochMarker.Value(i).c_str());
+    if (RTN_Valid(marker_rtn)) {
+      RTN_Open(marker_rtn);
+      RTN_InsertCall(marker_rtn, IPOINT_BEFORE, (AFUNPTR)EpochMarkerBefore,
+                     IARG_THREAD_ID, IARG_RETURN_IP, IARG_END);
+      RTN_Close(marker_rtn);
+    }
+  }
+
   RTN libc_start_main_rtn = RTN_FindByName(img, "__libc_start_main");
   if (RTN_Valid(libc_start_main_rtn)) {
     RTN_Open(libc_start_main_rtn);
@@ -960,9 +2554,23 @@ VOID OnImageLoad(IMG img, VOID *) {
 // Callback that is executed before each system call.
 VOID OnSyscallEntry(THREADID threadId, CONTEXT *ctx, SYSCALL_STANDARD std,
                     VOID *v) {
-  PIN_MutexLock(&sysCallIdMapLock);
+  // The system call may write memory, after the out-of-scope code that made
+  // it.
+  apply_external_accesses(threadId);
+
+  sysCallIdMapLock.lock();
   auto sysCallId = sysCallIdMap[threadId]++;
-  PIN_MutexUnlock(&sysCallIdMapLock);
+  bool epochBoundary = false;
+
+  if ((KnobEpochSyscalls.Value() > 0) && main_reached && !end_reached)
+    epochBoundary = (++epochSyscallCount % KnobEpochSyscalls.Value() == 0);
+
+  sysCallIdMapLock.unlock();
+
+  if (epochBoundary) {
+    start_next_epoch("syscalls", PIN_GetContextReg(ctx, REG_INST_PTR),
+                     threadId);
+  }
 
   if (syscallsToTrack.empty())
     return;
@@ -985,12 +2593,23 @@ VOID OnSyscallEntry(THREADID threadId, CONTEXT *ctx, SYSCALL_STANDARD std,
   ADDRINT baseAddr = PIN_GetSyscallArgument(ctx, std, 1);
   ADDRINT count = it->number_of_bytes_to_taint;
 
-  PIN_MutexLock(&sysCallInstructionsLock);
+  if (KnobEpochTrackedSyscalls.Value())
+    start_next_epoch("tracked_syscall", ip, threadId);
+
+  sysCallInstructionsLock.lock();
   sysCallInstructions.insert(
       std::pair(SyscallInfo(it->index, threadId, sysCallId), ip));
-  PIN_MutexUnlock(&sysCallInstructionsLock);
+  sysCallInstructionsLock.unlock();
+
+  // With -taint, the buffer holds the tainted data.
+  if (KnobTaint.Value()) {
+    taintLock.lock();
+    taintShadow.set(baseAddr, count, true);
+    taintLock.unlock();
+    return;
+  }
 
-  PIN_MutexLock(&memoryLock);
+  memoryLock.lock();
 
   // Update memory map for every byte written.
   for (ADDRINT writtenAddr = baseAddr; writtenAddr < baseAddr + count;
@@ -998,113 +2617,120 @@ VOID OnSyscallEntry(THREADID threadId, CONTEXT *ctx, SYSCALL_STANDARD std,
     lastMemoryWrite[writtenAddr] = ip;
   }
 
-  PIN_MutexUnlock(&memoryLock);
+  lastMemoryWriteSize.update(lastMemoryWrite.size());
+
+  memoryLock.unlock();
 }
 
 // Callback for when a thread starts.
 VOID OnThreadStart(THREADID threadId, CONTEXT *ctx, INT32 flags, VOID *v) {
-  PIN_MutexLock(&initialStackPointersLock);
+  initialStackPointersLock.lock();
   initialStackPointers[threadId] = PIN_GetContextReg(ctx, REG_STACK_PTR);
-  PIN_MutexUnlock(&initialStackPointersLock);
+  initialStackPointersLock.unlock();
+
+  if (KnobTaint.Value()) {
+    TaintThreadData *thread_data = new TaintThreadData();
+
+    taintLock.lock();
+    taintThreadDatas.emplace_back(thread_data);
+    taintLock.unlock();
+
+    PIN_SetThreadData(taintTlsKey, thread_data, threadId);
+  }
+
+  if (externalWritersEnabled) {
+    ExternalThreadData *external_data = new ExternalThreadData(threadId);
+
+    externalThreadDatasLock.lock();
+    externalThreadDatas.emplace_back(external_data);
+    externalThreadDatasLock.unlock();
+
+    PIN_SetThreadData(externalTlsKey, external_data, threadId);
+    PIN_SetContextReg(ctx, externalStateRegister,
+                      reinterpret_cast<ADDRINT>(external_data));
+  }
 }
 
 // =============================================================================
 // Other routines
 // =============================================================================
 
-std::string pretty_offset(ADDRINT offset) {
-  if (offset != static_cast<ADDRINT>(-1)) {
-    std::ostringstream oss;
-    oss << offset;
-    return oss.str();
-  } else {
-    return "-1";
-  }
-}
-
 // This function is called when the application exits
 VOID Fini(INT32, VOID *) {
-  // Write register dependencies to CSV file.
-  registerDependenciesFile
-      << "Write_img,Write_off,Register,Read_img,Read_off\n";
-
-  for (const auto &instructionEntry : registerDependencies) {
-    ADDRINT ip_read = instructionEntry.first;
-    StaticInstructionAddress address_read = staticInstructionAddresses[ip_read];
-
-    for (const auto &registerDependency : instructionEntry.second) {
-      REG reg = registerDependency.first;
-      ADDRINT ip_write = registerDependency.second;
-      StaticInstructionAddress address_write =
-          staticInstructionAddresses[ip_write];
-
-      registerDependenciesFile
-          << '"' << get_filename(address_write.image_name) << '"' // Write_img
-          << ',' << pretty_offset(address_write.image_offset)     // Write_off
-          << ',' << REG_StringShort(reg)                          // Register
-          << ',' << '"' << get_filename(address_read.image_name)
-          << '"'                                             // Read_img
-          << ',' << pretty_offset(address_read.image_offset) // Read_off
-          << '\n';
-    }
-  }
+  ScopedStatTimer timer(finiTimer);
 
-  // Write memory dependencies to CSV file.
-  memoryDependenciesFile << "Write_img,Write_off,Memory,Read_img,Read_off\n";
-
-  for (const auto &instructionEntry : memoryDependencies) {
-    ADDRINT ip_read = instructionEntry.first;
-    StaticInstructionAddress address_read = staticInstructionAddresses[ip_read];
-
-    for (const auto &memoryDependency : instructionEntry.second) {
-      ADDRINT memLoc = memoryDependency.first;
-      ADDRINT ip_write = memoryDependency.second;
-      StaticInstructionAddress address_write =
-          staticInstructionAddresses[ip_write];
-
-      memoryDependenciesFile
-          << '"' << get_filename(address_write.image_name) << '"' // Write_img
-          << ',' << pretty_offset(address_write.image_offset)     // Write_off
-          << ',' << memLoc                                        // Memory
-          << ',' << '"' << get_filename(address_read.image_name)
-          << '"'                                             // Read_img
-          << ',' << pretty_offset(address_read.image_offset) // Read_off
-          << '\n';
-    }
-  }
+  // These only grow, so their peak size is their final size.
+  staticInstructionAddressesSize.update(staticInstructionAddresses.size());
+  taintShadowSize.update(taintShadow.size());
 
-  // Write system call instruction to CSV file.
-  syscallsFile << "image_name,image_offset,index,thread_id,syscall_id\n";
+  // Apply the remaining accesses of out-of-scope code.
+  for (const auto &external_data : externalThreadDatas)
+    apply_external_accesses(*external_data);
+
+  // Write the dependencies of the last epoch.
+  write_dependencies();
 
+  // Write system call instruction to CSV file.
   for (const auto &sci : sysCallInstructions) {
     const auto &info = sci.first;
     const auto &ip = sci.second;
 
-    StaticInstructionAddress address = staticInstructionAddresses[ip];
+    const StaticInstructionAddress &address = staticInstructionAddresses[ip];
+
+    *syscallsFile << get_image_filename(address.image_name) // image_name
+                  << address.image_offset                   // image_offset
+                  << info.index                             // index
+                  << info.threadId                          // thread_id
+                  << info.syscallId;                        // syscall_id
+  }
+
+  // Write tainted instructions to CSV file, with -taint.
+  if (taintedInstructionsFile) {
+    for (const auto &thread_data : taintThreadDatas) {
+      for (const auto &taintedInstruction :
+           thread_data->tainted_instructions) {
+        taintedInstructions[taintedInstruction.first] +=
+            taintedInstruction.second;
+      }
+    }
+
+    for (const auto &taintedInstruction : taintedInstructions) {
+      const StaticInstructionAddress &address =
+          staticInstructionAddresses[taintedInstruction.first];
+
+      *taintedInstructionsFile
+          << get_image_filename(address.image_name) // image_name
+          << address.image_offset                   // image_offset
+          << taintedInstruction.second;             // count
+    }
 
-    syscallsFile << '"' << get_filename(address.image_name) << '"' // image_name
-                 << ',' << pretty_offset(address.image_offset) // image_offset
-                 << ',' << info.index                          // index
-                 << ',' << info.threadId                       // thread_id
-                 << ',' << info.syscallId                      // syscall_id
-                 << '\n';
+    taintedInstructionsFile->close();
   }
 
   // Flush and close the output files.
-  memoryDependenciesFile.flush();
-  memoryDependenciesFile.close();
+  memoryDependenciesFile->close();
+  registerDependenciesFile->close();
+  syscallsFile->close();
 
-  registerDependenciesFile.flush();
-  registerDependenciesFile.close();
+  if (epochsFile)
+    epochsFile->close();
+}
 
-  syscallsFile.flush();
-  syscallsFile.close();
+// Writes the -tool_stats output. Runs after Fini(), so that its time is
+// included.
+VOID WriteToolStats(INT32, VOID *) {
+  if (!write_tool_stats(toolStatsPath))
+    cerr << "Could not write " << toolStatsPath << ".\n";
 }
 
 bool earlyFini(unsigned int, int, LEVEL_VM::CONTEXT *, bool,
                const LEVEL_BASE::EXCEPTION_INFO *, void *) {
   cerr << "signal caught" << endl;
   Fini(0, nullptr);
+
+  if (!toolStatsPath.empty())
+    WriteToolStats(0, nullptr);
+
   PIN_ExitProcess(0);
 }
 
@@ -1124,6 +2750,20 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  if (!parse_table_format(KnobOutputFormat.Value(), tableFormat)) {
+    cerr << "Invalid output format '" << KnobOutputFormat.Value() << "'.\n\n";
+    return Usage();
+  }
+
+  if (KnobTaint.Value() && KnobSyscallFile.Value().empty()) {
+    cerr << "The -taint option requires -syscall_file.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
   if (!KnobStartFromMain.Value())
@@ -1135,12 +2775,99 @@ int main(int argc, char *argv[]) {
     csv_prefix = "data_dependencies";
   }
 
+  csvPrefix = csv_prefix;
+  epochsEnabled = (KnobEpochSyscalls.Value() > 0) ||
+                  KnobEpochTrackedSyscalls.Value() ||
+                  (KnobEpochMarker.NumberOfValues() > 0);
+
+  // Spill the dependencies to run files next to the output, if their memory is
+  // bounded.
+  if (KnobMaxDependenciesMemory.Value() > 0) {
+    maxDependenciesInMemory =
+        std::max<UINT64>(1, KnobMaxDependenciesMemory.Value() * 1024 * 1024 /
+                                DEPENDENCY_SIZE / 2);
+    registerDependencyRuns.reset(
+        new DependencyRuns(csv_prefix + ".register_dependencies"));
+    memoryDependencyRuns.reset(
+        new DependencyRuns(csv_prefix + ".memory_dependencies"));
+  }
+
+  // Ensure that for each range, the user specified the image name, begin
+  // offset, and end offset.
+  const unsigned int image_count = KnobRangeImage.NumberOfValues();
+  const unsigned int begin_count = KnobRangeBeginOffset.NumberOfValues();
+  const unsigned int end_count = KnobRangeEndOffset.NumberOfValues();
+
+  if (!((image_count == begin_count) && (begin_count == end_count))) {
+    cerr << "You must provide the image name, begin offset, and end offset "
+            "for each instruction range!\n\n";
+    return Usage();
+  }
+
+  // Store the instruction ranges in instructionRanges. An image in scope is
+  // a range that covers all of it.
+  for (unsigned int i = 0; i < KnobScopeImage.NumberOfValues(); ++i) {
+    instructionRanges.insert(InstructionRange(KnobScopeImage.Value(i), 0,
+                                              static_cast<ADDRINT>(-1)));
+  }
+
+  for (unsigned int i = 0; i < image_count; ++i) {
+    instructionRanges.insert(InstructionRange(KnobRangeImage.Value(i),
+                                              KnobRangeBeginOffset.Value(i),
+                                              KnobRangeEndOffset.Value(i)));
+  }
+
+  // Check if the user specified an instruction ranges configuration file.
+  if (!KnobRangesFile.Value().empty()) {
+    std::string image;
+    ADDRINT begin_offset;
+    ADDRINT end_offset;
+
+    std::ifstream ifs(KnobRangesFile.Value().c_str());
+
+    while (ifs >> image >> begin_offset >> end_offset) {
+      instructionRanges.insert(
+          InstructionRange(image, begin_offset, end_offset));
+    }
+  }
+
+  // Out-of-scope code writes on behalf of in-scope calls when scoping, except
+  // with -taint, which propagates the taint through out-of-scope code instead.
+  externalWritersEnabled = !instructionRanges.empty() && !KnobTaint.Value();
+
+  if (externalWritersEnabled) {
+    externalStateRegister = PIN_ClaimToolRegister();
+    externalTlsKey = PIN_CreateThreadDataKey(nullptr);
+
+    if (!REG_valid(externalStateRegister) ||
+        (externalTlsKey == INVALID_TLS_KEY)) {
+      cerr << "Could not allocate the thread state of out-of-scope code!\n";
+      return EXIT_FAILURE;
+    }
+  }
+
   // Open CSV files.
-  memoryDependenciesFile.open(
-      (csv_prefix + ".memory_dependencies.csv").c_str());
-  registerDependenciesFile.open(
-      (csv_prefix + ".register_dependencies.csv").c_str());
-  syscallsFile.open((csv_prefix + ".syscall_instructions.csv").c_str());
+  open_dependency_files();
+  syscallsFile = open_table(csv_prefix + ".syscall_instructions", tableFormat,
+                            syscallsColumns);
+
+  if (epochsEnabled) {
+    epochsFile = open_table(csv_prefix + ".epochs", tableFormat, epochsColumns);
+    write_epoch("start", INVALID_ADDRESS, 0);
+  }
+
+  if (KnobTaint.Value()) {
+    taintedInstructionsFile =
+        open_table(csv_prefix + ".tainted_instructions", tableFormat,
+                   taintedInstructionsColumns);
+
+    // Initialise thread-local storage for the taint of the registers.
+    taintTlsKey = PIN_CreateThreadDataKey(nullptr);
+    if (taintTlsKey == INVALID_TLS_KEY) {
+      cerr << "Maximum amount of allocated TLS keys reached!\n";
+      return EXIT_FAILURE;
+    }
+  }
 
   // Parse syscall file, if set.
   if (!KnobSyscallFile.Value().empty()) {
@@ -1167,6 +2894,9 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (KnobLibcSummaries.Value())
+    summaryClobberedRegisters = get_caller_saved_registers();
+
   // Intercept image loading
   IMG_AddInstrumentFunction(OnImageLoad, nullptr);
 
@@ -1182,18 +2912,17 @@ int main(int argc, char *argv[]) {
   // Register Fini to be called when the application exits
   PIN_AddFiniFunction(Fini, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    toolStatsPath = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Make sure we can cut off execution
   PIN_UnblockSignal(15, true);
   PIN_InterceptSignal(15, earlyFini, nullptr);
 
-  // Initialize mutexes.
-  PIN_MutexInit(&registerLock);
-  PIN_MutexInit(&memoryLock);
-  PIN_MutexInit(&sysCallInstructionsLock);
-  PIN_MutexInit(&sysCallIdMapLock);
-  PIN_MutexInit(&staticInstructionAddressesLock);
-  PIN_MutexInit(&initialStackPointersLock);
-
   // Start the program, never returns
   PIN_StartProgram();
 
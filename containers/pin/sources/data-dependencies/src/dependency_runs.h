@@ -0,0 +1,314 @@
+#ifndef DEPENDENCY_RUNS_H
+#define DEPENDENCY_RUNS_H
+
+#include "pin.H"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/* SORTED RUN FILES OF DEPENDENCIES, FOR -max_dependencies_memory */
+
+// A dependency: the instruction at 'read' depends on the instruction at
+// 'write', through 'location', which is a register or a memory address.
+struct DependencyRecord {
+  ADDRINT read;
+  ADDRINT location;
+  ADDRINT write;
+
+  bool operator<(const DependencyRecord &other) const {
+    return std::tie(read, location, write) <
+           std::tie(other.read, other.location, other.write);
+  }
+
+  bool operator==(const DependencyRecord &other) const {
+    return (read == other.read) && (location == other.location) &&
+           (write == other.write);
+  }
+};
+
+// Spills the dependencies of one kind to disk, so that they do not need to be
+// kept in memory for the whole run.
+//
+// Every time the dependencies in memory reach their limit, they are written to
+// a new run file, in which they are sorted, and removed from memory. At the
+// end, the runs are merged with the dependencies that are still in memory, and
+// the dependencies that were found in several runs are only reported once.
+//
+// At most MAX_FAN_IN runs are read at once, each through a buffer of
+// BUFFER_SIZE records, so the memory used by the merge does not grow with the
+// number of runs. If there are more runs, the oldest ones are first merged into
+// larger runs.
+class DependencyRuns {
+public:
+  // The run files are named <path_prefix>.run<N>.
+  explicit DependencyRuns(const std::string &path_prefix)
+      : m_path_prefix(path_prefix), m_next_run(0) {}
+
+  // Returns whether any dependencies were written to disk.
+  bool empty() const { return m_paths.empty(); }
+
+  // Writes a map of dependencies, from the reading instruction to the set of
+  // (location, writing instruction) pairs, to a new run. Maps iterate in
+  // order, so the run is sorted. Returns false, and removes the run file, if it
+  // cannot be written.
+  template <typename Map> bool write_run(const Map &dependencies) {
+    MapReader<Map> reader(dependencies);
+    const std::string path = next_path();
+    RunWriter writer(path);
+    DependencyRecord record;
+
+    while (reader.next(record))
+      writer.write(record);
+
+    if (!writer.close()) {
+      std::remove(path.c_str());
+      return false;
+    }
+
+    m_paths.push_back(path);
+    return true;
+  }
+
+  // Merges the runs with a map of dependencies that are still in memory, and
+  // calls 'callback' with every distinct dependency, in order. Removes the run
+  // files. Returns false if a run file cannot be read or written, in which
+  // case the run files are kept, and 'callback' may not have been called for
+  // every dependency.
+  template <typename Map, typename Callback>
+  bool merge(const Map &dependencies, Callback callback) {
+    while (m_paths.size() > MAX_FAN_IN) {
+      const std::vector<std::string> paths(m_paths.begin(),
+                                           m_paths.begin() + MAX_FAN_IN);
+      const std::string path = next_path();
+      RunWriter writer(path);
+
+      const bool merged =
+          merge_sources(open_runs(paths),
+                        [&](const DependencyRecord &record) {
+                          writer.write(record);
+                        });
+
+      if (!writer.close() || !merged) {
+        std::remove(path.c_str());
+        return false;
+      }
+
+      for (const std::string &run_path : paths)
+        std::remove(run_path.c_str());
+
+      m_paths.erase(m_paths.begin(), m_paths.begin() + MAX_FAN_IN);
+      m_paths.push_back(path);
+    }
+
+    std::vector<std::unique_ptr<Source>> sources = open_runs(m_paths);
+    sources.emplace_back(new MapReader<Map>(dependencies));
+
+    if (!merge_sources(std::move(sources), callback))
+      return false;
+
+    for (const std::string &path : m_paths)
+      std::remove(path.c_str());
+
+    m_paths.clear();
+    return true;
+  }
+
+private:
+  // The number of records that are read or written at once.
+  static constexpr size_t BUFFER_SIZE = 4096;
+
+  // The maximum number of runs that are read at once.
+  static constexpr size_t MAX_FAN_IN = 16;
+
+  // A sorted sequence of records.
+  class Source {
+  public:
+    virtual ~Source() {}
+
+    // Reads the next record. Returns false at the end, or on an error.
+    virtual bool next(DependencyRecord &record) = 0;
+
+    // Returns whether the records could not all be read.
+    virtual bool failed() const { return false; }
+  };
+
+  // Reads the records of a map of dependencies, in order.
+  template <typename Map> class MapReader : public Source {
+  public:
+    explicit MapReader(const Map &dependencies)
+        : m_it(dependencies.begin()), m_end(dependencies.end()) {
+      if (m_it != m_end)
+        m_dependency = m_it->second.begin();
+    }
+
+    bool next(DependencyRecord &record) override {
+      while (m_it != m_end) {
+        if (m_dependency != m_it->second.end()) {
+          record = {m_it->first, static_cast<ADDRINT>(m_dependency->first),
+                    m_dependency->second};
+          ++m_dependency;
+          return true;
+        }
+
+        if (++m_it != m_end)
+          m_dependency = m_it->second.begin();
+      }
+
+      return false;
+    }
+
+  private:
+    typename Map::const_iterator m_it;
+    typename Map::const_iterator m_end;
+    typename Map::mapped_type::const_iterator m_dependency;
+  };
+
+  // Reads the records of a run, a buffer at a time.
+  class RunReader : public Source {
+  public:
+    explicit RunReader(const std::string &path)
+        : m_ifs(path.c_str(), std::ios::binary), m_position(0),
+          m_failed(!m_ifs.is_open()) {}
+
+    bool next(DependencyRecord &record) override {
+      if (m_position == m_buffer.size()) {
+        if (m_failed)
+          return false;
+
+        m_buffer.resize(BUFFER_SIZE);
+        m_ifs.read(reinterpret_cast<char *>(m_buffer.data()),
+                   BUFFER_SIZE * sizeof(DependencyRecord));
+
+        const std::streamsize bytes = m_ifs.gcount();
+
+        // A run only holds whole records, so anything else means that it was
+        // truncated or could not be read.
+        if (m_ifs.bad() || (bytes % sizeof(DependencyRecord) != 0))
+          m_failed = true;
+
+        m_buffer.resize(bytes / sizeof(DependencyRecord));
+        m_position = 0;
+
+        if (m_buffer.empty())
+          return false;
+      }
+
+      record = m_buffer[m_position++];
+      return true;
+    }
+
+    bool failed() const override { return m_failed; }
+
+  private:
+    std::ifstream m_ifs;
+    std::vector<DependencyRecord> m_buffer;
+    size_t m_position;
+    bool m_failed;
+  };
+
+  // Writes records to a run, a buffer at a time.
+  class RunWriter {
+  public:
+    explicit RunWriter(const std::string &path)
+        : m_ofs(path.c_str(), std::ios::binary) {
+      m_buffer.reserve(BUFFER_SIZE);
+    }
+
+    void write(const DependencyRecord &record) {
+      m_buffer.push_back(record);
+
+      if (m_buffer.size() == BUFFER_SIZE)
+        flush();
+    }
+
+    // Writes the buffered records, and closes the run. Returns false if the
+    // run could not be written.
+    bool close() {
+      flush();
+      m_ofs.close();
+      return !m_ofs.fail();
+    }
+
+  private:
+    void flush() {
+      m_ofs.write(reinterpret_cast<const char *>(m_buffer.data()),
+                  m_buffer.size() * sizeof(DependencyRecord));
+      m_buffer.clear();
+    }
+
+    std::ofstream m_ofs;
+    std::vector<DependencyRecord> m_buffer;
+  };
+
+  // Returns the path of a new run.
+  std::string next_path() {
+    return m_path_prefix + ".run" + std::to_string(m_next_run++);
+  }
+
+  // Opens the runs at the given paths.
+  static std::vector<std::unique_ptr<Source>>
+  open_runs(const std::vector<std::string> &paths) {
+    std::vector<std::unique_ptr<Source>> sources;
+
+    for (const std::string &path : paths)
+      sources.emplace_back(new RunReader(path));
+
+    return sources;
+  }
+
+  // Merges sorted sources, and calls 'callback' with every distinct record, in
+  // order. Returns false if a source could not be read entirely.
+  template <typename Callback>
+  static bool merge_sources(std::vector<std::unique_ptr<Source>> sources,
+                            Callback callback) {
+    // Min-heap of the next record of every source.
+    typedef std::pair<DependencyRecord, size_t> Entry;
+    auto greater = [](const Entry &a, const Entry &b) {
+      return b.first < a.first;
+    };
+    std::priority_queue<Entry, std::vector<Entry>, decltype(greater)> heap(
+        greater);
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+      DependencyRecord record;
+      if (sources[i]->next(record))
+        heap.push(Entry(record, i));
+    }
+
+    bool first = true;
+    DependencyRecord last = {};
+
+    while (!heap.empty()) {
+      const Entry entry = heap.top();
+      heap.pop();
+
+      if (first || !(entry.first == last)) {
+        callback(entry.first);
+        last = entry.first;
+        first = false;
+      }
+
+      DependencyRecord record;
+      if (sources[entry.second]->next(record))
+        heap.push(Entry(record, entry.second));
+    }
+
+    for (const auto &source : sources) {
+      if (source->failed())
+        return false;
+    }
+
+    return true;
+  }
+
+  std::string m_path_prefix;
+  std::vector<std::string> m_paths;
+  size_t m_next_run;
+};
+
+#endif
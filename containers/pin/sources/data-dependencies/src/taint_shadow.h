@@ -0,0 +1,169 @@
+#ifndef TAINT_SHADOW_H
+#define TAINT_SHADOW_H
+
+#include "pin.H"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/* SHADOW MEMORY OF TAINT BITS, FOR -taint */
+
+// Keeps one taint bit for every byte of memory.
+//
+// The bits are stored in pages, which are only allocated once a byte in them
+// is tainted, so memory that never holds tainted data costs nothing. The bits
+// of a range of bytes are tested and updated up to a 64-bit word at a time,
+// with a single page lookup per word.
+class TaintShadow {
+public:
+  // Returns whether any of the bytes in [address, address + size) is tainted.
+  bool any(ADDRINT address, ADDRINT size) const {
+    while (size > 0) {
+      const ADDRINT count = std::min<ADDRINT>(size, WORD_BITS);
+
+      if (read_bits(address, count) != 0)
+        return true;
+
+      address += count;
+      size -= count;
+    }
+
+    return false;
+  }
+
+  // Taints or untaints the bytes in [address, address + size).
+  void set(ADDRINT address, ADDRINT size, bool tainted) {
+    const std::uint64_t bits = tainted ? ~std::uint64_t(0) : 0;
+
+    while (size > 0) {
+      const ADDRINT count = std::min<ADDRINT>(size, WORD_BITS);
+
+      write_bits(address, count, bits);
+
+      address += count;
+      size -= count;
+    }
+  }
+
+  // Copies the taint of the bytes in [src, src + size) to [dst, dst + size).
+  // The ranges may overlap.
+  void copy(ADDRINT dst, ADDRINT src, ADDRINT size) {
+    std::vector<std::uint64_t> words((size + WORD_BITS - 1) / WORD_BITS);
+
+    for (ADDRINT i = 0; i < size; i += WORD_BITS)
+      words[i / WORD_BITS] =
+          read_bits(src + i, std::min<ADDRINT>(size - i, WORD_BITS));
+
+    for (ADDRINT i = 0; i < size; i += WORD_BITS)
+      write_bits(dst + i, std::min<ADDRINT>(size - i, WORD_BITS),
+                 words[i / WORD_BITS]);
+  }
+
+  // Returns the number of allocated pages.
+  size_t size() const { return m_pages.size(); }
+
+private:
+  static constexpr ADDRINT PAGE_SIZE = 4096;
+  static constexpr ADDRINT WORD_BITS = 64;
+
+  typedef std::array<std::uint64_t, PAGE_SIZE / WORD_BITS> Page;
+
+  // Returns a mask of the 'count' lowest bits, for 'count' up to 64.
+  static std::uint64_t mask(ADDRINT count) {
+    return (count == WORD_BITS) ? ~std::uint64_t(0)
+                                : (std::uint64_t(1) << count) - 1;
+  }
+
+  // Returns the 'count' bits at 'offset' in a page, for 'count' up to 64. The
+  // bits may span two words, but not the end of the page.
+  static std::uint64_t get_page_bits(const Page &page, ADDRINT offset,
+                                     ADDRINT count) {
+    const ADDRINT word = offset / WORD_BITS;
+    const ADDRINT shift = offset % WORD_BITS;
+    std::uint64_t bits = page[word] >> shift;
+
+    if ((shift != 0) && (shift + count > WORD_BITS))
+      bits |= page[word + 1] << (WORD_BITS - shift);
+
+    return bits & mask(count);
+  }
+
+  // Sets the 'count' bits at 'offset' in a page to the lowest bits of 'bits',
+  // with the same limits as get_page_bits().
+  static void set_page_bits(Page &page, ADDRINT offset, ADDRINT count,
+                            std::uint64_t bits) {
+    const ADDRINT word = offset / WORD_BITS;
+    const ADDRINT shift = offset % WORD_BITS;
+    const std::uint64_t m = mask(count);
+
+    bits &= m;
+    page[word] = (page[word] & ~(m << shift)) | (bits << shift);
+
+    if ((shift != 0) && (shift + count > WORD_BITS)) {
+      page[word + 1] = (page[word + 1] & ~(m >> (WORD_BITS - shift))) |
+                       (bits >> (WORD_BITS - shift));
+    }
+  }
+
+  // Returns the taint bits of the bytes in [address, address + count), for
+  // 'count' up to 64, in the lowest bits.
+  std::uint64_t read_bits(ADDRINT address, ADDRINT count) const {
+    const ADDRINT offset = address & (PAGE_SIZE - 1);
+    const ADDRINT first = std::min<ADDRINT>(count, PAGE_SIZE - offset);
+    std::uint64_t bits = 0;
+
+    if (const Page *page = find_page(address))
+      bits = get_page_bits(*page, offset, first);
+
+    if (first < count) {
+      if (const Page *page = find_page(address + first))
+        bits |= get_page_bits(*page, 0, count - first) << first;
+    }
+
+    return bits;
+  }
+
+  // Sets the taint bits of the bytes in [address, address + count), for
+  // 'count' up to 64, to the lowest bits of 'bits'. Pages are only allocated
+  // to taint bytes.
+  void write_bits(ADDRINT address, ADDRINT count, std::uint64_t bits) {
+    const ADDRINT offset = address & (PAGE_SIZE - 1);
+    const ADDRINT first = std::min<ADDRINT>(count, PAGE_SIZE - offset);
+
+    write_page_bits(address, offset, first, bits);
+
+    if (first < count)
+      write_page_bits(address + first, 0, count - first, bits >> first);
+  }
+
+  void write_page_bits(ADDRINT address, ADDRINT offset, ADDRINT count,
+                       std::uint64_t bits) {
+    Page *page =
+        ((bits & mask(count)) != 0) ? &get_page(address) : find_page(address);
+
+    if (page)
+      set_page_bits(*page, offset, count, bits);
+  }
+
+  Page *find_page(ADDRINT address) const {
+    auto it = m_pages.find(address / PAGE_SIZE);
+    return (it != m_pages.end()) ? it->second.get() : nullptr;
+  }
+
+  Page &get_page(ADDRINT address) {
+    std::unique_ptr<Page> &page = m_pages[address / PAGE_SIZE];
+
+    if (!page)
+      page.reset(new Page());
+
+    return *page;
+  }
+
+  std::unordered_map<ADDRINT, std::unique_ptr<Page>> m_pages;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef VIRTUAL_INSTRUCTION_TABLE_H
+#define VIRTUAL_INSTRUCTION_TABLE_H
+
+#include "pin.H"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/* HASH-CONSING OF VIRTUAL "MERGE" INSTRUCTIONS */
+
+// A (memory address, instruction address) pair: the instruction that last
+// wrote to the memory address.
+typedef std::pair<ADDRINT, ADDRINT> LastWrite;
+
+// Maps lists of last writes to the virtual instruction that merges them, so
+// that every distinct list gets a single virtual instruction.
+//
+// The lists are stored back to back in one vector, and looked up through an
+// open-addressing table of (fingerprint, list) slots with linear probing. The
+// full lists are only compared when their 64-bit fingerprints match, so a
+// lookup is usually a hash of the list and a single comparison.
+class VirtualInstructionTable {
+public:
+  VirtualInstructionTable() : m_slots(16), m_size(0) {}
+
+  // Looks up the virtual instruction of a sorted list of last writes, with at
+  // least one element. If there is none yet, adds the list, and sets
+  // 'inserted' to true. The caller then needs to assign the returned
+  // instruction address, which is only valid until the next lookup.
+  ADDRINT &lookup(const LastWrite *writes, size_t count, bool &inserted) {
+    const std::uint64_t fingerprint = hash(writes, count);
+
+    for (size_t i = fingerprint & (m_slots.size() - 1);;
+         i = (i + 1) & (m_slots.size() - 1)) {
+      Slot &slot = m_slots[i];
+
+      if (slot.count == 0) {
+        // Grow before the table gets half full, which keeps the probe
+        // sequences short.
+        if (2 * (m_size + 1) > m_slots.size()) {
+          grow();
+          return lookup(writes, count, inserted);
+        }
+
+        slot.fingerprint = fingerprint;
+        slot.first = m_writes.size();
+        slot.count = count;
+        m_writes.insert(m_writes.end(), writes, writes + count);
+        ++m_size;
+
+        inserted = true;
+        return slot.instruction;
+      }
+
+      if ((slot.fingerprint == fingerprint) && (slot.count == count) &&
+          std::equal(writes, writes + count, m_writes.begin() + slot.first)) {
+        inserted = false;
+        return slot.instruction;
+      }
+    }
+  }
+
+  // Returns the number of distinct lists.
+  size_t size() const { return m_size; }
+
+private:
+  struct Slot {
+    Slot() : fingerprint(0), first(0), count(0), instruction(0) {}
+
+    std::uint64_t fingerprint; // Hash of the list.
+    size_t first;              // Index of the list in m_writes.
+    size_t count;              // Length of the list, or 0 for an empty slot.
+    ADDRINT instruction;       // Address of the virtual instruction.
+  };
+
+  static std::uint64_t mix(std::uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  static std::uint64_t hash(const LastWrite *writes, size_t count) {
+    std::uint64_t h = count;
+
+    for (size_t i = 0; i < count; ++i) {
+      h = mix(h + 0x9e3779b97f4a7c15ULL + writes[i].first);
+      h = mix(h + 0x9e3779b97f4a7c15ULL + writes[i].second);
+    }
+
+    return h;
+  }
+
+  void grow() {
+    std::vector<Slot> slots(2 * m_slots.size());
+
+    for (const Slot &slot : m_slots) {
+      if (slot.count == 0)
+        continue;
+
+      size_t i = slot.fingerprint & (slots.size() - 1);
+      while (slots[i].count != 0)
+        i = (i + 1) & (slots.size() - 1);
+
+      slots[i] = slot;
+    }
+
+    m_slots.swap(slots);
+  }
+
+  std::vector<Slot> m_slots;
+  std::vector<LastWrite> m_writes;
+  size_t m_size;
+};
+
+#endif
@@ -0,0 +1,63 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -epoch_marker epoch_marker -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t --epoch=0 >%t.epoch0.out
+// RUN: pretty-print-csvs.py --prefix=%t --epoch=1 >%t.epoch1.out
+
+// RUN: cat %t.symbols %t.epoch0.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefix=EPOCH0
+// RUN: cat %t.symbols %t.epoch1.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefix=EPOCH1
+// RUN: cat %t.symbols %t.epochs.csv | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefix=EPOCHS
+
+// REQUIRES: x64
+
+#include <cstdint>
+
+asm(R"(
+  .section        .text
+  .globl          func
+
+.balign 16; func:
+.balign 16;   mov    QWORD PTR [rdi], 1
+.balign 16;   mov    rcx, QWORD PTR [rdi]
+.balign 16;   push   rdi
+.balign 16;   call   epoch_marker
+.balign 16;   pop    rdi
+.balign 16;   mov    rdx, QWORD PTR [rdi]
+.balign 16;   ret
+)");
+
+extern "C" void func(std::int64_t *buffer);
+
+extern "C" __attribute__((noinline)) void epoch_marker() { asm volatile(""); }
+
+int main() {
+  std::int64_t buffer;
+
+  func(&buffer);
+
+  return 0;
+}
+
+// clang-format off
+
+// EPOCH0:     [[#%x,FUNC_ADDR:]] {{.*}} func
+// EPOCH0:     MEMORY DEPENDENCIES
+// EPOCH0:     Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(0, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(1, 16)]]
+// EPOCH0-NOT: Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(0, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(5, 16)]]
+
+// The dependency belongs to the epoch of the reading instruction, even if the
+// writing instruction ran in an earlier epoch.
+// EPOCH1:     [[#%x,FUNC_ADDR:]] {{.*}} func
+// EPOCH1:     MEMORY DEPENDENCIES
+// EPOCH1-NOT: Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(0, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(1, 16)]]
+// EPOCH1:     Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(0, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(5, 16)]]
+
+// The marker epoch starts at the return address of the call.
+// EPOCHS:      [[#%x,FUNC_ADDR:]] {{.*}} func
+// EPOCHS:      epoch,cause,image_name,image_offset,thread_id
+// EPOCHS-NEXT: 0,start,"???",-1,0
+// EPOCHS-NEXT: 1,marker,"[[EXE_NAME]]",[[#%u,FUNC_ADDR + mul(4, 16)]],0
+// EPOCHS-NOT:  {{.}}
@@ -0,0 +1,60 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -shortcuts -epoch_marker epoch_marker -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t --epoch=0 >%t.epoch0.out
+// RUN: pretty-print-csvs.py --prefix=%t --epoch=1 >%t.epoch1.out
+
+// RUN: cat %t.symbols %t.epoch0.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefixes=CHECK,EPOCH0
+// RUN: cat %t.symbols %t.epoch1.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefixes=CHECK,EPOCH1
+
+// REQUIRES: x64
+
+#include <cstdint>
+
+asm(R"(
+  .section        .text
+  .globl          func
+
+.balign 16; func:
+.balign 16;   mov    BYTE PTR [rdi], 1
+.balign 16;   mov    BYTE PTR [rdi + 1], 2
+.balign 16;   mov    ax, WORD PTR [rdi]
+.balign 16;   mov    cx, ax
+.balign 16;   push   rdi
+.balign 16;   call   epoch_marker
+.balign 16;   pop    rdi
+.balign 16;   mov    ax, WORD PTR [rdi]
+.balign 16;   mov    dx, ax
+.balign 16;   ret
+)");
+
+// Loads a word with two last writers before and after the marker, which both
+// merge them in the same virtual instruction.
+extern "C" void func(std::int16_t *buffer);
+
+extern "C" __attribute__((noinline)) void epoch_marker() { asm volatile(""); }
+
+int main() {
+  std::int16_t buffer;
+
+  func(&buffer);
+
+  return 0;
+}
+
+// clang-format off
+
+// CHECK:  [[#%x,FUNC_ADDR:]] {{.*}} func
+
+// The use of the merged word depends on the virtual instruction.
+// CHECK:  REGISTER DEPENDENCIES
+// EPOCH0: Instructions: virtual-instructions+0x[[#%x,VIRTUAL:]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(3, 16)]]
+// EPOCH1: Instructions: virtual-instructions+0x[[#%x,VIRTUAL:]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(8, 16)]]
+
+// Every epoch that uses the virtual instruction has its predecessors.
+// CHECK:  MEMORY DEPENDENCIES
+// CHECK:  Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(0, 16)]] <- virtual-instructions+0x[[#VIRTUAL]]
+// CHECK:  Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(1, 16)]] <- virtual-instructions+0x[[#VIRTUAL]]
@@ -0,0 +1,24 @@
+// RUN: g++ %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t.memory -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: %sde %toolarg -csv_prefix %t.spill -max_dependencies_memory 1 -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+
+// Spilling the dependencies to run files does not change the output, and the
+// run files are removed at the end.
+// RUN: diff %t.memory.memory_dependencies.csv %t.spill.memory_dependencies.csv
+// RUN: diff %t.memory.register_dependencies.csv %t.spill.register_dependencies.csv
+// RUN: not ls %t.spill.*.run*
+
+// With a limit of 1 MiB, the dependencies of the loops below do not fit in
+// memory.
+static int values[1 << 16];
+
+int main() {
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 1; i < (1 << 16); ++i)
+      values[i] = values[i - 1] + round;
+  }
+
+  return values[(1 << 16) - 1] == (1 << 16) - 1 ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -scope_image %basename_t.tmp.exe -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t >%t.out
+
+// RUN: cat %t.symbols %t.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe
+
+// REQUIRES: x64
+
+asm(R"(
+  .section        .text
+  .globl          sort
+
+.balign 16; sort:
+.balign 16;   push   rbx
+.balign 16;   mov    rbx, rdi
+.balign 16;   mov    esi, 2
+.balign 16;   mov    edx, 4
+.balign 16;   lea    rcx, [rip + compare]
+.balign 16;   call   qsort@PLT
+.balign 16;   mov    eax, DWORD PTR [rbx]
+.balign 16;   pop    rbx
+.balign 16;   ret
+
+.balign 16; compare:
+.balign 16;   mov    eax, DWORD PTR [rdi]
+.balign 16;   sub    eax, DWORD PTR [rsi]
+.balign 16;   ret
+)");
+
+// Sorts two integers with qsort(), whose comparator is in scope, and loads the
+// first one.
+extern "C" int sort(int *array);
+
+int main() {
+  int array[2] = {2, 1};
+
+  return sort(array) == 1 ? 0 : 1;
+}
+
+// clang-format off
+
+// Grab the start address of the 'sort' function.
+// CHECK: [[#%x,SORT_ADDR:]] {{.*}} sort
+
+// qsort() swaps the integers after the comparator returned, still on behalf of
+// the call of qsort(), so the load depends on the call.
+// CHECK:      MEMORY DEPENDENCIES
+// CHECK:      Instructions: [[EXE_NAME]]+0x[[#SORT_ADDR + mul(5, 16)]] <- [[EXE_NAME]]+0x[[#SORT_ADDR + mul(6, 16)]]
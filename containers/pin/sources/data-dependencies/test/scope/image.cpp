@@ -0,0 +1,56 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -scope_image %basename_t.tmp.exe -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t >%t.out
+
+// RUN: cat %t.symbols %t.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe
+
+// No dependencies are recorded in the other images.
+// RUN: cat %t.memory_dependencies.csv %t.register_dependencies.csv | \
+// RUN: FileCheck %s --check-prefix=SCOPE
+
+// REQUIRES: x64
+
+#include <cstring>
+
+asm(R"(
+  .section        .text
+  .globl          fill
+
+.balign 16; fill:
+.balign 16;   push   rbx
+.balign 16;   mov    rbx, rdi
+.balign 16;   mov    esi, 1
+.balign 16;   mov    edx, 16
+.balign 16;   call   memset@PLT
+.balign 16;   movzx  eax, BYTE PTR [rbx]
+.balign 16;   pop    rbx
+.balign 16;   ret
+)");
+
+extern "C" int fill(char *buffer);
+
+int main() {
+  char buffer[16];
+
+  return fill(buffer) == 1 ? 0 : 1;
+}
+
+// clang-format off
+
+// Grab the start address of the 'fill' function.
+// CHECK: [[#%x,FILL_ADDR:]] {{.*}} fill
+
+// The call depends on the registers that memset() reads.
+// CHECK:      REGISTER DEPENDENCIES
+// CHECK:      Instructions: [[EXE_NAME]]+0x[[#FILL_ADDR + mul(3, 16)]] <- [[EXE_NAME]]+0x[[#FILL_ADDR + mul(4, 16)]]
+// CHECK-NEXT: Register: rdx
+
+// The bytes that memset() writes are written on behalf of the call.
+// CHECK:      MEMORY DEPENDENCIES
+// CHECK:      Instructions: [[EXE_NAME]]+0x[[#FILL_ADDR + mul(4, 16)]] <- [[EXE_NAME]]+0x[[#FILL_ADDR + mul(5, 16)]]
+
+// SCOPE-NOT: libc
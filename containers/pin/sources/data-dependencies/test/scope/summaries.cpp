@@ -0,0 +1,74 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe %S/../syscalls/Input/test.txt
+// RUN: %sde %toolarg -csv_prefix %t -scope_image %basename_t.tmp.exe -libc_summaries -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t >%t.out
+
+// RUN: cat %t.symbols %t.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe
+
+// RUN: %sde %toolarg -csv_prefix %t.taint -scope_image %basename_t.tmp.exe -libc_summaries -syscall_file %S/../syscalls/Input/syscalls.csv -taint 1 -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+
+// RUN: cat %t.symbols %t.taint.tainted_instructions.csv | \
+// RUN: FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefix=TAINT
+
+// REQUIRES: x64
+
+#include <cstdio>
+#include <iostream>
+
+asm(R"(
+  .section        .text
+  .globl          func
+
+.balign 16; func:
+.balign 16;   push   rbx
+.balign 16;   mov    rbx, rsi
+.balign 16;   mov    DWORD PTR [rsi], 0
+.balign 16;   mov    rcx, rdi
+.balign 16;   mov    rdi, rsi
+.balign 16;   mov    esi, 1
+.balign 16;   mov    edx, 4
+.balign 16;   call   fread@PLT
+.balign 16;   mov    eax, DWORD PTR [rbx]
+.balign 16;   pop    rbx
+.balign 16;   ret
+)");
+
+// Clears the buffer, reads 4 bytes of the file into it with fread(), and loads
+// them. fread() copies the bytes from the buffer of the file with memcpy().
+extern "C" int func(FILE *file, char *buffer);
+
+int main(int argc, char *argv[]) {
+  char buffer[4];
+  FILE *file = fopen(argv[1], "r");
+
+  func(file, buffer);
+  fclose(file);
+
+  // Link the same libraries as syscalls/read.cpp, whose system call
+  // specification this test shares.
+  std::cout << "Output: " << buffer[0] << "\n";
+
+  return 0;
+}
+
+// clang-format off
+
+// Grab the start address of the 'func' function.
+// CHECK: [[#%x,FUNC_ADDR:]] {{.*}} func
+
+// The memcpy() that fread() calls from out of scope is summarized on behalf of
+// the call of fread(), so that the load does not depend on the store that
+// cleared the buffer.
+// CHECK:     MEMORY DEPENDENCIES
+// CHECK-NOT: Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(2, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(8, 16)]]
+// CHECK:     Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(7, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(8, 16)]]
+// CHECK-NOT: Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(2, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(8, 16)]]
+
+// The summary copies the taint of the data that read() put in the buffer of
+// the file.
+// TAINT: [[#%x,FUNC_ADDR:]] {{.*}} func
+// TAINT: image_name,image_offset,count
+// TAINT: "[[EXE_NAME]]",[[#%u,FUNC_ADDR + mul(8, 16)]],1
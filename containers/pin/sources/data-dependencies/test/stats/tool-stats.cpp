@@ -0,0 +1,30 @@
+// RUN: g++ %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -tool_stats 1 -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: FileCheck %s < %t.toolstats.json
+
+// Without -tool_stats, no statistics are written.
+// RUN: rm -f %t.toolstats.json
+// RUN: %sde %toolarg -csv_prefix %t -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+// RUN: not test -e %t.toolstats.json
+
+int values[16];
+
+int main() {
+  for (int i = 1; i < 16; ++i)
+    values[i] = values[i - 1] + i;
+
+  return values[15] == 120 ? 0 : 1;
+}
+
+// CHECK:      "analysis_calls": {
+// CHECK:        "InstructionBefore": {{[1-9][0-9]*}}
+// CHECK:        "MemoryReadBefore": {{[1-9][0-9]*}}
+// CHECK:      "locks": {
+// CHECK:        "memoryLock": {"acquisitions": {{[1-9][0-9]*}}, "contended": {{[0-9]+}}}
+// CHECK:      "timers": {
+// CHECK:        "OnInstruction": {"calls": {{[1-9][0-9]*}}, "seconds": {{.*}}}
+// CHECK:        "Fini": {"calls": 1, "seconds": {{.*}}}
+// CHECK:      "peak_sizes": {
+// CHECK:        "lastMemoryWrite": {{[1-9][0-9]*}}
@@ -0,0 +1,88 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+
+// RUN: %sde %toolarg -csv_prefix %t -libc_summaries -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp >%t.appout
+// RUN: pretty-print-csvs.py --prefix=%t > %t.out
+
+// RUN: cat %t.appout %t.symbols %t.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefixes=CHECK,NOSHORTCUTS
+
+// RUN: %sde %toolarg -csv_prefix %t.shortcuts -libc_summaries -shortcuts -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp >%t.appout
+// RUN: pretty-print-csvs.py --prefix=%t.shortcuts > %t.shortcuts.out
+
+// RUN: cat %t.appout %t.symbols %t.shortcuts.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe --check-prefixes=CHECK,SHORTCUTS
+
+// REQUIRES: x64
+
+#include <cstdint>
+#include <iostream>
+
+asm(R"(
+  .section        .text
+  .globl          func
+
+.balign 16; func:
+.balign 16;   push   rbx
+
+.balign 16;   mov    QWORD PTR [rdi], 1
+
+.balign 16;   mov    rbx, rsi
+.balign 16;   xchg   rdi, rsi
+.balign 16;   mov    edx, 8
+.balign 16;   call   memcpy@PLT
+
+.balign 16;   mov    rcx, QWORD PTR [rbx]
+.balign 16;   mov    rdx, rax
+
+.balign 16;   pop    rbx
+.balign 16;   ret
+)");
+
+// Writes to src, copies src to dst with memcpy(), reads dst, and reads the
+// pointer that memcpy() returns.
+extern "C" void func(std::int64_t *src, std::int64_t *dst);
+
+int main(int argc, char *argv[]) {
+  std::int64_t x, y;
+
+  std::cout << "Address of x: " << &x << std::endl;
+  std::cout << "Address of y: " << &y << std::endl;
+  func(&x, &y);
+
+  return 0;
+}
+
+// clang-format off
+
+// Grab the addresses of x and y.
+// CHECK: Address of x: 0x[[#%x,X_ADDR:]]
+// CHECK: Address of y: 0x[[#%x,Y_ADDR:]]
+
+// Grab the start address of the 'func' function.
+// CHECK: [[#%x,FUNC_ADDR:]] {{.*}} func
+
+// The call of memcpy() writes the returned pointer.
+// CHECK:      REGISTER DEPENDENCIES
+// CHECK-NOT:  <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(7, 16)]]
+// CHECK:      Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(5, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(7, 16)]]
+// CHECK-NEXT: Register: rax
+// CHECK-NOT:  <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(7, 16)]]
+
+// CHECK: MEMORY DEPENDENCIES
+// CHECK: ===================
+
+// Without shortcuts, the call of memcpy() reads x and writes y.
+// NOSHORTCUTS:      Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(1, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(5, 16)]]
+// NOSHORTCUTS:      Memory address:
+// NOSHORTCUTS-SAME: 0x[[#X_ADDR]]
+
+// NOSHORTCUTS:      Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(5, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(6, 16)]]
+// NOSHORTCUTS:      Memory address:
+// NOSHORTCUTS-SAME: 0x[[#Y_ADDR]]
+
+// With shortcuts, the read of y depends on the write of x.
+// SHORTCUTS:      Instructions: [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(1, 16)]] <- [[EXE_NAME]]+0x[[#FUNC_ADDR + mul(6, 16)]]
+// SHORTCUTS:      Memory address:
+// SHORTCUTS-SAME: 0x[[#Y_ADDR]]
@@ -0,0 +1,76 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm --numeric-sort %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe %S/Input/test.txt key!
+// RUN: %sde %toolarg -csv_prefix %t -syscall_file %S/Input/syscalls.csv -taint 1 -replay -replay:basename %t/pinball -replay:addr_trans -replay:playout -- nullapp
+
+// RUN: cat %t.symbols %t.tainted_instructions.csv | \
+// RUN: FileCheck %s -DEXE_NAME=%basename_t.tmp.exe
+
+// No dependencies are recorded with -taint.
+// RUN: cat %t.memory_dependencies.csv | FileCheck %s --check-prefix=EMPTY
+
+// REQUIRES: x64
+
+#include <cstdint>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+asm(R"(
+    .section    .text
+    .globl      encrypt
+
+.balign 16; encrypt:
+
+.balign 16; .copyloop:
+.balign 16;     mov         al, BYTE PTR [rsi]
+.balign 16;     mov         ah, BYTE PTR [rdx]
+.balign 16;     xor         ah, al
+.balign 16;     mov         BYTE PTR [rdi], ah
+.balign 16;     inc         rsi
+.balign 16;     inc         rdx
+.balign 16;     inc         rdi
+.balign 16;     loop        .copyloop
+
+.balign 16;     ret
+)");
+
+extern "C" void encrypt(char *out, char *data, char *key, std::int64_t len);
+
+int main(int argc, char *argv[]) {
+  char data[4] = {};
+  char out[4] = {};
+
+  int fd = open(argv[1], O_RDONLY);
+  read(fd, data, 4);
+  close(fd);
+
+  encrypt(out, data, argv[2], 4);
+
+  // Link the same libraries as read.cpp, whose system call specification this
+  // test shares.
+  std::cout << "Output: " << std::hex << (int)out[0] << "\n";
+
+  return 0;
+}
+
+// clang-format off
+
+// Grab the start address of the 'encrypt' function.
+// CHECK: [[#%x,ENCRYPT_ADDR:]] {{.*}} encrypt
+
+// CHECK: image_name,image_offset,count
+
+// The loads of the key, the increments and the loop do not read data from the
+// file, but the other instructions of the loop do, once per byte.
+// CHECK-NOT: "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(1, 16)]],
+// CHECK:     "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(0, 16)]],4
+// CHECK-NOT: "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(1, 16)]],
+// CHECK:     "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(2, 16)]],4
+// CHECK-NEXT: "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(3, 16)]],4
+// CHECK-NOT: "[[EXE_NAME]]",[[#%u,ENCRYPT_ADDR + mul(4, 16)]],
+
+// EMPTY:      Write_img,Write_off,Memory,Read_img,Read_off
+// EMPTY-NOT:  {{.}}
@@ -7,11 +7,13 @@ import csv
 parser = argparse.ArgumentParser(description = 'Helper script to print the contents of the CSV output files of the data dependencies Pin tool', epilog='example: pretty-print-csvs.py --prefix=path/to/prefix')
 
 parser.add_argument('--prefix', help='Prefix path of the CSV files', required=True)
+parser.add_argument('--epoch', type=int, help='Print the dependencies of this epoch, when the tool ran with epochs')
 
 args = parser.parse_args()
 
 # Read arguments
 prefix = args.prefix
+dependencies_prefix = prefix if args.epoch is None else f'{prefix}.epoch{args.epoch}'
 
 def print_syscall_ins(csv_file):
     reader = csv.DictReader(csv_file)
@@ -50,7 +52,7 @@ print('REGISTER DEPENDENCIES')
 print('=====================')
 print()
 
-with open(prefix + '.register_dependencies.csv') as f:
+with open(dependencies_prefix + '.register_dependencies.csv') as f:
     print_register_deps(f)
 
 # Print memory deps
@@ -59,5 +61,5 @@ print('MEMORY DEPENDENCIES')
 print('===================')
 print()
 
-with open(prefix + '.memory_dependencies.csv') as f:
+with open(dependencies_prefix + '.memory_dependencies.csv') as f:
     print_memory_deps(f)
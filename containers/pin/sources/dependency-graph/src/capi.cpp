@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "capi.h"
+#include "graph.h"
+
+struct DgGraph {
+  DependencyGraph graph;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// Copies a list of nodes to a buffer that the caller frees with
+// dg_free_nodes().
+size_t return_nodes(const std::vector<std::uint32_t> &list,
+                    uint32_t **nodes) {
+  *nodes = static_cast<uint32_t *>(
+      std::malloc(std::max<std::size_t>(list.size(), 1) * sizeof(uint32_t)));
+
+  if (!list.empty())
+    std::memcpy(*nodes, list.data(), list.size() * sizeof(uint32_t));
+
+  return list.size();
+}
+
+} // namespace
+
+DgGraph *dg_load(const char *prefix, int memory, int registers,
+                 const char *excluded_registers) {
+  LoadOptions options;
+  options.memory = memory;
+  options.registers = registers;
+
+  // Split the list of registers.
+  const std::string list = excluded_registers ? excluded_registers : "";
+  std::string::size_type begin = 0;
+
+  while (begin < list.size()) {
+    std::string::size_type end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+
+    if (end != begin)
+      options.excluded_registers.push_back(list.substr(begin, end - begin));
+
+    begin = end + 1;
+  }
+
+  DgGraph *graph = new DgGraph();
+
+  if (!graph->graph.load(prefix, options, last_error)) {
+    delete graph;
+    return nullptr;
+  }
+
+  return graph;
+}
+
+void dg_free(DgGraph *graph) { delete graph; }
+
+const char *dg_last_error(void) { return last_error.c_str(); }
+
+uint32_t dg_num_nodes(const DgGraph *graph) {
+  return graph->graph.num_nodes();
+}
+
+uint64_t dg_num_edges(const DgGraph *graph) {
+  return graph->graph.num_edges();
+}
+
+int64_t dg_find_node(const DgGraph *graph, const char *image_name,
+                     int64_t image_offset) {
+  const std::uint32_t node = graph->graph.find_node(image_name, image_offset);
+
+  return (node == DependencyGraph::NO_NODE) ? -1 : node;
+}
+
+const char *dg_image_name(const DgGraph *graph, uint32_t node) {
+  return graph->graph.image_name(node).c_str();
+}
+
+int64_t dg_image_offset(const DgGraph *graph, uint32_t node) {
+  return graph->graph.image_offset(node);
+}
+
+size_t dg_expand(const DgGraph *graph, const uint32_t *seeds, size_t num_seeds,
+                 uint32_t max_depth, int direction, uint32_t **nodes) {
+  return return_nodes(
+      graph->graph.expand(std::vector<std::uint32_t>(seeds, seeds + num_seeds),
+                          max_depth, static_cast<Direction>(direction)),
+      nodes);
+}
+
+void dg_distances(const DgGraph *graph, const uint32_t *sources,
+                  const uint32_t *targets, size_t num_pairs, int direction,
+                  uint32_t max_length, uint32_t num_threads,
+                  uint32_t *distances) {
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+
+  for (size_t i = 0; i < num_pairs; ++i)
+    pairs.emplace_back(sources[i], targets[i]);
+
+  const std::vector<std::uint32_t> result =
+      graph->graph.distances(pairs, static_cast<Direction>(direction),
+                             max_length, num_threads);
+
+  std::copy(result.begin(), result.end(), distances);
+}
+
+size_t dg_shortest_path(const DgGraph *graph, uint32_t source, uint32_t target,
+                        int direction, uint32_t max_length, uint32_t **nodes) {
+  return return_nodes(
+      graph->graph.shortest_path(source, target,
+                                 static_cast<Direction>(direction), max_length),
+      nodes);
+}
+
+void dg_free_nodes(uint32_t *nodes) { std::free(nodes); }
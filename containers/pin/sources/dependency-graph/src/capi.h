@@ -0,0 +1,71 @@
+#ifndef CAPI_H
+#define CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface of the dependency graph in libDependencyGraph.so, for
+// containers/pin/dependency_graph.py, which loads it with ctypes. See graph.h
+// for the meaning of the queries.
+//
+// Nodes are numbered from 0. Lists of nodes that are returned must be freed
+// with dg_free_nodes(). Directions are 0 (dependencies), 1 (dependents) and 2
+// (both).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DgGraph DgGraph;
+
+// Loads the output of the data-dependencies tool with the given prefix.
+// 'excluded_registers' is a list of registers separated by ',', whose
+// dependencies are not loaded. Returns NULL if the output cannot be read, see
+// dg_last_error().
+DgGraph *dg_load(const char *prefix, int memory, int registers,
+                 const char *excluded_registers);
+
+// Frees a graph.
+void dg_free(DgGraph *graph);
+
+// Returns the error of the last call of dg_load() in this thread.
+const char *dg_last_error(void);
+
+uint32_t dg_num_nodes(const DgGraph *graph);
+uint64_t dg_num_edges(const DgGraph *graph);
+
+// Returns the node of an instruction, or -1.
+int64_t dg_find_node(const DgGraph *graph, const char *image_name,
+                     int64_t image_offset);
+
+// Returns the instruction of a node.
+const char *dg_image_name(const DgGraph *graph, uint32_t node);
+int64_t dg_image_offset(const DgGraph *graph, uint32_t node);
+
+// Stores the nodes at most 'max_depth' edges away from any of the seeds in
+// 'nodes', and returns their number.
+size_t dg_expand(const DgGraph *graph, const uint32_t *seeds, size_t num_seeds,
+                 uint32_t max_depth, int direction, uint32_t **nodes);
+
+// Stores the length of the shortest path from sources[i] to targets[i] in
+// distances[i], or UINT32_MAX if there is none of at most 'max_length' edges.
+// Uses 'num_threads' threads, or all processors if 0.
+void dg_distances(const DgGraph *graph, const uint32_t *sources,
+                  const uint32_t *targets, size_t num_pairs, int direction,
+                  uint32_t max_length, uint32_t num_threads,
+                  uint32_t *distances);
+
+// Stores the nodes on a shortest path from the source to the target in
+// 'nodes', and returns their number, which is 0 if there is no path of at
+// most 'max_length' edges.
+size_t dg_shortest_path(const DgGraph *graph, uint32_t source, uint32_t target,
+                        int direction, uint32_t max_length, uint32_t **nodes);
+
+// Frees a list of nodes.
+void dg_free_nodes(uint32_t *nodes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
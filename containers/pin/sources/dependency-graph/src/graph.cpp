@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "graph.h"
+#include "inputtable.h"
+
+void DependencyGraph::Search::start() {
+  ++number;
+
+  // Clear the stamps when the search number wraps around, so stamps of old
+  // searches cannot be mistaken for the current one.
+  if (number == 0) {
+    std::fill(stamps.begin(), stamps.end(), 0);
+    number = 1;
+  }
+}
+
+bool DependencyGraph::load(const std::string &prefix,
+                           const LoadOptions &options, std::string &error) {
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+
+  for (const auto &kind : {std::make_pair("memory", "Memory"),
+                           std::make_pair("register", "Register")}) {
+    const bool is_register = (kind.first == std::string("register"));
+
+    if (!(is_register ? options.registers : options.memory))
+      continue;
+
+    const std::string path = prefix + "." + kind.first + "_dependencies";
+    std::unique_ptr<InputTable> table = open_input_table(path);
+
+    if (!table) {
+      error = "Could not read '" + path + ".col' or '" + path + ".csv'!";
+      return false;
+    }
+
+    std::vector<int> columns;
+
+    for (const char *name :
+         {"Write_img", "Write_off", kind.second, "Read_img", "Read_off"}) {
+      columns.push_back(table->find_column(name));
+
+      if (columns.back() < 0) {
+        error = "'" + path + "' has no column '" + name + "'!";
+        return false;
+      }
+    }
+
+    while (table->next_row()) {
+      if (is_register && !options.excluded_registers.empty()) {
+        const std::string reg = table->get_string(columns[2]);
+
+        if (std::find(options.excluded_registers.begin(),
+                      options.excluded_registers.end(),
+                      reg) != options.excluded_registers.end())
+          continue;
+      }
+
+      const std::uint32_t write = get_node(table->get_string(columns[0]),
+                                           table->get_int64(columns[1]));
+      const std::uint32_t read = get_node(table->get_string(columns[3]),
+                                          table->get_int64(columns[4]));
+
+      // The reading instruction depends on the writing instruction.
+      edges.emplace_back(read, write);
+    }
+  }
+
+  build_csr(edges, dependency_offsets, dependency_targets);
+
+  for (auto &edge : edges)
+    std::swap(edge.first, edge.second);
+
+  build_csr(edges, dependent_offsets, dependent_targets);
+
+  return true;
+}
+
+std::uint32_t DependencyGraph::find_node(const std::string &image_name,
+                                         std::int64_t image_offset) const {
+  auto image = image_ids.find(image_name);
+  if (image == image_ids.end())
+    return NO_NODE;
+
+  auto node = node_ids.find(std::make_pair(image->second, image_offset));
+  if (node == node_ids.end())
+    return NO_NODE;
+
+  return node->second;
+}
+
+std::uint32_t DependencyGraph::get_node(const std::string &image_name,
+                                        std::int64_t image_offset) {
+  auto image = image_ids.emplace(image_name, image_names.size());
+  if (image.second)
+    image_names.push_back(image_name);
+
+  auto node = node_ids.emplace(
+      std::make_pair(image.first->second, image_offset), image_offsets.size());
+
+  if (node.second) {
+    node_images.push_back(image.first->second);
+    image_offsets.push_back(image_offset);
+  }
+
+  return node.first->second;
+}
+
+void DependencyGraph::build_csr(
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> &edges,
+    std::vector<std::uint64_t> &offsets,
+    std::vector<std::uint32_t> &targets) const {
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  offsets.assign(num_nodes() + 1, 0);
+  targets.resize(edges.size());
+
+  // Count the edges of every node, and turn the counts into offsets.
+  for (const auto &edge : edges)
+    ++offsets[edge.first + 1];
+
+  for (std::uint32_t node = 0; node < num_nodes(); ++node)
+    offsets[node + 1] += offsets[node];
+
+  // The edges are sorted by their source, so their targets are in order.
+  for (std::size_t i = 0; i < edges.size(); ++i)
+    targets[i] = edges[i].second;
+}
+
+template <typename F>
+void DependencyGraph::for_each_neighbour(std::uint32_t node,
+                                         Direction direction, F visit) const {
+  if (direction != Direction::DEPENDENTS) {
+    for (std::uint64_t i = dependency_offsets[node];
+         i < dependency_offsets[node + 1]; ++i)
+      visit(dependency_targets[i]);
+  }
+
+  if (direction != Direction::DEPENDENCIES) {
+    for (std::uint64_t i = dependent_offsets[node];
+         i < dependent_offsets[node + 1]; ++i)
+      visit(dependent_targets[i]);
+  }
+}
+
+template <typename Visit, typename Done>
+void DependencyGraph::search(Search &state, std::uint32_t source,
+                             Direction direction, std::uint32_t max_length,
+                             Visit visit, Done done) const {
+  state.start();
+  state.frontier.assign(1, source);
+  state.stamps[source] = state.number;
+  state.parents[source] = source;
+  visit(source, 0);
+
+  for (std::uint32_t depth = 1;
+       depth <= max_length && !state.frontier.empty() && !done(); ++depth) {
+    state.next_frontier.clear();
+
+    for (std::uint32_t node : state.frontier) {
+      for_each_neighbour(node, direction, [&](std::uint32_t neighbour) {
+        if (state.stamps[neighbour] == state.number)
+          return;
+
+        state.stamps[neighbour] = state.number;
+        state.parents[neighbour] = node;
+        state.next_frontier.push_back(neighbour);
+        visit(neighbour, depth);
+      });
+    }
+
+    state.frontier.swap(state.next_frontier);
+  }
+}
+
+std::vector<std::uint32_t>
+DependencyGraph::expand(const std::vector<std::uint32_t> &seeds,
+                        std::uint32_t max_depth, Direction direction) const {
+  // A search from all seeds at once visits the union of the nodes that the
+  // searches from every seed visit.
+  std::vector<bool> visited(num_nodes(), false);
+  std::vector<std::uint32_t> frontier;
+  std::vector<std::uint32_t> next_frontier;
+
+  for (std::uint32_t seed : seeds) {
+    if (seed < num_nodes() && !visited[seed]) {
+      visited[seed] = true;
+      frontier.push_back(seed);
+    }
+  }
+
+  std::vector<std::uint32_t> result = frontier;
+
+  for (std::uint32_t depth = 1; depth <= max_depth && !frontier.empty();
+       ++depth) {
+    next_frontier.clear();
+
+    for (std::uint32_t node : frontier) {
+      for_each_neighbour(node, direction, [&](std::uint32_t neighbour) {
+        if (visited[neighbour])
+          return;
+
+        visited[neighbour] = true;
+        next_frontier.push_back(neighbour);
+        result.push_back(neighbour);
+      });
+    }
+
+    frontier.swap(next_frontier);
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<std::uint32_t> DependencyGraph::distances(
+    const std::vector<std::pair<std::uint32_t, std::uint32_t>> &pairs,
+    Direction direction, std::uint32_t max_length,
+    unsigned num_threads) const {
+  std::vector<std::uint32_t> result(pairs.size(), NO_PATH);
+
+  // Group the pairs by their source, so that every source is searched once.
+  std::vector<std::size_t> order;
+
+  for (std::size_t i = 0; i < pairs.size(); ++i) {
+    if (pairs[i].first < num_nodes() && pairs[i].second < num_nodes())
+      order.push_back(i);
+  }
+
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return pairs[a].first < pairs[b].first;
+  });
+
+  std::vector<std::size_t> groups;
+
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    if (i == 0 || pairs[order[i]].first != pairs[order[i - 1]].first)
+      groups.push_back(i);
+  }
+
+  groups.push_back(order.size());
+
+  const std::size_t num_groups = groups.size() - 1;
+
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  num_threads = std::min<std::size_t>(num_threads, num_groups);
+
+  // Every thread takes the next group until all are done.
+  std::atomic<std::size_t> next_group(0);
+
+  auto worker = [&]() {
+    Search state(num_nodes());
+    std::vector<std::uint32_t> depths(num_nodes());
+
+    for (std::size_t group = next_group++; group < num_groups;
+         group = next_group++) {
+      const std::size_t begin = groups[group];
+      const std::size_t end = groups[group + 1];
+
+      auto all_targets_visited = [&]() {
+        for (std::size_t i = begin; i < end; ++i) {
+          if (state.stamps[pairs[order[i]].second] != state.number)
+            return false;
+        }
+
+        return true;
+      };
+
+      auto record_depth = [&](std::uint32_t node, std::uint32_t depth) {
+        depths[node] = depth;
+      };
+
+      search(state, pairs[order[begin]].first, direction, max_length,
+             record_depth, all_targets_visited);
+
+      for (std::size_t i = begin; i < end; ++i) {
+        const std::uint32_t target = pairs[order[i]].second;
+
+        if (state.stamps[target] == state.number)
+          result[order[i]] = depths[target];
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+
+  for (unsigned i = 1; i < num_threads; ++i)
+    threads.emplace_back(worker);
+
+  if (num_threads > 0)
+    worker();
+
+  for (std::thread &thread : threads)
+    thread.join();
+
+  return result;
+}
+
+std::vector<std::uint32_t>
+DependencyGraph::shortest_path(std::uint32_t source, std::uint32_t target,
+                               Direction direction,
+                               std::uint32_t max_length) const {
+  if (source >= num_nodes() || target >= num_nodes())
+    return {};
+
+  Search state(num_nodes());
+
+  search(
+      state, source, direction, max_length, [](std::uint32_t, std::uint32_t) {},
+      [&]() { return state.stamps[target] == state.number; });
+
+  if (state.stamps[target] != state.number)
+    return {};
+
+  // Follow the parents back from the target.
+  std::vector<std::uint32_t> path(1, target);
+
+  while (path.back() != source)
+    path.push_back(state.parents[path.back()]);
+
+  std::reverse(path.begin(), path.end());
+  return path;
+}
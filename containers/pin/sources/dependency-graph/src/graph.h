@@ -0,0 +1,164 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The direction in which to follow the dependencies between instructions.
+enum class Direction {
+  DEPENDENCIES = 0, // From an instruction to the instructions it depends on.
+  DEPENDENTS = 1,   // From an instruction to the instructions that depend on
+                    // it.
+  BOTH = 2,         // Both, as for an undirected graph.
+};
+
+// The options for loading a dependency graph.
+struct LoadOptions {
+  // Whether to load the memory and the register dependencies.
+  bool memory = true;
+  bool registers = true;
+
+  // The registers whose dependencies are not loaded, e.g. the stack pointer.
+  std::vector<std::string> excluded_registers;
+};
+
+// The dependency graph in the output of the data-dependencies tool, in
+// compressed sparse row (CSR) form: the neighbours of each node are stored
+// contiguously, in one array per direction, so traversals do not chase
+// pointers.
+//
+// The nodes are the instructions, identified by (image_name, image_offset),
+// and numbered in order of appearance. Every edge goes from a reading
+// instruction to the writing instruction it depends on, like the DEPENDS_ON
+// relationships that modules/data_dependencies.py imports. Dependencies
+// through several registers or memory addresses are merged into one edge.
+//
+// The graph is immutable after loading, so queries can run concurrently.
+class DependencyGraph {
+public:
+  // The node of an instruction that is not in the graph.
+  static constexpr std::uint32_t NO_NODE = UINT32_MAX;
+
+  // The distance between nodes without a path between them.
+  static constexpr std::uint32_t NO_PATH = UINT32_MAX;
+
+  // Loads <prefix>.memory_dependencies and <prefix>.register_dependencies, in
+  // either the CSV or the columnar format. Returns false and sets 'error' if
+  // a table cannot be read.
+  bool load(const std::string &prefix, const LoadOptions &options,
+            std::string &error);
+
+  std::uint32_t num_nodes() const { return image_offsets.size(); }
+  std::uint64_t num_edges() const { return dependency_targets.size(); }
+
+  // Returns the node of an instruction, or NO_NODE.
+  std::uint32_t find_node(const std::string &image_name,
+                          std::int64_t image_offset) const;
+
+  // Returns the instruction of a node.
+  const std::string &image_name(std::uint32_t node) const {
+    return image_names[node_images[node]];
+  }
+  std::int64_t image_offset(std::uint32_t node) const {
+    return image_offsets[node];
+  }
+
+  // Returns the nodes that are at most 'max_depth' edges away from any of the
+  // seeds, including the seeds, in increasing order. This is the union of the
+  // breadth-first searches from every seed, computed in one search.
+  std::vector<std::uint32_t> expand(const std::vector<std::uint32_t> &seeds,
+                                    std::uint32_t max_depth,
+                                    Direction direction) const;
+
+  // Returns the length of the shortest path from the source to the target of
+  // each pair, or NO_PATH if there is none of at most 'max_length' edges.
+  // Pairs with the same source share a breadth-first search, and the searches
+  // are spread over 'num_threads' threads (0 for all processors).
+  std::vector<std::uint32_t>
+  distances(const std::vector<std::pair<std::uint32_t, std::uint32_t>> &pairs,
+            Direction direction, std::uint32_t max_length,
+            unsigned num_threads) const;
+
+  // Returns the nodes on a shortest path from the source to the target,
+  // including both, or an empty list if there is no path of at most
+  // 'max_length' edges.
+  std::vector<std::uint32_t> shortest_path(std::uint32_t source,
+                                           std::uint32_t target,
+                                           Direction direction,
+                                           std::uint32_t max_length) const;
+
+private:
+  // Hash of the key of a node.
+  struct NodeKeyHash {
+    std::size_t
+    operator()(const std::pair<std::uint32_t, std::int64_t> &key) const {
+      return std::hash<std::int64_t>()(key.second) * 31 + key.first;
+    }
+  };
+
+  // Breadth-first search state, reused between searches of a thread. A node
+  // is visited in the current search if its stamp equals the search number, so
+  // the state does not need to be cleared between searches.
+  struct Search {
+    explicit Search(std::uint32_t num_nodes)
+        : stamps(num_nodes, 0), parents(num_nodes) {}
+
+    std::vector<std::uint32_t> stamps;
+    std::vector<std::uint32_t> parents;
+    std::vector<std::uint32_t> frontier;
+    std::vector<std::uint32_t> next_frontier;
+    std::uint32_t number = 0;
+
+    // Starts a new search, in which no node is visited.
+    void start();
+  };
+
+  // Returns the node of an instruction, adding it if needed.
+  std::uint32_t get_node(const std::string &image_name,
+                         std::int64_t image_offset);
+
+  // Calls 'visit' for every neighbour of a node.
+  template <typename F>
+  void for_each_neighbour(std::uint32_t node, Direction direction,
+                          F visit) const;
+
+  // Runs a breadth-first search from a source, that stops after 'max_length'
+  // levels, or when 'done' returns true after a level. Calls 'visit' with
+  // every node and its distance, including the source.
+  template <typename Visit, typename Done>
+  void search(Search &state, std::uint32_t source, Direction direction,
+              std::uint32_t max_length, Visit visit, Done done) const;
+
+  // Converts a list of edges to compressed sparse row form, without duplicate
+  // edges.
+  void build_csr(std::vector<std::pair<std::uint32_t, std::uint32_t>> &edges,
+                 std::vector<std::uint64_t> &offsets,
+                 std::vector<std::uint32_t> &targets) const;
+
+  // The instructions of the nodes.
+  std::vector<std::string> image_names;
+  std::vector<std::uint32_t> node_images;
+  std::vector<std::int64_t> image_offsets;
+
+  // Maps the image names and the instructions to their indices.
+  std::unordered_map<std::string, std::uint32_t> image_ids;
+  std::unordered_map<std::pair<std::uint32_t, std::int64_t>, std::uint32_t,
+                     NodeKeyHash>
+      node_ids;
+
+  // The edges from every node to the nodes it depends on: the targets of node
+  // n are dependency_targets[dependency_offsets[n]] up to
+  // dependency_targets[dependency_offsets[n + 1]].
+  std::vector<std::uint64_t> dependency_offsets;
+  std::vector<std::uint32_t> dependency_targets;
+
+  // The reversed edges, from every node to the nodes that depend on it.
+  std::vector<std::uint64_t> dependent_offsets;
+  std::vector<std::uint32_t> dependent_targets;
+};
+
+#endif
@@ -0,0 +1,227 @@
+// Answers queries about the dependency graph in the output of the
+// data-dependencies tool, without importing it in Neo4j first.
+//
+// Usage: DependencyGraph [options] <prefix> expand <max depth> <instruction>...
+//        DependencyGraph [options] <prefix> distance (<source> <target>)...
+//        DependencyGraph [options] <prefix> path <source> <target>
+//
+// Instructions are written as <image name>:<image offset>. The results are
+// written to the standard output as CSV.
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace {
+
+// Parses an instruction of the form <image name>:<image offset>. Returns false
+// if it is malformed.
+bool parse_instruction(const std::string &text, std::string &image_name,
+                       std::int64_t &image_offset) {
+  const std::string::size_type colon = text.rfind(':');
+  if (colon == std::string::npos || colon == 0)
+    return false;
+
+  const std::string offset = text.substr(colon + 1);
+  char *end;
+
+  image_name = text.substr(0, colon);
+  image_offset = std::strtoll(offset.c_str(), &end, 0);
+
+  return !offset.empty() && *end == '\0';
+}
+
+// Looks up the nodes of a list of instructions. Instructions that are not in
+// the graph, because they have no dependencies, get NO_NODE. Returns false if
+// an instruction is malformed.
+bool find_nodes(const DependencyGraph &graph,
+                const std::vector<std::string> &instructions,
+                std::vector<std::uint32_t> &nodes) {
+  for (const std::string &instruction : instructions) {
+    std::string image_name;
+    std::int64_t image_offset;
+
+    if (!parse_instruction(instruction, image_name, image_offset)) {
+      std::cerr << "Invalid instruction '" << instruction << "'.\n\n";
+      return false;
+    }
+
+    nodes.push_back(graph.find_node(image_name, image_offset));
+  }
+
+  return true;
+}
+
+// Writes the instruction of a node as CSV values.
+void write_instruction(const DependencyGraph &graph, std::uint32_t node) {
+  std::cout << '"' << graph.image_name(node) << "\","
+            << graph.image_offset(node);
+}
+
+int usage(const char *program) {
+  std::cerr
+      << "Usage: " << program
+      << " [options] <prefix> expand <max depth> <instruction>...\n"
+      << "       " << program
+      << " [options] <prefix> distance (<source> <target>)...\n"
+      << "       " << program
+      << " [options] <prefix> path <source> <target>\n\n"
+         "Instructions are written as <image name>:<image offset>.\n\n"
+         "Options:\n"
+         "  -direction dependencies|dependents|both\n"
+         "      Follow the dependencies from an instruction to the\n"
+         "      instructions it depends on (default), to the instructions\n"
+         "      that depend on it, or both.\n"
+         "  -exclude_registers <register>,...\n"
+         "      Ignore the dependencies through these registers.\n"
+         "  -max_length <length>\n"
+         "      Ignore paths that are longer than this (default: no limit).\n"
+         "  -no_memory, -no_registers\n"
+         "      Ignore the memory or the register dependencies.\n"
+         "  -threads <threads>\n"
+         "      Number of threads for 'distance' (default: all "
+         "processors).\n";
+  return EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  LoadOptions options;
+  Direction direction = Direction::DEPENDENCIES;
+  std::uint32_t max_length = DependencyGraph::NO_PATH;
+  unsigned num_threads = 0;
+  std::vector<std::string> arguments;
+
+  // Parse the arguments.
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    if (arg == "-direction" && i + 1 < argc) {
+      const std::string value = argv[++i];
+
+      if (value == "dependencies")
+        direction = Direction::DEPENDENCIES;
+      else if (value == "dependents")
+        direction = Direction::DEPENDENTS;
+      else if (value == "both")
+        direction = Direction::BOTH;
+      else {
+        std::cerr << "Invalid direction '" << value << "'.\n\n";
+        return usage(argv[0]);
+      }
+    } else if (arg == "-exclude_registers" && i + 1 < argc) {
+      const std::string list = argv[++i];
+      std::string::size_type begin = 0;
+
+      while (begin < list.size()) {
+        std::string::size_type end = list.find(',', begin);
+        if (end == std::string::npos)
+          end = list.size();
+
+        if (end != begin)
+          options.excluded_registers.push_back(
+              list.substr(begin, end - begin));
+
+        begin = end + 1;
+      }
+    } else if (arg == "-max_length" && i + 1 < argc) {
+      max_length = std::strtoul(argv[++i], nullptr, 0);
+    } else if (arg == "-no_memory") {
+      options.memory = false;
+    } else if (arg == "-no_registers") {
+      options.registers = false;
+    } else if (arg == "-threads" && i + 1 < argc) {
+      num_threads = std::strtoul(argv[++i], nullptr, 0);
+    } else if (!arg.empty() && arg[0] == '-') {
+      return usage(argv[0]);
+    } else {
+      arguments.push_back(arg);
+    }
+  }
+
+  if (arguments.size() < 2)
+    return usage(argv[0]);
+
+  const std::string &prefix = arguments[0];
+  const std::string &command = arguments[1];
+  std::vector<std::string> instructions(arguments.begin() + 2,
+                                        arguments.end());
+
+  // Check the arguments of the command before loading the graph.
+  std::uint32_t max_depth = 0;
+
+  if (command == "expand") {
+    if (instructions.empty())
+      return usage(argv[0]);
+
+    max_depth = std::strtoul(instructions[0].c_str(), nullptr, 0);
+    instructions.erase(instructions.begin());
+  } else if (command == "distance") {
+    if (instructions.empty() || instructions.size() % 2 != 0)
+      return usage(argv[0]);
+  } else if (command == "path") {
+    if (instructions.size() != 2)
+      return usage(argv[0]);
+  } else {
+    return usage(argv[0]);
+  }
+
+  DependencyGraph graph;
+  std::string error;
+
+  if (!graph.load(prefix, options, error)) {
+    std::cerr << error << '\n';
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::uint32_t> nodes;
+
+  if (!find_nodes(graph, instructions, nodes))
+    return usage(argv[0]);
+
+  if (command == "expand") {
+    std::cout << "image_name,image_offset\n";
+
+    for (std::uint32_t node : graph.expand(nodes, max_depth, direction)) {
+      write_instruction(graph, node);
+      std::cout << '\n';
+    }
+  } else if (command == "distance") {
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+
+    for (std::size_t i = 0; i < nodes.size(); i += 2)
+      pairs.emplace_back(nodes[i], nodes[i + 1]);
+
+    const std::vector<std::uint32_t> distances =
+        graph.distances(pairs, direction, max_length, num_threads);
+
+    std::cout << "source,target,distance\n";
+
+    // Write the instructions as they were given, since they may not be in
+    // the graph.
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+      std::cout << instructions[2 * i] << ',' << instructions[2 * i + 1] << ',';
+
+      if (distances[i] == DependencyGraph::NO_PATH)
+        std::cout << "inf\n";
+      else
+        std::cout << distances[i] << '\n';
+    }
+  } else {
+    std::cout << "image_name,image_offset\n";
+
+    for (std::uint32_t node :
+         graph.shortest_path(nodes[0], nodes[1], direction, max_length)) {
+      write_instruction(graph, node);
+      std::cout << '\n';
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -8,6 +8,7 @@
 
 #include "pin.H"
 #include "sde-init.H"
+#include "symbols.h"
 
 #include <cassert>
 #include <fstream>
@@ -193,22 +194,16 @@ std::string InstructionLocation(ADDRINT ins) {
     if (ins == 0x0) {
         return "???";
     }
-    PIN_LockClient();
-    IMG image = IMG_FindByAddress(ins);
-    RTN rtn = RTN_FindByAddress(ins);
-    PIN_UnlockClient();
-    if (!RTN_Valid(rtn)) {
+    const SymbolLocation location = find_symbol(ins);
+    if (location.routine_name == UNKNOWN_NAME) {
         std::ostringstream os;
         os << "?rtn@0x" << std::hex << ins;
         return os.str();
     }
-    PIN_LockClient();
-    SEC section = RTN_Sec(RTN_FindByAddress(ins));
-    ADDRINT offset = ins - IMG_LowAddress(image);
-    PIN_UnlockClient();
     std::ostringstream os;
-    os << IMG_Name(image) << "(" << SEC_Name(section) << ")"
-       << "+0x" << std::hex << offset;
+    os << get_name(location.image_name) << "("
+       << get_name(location.section_name) << ")"
+       << "+0x" << std::hex << location.image_offset;
     return os.str();
 }
 
@@ -357,10 +352,9 @@ std::string getFunctionName(ADDRINT address) {
 std::string getImageName(ADDRINT address) {
     if (addressMapping.find(address) == addressMapping.end()) {
         // Try to find the image this address belongs to
-        IMG img = IMG_FindByAddress(address);
-        if (IMG_Valid(img)) {
-            const std::string &name = IMG_Name(img);
-            return extractFilename(name);
+        const SymbolLocation location = find_symbol(address);
+        if (location.image_name != UNKNOWN_NAME) {
+            return extractFilename(get_name(location.image_name));
         }
         return "unknown";
     }
@@ -382,9 +376,9 @@ std::string getInstructionBytes(const INS &ins) {
 
 void addAddressToMapping(ADDRINT address) {
     if (addressTranslation.find(address) == addressTranslation.end()) {
-        IMG img = IMG_FindByAddress(address);
-        if (IMG_Valid(img)) {
-            addressTranslation[address] = std::make_pair(getImageName(address), address - IMG_LowAddress(img));
+        const SymbolLocation location = find_symbol(address);
+        if (location.image_name != UNKNOWN_NAME) {
+            addressTranslation[address] = std::make_pair(getImageName(address), location.image_offset);
         }
     }
 }
@@ -568,6 +562,7 @@ int main(int argc, char *argv[]) {
     // Initialise Pin and SDE.
     sde_pin_init(argc, argv);
     sde_init();
+    init_symbols();
 
 #ifdef _WIN32
     char *target_filename = {};
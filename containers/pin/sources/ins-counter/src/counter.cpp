@@ -1,4 +1,5 @@
 #include "pin.H"
+#include "symbols.h"
 
 #include <iostream>
 
@@ -15,6 +16,9 @@ using std::ofstream;
 KNOB<bool> useOEP(KNOB_MODE_WRITEONCE, "pintool", "e", "1", "start counting only from entry point");
 KNOB<int> startAtOffset(KNOB_MODE_WRITEONCE, "pintool", "s", "-1", "start at a certain offset within the main binary");
 KNOB<std::string> outputFile(KNOB_MODE_WRITEONCE, "pintool", "o", "results.out", "specify results file name");
+KNOB<std::string> mainIcountsFile(KNOB_MODE_WRITEONCE, "pintool", "main_icounts", "",
+                                  "instead of counting, write the instruction counts of the main thread when main is "
+                                  "entered and when it returns to this file");
 
 static std::map<ADDRINT, uint64_t> insCounters;
 static std::map<std::string, std::set<ADDRINT>> imageIns;
@@ -24,6 +28,14 @@ static bool OEP_has_reached = false;
 static ADDRINT OEP = -1;
 static int offset = -1;
 
+// For -main_icounts: the number of instructions executed by the main thread, and that number when main is entered and
+// when it returns, i.e. when the instruction after the call of main is reached.
+static const UINT64 NO_ICOUNT = -1;
+static UINT64 mainThreadIcount = 0;
+static UINT64 mainEntryIcount = NO_ICOUNT;
+static UINT64 mainReturnIcount = NO_ICOUNT;
+static ADDRINT mainReturnAddress = -1;
+
 // This function is called before every instruction is executed and prints the IP
 VOID handleDynamicInstruction(ADDRINT ip) {
     if (!OEP_has_reached) {
@@ -37,15 +49,47 @@ VOID handleDynamicInstruction(ADDRINT ip) {
     insCounters[ip]++;
 }
 
+// This function is called before every instruction with -main_icounts
+VOID countMainThreadInstruction(THREADID tid, ADDRINT ip) {
+    if (tid != 0) {
+        return;
+    }
+
+    if (ip == OEP && mainEntryIcount == NO_ICOUNT) {
+        mainEntryIcount = mainThreadIcount;
+    } else if (ip == mainReturnAddress && mainReturnIcount == NO_ICOUNT) {
+        mainReturnIcount = mainThreadIcount;
+    }
+
+    mainThreadIcount++;
+}
+
+// This function is called before every call instruction with -main_icounts
+VOID callInstruction(ADDRINT target, ADDRINT next) {
+    if (target == OEP && mainReturnAddress == (ADDRINT) -1) {
+        mainReturnAddress = next;
+    }
+}
+
 // Pin calls this function every time a new instruction is encountered
 VOID Instruction(INS ins, VOID *)
 {
+    if (!mainIcountsFile.Value().empty()) {
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) countMainThreadInstruction, IARG_THREAD_ID, IARG_INST_PTR,
+                       IARG_END);
+        if (INS_IsCall(ins)) {
+            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) callInstruction, IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
+                           INS_NextAddress(ins), IARG_END);
+        }
+        return;
+    }
+
     ADDRINT address = INS_Address(ins);
     insCounters[address] = 0;
     
-    IMG i = IMG_FindByAddress(address);
-    if (IMG_Valid(i)) {
-        std::string iName = IMG_Name(i);
+    const SymbolLocation location = find_symbol(address);
+    if (location.image_name != UNKNOWN_NAME) {
+        const std::string &iName = get_name(location.image_name);
         if (imageIns.find(iName) == imageIns.end()) {
             imageIns.insert(std::make_pair(iName, std::set<ADDRINT>()));
         }
@@ -67,7 +111,7 @@ VOID imgInstrumentation(IMG img, VOID *) {
         cout << "Set OEP to offset within main executable, start at " << hexstr(OEP) << endl;
     }
     RTN libc_start_main_rtn = RTN_FindByName(img, "__libc_start_main");
-    if (RTN_Valid(libc_start_main_rtn) && offset == -1 && startFromMain) {
+    if (RTN_Valid(libc_start_main_rtn) && offset == -1 && (startFromMain || !mainIcountsFile.Value().empty())) {
         cout << "OEP can be determined using __libc_start_main." << endl;
         RTN_Open(libc_start_main_rtn);
         RTN_InsertCall(
@@ -82,6 +126,19 @@ VOID imgInstrumentation(IMG img, VOID *) {
 // This function is called when the application exits
 VOID Fini(INT32, VOID *)
 {
+    if (!mainIcountsFile.Value().empty()) {
+        std::ofstream icountsFile(mainIcountsFile.Value().c_str());
+        if (mainEntryIcount != NO_ICOUNT) {
+            icountsFile << "main_entry," << mainEntryIcount << endl;
+        }
+        if (mainReturnIcount != NO_ICOUNT) {
+            icountsFile << "main_return," << mainReturnIcount << endl;
+        }
+        icountsFile << "total," << mainThreadIcount << endl;
+        icountsFile.close();
+        return;
+    }
+
     uint8_t digits = 2;
     uint64_t factor = 10^digits;
     std::map<std::string, uint64_t> counts {};
@@ -135,6 +192,7 @@ int main(int argc, char * argv[])
         return Usage();
     }
     PIN_InitSymbols();
+    init_symbols();
 
     if (startAtOffset.Value() != -1) {
         offset = startAtOffset.Value();
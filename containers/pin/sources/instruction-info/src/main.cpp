@@ -1,21 +1,35 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
 #include <string>
-#include <iomanip>
+#include <unordered_map>
 #include <vector>
 
+#include <elf.h>
+
 #include "pin.H"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_instructions;
+// Table to write the instructions to.
+static std::unique_ptr<TableWriter> instructions_table;
 
-// Mutex for writing to csv_instructions.
-static PIN_MUTEX csv_instructions_lock;
+// Mutex for writing to instructions_table.
+static StatMutex instructions_table_lock("instructions_table_lock");
 
 // Option (-o) to set the output filename.
 KNOB<std::string>
@@ -29,6 +43,99 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.instruction-info.csv.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.instruction-info.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
+// Option (-cache_dir) to set the directory of the persistent instruction cache.
+KNOB<std::string> KnobCacheDir(
+    KNOB_MODE_WRITEONCE, "pintool", "cache_dir", "",
+    "Set the directory used to cache the information of the instructions of "
+    "each image, keyed by its build ID. Later runs on the same images use the "
+    "cache instead of decoding the instructions. The directory must exist. "
+    "When empty, no cache is used.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
+// Contains the static information of an instruction, i.e. everything but the
+// name of its image.
+struct StaticInstruction {
+  // The name of the section this instruction belongs to.
+  std::string section_name;
+
+  // The name of the routine this instruction belongs to.
+  std::string routine_name;
+
+  // The offset from the start of the routine of this instruction.
+  int routine_offset;
+
+  // The opcode, operands, and category of the instruction.
+  std::string opcode;
+  std::string operands;
+  std::string category;
+
+  // The bytes that form the instruction, in hexadecimal.
+  std::string bytes;
+
+  // Whether the instruction was written to the CSV file already.
+  bool emitted = false;
+};
+
+// A section of an image.
+struct SectionRange {
+  ADDRINT low_address;
+  ADDRINT high_address;
+  std::string name;
+};
+
+// Contains the information of a loaded image.
+struct ImageInfo {
+  // The full path of the image.
+  std::string full_image_name;
+
+  // The lowest and highest address of the image.
+  ADDRINT low_address;
+  ADDRINT high_address;
+
+  // The sections of the image, sorted by address.
+  std::vector<SectionRange> sections;
+
+  // The GNU build ID of the image in hexadecimal, or empty if it has none.
+  std::string build_id;
+
+  // Maps the offset of an instruction in the image to its static information.
+  // This contains the instructions that were instrumented, and those loaded
+  // from the cache.
+  std::unordered_map<ADDRINT, StaticInstruction> instructions;
+
+  // Whether instructions were decoded that are not in the cache yet.
+  bool dirty = false;
+};
+
+// Maps the lowest address of each loaded image to its information.
+static std::map<ADDRINT, std::unique_ptr<ImageInfo>> images;
+
+// Addresses of the instructions outside any image that were written to the CSV
+// file already.
+static std::set<ADDRINT> emitted_unknown_instructions;
+
+// Statistics for -tool_stats.
+static StatTimer on_trace_timer("OnTrace");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_image_unload_timer("OnImageUnload");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize images_size("images");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
+
 // =============================================================================
 // Helper functions
 // =============================================================================
@@ -48,131 +155,447 @@ std::string get_filename(const std::string &path) {
   }
 }
 
-// =============================================================================
-// Instrumentation routines
-// =============================================================================
+// Returns the loaded image that contains the given address, or nullptr if
+// there is none.
+ImageInfo *find_image(ADDRINT address) {
+  auto it = images.upper_bound(address);
+  if (it == images.begin())
+    return nullptr;
 
-// Instrumentation routine run for every trace.
-VOID OnTrace(TRACE trace, VOID *v) {
-  PIN_MutexLock(&csv_instructions_lock);
+  --it;
+  return (address <= it->second->high_address) ? it->second.get() : nullptr;
+}
 
-  // Iterate over all basic blocks in the trace.
-  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
-    // Iterate over all instructions in the basic block.
-    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
-      // Get the address of the instruction.
-      auto ins_addr = INS_Address(ins);
+// Returns the name of the section of an image that contains the given address.
+std::string find_section_name(const ImageInfo &image, ADDRINT address) {
+  for (const auto &section : image.sections) {
+    if (section.low_address <= address && address < section.high_address)
+      return section.name;
+  }
 
-      // Initialise routine, section, and image to default invalid values.
-      RTN rtn = RTN_Invalid();
-      SEC sec = SEC_Invalid();
-      IMG img = IMG_Invalid();
+  return "???";
+}
 
-      // Find routine
-      rtn = RTN_FindByAddress(ins_addr);
+// Returns the GNU build ID in the section headers of an ELF file, read from
+// 'ifs', in hexadecimal. Returns an empty string if it has none.
+template <typename Ehdr, typename Shdr>
+std::string read_build_id(std::ifstream &ifs) {
+  Ehdr ehdr;
+  if (!ifs.seekg(0) || !ifs.read(reinterpret_cast<char *>(&ehdr), sizeof(ehdr)))
+    return "";
+
+  for (unsigned int i = 0; i < ehdr.e_shnum; ++i) {
+    Shdr shdr;
+    if (!ifs.seekg(ehdr.e_shoff + i * ehdr.e_shentsize) ||
+        !ifs.read(reinterpret_cast<char *>(&shdr), sizeof(shdr)))
+      return "";
+
+    if (shdr.sh_type != SHT_NOTE)
+      continue;
+
+    std::vector<char> notes(shdr.sh_size);
+    if (!ifs.seekg(shdr.sh_offset) || !ifs.read(notes.data(), notes.size()))
+      return "";
+
+    // Every note consists of a header, followed by the name and the
+    // description, both padded to 4 bytes.
+    std::size_t offset = 0;
+    while (offset + sizeof(Elf32_Nhdr) <= notes.size()) {
+      Elf32_Nhdr nhdr;
+      std::memcpy(&nhdr, &notes[offset], sizeof(nhdr));
+
+      const std::size_t name_offset = offset + sizeof(nhdr);
+      const std::size_t desc_offset = name_offset + ((nhdr.n_namesz + 3) & ~3u);
+      offset = desc_offset + ((nhdr.n_descsz + 3) & ~3u);
+
+      if (offset > notes.size())
+        break;
+
+      if (nhdr.n_type != NT_GNU_BUILD_ID || nhdr.n_namesz != 4 ||
+          std::memcmp(&notes[name_offset], "GNU", 4) != 0)
+        continue;
+
+      std::ostringstream oss;
+      oss << std::hex << std::setfill('0');
+      for (std::size_t j = 0; j < nhdr.n_descsz; ++j) {
+        oss << std::setw(2)
+            << static_cast<unsigned int>(
+                   static_cast<UINT8>(notes[desc_offset + j]));
+      }
 
-      // Find section
-      if (RTN_Valid(rtn)) {
-        sec = RTN_Sec(rtn);
+      return oss.str();
+    }
+  }
 
-        // Find image
-        if (SEC_Valid(sec)) {
-          img = SEC_Img(sec);
-        }
-      }
+  return "";
+}
 
-      USIZE ins_size = INS_Size(ins);
+// Returns the GNU build ID of an image in hexadecimal, or an empty string if it
+// has none. The build ID is read from the file on disk, as the sections of
+// images in a replayed pinball are not available in memory.
+std::string get_build_id(const std::string &path) {
+  std::ifstream ifs(path.c_str(), std::ios::binary);
+
+  unsigned char ident[EI_NIDENT];
+  if (!ifs.read(reinterpret_cast<char *>(ident), sizeof(ident)) ||
+      std::memcmp(ident, ELFMAG, SELFMAG) != 0)
+    return "";
+
+  if (ident[EI_CLASS] == ELFCLASS64)
+    return read_build_id<Elf64_Ehdr, Elf64_Shdr>(ifs);
+  else
+    return read_build_id<Elf32_Ehdr, Elf32_Shdr>(ifs);
+}
 
-      std::vector<UINT8> ins_bytes(ins_size);
-      PIN_SafeCopy(&ins_bytes[0], reinterpret_cast<void*>(ins_addr), ins_size);
+// Returns the path of the cache file of an image with the given build ID.
+std::string get_cache_path(const std::string &build_id) {
+  return KnobCacheDir.Value() + "/" + build_id + ".instruction-info.cache";
+}
 
-      // Write the information of the instruction to the CSV output file.
-      auto full_image_name = (IMG_Valid(img) ? IMG_Name(img) : "???");
+// Header of the cache files, which is changed whenever their format changes.
+static const char *CACHE_HEADER = "instruction-info cache v1";
 
-      // image_name
-      csv_instructions << get_filename(full_image_name) << ",";
+// Parses a decimal field of a cache file. Returns false if it is not a number,
+// or if the number does not fit.
+bool parse_cache_field(const std::string &field, ADDRINT &value) {
+  char *end = nullptr;
+  errno = 0;
+  const unsigned long long parsed = std::strtoull(field.c_str(), &end, 10);
 
-      // full_image_name
-      csv_instructions << full_image_name << ",";
+  if (field.empty() || *end != '\0' || errno == ERANGE ||
+      parsed != static_cast<ADDRINT>(parsed))
+    return false;
 
-      // section_name
-      csv_instructions << (SEC_Valid(sec) ? SEC_Name(sec) : "???") << ",";
+  value = static_cast<ADDRINT>(parsed);
+  return true;
+}
 
-      // image_offset
-      const auto image_offset =
-          (int)(IMG_Valid(img) ? ins_addr - IMG_LowAddress(img) : -1);
-      csv_instructions << image_offset << ",";
+bool parse_cache_field(const std::string &field, int &value) {
+  char *end = nullptr;
+  errno = 0;
+  const long parsed = std::strtol(field.c_str(), &end, 10);
 
-      // routine_name
-      csv_instructions << (RTN_Valid(rtn) ? RTN_Name(rtn) : "???") << ",";
+  if (field.empty() || *end != '\0' || errno == ERANGE ||
+      parsed != static_cast<int>(parsed))
+    return false;
 
-      // routine_offset
-      csv_instructions << (int)(RTN_Valid(rtn) ? ins_addr - RTN_Address(rtn)
-                                               : -1)
-                       << ",";
+  value = static_cast<int>(parsed);
+  return true;
+}
 
-      const std::string disassembly = INS_Disassemble(ins);
+// Load the cached instructions of an image, if any. Every line of a cache file
+// contains the tab-separated fields of one instruction. A cache file with a
+// line that cannot be parsed is ignored entirely.
+void load_cache(ImageInfo &image) {
+  std::ifstream ifs(get_cache_path(image.build_id).c_str());
+  if (!ifs)
+    return;
+
+  std::string line;
+  if (!std::getline(ifs, line) || line != CACHE_HEADER) {
+    log_file << "Ignoring cache of " << image.full_image_name
+             << " with unknown format.\n";
+    return;
+  }
 
-      // Skip prefixes by finding the last occurrence of a known prefix string.
-      const char *prefixes[] = {"lock ", "rep ", "repne ", "data16 "};
-      std::string::size_type sep_pos = 0;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    std::string image_offset, routine_offset;
+    ADDRINT offset;
+    StaticInstruction ins;
+
+    if (!std::getline(iss, image_offset, '\t') ||
+        !std::getline(iss, ins.section_name, '\t') ||
+        !std::getline(iss, ins.routine_name, '\t') ||
+        !std::getline(iss, routine_offset, '\t') ||
+        !std::getline(iss, ins.opcode, '\t') ||
+        !std::getline(iss, ins.operands, '\t') ||
+        !std::getline(iss, ins.category, '\t') ||
+        !std::getline(iss, ins.bytes, '\t') ||
+        !parse_cache_field(image_offset, offset) ||
+        !parse_cache_field(routine_offset, ins.routine_offset)) {
+      log_file << "Ignoring cache of " << image.full_image_name
+               << " with a corrupt line.\n";
+      image.instructions.clear();
+      return;
+    }
 
-      for (const auto &prefix : prefixes) {
-        auto pos = disassembly.find(prefix, sep_pos);
-        if (pos != std::string::npos)
-          sep_pos = pos + std::strlen(prefix);
-      }
+    image.instructions.emplace(offset, std::move(ins));
+  }
+
+  log_file << "Loaded " << image.instructions.size()
+           << " cached instructions of " << image.full_image_name << ".\n";
+}
+
+// Write the instructions of an image to its cache file, if new instructions
+// were decoded. The file is replaced atomically, so that concurrent runs never
+// see a partial cache.
+void store_cache(ImageInfo &image) {
+  if (KnobCacheDir.Value().empty() || image.build_id.empty() || !image.dirty)
+    return;
+
+  const std::string path = get_cache_path(image.build_id);
+  const std::string temp_path =
+      path + ".tmp" + std::to_string(PIN_GetPid());
+
+  {
+    std::ofstream ofs(temp_path.c_str());
+    if (!ofs) {
+      log_file << "Could not write cache file " << temp_path << ".\n";
+      return;
+    }
+
+    ofs << CACHE_HEADER << '\n';
+
+    for (const auto &p : image.instructions) {
+      const StaticInstruction &ins = p.second;
+      ofs << p.first << '\t' << ins.section_name << '\t' << ins.routine_name
+          << '\t' << ins.routine_offset << '\t' << ins.opcode << '\t'
+          << ins.operands << '\t' << ins.category << '\t' << ins.bytes
+          << '\n';
+    }
+  }
+
+  std::rename(temp_path.c_str(), path.c_str());
+  image.dirty = false;
+}
 
-      // Find the first space after the prefixes.
-      sep_pos = disassembly.find(' ', sep_pos);
+// Decode an instruction.
+StaticInstruction decode_instruction(INS ins, const ImageInfo *image) {
+  StaticInstruction result;
 
-      const auto opcode = disassembly.substr(0, sep_pos);
-      const auto operands = disassembly.substr(sep_pos + 1);
+  const ADDRINT ins_addr = INS_Address(ins);
 
-      // opcode
-      csv_instructions << "\"" << opcode << "\",";
+  // Find section and routine.
+  result.section_name =
+      (image != nullptr) ? find_section_name(*image, ins_addr) : "???";
 
-      // operands
-      csv_instructions << "\"" << operands << "\",";
+  const SymbolLocation location = find_symbol(ins_addr);
+  result.routine_name = get_name(location.routine_name);
+  result.routine_offset = (int)location.routine_offset;
 
-      // category
-      csv_instructions << "\"" << CATEGORY_StringShort(INS_Category(ins))
-                       << "\",";
+  const std::string disassembly = INS_Disassemble(ins);
 
-      // DEBUG_filename
-      csv_instructions << "\"$DEBUG(" << full_image_name << "," << image_offset
-                       << ","
-                       << "filename"
-                       << ")\""
-                       << ",";
+  // Skip prefixes by finding the last occurrence of a known prefix string.
+  const char *prefixes[] = {"lock ", "rep ", "repne ", "data16 "};
+  std::string::size_type sep_pos = 0;
 
-      // DEBUG_line
-      csv_instructions << "\"$DEBUG(" << full_image_name << "," << image_offset
-                       << ","
-                       << "line"
-                       << ")\""
-                       << ",";
+  for (const auto &prefix : prefixes) {
+    auto pos = disassembly.find(prefix, sep_pos);
+    if (pos != std::string::npos)
+      sep_pos = pos + std::strlen(prefix);
+  }
+
+  // Find the first space after the prefixes.
+  sep_pos = disassembly.find(' ', sep_pos);
+
+  result.opcode = disassembly.substr(0, sep_pos);
+  result.operands = disassembly.substr(sep_pos + 1);
+  result.category = CATEGORY_StringShort(INS_Category(ins));
+
+  USIZE ins_size = INS_Size(ins);
 
-      // DEBUG_column
-      csv_instructions << "\"$DEBUG(" << full_image_name << "," << image_offset
-                       << ","
-                       << "column"
-                       << ")\""
-                       << ",";
+  std::vector<UINT8> ins_bytes(ins_size);
+  PIN_SafeCopy(&ins_bytes[0], reinterpret_cast<void *>(ins_addr), ins_size);
+
+  std::ostringstream oss;
+  oss << std::hex;
+
+  for (size_t i = 0; i < ins_size; i++) {
+    oss << std::setfill('0') << std::setw(2)
+        << static_cast<unsigned int>(ins_bytes[i]);
+  }
 
-      csv_instructions << std::hex;
+  result.bytes = oss.str();
+
+  return result;
+}
+
+// The columns of the instructions table.
+static const std::vector<TableColumn> INSTRUCTIONS_COLUMNS = {
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset", ColumnType::INT64},
+    {"opcode", ColumnType::STRING, true},
+    {"operands", ColumnType::STRING, true},
+    {"category", ColumnType::STRING, true},
+    {"DEBUG_filename", ColumnType::STRING, true},
+    {"DEBUG_line", ColumnType::STRING, true},
+    {"DEBUG_column", ColumnType::STRING, true},
+    {"bytes", ColumnType::STRING},
+};
+
+// Returns a reference to debug information of an instruction, which is
+// resolved when the output is imported.
+std::string debug_reference(const std::string &full_image_name,
+                            int image_offset, const char *field) {
+  std::ostringstream oss;
+  oss << "$DEBUG(" << full_image_name << ',' << image_offset << ',' << field
+      << ')';
+  return oss.str();
+}
+
+// A row of the instructions table. The strings are formatted before the row is
+// written, so that instructions_table_lock is only held to write it.
+struct InstructionRow {
+  std::string image_name;
+  std::string full_image_name;
+  int image_offset;
+  const StaticInstruction *ins;
+  std::string debug_filename;
+  std::string debug_line;
+  std::string debug_column;
+};
+
+// Format the information of an instruction as a row of the instructions table.
+InstructionRow format_instruction(const std::string &full_image_name,
+                                  int image_offset,
+                                  const StaticInstruction &ins) {
+  InstructionRow row;
+  row.image_name = get_filename(full_image_name);
+  row.full_image_name = full_image_name;
+  row.image_offset = image_offset;
+  row.ins = &ins;
+  row.debug_filename =
+      debug_reference(full_image_name, image_offset, "filename");
+  row.debug_line = debug_reference(full_image_name, image_offset, "line");
+  row.debug_column = debug_reference(full_image_name, image_offset, "column");
+  return row;
+}
 
-      for(size_t i = 0; i<ins_size; i++){
-        csv_instructions << std::setfill('0') << std::setw(2) << static_cast<unsigned int>(ins_bytes[i]);
+// Write a formatted row to the instructions table.
+void write_instruction(TableWriter &table, const InstructionRow &row) {
+  const StaticInstruction &ins = *row.ins;
+
+  table << row.image_name        // image_name
+        << row.full_image_name   // full_image_name
+        << ins.section_name      // section_name
+        << row.image_offset      // image_offset
+        << ins.routine_name      // routine_name
+        << ins.routine_offset    // routine_offset
+        << ins.opcode            // opcode
+        << ins.operands          // operands
+        << ins.category          // category
+        << row.debug_filename    // DEBUG_filename
+        << row.debug_line        // DEBUG_line
+        << row.debug_column      // DEBUG_column
+        << ins.bytes;            // bytes
+}
+
+// =============================================================================
+// Instrumentation routines
+// =============================================================================
+
+// Instrumentation routine run for every trace. Every instruction is written to
+// the output only once, even if Pin instruments its trace several times.
+//
+// The images are only used by instrumentation routines, which Pin serializes,
+// so the instructions are decoded and their rows formatted without holding
+// instructions_table_lock. It is only held to write the rows.
+VOID OnTrace(TRACE trace, VOID *v) {
+  ScopedStatTimer timer(on_trace_timer);
+
+  // The decoded instructions outside any image, which are not kept.
+  std::deque<StaticInstruction> unknown_instructions;
+
+  // The rows of the instructions that were not written yet.
+  std::vector<InstructionRow> rows;
+
+  // Iterate over all basic blocks in the trace.
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    // Iterate over all instructions in the basic block.
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+      // Get the address of the instruction.
+      auto ins_addr = INS_Address(ins);
+
+      ImageInfo *image = find_image(ins_addr);
+
+      if (image == nullptr) {
+        // Instructions outside any image cannot be cached.
+        if (!emitted_unknown_instructions.insert(ins_addr).second)
+          continue;
+
+        unknown_instructions.push_back(decode_instruction(ins, nullptr));
+        rows.push_back(
+            format_instruction("???", -1, unknown_instructions.back()));
+        continue;
       }
 
-      csv_instructions << std::dec;
+      const ADDRINT image_offset = ins_addr - image->low_address;
+
+      // Decode the instruction, unless it was decoded or cached already.
+      auto it = image->instructions.find(image_offset);
+      if (it == image->instructions.end()) {
+        it = image->instructions
+                 .emplace(image_offset, decode_instruction(ins, image))
+                 .first;
+        image->dirty = true;
+      }
+
+      if (it->second.emitted)
+        continue;
+
+      it->second.emitted = true;
+      rows.push_back(format_instruction(image->full_image_name,
+                                        (int)image_offset, it->second));
+    }
+  }
+
+  if (rows.empty())
+    return;
 
-      csv_instructions << "\n";
+  instructions_table_lock.lock();
+
+  for (const auto &row : rows)
+    write_instruction(*instructions_table, row);
+
+  instructions_table_lock.unlock();
+}
+
+// Instrumentation routine run for every image loaded.
+VOID OnImageLoad(IMG img, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
+  std::unique_ptr<ImageInfo> image(new ImageInfo());
+
+  image->full_image_name = IMG_Name(img);
+  image->low_address = IMG_LowAddress(img);
+  image->high_address = IMG_HighAddress(img);
+
+  for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec)) {
+    if (SEC_Address(sec) != 0) {
+      image->sections.push_back(SectionRange{
+          SEC_Address(sec), SEC_Address(sec) + SEC_Size(sec), SEC_Name(sec)});
     }
   }
 
-  PIN_MutexUnlock(&csv_instructions_lock);
+  if (!KnobCacheDir.Value().empty()) {
+    image->build_id = get_build_id(image->full_image_name);
+
+    if (!image->build_id.empty())
+      load_cache(*image);
+    else
+      log_file << "Not caching " << image->full_image_name
+               << ", as it has no build ID.\n";
+  }
+
+  images[image->low_address] = std::move(image);
+  images_size.update(images.size());
+}
+
+// Run for every image unloaded.
+VOID OnImageUnload(IMG img, VOID *v) {
+  ScopedStatTimer timer(on_image_unload_timer);
+
+  auto it = images.find(IMG_LowAddress(img));
+  if (it == images.end())
+    return;
+
+  store_cache(*it->second);
+  images.erase(it);
 }
 
 // =============================================================================
@@ -181,6 +604,12 @@ VOID OnTrace(TRACE trace, VOID *v) {
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
+  // Write the caches of the images that are still loaded.
+  for (auto &p : images)
+    store_cache(*p.second);
+
   // -------
   // Cleanup
   // -------
@@ -190,8 +619,16 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV file.
-  csv_instructions.flush();
-  csv_instructions.close();
+  instructions_table_lock.lock();
+  instructions_table->close();
+  instructions_table_lock.unlock();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -201,6 +638,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -228,6 +668,18 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
   // Open output file.
   log_file.open(KnobOutputFile.Value().c_str());
 
@@ -239,12 +691,12 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_instructions.open((csv_prefix + ".instruction-info.csv").c_str());
+  instructions_table = open_table(csv_prefix + ".instruction-info",
+                                  table_format, INSTRUCTIONS_COLUMNS);
 
-  // Print the CSV header.
-  csv_instructions << "image_name,full_image_name,section_name,image_offset,"
-                      "routine_name,routine_offset,opcode,operands,category,"
-                      "DEBUG_filename,DEBUG_line,DEBUG_column,bytes\n";
+  // Register image load and unload callbacks.
+  IMG_AddInstrumentFunction(OnImageLoad, nullptr);
+  IMG_AddUnloadFunction(OnImageUnload, nullptr);
 
   // Register trace callback.
   TRACE_AddInstrumentFunction(OnTrace, nullptr);
@@ -252,15 +704,19 @@ int main(int argc, char *argv[]) {
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutex.
-  PIN_MutexInit(&csv_instructions_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
@@ -0,0 +1,49 @@
+// RUN: g++ %s -o %t.exe -masm=intel -Wl,--build-id
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: rm -rf %t.cache && mkdir %t.cache
+
+// The first run decodes the instructions and fills the cache.
+// RUN: %sde %toolarg -output %t.first.log -cache_dir %t.cache -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.first.log > %t.first.out
+
+// The second run uses the cache, and should produce the same output.
+// RUN: %sde %toolarg -output %t.second.log -cache_dir %t.cache -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.second.log > %t.second.out
+// RUN: diff %t.first.out %t.second.out
+// RUN: FileCheck %s --check-prefix=LOG <%t.second.log
+// RUN: FileCheck %s --check-prefix=CSV -DEXE_PATH=%t.exe <%t.second.out
+
+// Every instruction is output only once.
+// RUN: cut -d, -f2,4 %t.second.log.instruction-info.csv | sort | uniq -d > %t.duplicates
+// RUN: test ! -s %t.duplicates
+
+// A cache with a corrupt line is ignored, and the instructions are decoded
+// again.
+// RUN: sed -i -e '2s/^[0-9]*/corrupt/' %t.cache/*.cache
+// RUN: %sde %toolarg -output %t.corrupt.log -cache_dir %t.cache -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.corrupt.log > %t.corrupt.out
+// RUN: diff %t.first.out %t.corrupt.out
+// RUN: FileCheck %s --check-prefix=CORRUPT <%t.corrupt.log
+
+// LOG: Loaded {{[1-9][0-9]*}} cached instructions of {{.*}}.exe.
+
+// CORRUPT: Ignoring cache of {{.*}}.exe with a corrupt line.
+
+#include <iostream>
+
+int square(int x) { return x * x; }
+
+int main() {
+  int sum = 0;
+
+  for (int i = 0; i < 10; ++i)
+    sum += square(i);
+
+  std::cout << sum << std::endl;
+
+  return 0;
+}
+
+// CSV: Address:     [[EXE_PATH]]::{{.*}}::square+0x0
+// CSV: Address:     [[EXE_PATH]]::{{.*}}::main+0x0
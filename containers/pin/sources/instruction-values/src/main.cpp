@@ -1,17 +1,25 @@
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "asyncanalysis.h"
+#include "operandvalue.h"
 #include "pin.H"
+#include "sampling.h"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_instruction_values;
+// Table to write the instruction values to.
+static std::unique_ptr<TableWriter> instruction_values_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -40,6 +48,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.instruction-values.csv.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.instruction-values.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -58,6 +73,17 @@ KNOB<std::size_t> KnobInstructionValuesLimit(
     "The maximum number of unique read/written "
     "values stored per instruction operand. Set to '-1' to store ALL values.");
 
+// Option (-sample_period) to only analyse a random sample of the executions.
+KNOB<UINT64> KnobSamplePeriod(
+    KNOB_MODE_WRITEONCE, "pintool", "sample_period", "1",
+    "Analyse 1 in <sample_period> instruction executions on average, chosen "
+    "at random. The numbers of occurrences of the values are then estimates. "
+    "1 analyses every execution.");
+
+// Option (-sample_seed) to set the seed of the random sampling.
+KNOB<UINT64> KnobSampleSeed(KNOB_MODE_WRITEONCE, "pintool", "sample_seed",
+                            "0", "Seed of the random sampling.");
+
 // Option (-range_image) that determines the image name of ranges of
 // instructions to profile.
 KNOB<std::string> KnobRangeImage(
@@ -94,6 +120,30 @@ KNOB<std::string> KnobRangesFile(
     "when you want to specify more instruction ranges than allowed by the "
     "maximum argument length.");
 
+// Option (-async) to analyse operand values in internal threads.
+KNOB<bool> KnobAsync(
+    KNOB_MODE_WRITEONCE, "pintool", "async", "0",
+    "When true, application threads only append a record of each operand "
+    "value to a per-thread buffer, and internal threads update the profile "
+    "from the full buffers.");
+
+// Option (-async_threads) to set the number of internal analysis threads.
+KNOB<unsigned int> KnobAsyncThreads(
+    KNOB_MODE_WRITEONCE, "pintool", "async_threads", "2",
+    "Number of internal threads that analyse the buffers with -async. Each "
+    "thread updates the profile of a fixed subset of the instructions.");
+
+// Option (-async_buffer_size) to set the size of the per-thread buffers.
+KNOB<std::size_t> KnobAsyncBufferSize(
+    KNOB_MODE_WRITEONCE, "pintool", "async_buffer_size", "262144",
+    "Size in bytes of the buffers of operand value records with -async.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
 // Represents an instruction range, i.e. the set of instructions inside an
 // image, and with an offset in the interval [begin, end[.
 struct InstructionRange {
@@ -146,13 +196,17 @@ struct InstructionInfo {
   static constexpr std::size_t MAX_NUM_OPERANDS =
       4; // Maximum number of operands that will be tracked.
 
-  InstructionInfo() : InstructionInfo("???", 0) {}
+  InstructionInfo() : InstructionInfo("???", 0, 0) {}
 
-  InstructionInfo(const std::string &image_name, ADDRINT image_offset)
-      : image_name(image_name), image_offset(image_offset), num_operands(0) {}
+  InstructionInfo(const std::string &image_name, ADDRINT image_offset,
+                  unsigned int shard)
+      : image_name(image_name), image_offset(image_offset), shard(shard),
+        num_operands(0) {}
 
   std::string image_name; // Name of the image.
   ADDRINT image_offset;   // Offset from the start of the image.
+  unsigned int shard;     // With -async, the index of the internal thread
+                          // that updates this info.
   UINT32 num_operands;    // The number of register+memory operands of this
                           // instruction.
 
@@ -163,14 +217,63 @@ struct InstructionInfo {
 std::map<ADDRINT, InstructionInfo> instruction_infos;
 
 // Mutex to control access to instruction_infos.
-static PIN_MUTEX instruction_infos_lock;
+static StatMutex instruction_infos_lock("instruction_infos_lock");
 
 // Remembers the effective address of memory operands.
 // Key = (threadID, operand index), value = effective address.
 std::map<std::pair<THREADID, UINT32>, ADDRINT> memory_operands_map;
 
 // Mutex to control access to memory_operands_map.
-static PIN_MUTEX memory_operands_map_lock;
+static StatMutex memory_operands_map_lock("memory_operands_map_lock");
+
+// -----------------------------------------------------------------------------
+// Asynchronous analysis (-async)
+// -----------------------------------------------------------------------------
+//
+// Application threads append a record of every operand value to a buffer,
+// which the analysis threads of asyncanalysis.h analyse. Every analysis thread
+// updates the infos of a fixed subset (shard) of the instructions.
+
+// A record of the value of an operand. It is followed by the bytes of the
+// value.
+struct OperandValueRecord {
+  InstructionInfo *info;
+  UINT32 operand_index;
+  UINT32 is_written;
+  ADDRINT size;
+};
+
+// The operand slots of written memory operands must fit in the effective
+// addresses that are remembered per thread.
+static_assert(InstructionInfo::MAX_NUM_OPERANDS <= MAX_ASYNC_WRITE_ADDRESSES,
+              "Too many operand slots for the asynchronous analysis");
+
+// Statistics for -tool_stats.
+static CallCounter main_called_calls("MainCalled");
+static CallCounter main_returned_calls("MainReturned");
+static CallCounter
+    instruction_read_register_before_calls("InstructionReadRegisterBefore");
+static CallCounter
+    instruction_read_memory_before_calls("InstructionReadMemoryBefore");
+static CallCounter
+    instruction_write_register_after_calls("InstructionWriteRegisterAfter");
+static CallCounter
+    instruction_write_memory_before_calls("InstructionWriteMemoryBefore");
+static CallCounter
+    instruction_write_memory_after_calls("InstructionWriteMemoryAfter");
+static CallCounter async_read_register_before_calls("AsyncReadRegisterBefore");
+static CallCounter async_read_memory_before_calls("AsyncReadMemoryBefore");
+static CallCounter async_write_register_after_calls("AsyncWriteRegisterAfter");
+static CallCounter async_write_memory_before_calls("AsyncWriteMemoryBefore");
+static CallCounter async_write_memory_after_calls("AsyncWriteMemoryAfter");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize instruction_infos_size("instruction_infos");
+static PeakSize memory_operands_map_size("memory_operands_map");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
 
 // =============================================================================
 // Helper routines
@@ -195,31 +298,37 @@ std::string get_filename(const std::string &path) {
 // Analysis routines
 // =============================================================================
 
-// Run before every instruction.
-VOID InstructionBefore(ADDRINT instruction_pointer) {
-  // Check if main if reached yet.
-  if (instruction_pointer == main_address) {
-    log_file << "\nMain reached, setting global flag.\n";
-    main_reached = true;
-  }
+// Inlined check that runs before every call instruction. Returns whether this
+// is the first call to main().
+ADDRINT PIN_FAST_ANALYSIS_CALL CallsMain(ADDRINT target_address) {
+  return (end_address == INVALID_ADDRESS) & (target_address == main_address);
+}
 
-  // Check if main is finished.
-  if (instruction_pointer == end_address) {
-    log_file
-        << "\nInstruction after call to main reached, setting global flag.\n";
-    end_reached = true;
-  }
+// Runs at the first call to main().
+VOID MainCalled(ADDRINT next_instruction_pointer) {
+  main_called_calls.count();
+
+  log_file << "\nMain called, next ip = " << std::hex << std::showbase
+           << next_instruction_pointer << std::dec << "\n";
+  end_address = next_instruction_pointer;
+
+  log_file << "\nMain reached, setting global flag.\n";
+  main_reached = true;
 }
 
-// Runs before every call instruction.
-VOID InstructionCallBefore(ADDRINT target_address,
-                           ADDRINT next_instruction_pointer) {
-  // Check if this is the first call to main().
-  if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
-    log_file << "\nMain called, next ip = " << std::hex << std::showbase
-             << next_instruction_pointer << std::dec << "\n";
-    end_address = next_instruction_pointer;
-  }
+// Inlined check that runs before every return instruction. Returns whether it
+// returns from main().
+ADDRINT PIN_FAST_ANALYSIS_CALL ReturnsFromMain(ADDRINT target_address) {
+  return target_address == end_address;
+}
+
+// Runs when main() returns.
+VOID MainReturned() {
+  main_returned_calls.count();
+
+  log_file
+      << "\nInstruction after call to main reached, setting global flag.\n";
+  end_reached = true;
 }
 
 // Run at the start of __libc_start_main().
@@ -234,10 +343,12 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
 VOID InstructionReadRegisterBefore(ADDRINT instruction_address,
                                    ADDRINT operand_index, UINT8 *reg_value,
                                    ADDRINT reg_size) {
+  instruction_read_register_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  PIN_MutexLock(&instruction_infos_lock);
+  instruction_infos_lock.lock();
 
   auto &value_set = instruction_infos[instruction_address]
                         .operands[operand_index]
@@ -248,41 +359,44 @@ VOID InstructionReadRegisterBefore(ADDRINT instruction_address,
                                          &reg_value[reg_size])]++;
   }
 
-  PIN_MutexUnlock(&instruction_infos_lock);
+  instruction_infos_lock.unlock();
 }
 
-// Run before an instruction, for every read from memory.
+// Run before an instruction, for every read from memory of SIZE bytes.
+template <std::size_t SIZE>
 VOID InstructionReadMemoryBefore(ADDRINT instruction_address,
                                  ADDRINT operand_index, ADDRINT memoryop_ea,
                                  ADDRINT memoryop_size) {
+  instruction_read_memory_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  PIN_MutexLock(&instruction_infos_lock);
+  instruction_infos_lock.lock();
 
   auto &value_set = instruction_infos[instruction_address]
                         .operands[operand_index]
                         .read_values;
 
   if (value_set.size() < KnobInstructionValuesLimit.Value()) {
-    unsigned char *buf = new unsigned char[memoryop_size];
-    PIN_SafeCopy(buf, reinterpret_cast<const void *>(memoryop_ea),
-                 memoryop_size);
-    value_set[std::vector<unsigned char>(buf, buf + memoryop_size)]++;
-    delete[] buf;
+    const OperandValue<SIZE> value(memoryop_ea, memoryop_size);
+    value_set[std::vector<unsigned char>(value.data(),
+                                         value.data() + value.size())]++;
   }
 
-  PIN_MutexUnlock(&instruction_infos_lock);
+  instruction_infos_lock.unlock();
 }
 
 // Run after an instruction, for every write to a register.
 VOID InstructionWriteRegisterAfter(ADDRINT instruction_address,
                                    ADDRINT operand_index, UINT8 *reg_value,
                                    ADDRINT reg_size) {
+  instruction_write_register_after_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
-  PIN_MutexLock(&instruction_infos_lock);
+  instruction_infos_lock.lock();
 
   auto &value_set = instruction_infos[instruction_address]
                         .operands[operand_index]
@@ -293,85 +407,208 @@ VOID InstructionWriteRegisterAfter(ADDRINT instruction_address,
                                          &reg_value[reg_size])]++;
   }
 
-  PIN_MutexUnlock(&instruction_infos_lock);
+  instruction_infos_lock.unlock();
 }
 
 // Run before an instruction, for every write to memory. This routine is only
 // used to store the effective address of the memory operand.
 VOID InstructionWriteMemoryBefore(THREADID thread_id, ADDRINT operand_index,
                                   ADDRINT memoryop_ea) {
+  instruction_write_memory_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Store effective address of this memory operand, so we can reuse it later in
   // InstructionWriteMemoryAfter.
-  PIN_MutexLock(&memory_operands_map_lock);
+  memory_operands_map_lock.lock();
   memory_operands_map[std::make_pair(thread_id, operand_index)] = memoryop_ea;
-  PIN_MutexUnlock(&memory_operands_map_lock);
+  memory_operands_map_size.update(memory_operands_map.size());
+  memory_operands_map_lock.unlock();
 }
 
-// Run after an instruction, for every write to memory.
+// Run after an instruction, for every write to memory of SIZE bytes.
+template <std::size_t SIZE>
 VOID InstructionWriteMemoryAfter(THREADID thread_id,
                                  ADDRINT instruction_address,
                                  ADDRINT operand_index, ADDRINT memoryop_size) {
+  instruction_write_memory_after_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Obtain the effective address of this memory operand, stored by
   // InstructionReadMemoryBefore. We need to do this because IARG_MEMORYOP_EA is
   // only valid at IPOINT_BEFORE.
-  PIN_MutexLock(&memory_operands_map_lock);
+  memory_operands_map_lock.lock();
   ADDRINT memoryop_ea =
       memory_operands_map[std::make_pair(thread_id, operand_index)];
-  PIN_MutexUnlock(&memory_operands_map_lock);
+  memory_operands_map_lock.unlock();
 
-  PIN_MutexLock(&instruction_infos_lock);
+  instruction_infos_lock.lock();
 
   auto &value_set = instruction_infos[instruction_address]
                         .operands[operand_index]
                         .written_values;
 
   if (value_set.size() < KnobInstructionValuesLimit.Value()) {
-    unsigned char *buf = new unsigned char[memoryop_size];
-    PIN_SafeCopy(buf, reinterpret_cast<const void *>(memoryop_ea),
-                 memoryop_size);
-    value_set[std::vector<unsigned char>(buf, buf + memoryop_size)]++;
-    delete[] buf;
+    const OperandValue<SIZE> value(memoryop_ea, memoryop_size);
+    value_set[std::vector<unsigned char>(value.data(),
+                                         value.data() + value.size())]++;
   }
 
-  PIN_MutexUnlock(&instruction_infos_lock);
+  instruction_infos_lock.unlock();
+}
+
+// Update the infos with a record of an operand value. Runs in the analysis
+// thread of the instruction's shard.
+void AnalyseRecord(const OperandValueRecord &record,
+                   const unsigned char *value) {
+  OperandInfo &operand = record.info->operands[record.operand_index];
+  auto &value_set =
+      record.is_written ? operand.written_values : operand.read_values;
+
+  if (value_set.size() < KnobInstructionValuesLimit.Value())
+    value_set[std::vector<unsigned char>(value, value + record.size)]++;
+}
+
+// Append a record of an operand value to the buffer of the instruction's
+// shard, and return where the caller copies the 'size' bytes of the value.
+unsigned char *AppendRecord(THREADID thread_id, InstructionInfo *info,
+                            ADDRINT operand_index, bool is_written,
+                            ADDRINT size) {
+  auto *record =
+      append_async_record<OperandValueRecord>(thread_id, info->shard, size);
+  record->info = info;
+  record->operand_index = operand_index;
+  record->is_written = is_written;
+
+  return async_record_value(record);
+}
+
+// Run before an instruction, for every read from a register, with -async.
+VOID AsyncReadRegisterBefore(THREADID thread_id, InstructionInfo *info,
+                             ADDRINT operand_index, UINT8 *reg_value,
+                             ADDRINT reg_size) {
+  async_read_register_before_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  std::memcpy(AppendRecord(thread_id, info, operand_index, false, reg_size),
+              reg_value, reg_size);
+}
+
+// Run before an instruction, for every read from memory, with -async.
+VOID AsyncReadMemoryBefore(THREADID thread_id, InstructionInfo *info,
+                           ADDRINT operand_index, ADDRINT memoryop_ea,
+                           ADDRINT memoryop_size) {
+  async_read_memory_before_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  PIN_SafeCopy(
+      AppendRecord(thread_id, info, operand_index, false, memoryop_size),
+      reinterpret_cast<const VOID *>(memoryop_ea), memoryop_size);
+}
+
+// Run after an instruction, for every write to a register, with -async.
+VOID AsyncWriteRegisterAfter(THREADID thread_id, InstructionInfo *info,
+                             ADDRINT operand_index, UINT8 *reg_value,
+                             ADDRINT reg_size) {
+  async_write_register_after_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  std::memcpy(AppendRecord(thread_id, info, operand_index, true, reg_size),
+              reg_value, reg_size);
+}
+
+// Run before an instruction, for every write to memory, with -async. This
+// routine is only used to store the effective address of the memory operand.
+VOID AsyncWriteMemoryBefore(THREADID thread_id, ADDRINT operand_index,
+                            ADDRINT memoryop_ea) {
+  async_write_memory_before_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  // Store the effective address so we can reuse it later in
+  // AsyncWriteMemoryAfter.
+  async_write_addresses(thread_id)[operand_index] = memoryop_ea;
+}
+
+// Run after an instruction, for every write to memory, with -async.
+VOID AsyncWriteMemoryAfter(THREADID thread_id, InstructionInfo *info,
+                           ADDRINT operand_index, ADDRINT memoryop_size) {
+  async_write_memory_after_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  const ADDRINT memoryop_ea = async_write_addresses(thread_id)[operand_index];
+
+  PIN_SafeCopy(
+      AppendRecord(thread_id, info, operand_index, true, memoryop_size),
+      reinterpret_cast<const VOID *>(memoryop_ea), memoryop_size);
 }
 
 // =============================================================================
 // Instrumentation routines
 // =============================================================================
 
+// Add the arguments that identify the instruction of an analysis call of an
+// operand value: its address, or with -async, the thread and its info.
+void AddInstructionArguments(IARGLIST args, InstructionInfo *info) {
+  if (KnobAsync.Value())
+    IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_PTR, info, IARG_END);
+  else
+    IARGLIST_AddArguments(args, IARG_INST_PTR, IARG_END);
+}
+
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
-  // Call InstructionBefore() before every instruction.
-  // Pass RIP as argument.
-  INS_InsertCall(instruction, IPOINT_BEFORE,
-                 reinterpret_cast<AFUNPTR>(InstructionBefore), IARG_INST_PTR,
-                 IARG_END);
+  ScopedStatTimer timer(on_instruction_timer);
 
-  // Call InstructionCallBefore() before every call instruction.
+  // Call MainCalled() if a call instruction is the first call to main(). It
+  // runs after the other analysis routines of the call, which is not part of
+  // main() yet.
   // Pass the target address (i.e. the address of the function being called) and
   // the address of the next instruction (i.e. the one following the call).
   if (INS_IsCall(instruction)) {
-    INS_InsertCall(instruction, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(InstructionCallBefore),
-                   IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
-                   INS_NextAddress(instruction), IARG_END);
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(CallsMain), IARG_CALL_ORDER,
+                     CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainCalled), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_ADDRINT,
+                       INS_NextAddress(instruction), IARG_END);
+  }
+
+  // Call MainReturned() if a return instruction returns from main(). It runs
+  // after the other analysis routines of the return, which is still part of
+  // main().
+  // Pass the return address.
+  if (INS_IsRet(instruction)) {
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(ReturnsFromMain),
+                     IARG_CALL_ORDER, CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainReturned), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_END);
   }
 
   // Get instruction address.
   const ADDRINT instruction_address = INS_Address(instruction);
 
   // Get the image name and offset.
-  IMG img = IMG_FindByAddress(instruction_address);
-  std::string image_name = IMG_Valid(img) ? get_filename(IMG_Name(img)) : "???";
-  ADDRINT image_offset =
-      IMG_Valid(img) ? (instruction_address - IMG_LowAddress(img)) : -1;
+  const SymbolLocation location = find_symbol(instruction_address);
+  std::string image_name = get_filename(get_name(location.image_name));
+  ADDRINT image_offset = location.image_offset;
 
   // Only profile instructions that are specified in instruction_ranges.
   bool should_profile = false;
@@ -394,16 +631,28 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
   // Only profile instructions that we are interested in.
   if (should_profile) {
-    // Fill in instruction info, if it doesn't exist already.
-    PIN_MutexLock(&instruction_infos_lock);
-    instruction_infos.insert(std::make_pair(
-        instruction_address, InstructionInfo(image_name, image_offset)));
-    PIN_MutexUnlock(&instruction_infos_lock);
+    // Fill in instruction info, if it doesn't exist already. With -async, the
+    // instructions are assigned to the analysis threads round-robin.
+    instruction_infos_lock.lock();
+    const unsigned int shard =
+        KnobAsync.Value() ? instruction_infos.size() % async_analysis_threads()
+                          : 0;
+    InstructionInfo *info =
+        &instruction_infos
+             .insert(std::make_pair(
+                 instruction_address,
+                 InstructionInfo(image_name, image_offset, shard)))
+             .first->second;
+    instruction_infos_size.update(instruction_infos.size());
+    instruction_infos_lock.unlock();
+
+    // With sampling, only the values of sampled executions are analysed.
+    insert_sample_countdown(instruction);
 
     // Remember the next free slot for operands.
     std::size_t next_free_operand_slot = 0;
 
-    PIN_MutexLock(&instruction_infos_lock);
+    instruction_infos_lock.lock();
 
     for (UINT32 i = 0; i < INS_OperandCount(instruction); ++i) {
       if (INS_OperandIsReg(instruction, i)) {
@@ -431,29 +680,41 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
         // Register instrumentation routines.
         if (is_read) {
-          INS_InsertPredicatedCall(
-              instruction, IPOINT_BEFORE,
-              reinterpret_cast<AFUNPTR>(InstructionReadRegisterBefore),
-
-              IARG_INST_PTR, // ADDRINT instruction_address
+          IARGLIST args = IARGLIST_Alloc();
+          AddInstructionArguments(args, info);
+          IARGLIST_AddArguments(
+              args,
               IARG_ADDRINT, next_free_operand_slot, // ADDRINT operand_index
               IARG_REG_CONST_REFERENCE, reg,        // UINT8* reg_value
               IARG_ADDRINT,
               static_cast<ADDRINT>(REG_Size(reg)), // ADDRINT reg_size
               IARG_END);
+
+          insert_sampled_call(
+              instruction, IPOINT_BEFORE,
+              KnobAsync.Value()
+                  ? reinterpret_cast<AFUNPTR>(AsyncReadRegisterBefore)
+                  : reinterpret_cast<AFUNPTR>(InstructionReadRegisterBefore),
+              args);
         }
 
         if (is_written && INS_IsValidForIpointAfter(instruction)) {
-          INS_InsertPredicatedCall(
-              instruction, IPOINT_AFTER,
-              reinterpret_cast<AFUNPTR>(InstructionWriteRegisterAfter),
-
-              IARG_INST_PTR, // ADDRINT instruction_address
+          IARGLIST args = IARGLIST_Alloc();
+          AddInstructionArguments(args, info);
+          IARGLIST_AddArguments(
+              args,
               IARG_ADDRINT, next_free_operand_slot, // ADDRINT operand_index
               IARG_REG_CONST_REFERENCE, reg,        // UINT8* reg_value
               IARG_ADDRINT,
               static_cast<ADDRINT>(REG_Size(reg)), // ADDRINT reg_size
               IARG_END);
+
+          insert_sampled_call(
+              instruction, IPOINT_AFTER,
+              KnobAsync.Value()
+                  ? reinterpret_cast<AFUNPTR>(AsyncWriteRegisterAfter)
+                  : reinterpret_cast<AFUNPTR>(InstructionWriteRegisterAfter),
+              args);
         }
 
         // Increment next free slot.
@@ -500,43 +761,71 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
         // Check if the memory operand is found.
         if (memory_operand_index != static_cast<UINT32>(-1)) {
+          const ADDRINT memoryop_size =
+              INS_MemoryOperandSize(instruction, memory_operand_index);
+
           // Register instrumentation routines.
           if (is_read) {
-            INS_InsertPredicatedCall(
-                instruction, IPOINT_BEFORE,
-                reinterpret_cast<AFUNPTR>(InstructionReadMemoryBefore),
-                IARG_INST_PTR, // ADDRINT instruction_address
+            IARGLIST args = IARGLIST_Alloc();
+            AddInstructionArguments(args, info);
+            IARGLIST_AddArguments(
+                args,
                 IARG_ADDRINT, next_free_operand_slot,   // ADDRINT operand_index
                 IARG_MEMORYOP_EA, memory_operand_index, // ADDRINT memoryop_ea
-                IARG_ADDRINT,
-                static_cast<ADDRINT>(INS_MemoryOperandSize(
-                    instruction,
-                    memory_operand_index)), // ADDRINT memoryop_size
+                IARG_ADDRINT, memoryop_size,            // ADDRINT memoryop_size
                 IARG_END);
+
+            // Use the instantiation that is specialized for the operand size.
+            insert_sampled_call(
+                instruction, IPOINT_BEFORE,
+                KnobAsync.Value()
+                    ? reinterpret_cast<AFUNPTR>(AsyncReadMemoryBefore)
+                    : SIZED_ROUTINE(InstructionReadMemoryBefore, memoryop_size),
+                args);
           }
 
           if (is_written) {
             if (INS_IsValidForIpointAfter(instruction)) {
               // Store the effective address in memory_operands_map.
-              INS_InsertPredicatedCall(
-                  instruction, IPOINT_BEFORE,
-                  reinterpret_cast<AFUNPTR>(InstructionWriteMemoryBefore),
+              IARGLIST args = IARGLIST_Alloc();
+              IARGLIST_AddArguments(
+                  args,
                   IARG_THREAD_ID,                       // THREADID thread_id
                   IARG_ADDRINT, next_free_operand_slot, // ADDRINT operand_index
                   IARG_MEMORYOP_EA, memory_operand_index, // ADDRINT memoryop_ea
                   IARG_END);
 
-              INS_InsertPredicatedCall(
-                  instruction, IPOINT_AFTER,
-                  reinterpret_cast<AFUNPTR>(InstructionWriteMemoryAfter),
-                  IARG_THREAD_ID, // THREADID thread_id
-                  IARG_INST_PTR,  // ADDRINT instruction_address
+              insert_sampled_call(
+                  instruction, IPOINT_BEFORE,
+                  KnobAsync.Value()
+                      ? reinterpret_cast<AFUNPTR>(AsyncWriteMemoryBefore)
+                      : reinterpret_cast<AFUNPTR>(InstructionWriteMemoryBefore),
+                  args);
+
+              args = IARGLIST_Alloc();
+
+              // InstructionWriteMemoryAfter() also takes the thread, to find
+              // the effective address. With -async, AddInstructionArguments()
+              // passes it already.
+              if (!KnobAsync.Value())
+                IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_END);
+
+              AddInstructionArguments(args, info);
+              IARGLIST_AddArguments(
+                  args,
                   IARG_ADDRINT, next_free_operand_slot, // ADDRINT operand_index
-                  IARG_ADDRINT,
-                  static_cast<ADDRINT>(INS_MemoryOperandSize(
-                      instruction,
-                      memory_operand_index)), // ADDRINT memoryop_size
+                  IARG_ADDRINT, memoryop_size, // ADDRINT memoryop_size
                   IARG_END);
+
+              // Use the instantiation that is specialized for the operand
+              // size.
+              insert_sampled_call(
+                  instruction, IPOINT_AFTER,
+                  KnobAsync.Value()
+                      ? reinterpret_cast<AFUNPTR>(AsyncWriteMemoryAfter)
+                      : SIZED_ROUTINE(InstructionWriteMemoryAfter,
+                                      memoryop_size),
+                  args);
             } else {
               log_file << "Cannot add predicated call to "
                           "InstructionWriteMemoryAfter "
@@ -561,12 +850,14 @@ VOID OnInstruction(INS instruction, VOID *v) {
     instruction_infos[instruction_address].num_operands =
         next_free_operand_slot;
 
-    PIN_MutexUnlock(&instruction_infos_lock);
+    instruction_infos_lock.unlock();
   }
 }
 
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -590,95 +881,99 @@ VOID OnImageLoad(IMG image, VOID *v) {
 // Machine-parsable output routines
 // =============================================================================
 
-// Pretty print the read/written values.
+// Pretty print the read/written values into out, replacing its contents.
 void pretty_print_value_list(
-    std::ofstream &ofs,
+    std::string &out,
     const std::map<std::vector<unsigned char>, unsigned int> &values) {
-  ofs << '"';
+  out.clear();
 
   bool first_value = true;
   for (const auto &entry : values) {
     const auto &value = entry.first;
     const auto &count = entry.second;
 
-    ofs << (first_value ? "" : ",");
+    if (!first_value)
+      out += ',';
     first_value = false;
 
     bool first_byte = true;
     for (const unsigned char byte : value) {
-      std::ostringstream oss;
-      oss << std::hex << std::setw(2) << std::setfill('0')
-          << static_cast<unsigned int>(byte);
-      ofs << (first_byte ? "" : " ") << oss.str();
+      if (!first_byte)
+        out += ' ';
+      append_hex_byte(out, byte);
       first_byte = false;
     }
 
-    ofs << " (occurs " << std::dec << count << " time(s))";
+    out += " (occurs ";
+    append_decimal(out, static_cast<std::uint64_t>(estimate_count(count)));
+    out += " time(s))";
   }
-
-  ofs << '"';
 }
 
-// Dump the information for instruction values in CSV format.
-void dump_csv_instruction_values(
-    std::ofstream &ofs,
-    const std::map<ADDRINT, InstructionInfo> &instruction_infos) {
-  // Print header.
-  ofs << "image_name,image_offset,num_operands";
+// Returns the columns of the instruction values table.
+std::vector<TableColumn> instruction_values_columns() {
+  std::vector<TableColumn> columns = {
+      {"image_name", ColumnType::STRING},
+      {"image_offset", ColumnType::INT64},
+      {"num_operands", ColumnType::UINT64},
+  };
 
   for (std::size_t i = 0; i < InstructionInfo::MAX_NUM_OPERANDS; ++i) {
-    ofs << ",operand_" << i << "_repr";
-    ofs << ",operand_" << i << "_width";
-    ofs << ",operand_" << i << "_is_read";
-    ofs << ",operand_" << i << "_is_written";
-    ofs << ",operand_" << i << "_read_values";
-    ofs << ",operand_" << i << "_written_values";
+    const std::string prefix = "operand_" + std::to_string(i);
+
+    columns.push_back({prefix + "_repr", ColumnType::STRING, true});
+    columns.push_back({prefix + "_width", ColumnType::UINT64});
+    columns.push_back({prefix + "_is_read", ColumnType::UINT64});
+    columns.push_back({prefix + "_is_written", ColumnType::UINT64});
+    columns.push_back({prefix + "_read_values", ColumnType::STRING, true});
+    columns.push_back({prefix + "_written_values", ColumnType::STRING, true});
   }
 
-  ofs << "\n";
+  return columns;
+}
+
+// Dump the information for instruction values.
+void dump_instruction_values(
+    TableWriter &table,
+    const std::map<ADDRINT, InstructionInfo> &instruction_infos) {
+  // Buffer reused for the pretty printed values of every operand.
+  std::string values;
 
-  // Print data.
+  // Print data. The offset column is signed, so unknown offsets are -1.
   for (const auto &p : instruction_infos) {
     const InstructionInfo &info = p.second;
-    ofs << info.image_name; // image_name
-
-    // Print "-1" for unknown offsets.
-    if (info.image_offset != static_cast<ADDRINT>(-1))
-      ofs << ',' << info.image_offset; // image_offset
-    else
-      ofs << ',' << -1; // image_offset
 
-    ofs << ',' << info.num_operands; // num_operands
+    table << info.image_name    // image_name
+          << info.image_offset  // image_offset
+          << info.num_operands; // num_operands
 
     for (std::size_t i = 0; i < InstructionInfo::MAX_NUM_OPERANDS; ++i) {
       if (i < info.num_operands) {
         // Filled in operand.
         const OperandInfo &op = info.operands[i];
 
-        ofs << ',' << '"' << op.repr << '"' // operand_<i>_repr
-            << ',' << op.width              // operand_<i>_width
-            << ',' << op.is_read            // operand_<i>_is_read
-            << ',' << op.is_written;        // operand_<i>_is_written
+        table << op.repr        // operand_<i>_repr
+              << op.width       // operand_<i>_width
+              << op.is_read     // operand_<i>_is_read
+              << op.is_written; // operand_<i>_is_written
 
         // operand_<i>_read_values
-        ofs << ',';
-        pretty_print_value_list(ofs, op.read_values);
+        pretty_print_value_list(values, op.read_values);
+        table << values;
 
         // operand_<i>_written_values
-        ofs << ',';
-        pretty_print_value_list(ofs, op.written_values);
+        pretty_print_value_list(values, op.written_values);
+        table << values;
       } else {
         // Operand not filled in.
-        ofs << ',' << "\"\""  // operand_<i>_repr
-            << ',' << 0       // operand_<i>_width
-            << ',' << false   // operand_<i>_is_read
-            << ',' << false   // operand_<i>_is_written
-            << ',' << "\"\""  // operand_<i>_read_values
-            << ',' << "\"\""; // operand_<i>_written_values
+        table << ""    // operand_<i>_repr
+              << 0     // operand_<i>_width
+              << false // operand_<i>_is_read
+              << false // operand_<i>_is_written
+              << ""    // operand_<i>_read_values
+              << "";   // operand_<i>_written_values
       }
     }
-
-    ofs << '\n';
   }
 }
 
@@ -688,11 +983,16 @@ void dump_csv_instruction_values(
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
   // -----------------------
   // Machine parsable output
   // -----------------------
 
-  dump_csv_instruction_values(csv_instruction_values, instruction_infos);
+  if (KnobAsync.Value())
+    finish_async_analysis();
+
+  dump_instruction_values(*instruction_values_table, instruction_infos);
 
   // -------
   // Cleanup
@@ -703,8 +1003,14 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV file.
-  csv_instruction_values.flush();
-  csv_instruction_values.close();
+  instruction_values_table->close();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -714,6 +1020,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -740,6 +1049,34 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
+  if (!init_sampling(KnobSamplePeriod.Value(), KnobSampleSeed.Value())) {
+    std::cerr << "Invalid sample period '" << KnobSamplePeriod.Value()
+              << "', or no register available for sampling.\n\n";
+    return Usage();
+  }
+
+  if (KnobAsync.Value() && KnobAsyncThreads.Value() == 0) {
+    std::cerr << "The number of analysis threads must be at least 1.\n\n";
+    return Usage();
+  }
+
+  if (KnobAsync.Value() && KnobAsyncBufferSize.Value() < 4096) {
+    std::cerr << "The buffer size must be at least 4096 bytes.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
   if (!KnobStartFromMain.Value())
@@ -793,7 +1130,9 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_instruction_values.open((csv_prefix + ".instruction-values.csv").c_str());
+  instruction_values_table =
+      open_table(csv_prefix + ".instruction-values", table_format,
+                 instruction_values_columns());
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
@@ -801,19 +1140,32 @@ int main(int argc, char *argv[]) {
   // Register image load callback.
   IMG_AddInstrumentFunction(OnImageLoad, nullptr);
 
+  // Start the asynchronous analysis.
+  if (KnobAsync.Value() &&
+      !init_async_analysis(
+          KnobAsyncThreads.Value(), KnobAsyncBufferSize.Value(),
+          analyse_async_records<OperandValueRecord, AnalyseRecord>)) {
+    std::cerr << "Could not start the asynchronous analysis!" << std::endl;
+    PIN_ExitProcess(1);
+    return EXIT_FAILURE;
+  }
+
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&instruction_infos_lock);
-  PIN_MutexInit(&memory_operands_map_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
@@ -9,6 +9,12 @@
 // RUN: cat %t.symbols %t.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe \
 // RUN: --check-prefixes CHECK,%arch
 
+// RUN: %sde %toolarg -csv_prefix %t.async -async 1 -async_threads 3 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.async > %t.async.out
+
+// RUN: cat %t.symbols %t.async.out | FileCheck %s -DEXE_NAME=%basename_t.tmp.exe \
+// RUN: --check-prefixes CHECK,%arch
+
 extern "C" void func();
 
 #ifdef PIN_TARGET_ARCH_X64
@@ -0,0 +1,43 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: nm %t.exe > %t.symbols
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -csv_prefix %t -sample_period 64 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// The move of hot_move() is executed 100000 times, and always writes 7 to rax.
+// Sampling 1 in 64 of them should estimate the occurrences of that value within
+// a few percent.
+// RUN: python3 -c "import csv, re; \
+// RUN:   addr = next(int(l.split()[0], 16) for l in open('%t.symbols') if l.split()[-1] == 'hot_move'); \
+// RUN:   row = next(r for r in csv.DictReader(open('%t.instruction-values.csv')) if int(r['image_offset']) == addr); \
+// RUN:   values = [v for c, v in row.items() if c.endswith('_written_values') and v]; \
+// RUN:   n = int(re.fullmatch(r'07( 00){7} \(occurs (\d+) time\(s\)\)', values[0]).group(2)); \
+// RUN:   assert 80000 <= n <= 120000, n"
+
+// XFAIL: x86
+
+#include <cstdint>
+
+// Returns its argument.
+extern "C" std::int64_t hot_move(std::int64_t n);
+
+asm(R"(
+    .section        .text
+    .intel_syntax   noprefix
+    .globl          hot_move
+    .type           hot_move, @function
+
+hot_move:
+    mov             rax, rdi
+    ret
+)");
+
+int main(int argc, char *argv[]) {
+  std::int64_t n = 0;
+
+  for (int i = 0; i < 100000; ++i)
+    n += hot_move(7);
+
+  return n == 700000 ? 0 : 1;
+}
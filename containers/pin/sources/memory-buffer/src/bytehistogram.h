@@ -0,0 +1,72 @@
+#ifndef BYTEHISTOGRAM_H
+#define BYTEHISTOGRAM_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+// Counts the number of occurrences of every byte value.
+//
+// Most static instructions only access a handful of bytes, so the counters are
+// only allocated once the first byte is added. They start out as 16-bit
+// counters, and are promoted to 32-bit counters once one of them overflows.
+class ByteHistogram {
+public:
+  // Counts one occurrence of every byte in [values, values + size).
+  void add(const unsigned char *values, std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i)
+      add(values[i]);
+  }
+
+  // Counts one occurrence of 'byte'.
+  void add(unsigned char byte) {
+    if (wide_counts) {
+      ++wide_counts[byte];
+      return;
+    }
+
+    if (!narrow_counts)
+      narrow_counts.reset(new std::uint16_t[256]());
+
+    if (narrow_counts[byte] == std::numeric_limits<std::uint16_t>::max()) {
+      promote();
+      ++wide_counts[byte];
+    } else {
+      ++narrow_counts[byte];
+    }
+  }
+
+  // Returns the number of occurrences of 'byte'.
+  unsigned int get_count(unsigned char byte) const {
+    if (wide_counts)
+      return wide_counts[byte];
+
+    return narrow_counts ? narrow_counts[byte] : 0;
+  }
+
+  // Writes the number of occurrences of every byte value to 'counts'.
+  void get_counts(unsigned int (&counts)[256]) const {
+    for (std::size_t i = 0; i < 256; ++i)
+      counts[i] = get_count(static_cast<unsigned char>(i));
+  }
+
+private:
+  // The 16-bit counters, or nullptr if no byte was added yet or the counters
+  // were promoted.
+  std::unique_ptr<std::uint16_t[]> narrow_counts;
+
+  // The 32-bit counters, or nullptr if the counters were not promoted yet.
+  std::unique_ptr<unsigned int[]> wide_counts;
+
+  // Replaces the 16-bit counters by 32-bit counters.
+  void promote() {
+    wide_counts.reset(new unsigned int[256]);
+
+    for (std::size_t i = 0; i < 256; ++i)
+      wide_counts[i] = narrow_counts[i];
+
+    narrow_counts.reset();
+  }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "contentsinfo.h"
+
+#include "pin.H"
+
+void ContentsInfo::initialise(const unsigned char *start_address,
+                              unsigned int size, bool keep_copy,
+                              unsigned long long num_syscalls,
+                              TemporalEntropyInfo &temporal_entropy_info) {
+  std::vector<unsigned char> current_contents(size);
+  PIN_SafeCopy(current_contents.data(), start_address, size);
+
+  byte_counts.assign(256, 0);
+  total_hamming_weight = 0;
+
+  for (const unsigned char byte : current_contents) {
+    ++byte_counts[byte];
+    total_hamming_weight += hamming_weight(byte);
+  }
+
+  if (keep_copy)
+    contents.swap(current_contents);
+
+  dirty_begin = dirty_end = 0;
+  scanned_syscalls = num_syscalls;
+
+  temporal_entropy_info.start_lazy_recording();
+}
+
+unsigned int ContentsInfo::rescan(const unsigned char *start_address,
+                                  TemporalEntropyInfo &temporal_entropy_info) {
+  const unsigned int num_bytes = dirty_end - dirty_begin;
+
+  if (num_bytes == 0)
+    return 0;
+
+  std::vector<unsigned char> new_contents(num_bytes);
+  PIN_SafeCopy(new_contents.data(), start_address + dirty_begin, num_bytes);
+
+  for (unsigned int i = 0; i < num_bytes; ++i) {
+    unsigned char &old_byte = contents[dirty_begin + i];
+    const unsigned char new_byte = new_contents[i];
+
+    if (old_byte == new_byte)
+      continue;
+
+    // The old value was present up to and including the previous sample.
+    temporal_entropy_info.update_byte(dirty_begin + i, old_byte);
+
+    update_histogram(old_byte, new_byte);
+
+    old_byte = new_byte;
+  }
+
+  dirty_begin = dirty_end = 0;
+
+  return num_bytes;
+}
+
+void ContentsInfo::finalize(const unsigned char *start_address,
+                            unsigned long long num_syscalls,
+                            TemporalEntropyInfo &temporal_entropy_info) {
+  if (!temporal_entropy_info.is_lazy())
+    return;
+
+  if (!contents.empty()) {
+    rescan_after_syscalls(start_address, num_syscalls, temporal_entropy_info);
+
+    temporal_entropy_info.flush(contents);
+    return;
+  }
+
+  std::vector<unsigned char> current_contents(temporal_entropy_info.size());
+  PIN_SafeCopy(current_contents.data(), start_address,
+               current_contents.size());
+  temporal_entropy_info.flush(current_contents);
+}
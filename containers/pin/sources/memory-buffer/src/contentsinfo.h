@@ -0,0 +1,163 @@
+#ifndef CONTENTSINFO_H
+#define CONTENTSINFO_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "entropy.h"
+#include "temporalentropyinfo.h"
+
+// Keeps the byte histogram and Hamming weight of a contiguous region of memory,
+// so that sampling its entropy does not require reading the entire region.
+//
+// The histogram is kept up to date in one of two ways:
+// - By keeping a copy of the contents, and rescanning the bytes that were
+//   written since the previous sample (see mark_dirty() and rescan()).
+// - By applying the old and new values of every write (see apply_write()).
+//   The copy of the contents is then only used to detect writes that were not
+//   tracked, after which the region is rescanned.
+//
+// In both cases, the kernel may write to the region during a system call
+// without being tracked, so the region is rescanned entirely after system
+// calls (see rescan_after_syscalls()).
+class ContentsInfo {
+public:
+  // Creates a new, uninitialised ContentsInfo.
+  ContentsInfo()
+      : total_hamming_weight(0), dirty_begin(0), dirty_end(0),
+        scanned_syscalls(0) {}
+
+  // Returns whether the contents were read already.
+  bool is_initialised() const { return !byte_counts.empty(); }
+
+  // Reads the entire memory region, starting at the specified address and of
+  // a given size, keeping a copy of its contents if 'keep_copy' is true.
+  // 'num_syscalls' is the number of system calls that were made so far.
+  // Starts lazy recording in the temporal entropy info.
+  void initialise(const unsigned char *start_address, unsigned int size,
+                  bool keep_copy, unsigned long long num_syscalls,
+                  TemporalEntropyInfo &temporal_entropy_info);
+
+  // Marks the bytes in [begin, end) (relative to the start of the memory
+  // region) as written to since the previous sample.
+  void mark_dirty(unsigned int begin, unsigned int end) {
+    if (dirty_begin == dirty_end) {
+      dirty_begin = begin;
+      dirty_end = end;
+    } else {
+      dirty_begin = std::min(dirty_begin, begin);
+      dirty_end = std::max(dirty_end, end);
+    }
+  }
+
+  // Rereads the bytes that were written since the previous sample, and
+  // updates the histogram, Hamming weight and temporal entropy info
+  // accordingly. Returns the number of bytes that were read.
+  unsigned int rescan(const unsigned char *start_address,
+                      TemporalEntropyInfo &temporal_entropy_info);
+
+  // Rereads the entire memory region, starting at the specified address, if
+  // system calls were made since it was last read entirely, and updates the
+  // histogram, Hamming weight and temporal entropy info accordingly.
+  // 'num_syscalls' is the number of system calls that were made so far.
+  // Returns the number of bytes that were read.
+  unsigned int
+  rescan_after_syscalls(const unsigned char *start_address,
+                        unsigned long long num_syscalls,
+                        TemporalEntropyInfo &temporal_entropy_info) {
+    if (contents.empty() || (num_syscalls == scanned_syscalls))
+      return 0;
+
+    scanned_syscalls = num_syscalls;
+    mark_dirty(0, contents.size());
+    return rescan(start_address, temporal_entropy_info);
+  }
+
+  // Updates the histogram, Hamming weight, copy of the contents and temporal
+  // entropy info for a write of 'size' bytes at 'offset' (relative to the
+  // start of the memory region), given the values before and after the write.
+  // If the values before the write differ from the copy, the memory region was
+  // written to without being tracked, so it is rescanned entirely instead,
+  // starting at the specified address.
+  void apply_write(const unsigned char *start_address, unsigned int offset,
+                   const unsigned char *old_values,
+                   const unsigned char *new_values, unsigned int size,
+                   TemporalEntropyInfo &temporal_entropy_info) {
+    if (std::memcmp(old_values, &contents[offset], size) != 0) {
+      mark_dirty(0, contents.size());
+      rescan(start_address, temporal_entropy_info);
+      return;
+    }
+
+    for (unsigned int i = 0; i < size; ++i) {
+      if (old_values[i] != new_values[i]) {
+        temporal_entropy_info.update_byte(offset + i, old_values[i]);
+        update_histogram(old_values[i], new_values[i]);
+        contents[offset + i] = new_values[i];
+      }
+    }
+  }
+
+  // Counts the current value of every byte in lazy temporal entropy
+  // recording. The memory region, starting at the specified address, is only
+  // read if no copy of its contents is kept, or if system calls were made
+  // since it was last read entirely ('num_syscalls' is the number of system
+  // calls that were made so far).
+  void finalize(const unsigned char *start_address,
+                unsigned long long num_syscalls,
+                TemporalEntropyInfo &temporal_entropy_info);
+
+  // Forgets the contents, so that they are read again at the next
+  // initialise(). Used when the memory region may have been written to without
+  // being tracked, such as a stack frame that is no longer active.
+  void reset() {
+    contents.clear();
+    byte_counts.clear();
+    total_hamming_weight = 0;
+    dirty_begin = dirty_end = 0;
+  }
+
+  // Returns the number of occurrences of every byte value.
+  const unsigned int *get_byte_counts() const { return byte_counts.data(); }
+
+  // Returns the total number of 1-bits in the memory region.
+  unsigned int get_total_hamming_weight() const {
+    return total_hamming_weight;
+  }
+
+  // Returns the copy of the contents of the memory region.
+  const std::vector<unsigned char> &get_contents() const { return contents; }
+
+private:
+  // Copy of the contents of the memory region at the previous sample. This is
+  // empty if no copy is kept.
+  std::vector<unsigned char> contents;
+
+  // Number of occurrences of every byte value in 'contents'. This is only
+  // allocated once the contents are read for the first time.
+  std::vector<unsigned int> byte_counts;
+
+  // Total number of 1-bits in 'contents'.
+  unsigned int total_hamming_weight;
+
+  // Range of bytes [dirty_begin, dirty_end) that were written to since the
+  // previous sample.
+  unsigned int dirty_begin;
+  unsigned int dirty_end;
+
+  // Number of system calls that were made when the entire memory region was
+  // last read.
+  unsigned long long scanned_syscalls;
+
+  // Replaces one occurrence of 'old_byte' by 'new_byte' in the histogram and
+  // Hamming weight.
+  void update_histogram(unsigned char old_byte, unsigned char new_byte) {
+    --byte_counts[old_byte];
+    ++byte_counts[new_byte];
+    total_hamming_weight += hamming_weight(new_byte);
+    total_hamming_weight -= hamming_weight(old_byte);
+  }
+};
+
+#endif
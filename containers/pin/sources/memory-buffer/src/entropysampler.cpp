@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include "entropysampler.h"
+
+EntropySamplerConfig EntropySampler::config;
+
+// Upper bound on the sample interval, so that doubling it never overflows.
+static constexpr unsigned int MAX_INTERVAL = 1u << 31;
+
+bool parse_entropy_sample_policy(const std::string &name,
+                                 EntropySamplePolicy &policy) {
+  if (name == "interval")
+    policy = EntropySamplePolicy::Interval;
+  else if (name == "budget")
+    policy = EntropySamplePolicy::Budget;
+  else if (name == "backoff")
+    policy = EntropySamplePolicy::Backoff;
+  else if (name == "instructions")
+    policy = EntropySamplePolicy::Instructions;
+  else
+    return false;
+
+  return true;
+}
+
+bool parse_entropy_scan_strategy(const std::string &name,
+                                 EntropyScanStrategy &strategy) {
+  if (name == "full")
+    strategy = EntropyScanStrategy::Full;
+  else if (name == "dirty")
+    strategy = EntropyScanStrategy::Dirty;
+  else if (name == "incremental")
+    strategy = EntropyScanStrategy::Incremental;
+  else
+    return false;
+
+  return true;
+}
+
+EntropySampler::EntropySampler()
+    : interval(config.interval), writes_at_last_sample(0),
+      instructions_at_last_sample(0), sampled(false),
+      budget_left(config.byte_budget), epoch_budget(config.byte_budget) {}
+
+void EntropySampler::configure(const EntropySamplerConfig &new_config) {
+  config = new_config;
+}
+
+unsigned int EntropySampler::on_write(unsigned int num_writes,
+                                      UINT64 executed_instructions) {
+  switch (config.policy) {
+  case EntropySamplePolicy::Interval:
+    // Every sample stands for the same amount of time.
+    return (num_writes % config.interval == 0) ? 1 : 0;
+
+  case EntropySamplePolicy::Budget:
+  case EntropySamplePolicy::Backoff: {
+    if (num_writes - writes_at_last_sample < interval)
+      return 0;
+
+    writes_at_last_sample = num_writes;
+
+    // Weights are expressed in units of the base interval.
+    return interval / config.interval;
+  }
+
+  case EntropySamplePolicy::Instructions: {
+    // The first sample is taken at the first write, as there is no earlier
+    // point in time to measure from.
+    if (!sampled) {
+      sampled = true;
+      instructions_at_last_sample = executed_instructions;
+      return 1;
+    }
+
+    const UINT64 elapsed = executed_instructions - instructions_at_last_sample;
+    if (elapsed < config.instruction_interval)
+      return 0;
+
+    instructions_at_last_sample = executed_instructions;
+
+    // The buffer may not have been written to for several intervals, in which
+    // case its contents were constant during all of them.
+    return static_cast<unsigned int>(elapsed / config.instruction_interval);
+  }
+  }
+
+  return 0;
+}
+
+void EntropySampler::on_sample(unsigned int bytes_scanned, bool converged) {
+  sampled = true;
+
+  switch (config.policy) {
+  case EntropySamplePolicy::Budget:
+    budget_left -= std::min<UINT64>(budget_left, bytes_scanned);
+
+    // Once the budget is used up, sample half as often and grant half of the
+    // previous budget. The total number of bytes scanned is thus bounded by
+    // twice the budget, plus at most one sample per doubling.
+    if (budget_left == 0) {
+      interval = 2 * std::min(interval, MAX_INTERVAL / 2);
+      epoch_budget /= 2;
+      budget_left = epoch_budget;
+    }
+    break;
+
+  case EntropySamplePolicy::Backoff:
+    // Sample less frequently while the estimates are stable, and go back to
+    // the base interval as soon as they change.
+    if (converged)
+      interval = std::min(2 * std::min(interval, MAX_INTERVAL / 2),
+                          config.max_interval);
+    else
+      interval = config.interval;
+    break;
+
+  default:
+    break;
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef ENTROPYSAMPLER_H
+#define ENTROPYSAMPLER_H
+
+#include <string>
+
+#include "pin.H"
+
+// Policies that decide when the entropy of a memory buffer/region is sampled.
+enum class EntropySamplePolicy {
+  // Sample every 'interval' writes to the memory buffer/region.
+  Interval,
+
+  // Sample every 'interval' writes, but double the interval each time the
+  // buffer/region has used up its byte budget.
+  Budget,
+
+  // Sample every 'interval' writes, but double the interval each time the
+  // entropy estimates have converged, up to 'max_interval'.
+  Backoff,
+
+  // Sample every 'instruction_interval' executed instructions, checked on
+  // every write to the memory buffer/region.
+  Instructions,
+};
+
+// Strategies that decide how the contents of a memory buffer/region are read
+// when a sample is taken.
+enum class EntropyScanStrategy {
+  // Rescan the entire memory buffer/region.
+  Full,
+
+  // Only rescan the bytes that were written since the previous sample.
+  Dirty,
+
+  // Never rescan, but update the byte histogram and Hamming weight on every
+  // write, using the values before and after the write.
+  Incremental,
+};
+
+// Parses the name of a sample policy. Returns false if the name is unknown.
+bool parse_entropy_sample_policy(const std::string &name,
+                                 EntropySamplePolicy &policy);
+
+// Parses the name of a scan strategy. Returns false if the name is unknown.
+bool parse_entropy_scan_strategy(const std::string &name,
+                                 EntropyScanStrategy &strategy);
+
+// Global configuration of the entropy samplers.
+struct EntropySamplerConfig {
+  EntropySamplePolicy policy = EntropySamplePolicy::Interval;
+  EntropyScanStrategy scan = EntropyScanStrategy::Full;
+
+  // Base sample interval, in number of writes.
+  unsigned int interval = 100;
+
+  // Maximal sample interval for the backoff policy, in number of writes.
+  unsigned int max_interval = 65536;
+
+  // Maximal change in the average entropy estimates for which a sample is
+  // considered to be converged (backoff policy).
+  float convergence_threshold = 0.01f;
+
+  // Number of bytes that may be scanned per memory buffer/region before its
+  // sample interval is doubled (budget policy).
+  UINT64 byte_budget = 1 << 24;
+
+  // Sample interval, in number of executed instructions (instructions policy).
+  UINT64 instruction_interval = 10000;
+};
+
+// Decides when the entropy of a single memory buffer/region is sampled.
+//
+// Every sample carries a weight, i.e. the amount of time (in writes or
+// executed instructions) that it stands for. Policies that stretch the sample
+// interval give later samples a larger weight, so that the averages stay
+// averages over time instead of being biased towards the densely sampled
+// beginning of a buffer's lifetime.
+class EntropySampler {
+public:
+  // Creates a new EntropySampler using the global configuration.
+  EntropySampler();
+
+  // Sets the global configuration used by all samplers.
+  static void configure(const EntropySamplerConfig &config);
+
+  // Returns the global configuration used by all samplers.
+  static const EntropySamplerConfig &get_config() { return config; }
+
+  // Called on every write to the memory buffer/region. Returns the weight of
+  // the sample that should be taken now, or 0 if no sample should be taken.
+  unsigned int on_write(unsigned int num_writes, UINT64 executed_instructions);
+
+  // Called after a sample is taken, with the number of bytes that had to be
+  // read, and whether the entropy estimates changed less than the convergence
+  // threshold.
+  void on_sample(unsigned int bytes_scanned, bool converged);
+
+private:
+  // The global configuration.
+  static EntropySamplerConfig config;
+
+  // The current sample interval, in number of writes.
+  unsigned int interval;
+
+  // The number of writes at the time of the previous sample.
+  unsigned int writes_at_last_sample;
+
+  // The number of executed instructions at the time of the previous sample.
+  UINT64 instructions_at_last_sample;
+
+  // Whether a sample was taken already.
+  bool sampled;
+
+  // The number of bytes that may still be scanned before the sample interval
+  // is doubled (budget policy).
+  UINT64 budget_left;
+
+  // The budget that is granted every time the interval is doubled. This is
+  // halved every time, which bounds the total number of bytes scanned.
+  UINT64 epoch_budget;
+};
+
+#endif
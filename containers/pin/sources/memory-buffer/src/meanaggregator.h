@@ -5,15 +5,16 @@ template <typename T> class MeanAggregator {
 public:
   MeanAggregator() : num_samples(0), sum_samples(T(0)) {}
 
-  void add_sample(T sample) {
-    sum_samples += sample;
-    ++num_samples;
+  // Adds a sample that is counted 'weight' times.
+  void add_sample(T sample, unsigned int weight = 1) {
+    sum_samples += sample * static_cast<T>(weight);
+    num_samples += weight;
   }
 
   T get_mean() const { return sum_samples / static_cast<T>(num_samples); }
 
 private:
-  // Total number of samples.
+  // Total number of samples (i.e. the sum of their weights).
   unsigned int num_samples;
 
   // Sum of all samples.
@@ -3,6 +3,8 @@
 
 #include <set>
 
+#include "contentsinfo.h"
+#include "entropysampler.h"
 #include "spatialentropyinfo.h"
 #include "temporalentropyinfo.h"
 
@@ -18,6 +20,16 @@ public:
       : num_reads(0), num_writes(0), spatial_entropy_info(),
         temporal_entropy_info(size), allocation_address(allocation_addr) {}
 
+  // Count the values of any bytes that are still pending in lazy temporal
+  // entropy recording, given the start address of this memory region and the
+  // number of system calls that were made so far. Must be called before the
+  // entropy is reported, and while the memory region is still valid.
+  void finalize(ADDRINT start_address, UINT64 num_syscalls) {
+    contents_info.finalize(
+        reinterpret_cast<const unsigned char *>(start_address), num_syscalls,
+        temporal_entropy_info);
+  }
+
   // Total number of reads from any address inside this memory region.
   unsigned int num_reads;
 
@@ -30,6 +42,13 @@ public:
   // Information needed to calculate the temporal entropy of this memory region.
   TemporalEntropyInfo temporal_entropy_info;
 
+  // Decides when the entropy of this memory region is sampled.
+  EntropySampler entropy_sampler;
+
+  // Byte histogram of this memory region, used to avoid rescanning it entirely
+  // for every sample.
+  ContentsInfo contents_info;
+
   // The set of static instructions (i.e. values of IP) that read from this
   // memory region.
   std::set<ADDRINT> read_static_instructions;
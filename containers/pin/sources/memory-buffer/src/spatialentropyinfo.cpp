@@ -6,7 +6,7 @@
 #include "pin.H"
 
 void SpatialEntropyInfo::record(const unsigned char *start_address,
-                                unsigned int size) {
+                                unsigned int size, unsigned int weight) {
   unsigned char byte;
 
   unsigned int total_hamming_weight = 0;
@@ -24,6 +24,12 @@ void SpatialEntropyInfo::record(const unsigned char *start_address,
     ++byte_counts[byte];
   }
 
+  record(byte_counts, total_hamming_weight, size, weight);
+}
+
+void SpatialEntropyInfo::record(const unsigned int *byte_counts,
+                                unsigned int total_hamming_weight,
+                                unsigned int size, unsigned int weight) {
   // Bit-level entropy
   // -----------------
 
@@ -31,11 +37,11 @@ void SpatialEntropyInfo::record(const unsigned char *start_address,
       static_cast<float>(total_hamming_weight) / (8 * size);
 
   // Record the average bit value.
-  bit_average_aggregator.add_sample(fraction_one_bits);
+  bit_average_aggregator.add_sample(fraction_one_bits, weight);
 
   // Calculate the Shannon bit-level entropy based on the hamming weight.
   float shannon_bit_entropy = binary_entropy(fraction_one_bits);
-  bit_shannon_aggregator.add_sample(shannon_bit_entropy);
+  bit_shannon_aggregator.add_sample(shannon_bit_entropy, weight);
 
   // Byte-level entropy
   // ------------------
@@ -63,9 +69,9 @@ void SpatialEntropyInfo::record(const unsigned char *start_address,
     }
   }
 
-  byte_shannon_aggregator.add_sample(shannon_byte / log2(static_cast<float>(256)));
-  byte_shannon_adapted_aggregator.add_sample(shannon_byte / log2(static_cast<float>(std::min(256u, size))));
-  byte_num_different_aggregator.add_sample(num_different);
-  byte_num_unique_aggregator.add_sample(num_unique);
-  byte_average_aggregator.add_sample(sum / static_cast<float>(size));
+  byte_shannon_aggregator.add_sample(shannon_byte / log2(static_cast<float>(256)), weight);
+  byte_shannon_adapted_aggregator.add_sample(shannon_byte / log2(static_cast<float>(std::min(256u, size))), weight);
+  byte_num_different_aggregator.add_sample(num_different, weight);
+  byte_num_unique_aggregator.add_sample(num_unique, weight);
+  byte_average_aggregator.add_sample(sum / static_cast<float>(size), weight);
 }
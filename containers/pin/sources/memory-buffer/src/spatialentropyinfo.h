@@ -53,8 +53,17 @@ public:
   }
 
   // Add a sample of the spatial entropy of the memory region, starting at the
-  // specified address and of a given size.
-  void record(const unsigned char *start_address, unsigned int size);
+  // specified address and of a given size. The sample is counted 'weight'
+  // times.
+  void record(const unsigned char *start_address, unsigned int size,
+              unsigned int weight = 1);
+
+  // Add a sample of the spatial entropy of a memory region of a given size,
+  // given the number of occurrences of every byte value and the total number
+  // of 1-bits in it. The sample is counted 'weight' times.
+  void record(const unsigned int *byte_counts,
+              unsigned int total_hamming_weight, unsigned int size,
+              unsigned int weight = 1);
 
 private:
   // Aggregators used to calculate the average spatial entropy.
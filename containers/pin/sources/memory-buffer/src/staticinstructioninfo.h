@@ -1,55 +1,52 @@
 #ifndef STATICINSTRUCTIONINFO_H
 #define STATICINSTRUCTIONINFO_H
 
-#include <set>
 #include <string>
-#include <vector>
 
-#include "staticinstructionaddress.h"
+#include "bytehistogram.h"
+#include "symbols.h"
+#include "valueset.h"
 
 // Struct used to keep information per static instruction (i.e. per value of
 // RIP).
+//
+// There is one for every static instruction that accesses memory, so it is
+// kept small: the disassembly is interned, and the values and byte counters
+// are only allocated once the instruction is executed.
 class StaticInstructionInfo {
 public:
   // Create a new StaticInstructionInfo with a given disassembly representation
   // and instruction address.
   StaticInstructionInfo(const std::string &disassembly, ADDRINT addr)
-      : address(addr) {
+      : address(find_symbol(addr)) {
     // Split the disassembly in opcode (first word) and operands (rest of
     // string).
     const auto first_space = disassembly.find(' ');
 
-    opcode = disassembly.substr(0, first_space);
-    operands = disassembly.substr(first_space + 1);
-
-    // Zero out the counter arrays.
-    for (std::size_t i = 0; i < 256; ++i) {
-        byte_counts_read[i] = 0;
-        byte_counts_written[i] = 0;
-    }
+    opcode = intern_name(disassembly.substr(0, first_space));
+    operands = intern_name(disassembly.substr(first_space + 1));
   }
 
-  // Opcode of the instruction in Intel syntax (e.g. ret, add, xor, ...).
-  std::string opcode;
+  // Opcode of the instruction in Intel syntax (e.g. ret, add, xor, ...), as an
+  // interned name.
+  NameId opcode;
 
   // Operands of the instruction in Intel syntax (e.g. rax, dword ptr [rcx],
-  // ...).
-  std::string operands;
+  // ...), as an interned name.
+  NameId operands;
 
-  // Address of this instruction.
-  StaticInstructionAddress address;
+  // Location of this instruction.
+  SymbolLocation address;
 
-  // Vector of values read by the instruction. Every element is itself a vector,
-  // representing the different bytes of the read value.
-  std::set<std::vector<unsigned char>> read_values;
+  // Set of values read by the instruction.
+  ValueSet read_values;
 
-  // Vector of values written by the instruction. Every element is itself a
-  // vector, representing the different bytes of the read value.
-  std::set<std::vector<unsigned char>> written_values;
+  // Set of values written by the instruction.
+  ValueSet written_values;
 
   // Counters for the number of times a given byte value was read/written.
-  unsigned int byte_counts_read[256];
-  unsigned int byte_counts_written[256];
+  ByteHistogram byte_counts_read;
+  ByteHistogram byte_counts_written;
 };
 
 #endif
@@ -21,7 +21,7 @@ float TemporalEntropyInfo::get_average_bit_shannon_entropy() const {
 }
 
 void TemporalEntropyInfo::record(const unsigned char *start_address,
-                                 unsigned int size) {
+                                 unsigned int size, unsigned int weight) {
 
   // Check that we are getting the entire buffer.
   if (size != this->buf_size) {
@@ -33,19 +33,22 @@ void TemporalEntropyInfo::record(const unsigned char *start_address,
     unsigned char byte_value;
     PIN_SafeCopy(&byte_value, start_address + byte, 1);
 
-    // Iterate over every bit in that byte, least significant bit first.
-    for (std::size_t bit = 0; bit < 8; ++bit) {
-      // Get the index corresponding to the current bit.
-      const auto index = byte * 8 + bit;
+    count_byte(byte, byte_value, weight);
+  }
+}
 
-      // Get the BitCounter for the current bit.
-      BitCounter &bit_counter = bit_counters[index];
+void TemporalEntropyInfo::count_byte(unsigned int index,
+                                     unsigned char byte_value,
+                                     unsigned int weight) {
+  // Iterate over every bit in that byte, least significant bit first.
+  for (std::size_t bit = 0; bit < 8; ++bit) {
+    // Get the BitCounter for the current bit.
+    BitCounter &bit_counter = bit_counters[index * 8 + bit];
 
-      // Increment counters depending on the value of the bit.
-      const auto bit_value = (byte_value >> bit) & 1;
+    // Increment counters depending on the value of the bit.
+    const auto bit_value = (byte_value >> bit) & 1;
 
-      bit_counter.count_0 += !bit_value;
-      bit_counter.count_1 += bit_value;
-    }
+    bit_counter.count_0 += bit_value ? 0 : weight;
+    bit_counter.count_1 += bit_value ? weight : 0;
   }
 }
@@ -24,15 +24,48 @@ public:
   // Creates a new TemporalEntropyInfo for a contiguous memory region consisting
   // of 'size' bytes.
   TemporalEntropyInfo(unsigned int size)
-      : bit_counters(8 * size, BitCounter()), buf_size(size) {}
+      : bit_counters(8 * size, BitCounter()), buf_size(size), total_weight(0) {
+  }
 
   // Returns the temporal entropy, averaged over space (i.e. over different bits
   // in the buffer), and calculated using Shannon's bit entropy metric.
   float get_average_bit_shannon_entropy() const;
 
   // Update the temporal entropy info with the contents of the memory region,
-  // starting at the specified address and of a given size.
-  void record(const unsigned char *start_address, unsigned int size);
+  // starting at the specified address and of a given size. The sample is
+  // counted 'weight' times.
+  void record(const unsigned char *start_address, unsigned int size,
+              unsigned int weight = 1);
+
+  // Returns the size of the buffer in bytes.
+  unsigned int size() const { return buf_size; }
+
+  // Switch to lazy recording, where the value of a byte is only counted once
+  // it changes (see update_byte()) or at the end (see flush()), for all the
+  // samples that were taken in the meantime.
+  void start_lazy_recording() {
+    flushed_weight.assign(buf_size, total_weight);
+  }
+
+  // Returns whether lazy recording is used.
+  bool is_lazy() const { return !flushed_weight.empty(); }
+
+  // Lazy recording: the byte at 'index' is about to change. Count its old value
+  // for every sample that was taken since it was last counted.
+  void update_byte(unsigned int index, unsigned char old_value) {
+    count_byte(index, old_value, total_weight - flushed_weight[index]);
+    flushed_weight[index] = total_weight;
+  }
+
+  // Lazy recording: take a sample with a given weight.
+  void advance(unsigned int weight) { total_weight += weight; }
+
+  // Lazy recording: count the current value of every byte for every sample
+  // that was taken since it was last counted.
+  void flush(const std::vector<unsigned char> &contents) {
+    for (unsigned int i = 0; i < buf_size; ++i)
+      update_byte(i, contents[i]);
+  }
 
 private:
   // Counters for each bit how many times it was 0 or 1. Bytes are ordered
@@ -42,6 +75,16 @@ private:
 
   // The size of the buffer in bytes. This is set by the ctor.
   unsigned int buf_size;
+
+  // Lazy recording: the total weight of all samples taken so far.
+  unsigned int total_weight;
+
+  // Lazy recording: the total weight at the time each byte was last counted.
+  std::vector<unsigned int> flushed_weight;
+
+  // Count the bits of a byte at a given index 'weight' times.
+  void count_byte(unsigned int index, unsigned char byte_value,
+                  unsigned int weight);
 };
 
 #endif
@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "pin.H"
@@ -15,16 +20,21 @@
 #include "memory_buffer.h"
 #include "memory_buffer_map.h"
 #include "memoryregioninfo.h"
+#include "operandvalue.h"
 #include "staticinstructioninfo.h"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 #include "util.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File streams to write the CSV output to.
-static std::ofstream csv_instructions;
-static std::ofstream csv_buffers;
-static std::ofstream csv_regions;
+// Tables to write the machine-parsable output to.
+static std::unique_ptr<TableWriter> instructions_table;
+static std::unique_ptr<TableWriter> buffers_table;
+static std::unique_ptr<TableWriter> regions_table;
+static std::unique_ptr<TableWriter> stack_frames_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -52,6 +62,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output files. The output "
                   "files will be of the form <prefix>.instructions.csv etc.");
 
+// Option (-output_format) to set the format of the output files.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output files. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.<table>.col files instead. Use "
+    "containers/pin/columnar.py to read them.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -73,12 +90,92 @@ KNOB<int> KnobEntropySampleInterval(
     "entropy is sampled for a given memory buffer or region. It is expressed "
     "in number of writes to that specific memory buffer or region.");
 
+// Option (-entropy_sample_policy) that determines when spatial and temporal
+// entropy is sampled for a memory buffer/region.
+KNOB<std::string> KnobEntropySamplePolicy(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_sample_policy", "interval",
+    "Policy that determines when spatial and temporal entropy is sampled for "
+    "a memory buffer or region. One of 'interval' (every "
+    "-entropy_sample_interval writes), 'budget' (double the interval every "
+    "time -entropy_byte_budget bytes were scanned, and halve the budget), "
+    "'backoff' (double the interval, up to -entropy_max_sample_interval, every "
+    "time the estimates change less than -entropy_convergence_threshold) or "
+    "'instructions' (every -entropy_sample_instructions executed "
+    "instructions).");
+
+// Option (-entropy_scan) that determines which bytes of a memory buffer/region
+// are read when entropy is sampled.
+KNOB<std::string> KnobEntropyScan(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_scan", "full",
+    "Determines which bytes of a memory buffer or region are read when its "
+    "entropy is sampled. One of 'full' (the entire buffer or region), "
+    "'dirty' (only the range that was written to since the previous sample, "
+    "at the cost of keeping a copy of every sampled buffer or region) or "
+    "'incremental' (none, the byte histogram is updated on every write "
+    "instead; this also keeps a full copy of every written buffer or region, "
+    "which is only rescanned after system calls and writes that were not "
+    "instrumented).");
+
+// Option (-entropy_byte_budget) that determines the number of bytes that may be
+// scanned per memory buffer/region before its sample interval is doubled.
+KNOB<UINT64> KnobEntropyByteBudget(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_byte_budget", "16777216",
+    "Number of bytes that may be scanned per memory buffer or region before "
+    "its sample interval is doubled, for the 'budget' sample policy. The total "
+    "number of bytes scanned per buffer or region is at most twice this "
+    "value, plus one sample per doubling of the interval.");
+
+// Option (-entropy_max_sample_interval) that determines the maximal sample
+// interval of the 'backoff' policy.
+KNOB<unsigned int> KnobEntropyMaxSampleInterval(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_max_sample_interval", "65536",
+    "Maximal sample interval for the 'backoff' sample policy, expressed in "
+    "number of writes to a memory buffer or region.");
+
+// Option (-entropy_convergence_threshold) that determines when the entropy
+// estimates of a memory buffer/region are considered to be converged.
+KNOB<double> KnobEntropyConvergenceThreshold(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_convergence_threshold", "0.01",
+    "Maximal change of the average bit and byte Shannon spatial entropy "
+    "caused by a sample for which the estimates are considered to be "
+    "converged, for the 'backoff' sample policy.");
+
+// Option (-entropy_sample_instructions) that determines the sample interval of
+// the 'instructions' policy.
+KNOB<UINT64> KnobEntropySampleInstructions(
+    KNOB_MODE_WRITEONCE, "pintool", "entropy_sample_instructions", "10000",
+    "Sample interval for the 'instructions' sample policy, expressed in "
+    "number of executed instructions. Samples are only taken on writes to a "
+    "memory buffer or region.");
+
 // Option (-instruction_values_limit) that determines how many unique values to
 // keep per static instruction.
 KNOB<std::size_t> KnobInstructionValuesLimit(
     KNOB_MODE_WRITEONCE, "pintool", "instruction_values_limit", "5",
     "Number of unique read/written values to keep per static instruction.");
 
+// Option (-stack_frames) to track stack frames as memory buffers.
+KNOB<bool> KnobStackFrames(
+    KNOB_MODE_WRITEONCE, "pintool", "stack_frames", "0",
+    "When true, track the stack frames of the routines of the main executable "
+    "like memory buffers, and write them to <prefix>.stack_frames.csv. "
+    "Accesses to a stack frame are then no longer counted in memory regions.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
+// Number of instructions executed so far. Used as clock for the
+// 'instructions' entropy sample policy.
+static UINT64 executed_instructions = 0;
+
+// Number of system calls made so far. The kernel may write to memory during a
+// system call without being tracked, so memory buffers/regions of which a copy
+// is kept are rescanned entirely when this changed since they were last read.
+static UINT64 num_syscalls = 0;
+
 // Remembers the last size that was used as argument to malloc().
 static ADDRINT last_malloc_size = -1;
 
@@ -89,7 +186,7 @@ static ADDRINT last_allocation_address = 0;
 static std::string last_allocation_backtrace;
 
 // Global Pin lock.
-static PIN_LOCK pin_lock;
+static StatMutex pin_lock("pin_lock");
 
 // Contains the MemoryRegionInfo for memory buffers that are not free'd yet.
 static MemoryBufferMap<MemoryRegionInfo> active_mem_buf_infos;
@@ -109,19 +206,106 @@ static std::map<ADDRINT, StaticInstructionInfo> static_instruction_infos;
 // Size of each region of memory in bytes.
 static constexpr std::size_t MEMORY_REGION_SIZE = 16;
 
+// An active stack frame on the shadow call stack of a thread, for
+// -stack_frames.
+struct StackFrame {
+  // Range of the stack frame, from the lowest address reserved by the prologue
+  // of the routine up to and including its return address.
+  MemoryBuffer buffer;
+
+  // Address of the routine that the stack frame belongs to.
+  ADDRINT routine_address;
+
+  // Index of the information for the stack frame in stack_frame_infos, or
+  // NO_STACK_FRAME_INFO if the stack frame was not accessed yet.
+  std::size_t info_index;
+};
+
+// Index of a StackFrame whose information is not created yet.
+static constexpr std::size_t NO_STACK_FRAME_INFO = -1;
+
+// Shadow call stack of a thread. The innermost stack frame is last.
+typedef std::vector<StackFrame> ShadowStack;
+
+// Key of the shadow call stack of every thread in thread-local storage. Only
+// the thread itself accesses its shadow call stack, so this needs no lock.
+static TLS_KEY shadow_stack_key = INVALID_TLS_KEY;
+
+// Contains the MemoryRegionInfo for stack frames. Activations of a routine
+// that have the same range share the information, like accesses to the same
+// memory region do.
+// Note that this is a deque, so that adding stack frames does not move the
+// information of the others.
+static std::deque<std::pair<MemoryBuffer, MemoryRegionInfo>> stack_frame_infos;
+
+// Maps the routine address, start address and end address of a stack frame to
+// the index of its information in stack_frame_infos.
+static std::map<std::tuple<ADDRINT, ADDRINT, ADDRINT>, std::size_t>
+    stack_frame_ids;
+
+// Size of the red zone below the stack pointer, that leaf routines may use
+// without reserving it in their prologue.
+#ifdef TARGET_IA32E
+static constexpr ADDRINT RED_ZONE_SIZE = 128;
+#else
+static constexpr ADDRINT RED_ZONE_SIZE = 0;
+#endif
+
+// Maximal number of instructions at the start of a routine that are analysed
+// to find the size of its stack frame.
+static constexpr std::size_t MAX_PROLOGUE_SIZE = 16;
+
 // Remembers the effective address of memory operands.
 // Key = memory operand index, value = effective address.
 static std::map<UINT32, ADDRINT> memory_operands_map;
 
+// Remembers the values at the memory location of memory operands before they
+// are written to, for incremental entropy calculations.
+// Key = memory operand index, value = old contents.
+static std::map<UINT32, std::vector<unsigned char>> memory_operands_old_values;
+
 // Maximal size of the backtrace.
 static std::size_t BACKTRACE_MAX_SIZE = 10;
 
+// Statistics for -tool_stats.
+static CallCounter instruction_before_calls("InstructionBefore");
+static CallCounter malloc_before_calls("MallocBefore");
+static CallCounter malloc_after_calls("MallocAfter");
+static CallCounter free_before_calls("FreeBefore");
+static CallCounter memory_access_before_calls("MemoryAccessBefore");
+static CallCounter memory_access_after_calls("MemoryAccessAfter");
+static CallCounter annotate_memory_before_calls("AnnotateMemoryBefore");
+static CallCounter stack_frame_enter_calls("StackFrameEnter");
+static CallCounter stack_frame_return_calls("StackFrameReturn");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize active_mem_buf_infos_size("active_mem_buf_infos");
+static PeakSize freed_mem_buf_infos_size("freed_mem_buf_infos");
+static PeakSize memory_regions_infos_size("memory_regions_infos");
+static PeakSize static_instruction_infos_size("static_instruction_infos");
+static PeakSize stack_frame_infos_size("stack_frame_infos");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
+
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
+// Count the values of any bytes that are still pending in lazy temporal
+// entropy recording of the given memory buffers/regions.
+template <typename Container> VOID FinalizeInfos(Container &container) {
+  for (auto &p : container)
+    p.second.finalize(p.first.start_address, num_syscalls);
+}
+
 // Run before every instruction.
 VOID InstructionBefore(ADDRINT instruction_pointer) {
+  instruction_before_calls.count();
+
+  ++executed_instructions;
+
   // Check if main if reached yet.
   if (instruction_pointer == main_address) {
     log_file << "\nMain reached, setting global flag.\n";
@@ -133,6 +317,14 @@ VOID InstructionBefore(ADDRINT instruction_pointer) {
     log_file
         << "\nInstruction after call to main reached, setting global flag.\n";
     end_reached = true;
+
+    // Memory is not tracked from here on, so read the final contents of the
+    // memory buffers/regions now.
+    pin_lock.lock();
+    FinalizeInfos(active_mem_buf_infos);
+    FinalizeInfos(memory_regions_infos);
+    FinalizeInfos(stack_frame_infos);
+    pin_lock.unlock();
   }
 }
 
@@ -155,13 +347,135 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
   main_address = main_addr;
 }
 
+// Returns the shadow call stack of a thread.
+ShadowStack &GetShadowStack(THREADID thread_id) {
+  return *static_cast<ShadowStack *>(
+      PIN_GetThreadData(shadow_stack_key, thread_id));
+}
+
+// Pop the stack frames that end at or below 'end_address' from a shadow call
+// stack. Only takes pin_lock for stack frames that were accessed.
+VOID PopStackFrames(ShadowStack &stack, ADDRINT end_address) {
+  while (!stack.empty() && stack.back().buffer.end_address <= end_address) {
+    const StackFrame &frame = stack.back();
+
+    if (frame.info_index != NO_STACK_FRAME_INFO) {
+      pin_lock.lock();
+
+      auto &p = stack_frame_infos[frame.info_index];
+
+      // The memory of the stack frame is reused by other stack frames from
+      // here on, so read its final contents now, and read them again when it
+      // is active again.
+      p.second.finalize(p.first.start_address, num_syscalls);
+      p.second.contents_info.reset();
+
+      pin_lock.unlock();
+    }
+
+    stack.pop_back();
+  }
+}
+
+// Returns an iterator to the information of the innermost active stack frame
+// of a thread that contains 'address', or stack_frame_infos.end() if there is
+// none. The information is created at the first access to the stack frame.
+// Must be called with pin_lock held.
+std::deque<std::pair<MemoryBuffer, MemoryRegionInfo>>::iterator
+FindStackFrame(THREADID thread_id, ADDRINT address) {
+  ShadowStack &stack = GetShadowStack(thread_id);
+
+  // Stack frames are ordered by decreasing address, so addresses that are not
+  // on the stack are outside the range of the innermost and outermost ones.
+  if (stack.empty() || (address < stack.back().buffer.start_address) ||
+      (address >= stack.front().buffer.end_address))
+    return stack_frame_infos.end();
+
+  // Most accesses are to the innermost stack frame, which is checked first,
+  // so this usually stops after one of them.
+  for (auto frame = stack.rbegin(); frame != stack.rend(); ++frame) {
+    if (address < frame->buffer.start_address)
+      break;
+
+    if (address >= frame->buffer.end_address)
+      continue;
+
+    if (frame->info_index == NO_STACK_FRAME_INFO) {
+      const auto key =
+          std::make_tuple(frame->routine_address, frame->buffer.start_address,
+                          frame->buffer.end_address);
+      auto res = stack_frame_ids.insert({key, stack_frame_infos.size()});
+
+      if (res.second) {
+        const unsigned int size =
+            frame->buffer.end_address - frame->buffer.start_address;
+
+        stack_frame_infos.push_back(
+            {frame->buffer, MemoryRegionInfo(size, frame->routine_address)});
+        stack_frame_infos_size.update(stack_frame_infos.size());
+      }
+
+      frame->info_index = res.first->second;
+    }
+
+    return stack_frame_infos.begin() + frame->info_index;
+  }
+
+  return stack_frame_infos.end();
+}
+
+// Run at the start of every routine of the main executable, with
+// -stack_frames.
+// 'frame_size' is the number of bytes that the prologue of the routine reserves
+// below its return address.
+VOID StackFrameEnter(THREADID thread_id, ADDRINT routine_address,
+                     ADDRINT stack_pointer, ADDRINT frame_size) {
+  stack_frame_enter_calls.count();
+
+  ShadowStack &stack = GetShadowStack(thread_id);
+
+  // The stack pointer points to the return address.
+  const ADDRINT end_address = stack_pointer + sizeof(ADDRINT);
+
+  // Stack frames that were left without returning, e.g. by longjmp() or a tail
+  // call, are at or below the new stack frame.
+  PopStackFrames(stack, end_address);
+
+  stack.push_back({MemoryBuffer(stack_pointer - frame_size, end_address),
+                   routine_address, NO_STACK_FRAME_INFO});
+}
+
+// Run before every return instruction, with -stack_frames.
+VOID StackFrameReturn(THREADID thread_id, ADDRINT stack_pointer) {
+  stack_frame_return_calls.count();
+
+  // The stack pointer points to the return address, i.e. the end of the
+  // stack frame that is left.
+  PopStackFrames(GetShadowStack(thread_id), stack_pointer + sizeof(ADDRINT));
+}
+
+// Run when a thread starts, with -stack_frames.
+VOID OnThreadStart(THREADID thread_id, CONTEXT *ctx, INT32 flags, VOID *v) {
+  PIN_SetThreadData(shadow_stack_key, new ShadowStack(), thread_id);
+}
+
+// Run when a thread ends, with -stack_frames. The information of its stack
+// frames is kept in stack_frame_infos.
+VOID OnThreadFini(THREADID thread_id, const CONTEXT *ctx, INT32 code,
+                  VOID *v) {
+  delete &GetShadowStack(thread_id);
+  PIN_SetThreadData(shadow_stack_key, nullptr, thread_id);
+}
+
 // Run at the start of malloc().
 VOID MallocBefore(const CONTEXT *ctx, ADDRINT image_id, ADDRINT size) {
+  malloc_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+  pin_lock.lock();
 
   // Find the image name corresponding to this malloc.
   IMG image = IMG_FindImgById(image_id);
@@ -175,22 +489,22 @@ VOID MallocBefore(const CONTEXT *ctx, ADDRINT image_id, ADDRINT size) {
   // Save the backtrace of the allocation site.
   std::ostringstream allocation_backtrace_stream;
 
-  PIN_LockClient();
-
   // Reset last allocation address to 'unknown' value.
   last_allocation_address = 0;
 
   void *bt[BACKTRACE_MAX_SIZE];
+
+  PIN_LockClient();
   std::size_t bt_size = PIN_Backtrace(ctx, bt, sizeof(bt) / sizeof(*bt));
+  PIN_UnlockClient();
 
   for (std::size_t i = 0; i < bt_size; ++i) {
     ADDRINT addr = reinterpret_cast<ADDRINT>(bt[i]);
 
     // Get the image corresponding to this address in the backtrace.
-    IMG image = IMG_FindByAddress(addr);
-    std::string image_name = IMG_Valid(image) ? IMG_Name(image) : "???";
-    ADDRINT image_offset = IMG_Valid(image) ? (addr - IMG_LowAddress(image))
-                                            : static_cast<ADDRINT>(-1);
+    const SymbolLocation location = find_symbol(addr);
+    const std::string &image_name = get_name(location.image_name);
+    const ADDRINT image_offset = location.image_offset;
 
     // Use | instead of newline, because we can't embed newlines in CSV.
     allocation_backtrace_stream
@@ -212,21 +526,21 @@ VOID MallocBefore(const CONTEXT *ctx, ADDRINT image_id, ADDRINT size) {
     }
   }
 
-  PIN_UnlockClient();
-
   last_allocation_backtrace = allocation_backtrace_stream.str();
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
 }
 
 // Run at the end of malloc().
 VOID MallocAfter(ADDRINT addr) {
+  malloc_after_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+  pin_lock.lock();
 
   // Return value of malloc: pointer of first element of allocated buffer.
   log_file << "---> address = " << std::hex << std::showbase << addr << std::dec
@@ -237,18 +551,21 @@ VOID MallocAfter(ADDRINT addr) {
   info.DEBUG_allocation_backtrace = last_allocation_backtrace;
   active_mem_buf_infos.insert(
       {MemoryBuffer(addr, addr + last_malloc_size), info});
+  active_mem_buf_infos_size.update(active_mem_buf_infos.size());
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
 }
 
 // Run at the start of free().
 VOID FreeBefore(ADDRINT image_id, ADDRINT addr) {
+  free_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+  pin_lock.lock();
 
   // Find the image name corresponding to this free.
   IMG image = IMG_FindImgById(image_id);
@@ -262,79 +579,198 @@ VOID FreeBefore(ADDRINT image_id, ADDRINT addr) {
   // memory buffers, and add it to the list of free'd buffers.
   auto it = active_mem_buf_infos.find_buffer_containing_address(addr);
   if (it != active_mem_buf_infos.end()) {
+    // Read the final contents while the buffer is still valid.
+    it->second.finalize(it->first.start_address, num_syscalls);
+
     freed_mem_buf_infos.push_back(*it);
     active_mem_buf_infos.erase(it);
   }
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
 }
 
-// Run before every memory access, i.e. both read and write.
+// Run before every memory access, i.e. both read and write, of SIZE bytes.
+template <std::size_t SIZE>
 VOID MemoryAccessBefore(ADDRINT instruction_address, BOOL is_write,
                         UINT32 mem_op, ADDRINT memory_address, ADDRINT size) {
+  memory_access_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+  pin_lock.lock();
 
   // Store the memory address so we can reuse it later.
   memory_operands_map[mem_op] = memory_address;
 
+  // Store the old contents, so that the entropy information can be updated
+  // incrementally after the write.
+  if (is_write &&
+      EntropySampler::get_config().scan == EntropyScanStrategy::Incremental) {
+    auto &old_values = memory_operands_old_values[mem_op];
+    old_values.resize(size);
+    PIN_SafeCopy(old_values.data(), reinterpret_cast<void *>(memory_address),
+                 size);
+  }
+
   // Log read values per static instruction.
   if (!is_write) {
     // Get the read value.
-    unsigned char *value_buf = new unsigned char[size];
-    PIN_SafeCopy(value_buf, reinterpret_cast<void *>(memory_address), size);
+    const OperandValue<SIZE> value(memory_address, size);
 
     // Add the read value.
     auto it = static_instruction_infos.find(instruction_address);
     if (it != static_instruction_infos.end()) {
       auto &container = it->second.read_values;
       if (container.size() < KnobInstructionValuesLimit.Value()) {
-        container.insert(
-            std::vector<unsigned char>(value_buf, value_buf + size));
+        container.insert(value.data(), value.size());
       }
 
       // Update counters for read value.
-      for (ADDRINT i = 0; i < size; ++i) {
-        ++it->second.byte_counts_read[value_buf[i]];
-      }
+      it->second.byte_counts_read.add(value.data(), value.size());
     }
-
-    delete[] value_buf;
   }
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
+}
+
+// Take a sample of the spatial and temporal entropy of a memory buffer/region.
+// The sample is counted 'weight' times.
+template <typename map_iterator>
+VOID SampleEntropy(map_iterator &it, unsigned int weight) {
+  // Get the start address and size of the buffer/region.
+  const unsigned char *start_address =
+      reinterpret_cast<const unsigned char *>(it->first.start_address);
+  const unsigned int buf_size = it->first.end_address - it->first.start_address;
+
+  MemoryRegionInfo &info = it->second;
+
+  // Remember the current estimates to check for convergence afterwards.
+  const float old_bit_shannon =
+      info.spatial_entropy_info.get_average_bit_shannon_entropy();
+  const float old_byte_shannon =
+      info.spatial_entropy_info.get_average_byte_shannon_entropy();
+
+  unsigned int bytes_scanned = buf_size;
+
+  if (EntropySampler::get_config().scan == EntropyScanStrategy::Incremental) {
+    // The histogram is up to date already.
+    bytes_scanned = 0;
+
+    info.spatial_entropy_info.record(
+        info.contents_info.get_byte_counts(),
+        info.contents_info.get_total_hamming_weight(), buf_size, weight);
+    info.temporal_entropy_info.advance(weight);
+  } else if (EntropySampler::get_config().scan == EntropyScanStrategy::Dirty) {
+    // Read the entire buffer/region the first time, and only the bytes that
+    // were written since then afterwards, or the entire buffer/region again
+    // after system calls.
+    if (!info.contents_info.is_initialised()) {
+      info.contents_info.initialise(start_address, buf_size, true,
+                                    num_syscalls, info.temporal_entropy_info);
+    } else {
+      bytes_scanned = info.contents_info.rescan_after_syscalls(
+          start_address, num_syscalls, info.temporal_entropy_info);
+      bytes_scanned += info.contents_info.rescan(start_address,
+                                                 info.temporal_entropy_info);
+    }
+
+    info.spatial_entropy_info.record(
+        info.contents_info.get_byte_counts(),
+        info.contents_info.get_total_hamming_weight(), buf_size, weight);
+    info.temporal_entropy_info.advance(weight);
+  } else {
+    info.spatial_entropy_info.record(start_address, buf_size, weight);
+    info.temporal_entropy_info.record(start_address, buf_size, weight);
+  }
+
+  // Note that the comparisons are false for the first sample, as the old
+  // estimates are NaN then.
+  const float threshold = EntropySampler::get_config().convergence_threshold;
+  const bool converged =
+      (std::fabs(info.spatial_entropy_info.get_average_bit_shannon_entropy() -
+                 old_bit_shannon) < threshold) &&
+      (std::fabs(info.spatial_entropy_info.get_average_byte_shannon_entropy() -
+                 old_byte_shannon) < threshold);
+
+  info.entropy_sampler.on_sample(bytes_scanned, converged);
+}
+
+// Update the contents information of a memory buffer/region after a write of
+// 'size' bytes at 'memory_address', which may extend beyond the buffer/region.
+// For incremental entropy calculations, 'old_values' and 'new_values' contain
+// the contents of the memory location before and after the write.
+template <typename map_iterator>
+VOID UpdateContentsAfterWrite(map_iterator &it, ADDRINT memory_address,
+                              ADDRINT size, const unsigned char *old_values,
+                              const unsigned char *new_values) {
+  // Get the written range, clipped to the buffer/region.
+  const ADDRINT begin = std::max(memory_address, it->first.start_address);
+  const ADDRINT end = std::min(memory_address + size, it->first.end_address);
+
+  if (begin >= end)
+    return;
+
+  ContentsInfo &contents_info = it->second.contents_info;
+
+  if (EntropySampler::get_config().scan == EntropyScanStrategy::Incremental) {
+    // Read the entire buffer/region at the first write, and apply the changes
+    // of every write afterwards. The copy of the contents detects the writes
+    // that were not tracked. After system calls, the entire buffer/region is
+    // read again instead, which includes the current write.
+    const unsigned char *start_address =
+        reinterpret_cast<const unsigned char *>(it->first.start_address);
+
+    if (!contents_info.is_initialised()) {
+      contents_info.initialise(start_address,
+                               it->first.end_address - it->first.start_address,
+                               true, num_syscalls,
+                               it->second.temporal_entropy_info);
+    } else if (contents_info.rescan_after_syscalls(
+                   start_address, num_syscalls,
+                   it->second.temporal_entropy_info) == 0) {
+      contents_info.apply_write(start_address,
+                                begin - it->first.start_address,
+                                old_values + (begin - memory_address),
+                                new_values + (begin - memory_address),
+                                end - begin, it->second.temporal_entropy_info);
+    }
+  } else if (contents_info.is_initialised()) {
+    // Remember which bytes were written to.
+    contents_info.mark_dirty(begin - it->first.start_address,
+                             end - it->first.start_address);
+  }
 }
 
 // Processing code after memory accesses that is common to known buffers and to
-// unknown memory locations.
+// unknown memory locations. For writes with incremental entropy calculations,
+// 'old_values' and 'new_values' contain the contents of the memory location
+// before and after the write.
 template <typename map_iterator>
 VOID ProcessMemoryAccessAfter(ADDRINT instruction_address, BOOL is_write,
                               ADDRINT memory_address, ADDRINT size,
-                              map_iterator &it) {
+                              map_iterator &it,
+                              const unsigned char *old_values,
+                              const unsigned char *new_values) {
   // Update the #reads/#writes counters.
   if (is_write)
     ++it->second.num_writes;
   else
     ++it->second.num_reads;
 
-  // Update the spatial and temporal entropy information every x writes.
-  if (is_write &&
-      (it->second.num_writes % KnobEntropySampleInterval.Value() == 0)) {
-    // Get the start address and size of the buffer/region corresponding to this
-    // memory access.
-    const unsigned char *start_address =
-        reinterpret_cast<const unsigned char *>(it->first.start_address);
-    const unsigned int buf_size =
-        it->first.end_address - it->first.start_address;
+  // Update the spatial and temporal entropy information, if the sample policy
+  // decides that a sample is due.
+  if (is_write) {
+    UpdateContentsAfterWrite(it, memory_address, size, old_values, new_values);
+
+    const unsigned int weight = it->second.entropy_sampler.on_write(
+        it->second.num_writes, executed_instructions);
 
-    // Update the spatial and temporal entropy infos.
-    it->second.spatial_entropy_info.record(start_address, buf_size);
-    it->second.temporal_entropy_info.record(start_address, buf_size);
+    if (weight > 0)
+      SampleEntropy(it, weight);
   }
 
   // Update the list of static instructions that read from/write to this memory
@@ -345,103 +781,169 @@ VOID ProcessMemoryAccessAfter(ADDRINT instruction_address, BOOL is_write,
     it->second.read_static_instructions.insert(instruction_address);
 }
 
-// Run after every memory access, i.e. both read and write.
-VOID MemoryAccessAfter(ADDRINT instruction_address, BOOL is_write,
-                       UINT32 mem_op, ADDRINT size) {
-  if (!main_reached || end_reached)
-    return;
-
-  // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+// Processing code after every memory access, i.e. both read and write. For
+// writes, 'written_value' contains the contents of the memory location after
+// the write. Must be called with pin_lock held.
+VOID TrackMemoryAccessAfter(THREADID thread_id, ADDRINT instruction_address,
+                            BOOL is_write, UINT32 mem_op,
+                            ADDRINT memory_address, ADDRINT size,
+                            const unsigned char *written_value) {
+  // Get the value before the write if it was stored.
+  const unsigned char *old_values = nullptr;
 
-  // Retrieve the memory address stored in memory_operands_map.
-  ADDRINT memory_address = memory_operands_map[mem_op];
+  if (is_write &&
+      EntropySampler::get_config().scan == EntropyScanStrategy::Incremental)
+    old_values = memory_operands_old_values[mem_op].data();
 
   // Check if address lies within known buffer.
   auto it = active_mem_buf_infos.find_buffer_containing_address(memory_address);
   if (it != active_mem_buf_infos.end()) {
     ProcessMemoryAccessAfter(instruction_address, is_write, memory_address,
-                             size, it);
+                             size, it, old_values, written_value);
+  }
+
+  // Check if address lies within an active stack frame, with -stack_frames.
+  // Stack frames are tracked instead of the memory regions they span.
+  bool in_stack_frame = false;
+
+  if (KnobStackFrames.Value()) {
+    auto frame = FindStackFrame(thread_id, memory_address);
+    if (frame != stack_frame_infos.end()) {
+      ProcessMemoryAccessAfter(instruction_address, is_write, memory_address,
+                               size, frame, old_values, written_value);
+      in_stack_frame = true;
+    }
   }
 
-  // Insert memory region at this address, but only if it does not exist
-  // already.
-  const auto start = memory_address & (-MEMORY_REGION_SIZE);
-  const auto end = start + MEMORY_REGION_SIZE;
-  const MemoryBuffer cur_region(start, end);
+  if (!in_stack_frame) {
+    // Insert memory region at this address, but only if it does not exist
+    // already.
+    const auto start = memory_address & (-MEMORY_REGION_SIZE);
+    const auto end = start + MEMORY_REGION_SIZE;
+    const MemoryBuffer cur_region(start, end);
 
-  auto res = memory_regions_infos.insert(
-      {cur_region, MemoryRegionInfo(MEMORY_REGION_SIZE)});
+    auto res = memory_regions_infos.insert(
+        {cur_region, MemoryRegionInfo(MEMORY_REGION_SIZE)});
 
-  // Process memory access.
-  ProcessMemoryAccessAfter(instruction_address, is_write, memory_address, size,
-                           res.first);
+    // Process memory access.
+    ProcessMemoryAccessAfter(instruction_address, is_write, memory_address,
+                             size, res.first, old_values,
+                             written_value);
+
+    // Unaligned writes may extend into the next memory regions, whose
+    // contents information needs to be kept up to date as well.
+    if (is_write &&
+        EntropySampler::get_config().scan != EntropyScanStrategy::Full) {
+      for (ADDRINT region = end; region < memory_address + size;
+           region += MEMORY_REGION_SIZE) {
+        auto next =
+            memory_regions_infos.find_buffer_containing_address(region);
+        if (next != memory_regions_infos.end()) {
+          UpdateContentsAfterWrite(next, memory_address, size, old_values,
+                                   written_value);
+        }
+      }
+    }
+  }
 
   // Log written values per static instruction.
   if (is_write) {
-    // Get the written value.
-    unsigned char *value_buf = new unsigned char[size];
-    PIN_SafeCopy(value_buf, reinterpret_cast<void *>(memory_address), size);
-
     // Add the written value.
     auto it = static_instruction_infos.find(instruction_address);
     if (it != static_instruction_infos.end()) {
       auto &container = it->second.written_values;
       if (container.size() < KnobInstructionValuesLimit.Value()) {
-        container.insert(
-            std::vector<unsigned char>(value_buf, value_buf + size));
+        container.insert(written_value, size);
       }
 
       // Update counters for written value.
-      for (ADDRINT i = 0; i < size; ++i) {
-        ++it->second.byte_counts_written[value_buf[i]];
-      }
+      it->second.byte_counts_written.add(written_value, size);
     }
+  }
+}
+
+// Run after every memory access, i.e. both read and write, of SIZE bytes.
+template <std::size_t SIZE>
+VOID MemoryAccessAfter(THREADID thread_id, ADDRINT instruction_address,
+                       BOOL is_write, UINT32 mem_op, ADDRINT size) {
+  memory_access_after_calls.count();
 
-    delete[] value_buf;
+  if (!main_reached || end_reached)
+    return;
+
+  // Acquire lock.
+  pin_lock.lock();
+
+  // Retrieve the memory address stored in memory_operands_map.
+  ADDRINT memory_address = memory_operands_map[mem_op];
+
+  // Get the written value. Reads do not need the value.
+  if (is_write) {
+    const OperandValue<SIZE> written_value(memory_address, size);
+
+    TrackMemoryAccessAfter(thread_id, instruction_address, is_write, mem_op,
+                           memory_address, written_value.size(),
+                           written_value.data());
+  } else {
+    TrackMemoryAccessAfter(thread_id, instruction_address, is_write, mem_op,
+                           memory_address, size, nullptr);
   }
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
+}
+
+// Add a debug annotation to a memory buffer/stack frame.
+template <typename map_iterator>
+VOID AnnotateBuffer(map_iterator &it, ADDRINT address, ADDRINT size,
+                    ADDRINT annotation, ADDRINT filename, ADDRINT line) {
+  // Add the annotation to the memory buffer info.
+  // Separate different entries with ';'.
+  std::ostringstream annotation_oss;
+  annotation_oss << reinterpret_cast<const char *>(annotation);
+
+  // Add offset, size and location information to the annotation string.
+  // Format: "(offset=<off>,size=<sz>,location=<file>:<line>)"
+  annotation_oss << "(";
+  annotation_oss << "offset=" << address - it->first.start_address;
+  annotation_oss << ",size=" << size;
+  annotation_oss << ",location=" << reinterpret_cast<const char *>(filename)
+                 << ":" << line;
+  annotation_oss << ")";
+
+  if (!it->second.DEBUG_annotation.empty()) {
+    it->second.DEBUG_annotation += ";";
+  }
+
+  it->second.DEBUG_annotation += annotation_oss.str();
 }
 
 // Run at the start of the debug annotation routine
 // (MATE_FRAMEWORK_DEBUG_ANNOTATE_MEMORY)
-VOID AnnotateMemoryBefore(ADDRINT address, ADDRINT size, ADDRINT annotation,
-                          ADDRINT filename, ADDRINT line) {
+VOID AnnotateMemoryBefore(THREADID thread_id, ADDRINT address, ADDRINT size,
+                          ADDRINT annotation, ADDRINT filename, ADDRINT line) {
+  annotate_memory_before_calls.count();
+
   // Signature: MATE_FRAMEWORK_DEBUG_ANNOTATE_MEMORY(const char* address,
   // unsigned int size, const char* annotation, const char* filename, unsigned
   // int line);
 
   // Acquire lock.
-  PIN_GetLock(&pin_lock, 1);
+  pin_lock.lock();
 
-  // Check if the address corresponds to a known memory buffer.
+  // Check if the address corresponds to a known memory buffer, or to an active
+  // stack frame with -stack_frames.
   auto it = active_mem_buf_infos.find_buffer_containing_address(address);
   if (it != active_mem_buf_infos.end()) {
-    // Add the annotation to the memory buffer info.
-    // Separate different entries with ';'.
-    std::ostringstream annotation_oss;
-    annotation_oss << reinterpret_cast<const char *>(annotation);
-
-    // Add offset, size and location information to the annotation string.
-    // Format: "(offset=<off>,size=<sz>,location=<file>:<line>)"
-    annotation_oss << "(";
-    annotation_oss << "offset=" << address - it->first.start_address;
-    annotation_oss << ",size=" << size;
-    annotation_oss << ",location=" << reinterpret_cast<const char *>(filename)
-                   << ":" << line;
-    annotation_oss << ")";
-
-    if (!it->second.DEBUG_annotation.empty()) {
-      it->second.DEBUG_annotation += ";";
-    }
-
-    it->second.DEBUG_annotation += annotation_oss.str();
+    AnnotateBuffer(it, address, size, annotation, filename, line);
+  } else if (KnobStackFrames.Value()) {
+    auto frame = FindStackFrame(thread_id, address);
+    if (frame != stack_frame_infos.end())
+      AnnotateBuffer(frame, address, size, annotation, filename, line);
   }
 
   // Release lock.
-  PIN_ReleaseLock(&pin_lock);
+  pin_lock.unlock();
 }
 
 // =============================================================================
@@ -450,6 +952,8 @@ VOID AnnotateMemoryBefore(ADDRINT address, ADDRINT size, ADDRINT annotation,
 
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
+  ScopedStatTimer timer(on_instruction_timer);
+
   // Call InstructionBefore() before every instruction.
   // Pass RIP as argument.
   INS_InsertCall(instruction, IPOINT_BEFORE,
@@ -466,6 +970,14 @@ VOID OnInstruction(INS instruction, VOID *v) {
                    INS_NextAddress(instruction), IARG_END);
   }
 
+  // Call StackFrameReturn() before every return instruction, with
+  // -stack_frames. Pass the stack pointer, which points to the return address.
+  if (KnobStackFrames.Value() && INS_IsRet(instruction)) {
+    INS_InsertCall(instruction, IPOINT_BEFORE,
+                   reinterpret_cast<AFUNPTR>(StackFrameReturn), IARG_THREAD_ID,
+                   IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+  }
+
   // Get the number of memory operands this instruction has.
   UINT32 num_mem_operands = INS_MemoryOperandCount(instruction);
 
@@ -480,7 +992,8 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
   // Call MemoryAccessBefore() before every memory read/write
   // and MemoryAccessAfter() after every memory read/write (if supported).
-  // Pass the effective address and operand size as argument.
+  // Pass the effective address and operand size as argument, and use the
+  // instantiations that are specialized for the operand size.
   // Note that an instruction may have multiple memory operands.
   for (UINT32 mem_op = 0; mem_op < num_mem_operands; ++mem_op) {
     // Get the number of bytes of this memory operand.
@@ -493,7 +1006,7 @@ VOID OnInstruction(INS instruction, VOID *v) {
     // conditional moves and instructions with a REP prefix.
     if (INS_MemoryOperandIsRead(instruction, mem_op)) {
       INS_InsertPredicatedCall(instruction, IPOINT_BEFORE,
-                               reinterpret_cast<AFUNPTR>(MemoryAccessBefore),
+                               SIZED_ROUTINE(MemoryAccessBefore, size),
                                IARG_INST_PTR, IARG_BOOL, false, IARG_UINT32,
                                mem_op, IARG_MEMORYOP_EA, mem_op, IARG_ADDRINT,
                                size, IARG_END);
@@ -501,7 +1014,7 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
     if (INS_MemoryOperandIsWritten(instruction, mem_op)) {
       INS_InsertPredicatedCall(instruction, IPOINT_BEFORE,
-                               reinterpret_cast<AFUNPTR>(MemoryAccessBefore),
+                               SIZED_ROUTINE(MemoryAccessBefore, size),
                                IARG_INST_PTR, IARG_BOOL, true, IARG_UINT32,
                                mem_op, IARG_MEMORYOP_EA, mem_op, IARG_ADDRINT,
                                size, IARG_END);
@@ -511,23 +1024,57 @@ VOID OnInstruction(INS instruction, VOID *v) {
     if (INS_IsValidForIpointAfter(instruction)) {
       if (INS_MemoryOperandIsRead(instruction, mem_op)) {
         INS_InsertPredicatedCall(instruction, IPOINT_AFTER,
-                                 reinterpret_cast<AFUNPTR>(MemoryAccessAfter),
-                                 IARG_INST_PTR, IARG_BOOL, false, IARG_UINT32,
-                                 mem_op, IARG_ADDRINT, size, IARG_END);
+                                 SIZED_ROUTINE(MemoryAccessAfter, size),
+                                 IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                                 false, IARG_UINT32, mem_op, IARG_ADDRINT,
+                                 size, IARG_END);
       }
 
       if (INS_MemoryOperandIsWritten(instruction, mem_op)) {
         INS_InsertPredicatedCall(instruction, IPOINT_AFTER,
-                                 reinterpret_cast<AFUNPTR>(MemoryAccessAfter),
-                                 IARG_INST_PTR, IARG_BOOL, true, IARG_UINT32,
-                                 mem_op, IARG_ADDRINT, size, IARG_END);
+                                 SIZED_ROUTINE(MemoryAccessAfter, size),
+                                 IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                                 true, IARG_UINT32, mem_op, IARG_ADDRINT,
+                                 size, IARG_END);
       }
     }
   }
 }
 
+// Returns the number of bytes that a routine reserves on the stack below its
+// return address. This is found by analysing the prologue of the routine,
+// which pushes registers and subtracts from the stack pointer. Routines that do
+// not subtract from the stack pointer may use the red zone instead. The
+// routine must be open.
+ADDRINT get_static_frame_size(RTN routine) {
+  ADDRINT frame_size = 0;
+  bool reserves_stack = false;
+  std::size_t num_instructions = 0;
+
+  for (INS ins = RTN_InsHead(routine);
+       INS_Valid(ins) && num_instructions < MAX_PROLOGUE_SIZE;
+       ins = INS_Next(ins), ++num_instructions) {
+    // The prologue ends at the first control flow instruction.
+    if (INS_IsBranch(ins) || INS_IsCall(ins) || INS_IsRet(ins))
+      break;
+
+    if (INS_Opcode(ins) == XED_ICLASS_PUSH) {
+      frame_size += INS_MemoryOperandSize(ins, 0);
+    } else if (INS_Opcode(ins) == XED_ICLASS_SUB && INS_OperandIsReg(ins, 0) &&
+               INS_OperandReg(ins, 0) == REG_STACK_PTR &&
+               INS_OperandIsImmediate(ins, 1)) {
+      frame_size += INS_OperandImmediate(ins, 1);
+      reserves_stack = true;
+    }
+  }
+
+  return reserves_stack ? frame_size : frame_size + RED_ZONE_SIZE;
+}
+
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -608,83 +1155,103 @@ VOID OnImageLoad(IMG image, VOID *v) {
     // to the annotation string, and the filename and line number).
     RTN_InsertCall(
         debugAnnotationRoutine, IPOINT_BEFORE,
-        reinterpret_cast<AFUNPTR>(AnnotateMemoryBefore),
+        reinterpret_cast<AFUNPTR>(AnnotateMemoryBefore), IARG_THREAD_ID,
         IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
         IARG_FUNCARG_ENTRYPOINT_VALUE, 2, IARG_FUNCARG_ENTRYPOINT_VALUE, 3,
         IARG_FUNCARG_ENTRYPOINT_VALUE, 4, IARG_END);
 
     RTN_Close(debugAnnotationRoutine);
   }
+
+  // Call StackFrameEnter() at the start of every routine of the main
+  // executable, with -stack_frames. Pass the address of the routine, the stack
+  // pointer, which points to the return address, and the size of its stack
+  // frame.
+  if (KnobStackFrames.Value() && IMG_IsMainExecutable(image)) {
+    for (SEC sec = IMG_SecHead(image); SEC_Valid(sec); sec = SEC_Next(sec)) {
+      for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn)) {
+        RTN_Open(rtn);
+
+        RTN_InsertCall(rtn, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(StackFrameEnter),
+                       IARG_THREAD_ID, IARG_ADDRINT, RTN_Address(rtn),
+                       IARG_REG_VALUE, REG_STACK_PTR, IARG_ADDRINT,
+                       get_static_frame_size(rtn), IARG_END);
+
+        RTN_Close(rtn);
+      }
+    }
+  }
 }
 
 // =============================================================================
 // Machine-parsable output routines
 // =============================================================================
 
-// Dump the items in a container, separated by ',' to a CSV.
+// Format the items in a container, separated by ','.
 template <typename Container>
-void dump_csv_list(std::ofstream &ofs, const Container &container) {
+std::string format_list(const Container &container) {
+  std::ostringstream oss;
   bool first = true;
 
   for (const auto &item : container) {
-    ofs << (first ? "" : ",") << item;
+    oss << (first ? "" : ",") << item;
     first = false;
   }
+
+  return oss.str();
 }
 
-// Dump the information for memory buffers/regions in CSV format.
+// The columns of the memory buffers and memory regions tables.
+static const std::vector<TableColumn> BUFFER_INFO_COLUMNS = {
+    {"id", ColumnType::UINT64},
+    {"start_address", ColumnType::UINT64},
+    {"end_address", ColumnType::UINT64},
+    {"num_reads", ColumnType::UINT64},
+    {"num_writes", ColumnType::UINT64},
+    {"average_spatial_entropy_bit_shannon", ColumnType::DOUBLE},
+    {"average_spatial_entropy_byte_shannon", ColumnType::DOUBLE},
+    {"average_spatial_entropy_byte_shannon_adapted", ColumnType::DOUBLE},
+    {"average_spatial_entropy_byte_num_different", ColumnType::DOUBLE},
+    {"average_spatial_entropy_byte_num_unique", ColumnType::DOUBLE},
+    {"average_spatial_entropy_bit_average", ColumnType::DOUBLE},
+    {"average_spatial_entropy_byte_average", ColumnType::DOUBLE},
+    {"average_temporal_entropy_bit_shannon", ColumnType::DOUBLE},
+    {"read_ips", ColumnType::STRING, true},
+    {"write_ips", ColumnType::STRING, true},
+    {"allocation_address", ColumnType::UINT64},
+    {"DEBUG_allocation_backtrace", ColumnType::STRING, true},
+    {"DEBUG_annotation", ColumnType::STRING, true},
+};
+
+// Dump the information for memory buffers/regions.
 template <typename Container>
-void dump_csv_buffer_info(std::ofstream &ofs, const Container &container) {
+void dump_buffer_info(TableWriter &table, const Container &container) {
   // Counter that is used as a unique identifier of a memory buffer/region.
   unsigned int id = 0;
 
-  // Print header.
-  ofs << "id,start_address,end_address,num_reads,num_writes,average_spatial_"
-         "entropy_bit_shannon,average_spatial_entropy_byte_shannon,average_"
-         "spatial_entropy_byte_shannon_adapted,average_spatial_entropy_byte_"
-         "num_different,average_spatial_entropy_byte_num_unique,average_"
-         "spatial_entropy_bit_average,average_spatial_entropy_byte_average,"
-         "average_temporal_entropy_bit_shannon,read_ips,write_ips,"
-         "allocation_address,DEBUG_allocation_backtrace,DEBUG_annotation\n";
-
   // Print data.
   for (const auto &p : container) {
-    ofs << id++ << ',' << p.first.start_address << ',' << p.first.end_address
-        << ',' << p.second.num_reads << ',' << p.second.num_writes << ','
-        << p.second.spatial_entropy_info.get_average_bit_shannon_entropy()
-        << ','
-        << p.second.spatial_entropy_info.get_average_byte_shannon_entropy()
-        << ','
-        << p.second.spatial_entropy_info
-               .get_average_byte_shannon_adapted_entropy()
-        << ','
-        << p.second.spatial_entropy_info
-               .get_average_byte_num_different_entropy()
-        << ','
-        << p.second.spatial_entropy_info.get_average_byte_num_unique_entropy()
-        << ','
-        << p.second.spatial_entropy_info.get_average_bit_average_entropy()
-        << ','
-        << p.second.spatial_entropy_info.get_average_byte_average_entropy()
-        << ','
-        << p.second.temporal_entropy_info.get_average_bit_shannon_entropy()
-        << ",";
-
-    ofs << "\"";
-    dump_csv_list(ofs, p.second.read_static_instructions);
-    ofs << "\",";
-
-    ofs << "\"";
-    dump_csv_list(ofs, p.second.write_static_instructions);
-    ofs << "\"";
-
-    ofs << "," << p.second.allocation_address;
-
-    ofs << ",\"" << p.second.DEBUG_allocation_backtrace << "\"";
-
-    ofs << ",\"" << p.second.DEBUG_annotation << "\"";
-
-    ofs << "\n";
+    const auto &spatial = p.second.spatial_entropy_info;
+    const auto &temporal = p.second.temporal_entropy_info;
+
+    table << id++ << p.first.start_address << p.first.end_address
+          << p.second.num_reads << p.second.num_writes;
+
+    table << spatial.get_average_bit_shannon_entropy()
+          << spatial.get_average_byte_shannon_entropy()
+          << spatial.get_average_byte_shannon_adapted_entropy()
+          << spatial.get_average_byte_num_different_entropy()
+          << spatial.get_average_byte_num_unique_entropy()
+          << spatial.get_average_bit_average_entropy()
+          << spatial.get_average_byte_average_entropy()
+          << temporal.get_average_bit_shannon_entropy();
+
+    table << format_list(p.second.read_static_instructions)
+          << format_list(p.second.write_static_instructions);
+
+    table << p.second.allocation_address << p.second.DEBUG_allocation_backtrace
+          << p.second.DEBUG_annotation;
   }
 }
 
@@ -720,56 +1287,59 @@ float calculate_shannon_entropy_from_byte_counters(
   return entropy;
 }
 
-// Dump the information for static instructions in CSV format.
-void dump_csv_static_instructions(
-    std::ofstream &ofs, const std::map<ADDRINT, StaticInstructionInfo> &map) {
-
-  // Print header.
-  ofs << "ip,image_name,full_image_name,section_name,image_offset,routine_name,"
-         "routine_offset,"
-         "opcode,operands,"
-         "read_values,written_values,read_values_entropy,written_values_"
-         "entropy,num_bytes_read,num_bytes_written\n";
+// The columns of the static instructions table.
+static const std::vector<TableColumn> STATIC_INSTRUCTIONS_COLUMNS = {
+    {"ip", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset", ColumnType::INT64},
+    {"opcode", ColumnType::STRING},
+    {"operands", ColumnType::STRING, true},
+    {"read_values", ColumnType::STRING, true},
+    {"written_values", ColumnType::STRING, true},
+    {"read_values_entropy", ColumnType::DOUBLE},
+    {"written_values_entropy", ColumnType::DOUBLE},
+    {"num_bytes_read", ColumnType::UINT64},
+    {"num_bytes_written", ColumnType::UINT64},
+};
+
+// Format read/written values as a list.
+std::string format_values(const ValueSet &container) {
+  std::ostringstream oss;
+  pretty_print_values(oss, container);
+  return oss.str();
+}
 
-  // Print data.
+// Dump the information for static instructions.
+void dump_static_instructions(
+    TableWriter &table, const std::map<ADDRINT, StaticInstructionInfo> &map) {
+  // Print data. The offset columns are signed, so unknown offsets are -1.
   for (const auto &p : map) {
-    ofs << p.first << ',' << get_filename(p.second.address.image_name) << ','
-        << p.second.address.image_name << ',' << p.second.address.section_name
-        << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.image_offset != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.image_offset << ',';
-    else
-      ofs << -1 << ',';
+    const StaticInstructionInfo &info = p.second;
+    const std::string &image_name = get_name(info.address.image_name);
 
-    ofs << p.second.address.routine_name << ',';
+    table << p.first << get_filename(image_name) << image_name
+          << get_name(info.address.section_name) << info.address.image_offset
+          << get_name(info.address.routine_name)
+          << info.address.routine_offset;
 
-    // Print "-1" for unknown offsets.
-    if (p.second.address.routine_offset != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.routine_offset << ',';
-    else
-      ofs << -1 << ',';
+    table << get_name(info.opcode) << get_name(info.operands)
+          << format_values(info.read_values)
+          << format_values(info.written_values);
 
-    ofs << p.second.opcode << ",\"" << p.second.operands << "\",";
+    unsigned int byte_counts_read[256];
+    unsigned int byte_counts_written[256];
+    info.byte_counts_read.get_counts(byte_counts_read);
+    info.byte_counts_written.get_counts(byte_counts_written);
 
-    ofs << "\"";
-    pretty_print_values(ofs, p.second.read_values);
-    ofs << "\",";
+    table << calculate_shannon_entropy_from_byte_counters(byte_counts_read)
+          << calculate_shannon_entropy_from_byte_counters(byte_counts_written);
 
-    ofs << "\"";
-    pretty_print_values(ofs, p.second.written_values);
-    ofs << "\",";
-
-    ofs << calculate_shannon_entropy_from_byte_counters(
-               p.second.byte_counts_read)
-        << ",";
-    ofs << calculate_shannon_entropy_from_byte_counters(
-               p.second.byte_counts_written)
-        << ",";
-
-    ofs << get_total_byte_count(p.second.byte_counts_read) << ",";
-    ofs << get_total_byte_count(p.second.byte_counts_written) << "\n";
+    table << get_total_byte_count(byte_counts_read)
+          << get_total_byte_count(byte_counts_written);
   }
 }
 
@@ -779,25 +1349,43 @@ void dump_csv_static_instructions(
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
+  // These containers only grow, so their peak size is their final size.
+  memory_regions_infos_size.update(memory_regions_infos.size());
+  static_instruction_infos_size.update(static_instruction_infos.size());
+
+  // Count any pending bytes of lazily recorded temporal entropy. This was
+  // done already if main() returned, and for buffers that were free'd, while
+  // their memory was still valid, so those are not read again here.
+  FinalizeInfos(active_mem_buf_infos);
+  FinalizeInfos(memory_regions_infos);
+  FinalizeInfos(stack_frame_infos);
+
   // Move any buffers that are malloc'ed but not yet free'd to the free'd list,
   // and clear active buffer list.
   freed_mem_buf_infos.insert(freed_mem_buf_infos.end(),
                              active_mem_buf_infos.begin(),
                              active_mem_buf_infos.end());
   active_mem_buf_infos.clear();
+  freed_mem_buf_infos_size.update(freed_mem_buf_infos.size());
 
   // -----------------------
   // Machine parsable output
   // -----------------------
 
   // Print information for static instructions.
-  dump_csv_static_instructions(csv_instructions, static_instruction_infos);
+  dump_static_instructions(*instructions_table, static_instruction_infos);
 
   // Print info for memory buffers.
-  dump_csv_buffer_info(csv_buffers, freed_mem_buf_infos);
+  dump_buffer_info(*buffers_table, freed_mem_buf_infos);
 
   // Print info for memory regions.
-  dump_csv_buffer_info(csv_regions, memory_regions_infos);
+  dump_buffer_info(*regions_table, memory_regions_infos);
+
+  // Print info for stack frames, with -stack_frames.
+  if (stack_frames_table)
+    dump_buffer_info(*stack_frames_table, stack_frame_infos);
 
   // -------
   // Cleanup
@@ -808,14 +1396,19 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV files.
-  csv_instructions.flush();
-  csv_instructions.close();
+  instructions_table->close();
+  buffers_table->close();
+  regions_table->close();
 
-  csv_buffers.flush();
-  csv_buffers.close();
+  if (stack_frames_table)
+    stack_frames_table->close();
+}
 
-  csv_regions.flush();
-  csv_regions.close();
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -825,6 +1418,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -833,6 +1429,16 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   return FALSE;
 }
 
+// Run before and after every system call, if a copy of memory buffers/regions
+// is kept. Counting both makes sure that a buffer/region that is read during a
+// system call in another thread is read again after the system call.
+VOID OnSyscall(THREADID thread_id, CONTEXT *ctx, SYSCALL_STANDARD std,
+               VOID *v) {
+  pin_lock.lock();
+  ++num_syscalls;
+  pin_lock.unlock();
+}
+
 // Print usage information of the tool.
 INT32 Usage() {
   std::cerr
@@ -858,8 +1464,51 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
-  // Initialise Pin lock.
-  PIN_InitLock(&pin_lock);
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Configure entropy sampling.
+  EntropySamplerConfig entropy_sampler_config;
+
+  if (!parse_entropy_sample_policy(KnobEntropySamplePolicy.Value(),
+                                   entropy_sampler_config.policy)) {
+    std::cerr << "Unknown entropy sample policy '"
+              << KnobEntropySamplePolicy.Value() << "'.\n";
+    return Usage();
+  }
+
+  if (!parse_entropy_scan_strategy(KnobEntropyScan.Value(),
+                                   entropy_sampler_config.scan)) {
+    std::cerr << "Unknown entropy scan strategy '" << KnobEntropyScan.Value()
+              << "'.\n";
+    return Usage();
+  }
+
+  if (KnobEntropySampleInterval.Value() <= 0 ||
+      KnobEntropySampleInstructions.Value() == 0) {
+    std::cerr << "Entropy sample intervals must be positive.\n";
+    return Usage();
+  }
+
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Unknown output format '" << KnobOutputFormat.Value()
+              << "'.\n";
+    return Usage();
+  }
+
+  entropy_sampler_config.interval = KnobEntropySampleInterval.Value();
+  entropy_sampler_config.max_interval =
+      std::max(KnobEntropyMaxSampleInterval.Value(),
+               entropy_sampler_config.interval);
+  entropy_sampler_config.convergence_threshold =
+      static_cast<float>(KnobEntropyConvergenceThreshold.Value());
+  entropy_sampler_config.byte_budget = KnobEntropyByteBudget.Value();
+  entropy_sampler_config.instruction_interval =
+      KnobEntropySampleInstructions.Value();
+
+  EntropySampler::configure(entropy_sampler_config);
 
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
@@ -877,9 +1526,27 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_instructions.open((csv_prefix + ".instructions.csv").c_str());
-  csv_buffers.open((csv_prefix + ".buffers.csv").c_str());
-  csv_regions.open((csv_prefix + ".regions.csv").c_str());
+  instructions_table = open_table(csv_prefix + ".instructions", table_format,
+                                  STATIC_INSTRUCTIONS_COLUMNS);
+  buffers_table = open_table(csv_prefix + ".buffers", table_format,
+                             BUFFER_INFO_COLUMNS);
+  regions_table = open_table(csv_prefix + ".regions", table_format,
+                             BUFFER_INFO_COLUMNS);
+
+  if (KnobStackFrames.Value()) {
+    stack_frames_table = open_table(csv_prefix + ".stack_frames", table_format,
+                                    BUFFER_INFO_COLUMNS);
+
+    // Initialise thread-local storage for the shadow call stacks.
+    shadow_stack_key = PIN_CreateThreadDataKey(nullptr);
+    if (shadow_stack_key == INVALID_TLS_KEY) {
+      std::cerr << "Maximum amount of allocated TLS keys reached!\n";
+      return EXIT_FAILURE;
+    }
+
+    PIN_AddThreadStartFunction(OnThreadStart, nullptr);
+    PIN_AddThreadFiniFunction(OnThreadFini, nullptr);
+  }
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
@@ -887,9 +1554,23 @@ int main(int argc, char *argv[]) {
   // Register image load callback.
   IMG_AddInstrumentFunction(OnImageLoad, nullptr);
 
+  // Register system call callbacks, to detect writes by the kernel to the
+  // copies of memory buffers/regions.
+  if (entropy_sampler_config.scan != EntropyScanStrategy::Full) {
+    PIN_AddSyscallEntryFunction(OnSyscall, nullptr);
+    PIN_AddSyscallExitFunction(OnSyscall, nullptr);
+  }
+
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
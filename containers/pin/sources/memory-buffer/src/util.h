@@ -2,12 +2,11 @@
 #define UTIL_H
 
 #include <iostream>
-#include <set>
 #include <sstream>
 #include <string>
-#include <vector>
 
 #include "pin.H"
+#include "valueset.h"
 
 template <std::size_t N>
 void pretty_print_char_buf(std::ostream &os, const unsigned char (&arr)[N],
@@ -25,30 +24,30 @@ void pretty_print_char_buf(std::ostream &os, const unsigned char (&arr)[N],
   os << std::left << std::showbase << std::dec << std::setfill(' ');
 }
 
-void pretty_print_char_buf(std::ostream &os,
-                           const std::vector<unsigned char> &vec) {
+void pretty_print_char_buf(std::ostream &os, const unsigned char *buf,
+                           std::size_t size) {
   bool first = true;
   os << std::right << std::noshowbase << std::hex << std::setfill('0');
 
-  for (const unsigned char val : vec) {
-    os << (first ? "" : " ") << std::setw(2) << static_cast<unsigned int>(val);
+  for (std::size_t i = 0; i < size; ++i) {
+    os << (first ? "" : " ") << std::setw(2)
+       << static_cast<unsigned int>(buf[i]);
     first = false;
   }
 
   os << std::left << std::showbase << std::dec << std::setfill(' ');
 }
 
-void pretty_print_values(
-    std::ostream &os, const std::set<std::vector<unsigned char>> &container) {
+void pretty_print_values(std::ostream &os, const ValueSet &container) {
   bool first = true;
 
   os << '[';
 
-  for (const auto &val : container) {
+  container.for_each([&](const unsigned char *value, std::size_t size) {
     os << (first ? "" : ", ");
-    pretty_print_char_buf(os, val);
+    pretty_print_char_buf(os, value, size);
     first = false;
-  }
+  });
 
   os << ']';
 }
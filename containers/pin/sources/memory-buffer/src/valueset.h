@@ -0,0 +1,86 @@
+#ifndef VALUESET_H
+#define VALUESET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Set of the unique values read or written by a static instruction.
+//
+// The values are stored back to back in a single buffer, each preceded by its
+// size, rather than in a node and a separate allocation per value. Only a few
+// values are kept per instruction, so finding duplicates is a linear scan.
+class ValueSet {
+public:
+  ValueSet() : num_values(0) {}
+
+  // Returns the number of values in the set.
+  std::size_t size() const { return num_values; }
+
+  // Adds the value in [value, value + size) to the set, unless it is in the set
+  // already.
+  void insert(const unsigned char *value, std::size_t size) {
+    const std::uint16_t value_size = static_cast<std::uint16_t>(size);
+
+    for (std::size_t offset = 0; offset < buffer.size();) {
+      const std::uint16_t other_size = read_size(offset);
+      offset += sizeof(std::uint16_t);
+
+      if (other_size == value_size &&
+          std::memcmp(&buffer[offset], value, size) == 0)
+        return;
+
+      offset += other_size;
+    }
+
+    const std::size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(std::uint16_t) + size);
+    std::memcpy(&buffer[offset], &value_size, sizeof(std::uint16_t));
+    std::memcpy(&buffer[offset + sizeof(std::uint16_t)], value, size);
+    ++num_values;
+  }
+
+  // Calls 'f(value, size)' for every value in the set, in lexicographical
+  // order.
+  template <typename F> void for_each(F f) const {
+    std::vector<std::pair<const unsigned char *, std::size_t>> values;
+    values.reserve(num_values);
+
+    for (std::size_t offset = 0; offset < buffer.size();) {
+      const std::uint16_t size = read_size(offset);
+      offset += sizeof(std::uint16_t);
+
+      values.emplace_back(&buffer[offset], size);
+      offset += size;
+    }
+
+    std::sort(values.begin(), values.end(),
+              [](const std::pair<const unsigned char *, std::size_t> &a,
+                 const std::pair<const unsigned char *, std::size_t> &b) {
+                return std::lexicographical_compare(
+                    a.first, a.first + a.second, b.first, b.first + b.second);
+              });
+
+    for (const auto &value : values)
+      f(value.first, value.second);
+  }
+
+private:
+  // The values, each preceded by its size as a 16-bit integer. Memory operands
+  // are never larger than that.
+  std::vector<unsigned char> buffer;
+
+  // Number of values in 'buffer'.
+  unsigned int num_values;
+
+  // Returns the size of the value at 'offset' in 'buffer'.
+  std::uint16_t read_size(std::size_t offset) const {
+    std::uint16_t size;
+    std::memcpy(&size, &buffer[offset], sizeof(std::uint16_t));
+    return size;
+  }
+};
+
+#endif
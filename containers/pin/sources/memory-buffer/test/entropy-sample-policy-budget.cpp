@@ -0,0 +1,42 @@
+// RUN: g++ %s -o %t.exe
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -entropy_sample_interval 1 -entropy_sample_policy budget -entropy_byte_budget 2 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.log --log_file=%t.log | FileCheck %s
+
+int main(int argc, char *argv[]) {
+  // CHECK:      {{[^[:space:]]+}}/libc.so.6::malloc(size = 1)
+  // CHECK-NEXT: ---> address = 0x[[#%x,BUF1:]]
+  unsigned char *buf1 = new unsigned char[1];
+
+  // With a budget of 2 bytes, the sample interval doubles after the 2nd
+  // sample, and after every sample from then on. Samples are thus taken after
+  // writes 1, 2, 4, 8, 16, 32 and 64, with weights 1, 1, 2, 4, 8, 16 and 32.
+  // The first 6 samples see 0x00, the last one sees 0xFF, but both values are
+  // present for half of the time.
+  // ---> average bit value = 32/64 * 0 + 32/64 * 1 = 0.5
+  // ---> average temporal entropy = h(32/64) = 1
+
+  for (unsigned int i = 0; i < 64; ++i) {
+    buf1[0] = (i < 32) ? 0x00 : 0xFF;
+  }
+
+  delete[] buf1;
+  return 0;
+}
+
+// clang-format off
+
+// CHECK: MEMORY BUFFERS
+// CHECK: ==============
+
+// CHECK:      Buffer:                                Buffer 0x[[#BUF1]] --> 0x[[#BUF1 + 1]]
+// CHECK-NEXT: Number of reads:                       0
+// CHECK-NEXT: Number of writes:                      64
+// CHECK:      Average spatial entropy (bit_shannon):
+// CHECK-SAME: 0
+// CHECK:      Average spatial entropy (bit_average):
+// CHECK-SAME: 0.5
+// CHECK:      Average temporal entropy (bit_shannon):
+// CHECK-SAME: 1
+
+// clang-format on
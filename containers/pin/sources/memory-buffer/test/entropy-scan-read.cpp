@@ -0,0 +1,93 @@
+// RUN: g++ %s -o %t.exe
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -entropy_sample_interval 2 -entropy_scan incremental -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.log --log_file=%t.log | FileCheck %s
+// RUN: %sde %toolarg -output %t.dirty.log -entropy_sample_interval 2 -entropy_scan dirty -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.dirty.log --log_file=%t.dirty.log | FileCheck %s
+
+#include <fcntl.h>
+#include <unistd.h>
+
+void do_write(unsigned char *buf, unsigned char value) {
+  // Write 2 times (= sample interval).
+  for (unsigned int i = 0; i < 2; ++i) {
+    buf[0] = value;
+  }
+}
+
+// Lets the kernel write the first byte of the ELF header (0x7f) of 'path' to
+// 'buf', which is not tracked.
+bool read_elf_magic(const char *path, unsigned char *buf) {
+  int fd = open(path, O_RDONLY);
+  bool success = (read(fd, buf, 1) == 1);
+  close(fd);
+  return success;
+}
+
+int main(int argc, char *argv[]) {
+  // CHECK:      {{[^[:space:]]+}}/libc.so.6::malloc(size = 1)
+  // CHECK-NEXT: ---> address = 0x[[#%x,BUF1:]]
+  unsigned char *buf1 = new unsigned char[1];
+
+  // CHECK:      {{[^[:space:]]+}}/libc.so.6::malloc(size = 2)
+  // CHECK-NEXT: ---> address = 0x[[#%x,BUF2:]]
+  unsigned char *buf2 = new unsigned char[2];
+
+  // Both dirty and incremental scans must give the same results as a full
+  // scan, although the kernel writes to the buffers without being tracked.
+
+  // The next write to buf1 overwrites the byte that the kernel wrote. It must
+  // not remove 0x7f from the histogram, which only contains 0x00, but rescan
+  // buf1 instead.
+  do_write(buf1, 0x00);
+
+  if (!read_elf_magic(argv[0], buf1))
+    return 1;
+
+  do_write(buf1, 0xff);
+
+  // The samples contain 0 and 8 1-bits, respectively.
+  // ---> average bit value = 8/16 = 0.5
+  // Every bit is 0 in one sample and 1 in the other.
+  // ---> average temporal entropy = h(1/2) = 1
+
+  // The next writes to buf2 do not overwrite the byte that the kernel wrote,
+  // but buf2 must still be rescanned after the system call.
+  buf2[0] = 0x00;
+  buf2[1] = 0x00;
+
+  if (!read_elf_magic(argv[0], buf2))
+    return 1;
+
+  buf2[1] = 0xff;
+  buf2[1] = 0xff;
+
+  // The samples are 00 00 and 7f ff, which contain 0 and 15 1-bits.
+  // ---> average bit value = 15/32 = 0.46875
+  // Only the most significant bit of buf2[0] is 0 in both samples.
+  // ---> average temporal entropy = h(1/2) * 15/16 = 0.9375
+
+  delete[] buf1;
+  delete[] buf2;
+
+  return 0;
+}
+
+// CHECK: MEMORY BUFFERS
+// CHECK: ==============
+
+// CHECK:      Buffer:                   Buffer 0x[[#BUF1]] --> 0x[[#BUF1 + 1]]
+// CHECK-NEXT: Number of reads:          0
+// CHECK-NEXT: Number of writes:         4
+// CHECK:      Average spatial entropy (bit_average):
+// CHECK-SAME: 0.5
+// CHECK: Average temporal entropy (bit_shannon):
+// CHECK-SAME: 1
+
+// CHECK:      Buffer:                   Buffer 0x[[#BUF2]] --> 0x[[#BUF2 + 2]]
+// CHECK-NEXT: Number of reads:          0
+// CHECK-NEXT: Number of writes:         4
+// CHECK:      Average spatial entropy (bit_average):
+// CHECK-SAME: 0.46875
+// CHECK: Average temporal entropy (bit_shannon):
+// CHECK-SAME: 0.9375
@@ -0,0 +1,45 @@
+#include <cstddef>
+
+// clang-format off
+
+// RUN: g++ %s -o %t.exe
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -stack_frames 1 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.log --log_file=%t.log | FileCheck %s -DSRC_PATH=%s
+
+extern "C" void MATE_FRAMEWORK_DEBUG_ANNOTATE_MEMORY(const char *address,
+                                                     unsigned int size,
+                                                     const char *annotation,
+                                                     const char *filename,
+                                                     unsigned int line) {}
+
+// Fills a key on the stack, and sums it.
+__attribute__((noinline)) unsigned int sum_key() {
+  unsigned char key[32];
+
+  MATE_FRAMEWORK_DEBUG_ANNOTATE_MEMORY((char *)key, sizeof(key), "Stack key", __FILE__, __LINE__);
+
+  for (std::size_t i = 0; i < sizeof(key); ++i)
+    key[i] = i;
+
+  unsigned int sum = 0;
+  for (std::size_t i = 0; i < sizeof(key); ++i)
+    sum += key[i];
+
+  return sum;
+}
+
+int main(int argc, char *argv[]) {
+  // The stack frame of sum_key() is the same for both calls, so both are
+  // counted in the same row.
+  return (sum_key() + sum_key() == 2 * 496) ? 0 : 1;
+}
+
+// The key is neither a malloc'ed buffer, nor split into memory regions.
+// CHECK:     MEMORY BUFFERS
+// CHECK-NOT: Stack key
+// CHECK:     MEMORY REGIONS
+// CHECK-NOT: Stack key
+
+// CHECK: STACK FRAMES
+// CHECK: Annotation: Stack key(offset={{[0-9]+}},size=32,location=[[SRC_PATH]]:20);Stack key(offset={{[0-9]+}},size=32,location=[[SRC_PATH]]:20){{$}}
@@ -2,6 +2,7 @@
 
 import argparse
 import csv
+import os
 
 # Parse arguments
 parser = argparse.ArgumentParser(description = 'Helper script to print the contents of the human readable output log file and the CSV output files of the memory buffer Pin tool', epilog='example: pretty-print-csvs.py --prefix=path/to/prefix --log_file=path/to/tool.log')
@@ -88,3 +89,13 @@ print()
 
 with open(prefix + '.regions.csv') as f:
     print_memory(f)
+
+# Print stack frames, if they were tracked with -stack_frames
+if os.path.exists(prefix + '.stack_frames.csv'):
+    print()
+    print('STACK FRAMES')
+    print('============')
+    print()
+
+    with open(prefix + '.stack_frames.csv') as f:
+        print_memory(f)
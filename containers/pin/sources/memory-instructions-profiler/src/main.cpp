@@ -1,17 +1,25 @@
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "asyncanalysis.h"
+#include "operandvalue.h"
 #include "pin.H"
+#include "sampling.h"
 #include "sde-init.H"
+#include "symbols.h"
+#include "table.h"
+#include "toolstats.h"
 
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_memory_instructions;
+// Table to write the memory instructions to.
+static std::unique_ptr<TableWriter> memory_instructions_table;
 
 // Constant representing an invalid address.
 static constexpr ADDRINT INVALID_ADDRESS = -1;
@@ -40,6 +48,13 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.memory-instructions.csv.");
 
+// Option (-output_format) to set the format of the output file.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', and "
+    "'columnar', which writes <prefix>.memory-instructions.col instead. Use "
+    "containers/pin/columnar.py to read it.");
+
 // Option (-start_from_main) to only start analysis from the point that main()
 // is called.
 KNOB<bool> KnobStartFromMain(
@@ -57,56 +72,48 @@ KNOB<std::size_t> KnobInstructionValuesLimit(
     KNOB_MODE_WRITEONCE, "pintool", "instruction_values_limit", "5",
     "Number of unique read/written values to keep per static instruction.");
 
-// The address of an instruction.
-class StaticInstructionAddress {
-public:
-  // Creates a new StaticInstructionAddress corresponding to the given
-  // instruction address.
-  StaticInstructionAddress(ADDRINT address)
-      : image_name("???"), section_name("???"), routine_name("???"),
-        image_offset(-1), routine_offset(-1) {
-    // Routine info.
-    RTN routine = RTN_FindByAddress(address);
-    if (!RTN_Valid(routine)) {
-      return;
-    }
-
-    this->routine_name = RTN_Name(routine);
-    this->routine_offset = address - RTN_Address(routine);
-
-    // Section info.
-    SEC section = RTN_Sec(routine);
-    if (!SEC_Valid(section)) {
-      return;
-    }
-
-    this->section_name = SEC_Name(section);
-
-    // Image info.
-    IMG image = SEC_Img(section);
-    if (!IMG_Valid(image)) {
-      return;
-    }
-
-    this->image_name = IMG_Name(image);
-    this->image_offset = address - IMG_LowAddress(image);
-  }
-
-  // The name of the image this instruction belongs to.
-  std::string image_name;
-
-  // The name of the section this instruction belongs to.
-  std::string section_name;
-
-  // The name of the routine this instruction belongs to.
-  std::string routine_name;
-
-  // The offset of the instruction address relative to the base of the image.
-  ADDRINT image_offset;
-
-  // The offset of the instruction address relative to the base of the routine.
-  ADDRINT routine_offset;
-};
+// Option (-partial_output) to write a partial output that can be merged.
+KNOB<bool> KnobPartialOutput(
+    KNOB_MODE_WRITEONCE, "pintool", "partial_output", "0",
+    "When true, writes <prefix>.memory-instructions.partial.csv instead, "
+    "which also contains the state needed to merge the output exactly. Use "
+    "ProfileMerge to merge the partial outputs of the regions of a pinball.");
+
+// Option (-async) to analyse memory accesses in internal threads.
+KNOB<bool> KnobAsync(
+    KNOB_MODE_WRITEONCE, "pintool", "async", "0",
+    "When true, application threads only append a record of each memory "
+    "access to a per-thread buffer, and internal threads update the profile "
+    "from the full buffers.");
+
+// Option (-async_threads) to set the number of internal analysis threads.
+KNOB<unsigned int> KnobAsyncThreads(
+    KNOB_MODE_WRITEONCE, "pintool", "async_threads", "2",
+    "Number of internal threads that analyse the buffers with -async. Each "
+    "thread updates the profile of a fixed subset of the instructions.");
+
+// Option (-async_buffer_size) to set the size of the per-thread buffers.
+KNOB<std::size_t> KnobAsyncBufferSize(
+    KNOB_MODE_WRITEONCE, "pintool", "async_buffer_size", "262144",
+    "Size in bytes of the buffers of memory access records with -async.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
+// Option (-sample_period) to only analyse a random sample of the executions.
+KNOB<UINT64> KnobSamplePeriod(
+    KNOB_MODE_WRITEONCE, "pintool", "sample_period", "1",
+    "Analyse 1 in <sample_period> executions of memory instructions on "
+    "average, chosen at random. The counts are then estimates, and the "
+    "output has columns with the 95% confidence interval of num_executions. "
+    "1 analyses every execution.");
+
+// Option (-sample_seed) to set the seed of the random sampling.
+KNOB<UINT64> KnobSampleSeed(KNOB_MODE_WRITEONCE, "pintool", "sample_seed",
+                            "0", "Seed of the random sampling.");
 
 // Contains information for reads or writes of an instruction.
 struct ReadWriteInfo {
@@ -122,15 +129,26 @@ struct ReadWriteInfo {
 
   // A set of unique byte addresses that this instruction read from or wrote to.
   std::set<ADDRINT> byte_addresses;
+
+  // Only for the partial output: the values in the order in which they first
+  // occurred, and for each of them, the counts of the values before it at that
+  // point. Values stop being counted once the limit of unique values is
+  // reached, so this is needed to merge the values of consecutive regions.
+  std::vector<std::vector<unsigned char>> value_order;
+  std::vector<std::vector<unsigned int>> value_history;
 };
 
 // Contains the information for each memory instruction.
 struct MemoryInstructionInfo {
-  MemoryInstructionInfo(ADDRINT address)
-      : address(address), num_executions(0), read_info(), write_info() {}
+  MemoryInstructionInfo(ADDRINT address, unsigned int shard)
+      : address(find_symbol(address)), shard(shard), num_executions(0),
+        read_info(), write_info() {}
 
-  // The address of the memory instruction.
-  StaticInstructionAddress address;
+  // The location of the memory instruction.
+  SymbolLocation address;
+
+  // With -async, the index of the internal thread that updates this info.
+  unsigned int shard;
 
   // The number of times this instruction was executed.
   unsigned int num_executions;
@@ -146,7 +164,8 @@ struct MemoryInstructionInfo {
 static std::map<ADDRINT, MemoryInstructionInfo> memory_instruction_infos;
 
 // Mutex to control accesses to memory_instruction_infos.
-static PIN_MUTEX memory_instruction_infos_lock;
+static StatMutex
+    memory_instruction_infos_lock("memory_instruction_infos_lock");
 
 // Remembers the effective address of memory operands.
 // This is needed because Pin doesn't allow us to access the effective address
@@ -155,37 +174,77 @@ static PIN_MUTEX memory_instruction_infos_lock;
 static std::map<std::pair<THREADID, UINT32>, ADDRINT> memory_operands_map;
 
 // Mutex to control access to memory_operands_map.
-static PIN_MUTEX memory_operands_map_lock;
+static StatMutex memory_operands_map_lock("memory_operands_map_lock");
+
+// -----------------------------------------------------------------------------
+// Asynchronous analysis (-async)
+// -----------------------------------------------------------------------------
+//
+// Application threads append a record of every memory access, including the
+// value that was read or written, to a buffer, which the analysis threads of
+// asyncanalysis.h analyse. Every analysis thread updates the infos of a fixed
+// subset (shard) of the memory instructions.
+
+// A record of a memory access. It is followed by the bytes of the value.
+struct MemoryAccessRecord {
+  MemoryInstructionInfo *info;
+  ADDRINT memory_address;
+  UINT32 size;
+  UINT32 is_write;
+};
+
+// Statistics for -tool_stats.
+static CallCounter main_called_calls("MainCalled");
+static CallCounter main_returned_calls("MainReturned");
+static CallCounter memory_access_before_calls("MemoryAccessBefore");
+static CallCounter memory_access_after_calls("MemoryAccessAfter");
+static CallCounter async_memory_read_before_calls("AsyncMemoryReadBefore");
+static CallCounter async_memory_write_before_calls("AsyncMemoryWriteBefore");
+static CallCounter async_memory_write_after_calls("AsyncMemoryWriteAfter");
+static StatTimer on_instruction_timer("OnInstruction");
+static StatTimer on_image_load_timer("OnImageLoad");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize memory_instruction_infos_size("memory_instruction_infos");
+static PeakSize memory_operands_map_size("memory_operands_map");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
 
 // =============================================================================
 // Analysis routines
 // =============================================================================
 
-// Run before every instruction.
-VOID InstructionBefore(ADDRINT instruction_pointer) {
-  // Check if main if reached yet.
-  if (instruction_pointer == main_address) {
-    log_file << "\nMain reached, setting global flag.\n";
-    main_reached = true;
-  }
+// Inlined check that runs before every call instruction. Returns whether this
+// is the first call to main().
+ADDRINT PIN_FAST_ANALYSIS_CALL CallsMain(ADDRINT target_address) {
+  return (end_address == INVALID_ADDRESS) & (target_address == main_address);
+}
 
-  // Check if main is finished.
-  if (instruction_pointer == end_address) {
-    log_file
-        << "\nInstruction after call to main reached, setting global flag.\n";
-    end_reached = true;
-  }
+// Runs at the first call to main().
+VOID MainCalled(ADDRINT next_instruction_pointer) {
+  main_called_calls.count();
+
+  log_file << "\nMain called, next ip = " << std::hex << std::showbase
+           << next_instruction_pointer << std::dec << "\n";
+  end_address = next_instruction_pointer;
+
+  log_file << "\nMain reached, setting global flag.\n";
+  main_reached = true;
 }
 
-// Runs before every call instruction.
-VOID InstructionCallBefore(ADDRINT target_address,
-                           ADDRINT next_instruction_pointer) {
-  // Check if this is the first call to main().
-  if ((end_address == INVALID_ADDRESS) && (target_address == main_address)) {
-    log_file << "\nMain called, next ip = " << std::hex << std::showbase
-             << next_instruction_pointer << std::dec << "\n";
-    end_address = next_instruction_pointer;
-  }
+// Inlined check that runs before every return instruction. Returns whether it
+// returns from main().
+ADDRINT PIN_FAST_ANALYSIS_CALL ReturnsFromMain(ADDRINT target_address) {
+  return target_address == end_address;
+}
+
+// Runs when main() returns.
+VOID MainReturned() {
+  main_returned_calls.count();
+
+  log_file
+      << "\nInstruction after call to main reached, setting global flag.\n";
+  end_reached = true;
 }
 
 // Run at the start of __libc_start_main().
@@ -196,16 +255,30 @@ VOID LibcStartMainBefore(ADDRINT main_addr) {
   main_address = main_addr;
 }
 
-// Helper function to update read_info or write_info.
+// Helper function to update read_info or write_info with a value that was
+// read from or written to memory. For SIZE > 0, the value is SIZE bytes, so
+// that the loops over its bytes have a constant bound (see operandvalue.h).
+template <std::size_t SIZE>
 void UpdateReadWriteInfo(ReadWriteInfo &info, ADDRINT memory_address,
-                         ADDRINT size) {
-  // Copy the read/written value.
-  unsigned char *value_buf = new unsigned char[size];
-  PIN_SafeCopy(value_buf, reinterpret_cast<void *>(memory_address), size);
+                         const unsigned char *value_buf, ADDRINT size) {
+  if (SIZE != 0)
+    size = SIZE;
 
   // Update the set of read/written values.
   if (info.values.size() < KnobInstructionValuesLimit.Value()) {
-    info.values[std::vector<unsigned char>(value_buf, value_buf + size)]++;
+    std::vector<unsigned char> value(value_buf, value_buf + size);
+
+    if (KnobPartialOutput.Value() && info.values.count(value) == 0) {
+      std::vector<unsigned int> counts;
+
+      for (const auto &earlier_value : info.value_order)
+        counts.push_back(info.values[earlier_value]);
+
+      info.value_order.push_back(value);
+      info.value_history.push_back(std::move(counts));
+    }
+
+    info.values[value]++;
   }
 
   // Update the byte counters.
@@ -213,31 +286,107 @@ void UpdateReadWriteInfo(ReadWriteInfo &info, ADDRINT memory_address,
     ++info.byte_counts[value_buf[i]];
   }
 
-  // Cleanup value_buf array.
-  delete[] value_buf;
-
   // Update the set of unique byte addresses.
   for (ADDRINT i = 0; i < size; ++i) {
     info.byte_addresses.insert(memory_address + i);
   }
 }
 
-// Run before every memory access, i.e. both read and write.
+// Helper function to update read_info or write_info with the current contents
+// of memory, for a memory operand of SIZE bytes.
+template <std::size_t SIZE>
+void UpdateReadWriteInfo(ReadWriteInfo &info, ADDRINT memory_address,
+                         ADDRINT size) {
+  // Copy the read/written value.
+  const OperandValue<SIZE> value(memory_address, size);
+
+  UpdateReadWriteInfo<SIZE>(info, memory_address, value.data(), value.size());
+}
+
+// Update the infos with a record of a memory access. Runs in the analysis
+// thread of the instruction's shard.
+void AnalyseRecord(const MemoryAccessRecord &record,
+                   const unsigned char *value) {
+  MemoryInstructionInfo &info = *record.info;
+
+  // Update the num_executions counter.
+  ++info.num_executions;
+
+  // Update the read_info or write_info.
+  UpdateReadWriteInfo<0>(record.is_write ? info.write_info : info.read_info,
+                         record.memory_address, value, record.size);
+}
+
+// Append a record of a memory access to the buffer of the instruction's shard.
+void AppendRecord(THREADID threadID, MemoryInstructionInfo *info,
+                  ADDRINT memory_address, UINT32 size, bool is_write) {
+  auto *record =
+      append_async_record<MemoryAccessRecord>(threadID, info->shard, size);
+  record->info = info;
+  record->memory_address = memory_address;
+  record->is_write = is_write;
+
+  // Copy the read/written value.
+  PIN_SafeCopy(async_record_value(record),
+               reinterpret_cast<void *>(memory_address), size);
+}
+
+// Run before every memory read with -async.
+VOID AsyncMemoryReadBefore(THREADID threadID, MemoryInstructionInfo *info,
+                           ADDRINT memory_address, UINT32 size) {
+  async_memory_read_before_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  AppendRecord(threadID, info, memory_address, size, false);
+}
+
+// Run before every memory write with -async.
+VOID AsyncMemoryWriteBefore(THREADID threadID, UINT32 mem_op,
+                            ADDRINT memory_address) {
+  async_memory_write_before_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  // Store the memory address so we can reuse it later in
+  // AsyncMemoryWriteAfter.
+  async_write_addresses(threadID)[mem_op] = memory_address;
+}
+
+// Run after every memory write with -async.
+VOID AsyncMemoryWriteAfter(THREADID threadID, MemoryInstructionInfo *info,
+                           UINT32 mem_op, UINT32 size) {
+  async_memory_write_after_calls.count();
+
+  if (!main_reached || end_reached)
+    return;
+
+  AppendRecord(threadID, info, async_write_addresses(threadID)[mem_op], size,
+               true);
+}
+
+// Run before every memory access, i.e. both read and write, of SIZE bytes.
+template <std::size_t SIZE>
 VOID MemoryAccessBefore(THREADID threadID, ADDRINT instruction_address,
                         BOOL is_write, UINT32 mem_op, ADDRINT memory_address,
                         ADDRINT size) {
+  memory_access_before_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Store the memory address so we can reuse it later in MemoryAccessAfter.
-  PIN_MutexLock(&memory_operands_map_lock);
+  memory_operands_map_lock.lock();
   memory_operands_map[std::make_pair(threadID, mem_op)] = memory_address;
-  PIN_MutexUnlock(&memory_operands_map_lock);
+  memory_operands_map_size.update(memory_operands_map.size());
+  memory_operands_map_lock.unlock();
 
   // Update instruction info for reads.
   if (!is_write) {
     // Find the instruction info.
-    PIN_MutexLock(&memory_instruction_infos_lock);
+    memory_instruction_infos_lock.lock();
     auto it = memory_instruction_infos.find(instruction_address);
 
     if (it != memory_instruction_infos.end()) {
@@ -245,32 +394,35 @@ VOID MemoryAccessBefore(THREADID threadID, ADDRINT instruction_address,
       ++it->second.num_executions;
 
       // Update the read_info.
-      UpdateReadWriteInfo(it->second.read_info, memory_address, size);
+      UpdateReadWriteInfo<SIZE>(it->second.read_info, memory_address, size);
     } else {
       assert(false &&
              "Memory instruction not added to memory_instruction_infos!");
     }
 
-    PIN_MutexUnlock(&memory_instruction_infos_lock);
+    memory_instruction_infos_lock.unlock();
   }
 }
 
-// Run after every memory access, i.e. both read and write.
+// Run after every memory access, i.e. both read and write, of SIZE bytes.
+template <std::size_t SIZE>
 VOID MemoryAccessAfter(THREADID threadID, ADDRINT instruction_address,
                        BOOL is_write, UINT32 mem_op, ADDRINT size) {
+  memory_access_after_calls.count();
+
   if (!main_reached || end_reached)
     return;
 
   // Retrieve the memory address stored in the memory_operands_map.
-  PIN_MutexLock(&memory_operands_map_lock);
+  memory_operands_map_lock.lock();
   const ADDRINT memory_address =
       memory_operands_map[std::make_pair(threadID, mem_op)];
-  PIN_MutexUnlock(&memory_operands_map_lock);
+  memory_operands_map_lock.unlock();
 
   // Update instruction info for writes.
   if (is_write) {
     // Find the instruction info.
-    PIN_MutexLock(&memory_instruction_infos_lock);
+    memory_instruction_infos_lock.lock();
     auto it = memory_instruction_infos.find(instruction_address);
 
     if (it != memory_instruction_infos.end()) {
@@ -278,12 +430,12 @@ VOID MemoryAccessAfter(THREADID threadID, ADDRINT instruction_address,
       ++it->second.num_executions;
 
       // Update the write_info.
-      UpdateReadWriteInfo(it->second.write_info, memory_address, size);
+      UpdateReadWriteInfo<SIZE>(it->second.write_info, memory_address, size);
     } else {
       assert(false &&
              "Memory instruction not added to memory_instruction_infos!");
     }
-    PIN_MutexUnlock(&memory_instruction_infos_lock);
+    memory_instruction_infos_lock.unlock();
   }
 }
 
@@ -291,22 +443,78 @@ VOID MemoryAccessAfter(THREADID threadID, ADDRINT instruction_address,
 // Instrumentation routines
 // =============================================================================
 
+// Insert the analysis calls of -async for the memory operands of an
+// instruction.
+void InstrumentAsync(INS instruction, MemoryInstructionInfo *info,
+                     UINT32 num_mem_operands) {
+  for (UINT32 mem_op = 0; mem_op < num_mem_operands; ++mem_op) {
+    // Get the number of bytes of this memory operand.
+    UINT32 size = INS_MemoryOperandSize(instruction, mem_op);
+
+    // Use predicated calls, as for the synchronous analysis.
+    if (INS_MemoryOperandIsRead(instruction, mem_op)) {
+      IARGLIST args = IARGLIST_Alloc();
+      IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_PTR, info,
+                            IARG_MEMORYOP_EA, mem_op, IARG_UINT32, size,
+                            IARG_END);
+      insert_sampled_call(instruction, IPOINT_BEFORE,
+                          reinterpret_cast<AFUNPTR>(AsyncMemoryReadBefore),
+                          args);
+    }
+
+    // The written value is only available after the instruction.
+    if (INS_MemoryOperandIsWritten(instruction, mem_op) &&
+        INS_IsValidForIpointAfter(instruction) &&
+        mem_op < MAX_ASYNC_WRITE_ADDRESSES) {
+      IARGLIST args = IARGLIST_Alloc();
+      IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_UINT32, mem_op,
+                            IARG_MEMORYOP_EA, mem_op, IARG_END);
+      insert_sampled_call(instruction, IPOINT_BEFORE,
+                          reinterpret_cast<AFUNPTR>(AsyncMemoryWriteBefore),
+                          args);
+
+      args = IARGLIST_Alloc();
+      IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_PTR, info, IARG_UINT32,
+                            mem_op, IARG_UINT32, size, IARG_END);
+      insert_sampled_call(instruction, IPOINT_AFTER,
+                          reinterpret_cast<AFUNPTR>(AsyncMemoryWriteAfter),
+                          args);
+    }
+  }
+}
+
 // Instrumentation routine run for every instruction.
 VOID OnInstruction(INS instruction, VOID *v) {
-  // Call InstructionBefore() before every instruction.
-  // Pass RIP as argument.
-  INS_InsertCall(instruction, IPOINT_BEFORE,
-                 reinterpret_cast<AFUNPTR>(InstructionBefore), IARG_INST_PTR,
-                 IARG_END);
+  ScopedStatTimer timer(on_instruction_timer);
 
-  // Call InstructionCallBefore() before every call instruction.
+  // Call MainCalled() if a call instruction is the first call to main(). It
+  // runs after the other analysis routines of the call, which is not part of
+  // main() yet.
   // Pass the target address (i.e. the address of the function being called) and
   // the address of the next instruction (i.e. the one following the call).
   if (INS_IsCall(instruction)) {
-    INS_InsertCall(instruction, IPOINT_BEFORE,
-                   reinterpret_cast<AFUNPTR>(InstructionCallBefore),
-                   IARG_BRANCH_TARGET_ADDR, IARG_ADDRINT,
-                   INS_NextAddress(instruction), IARG_END);
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(CallsMain), IARG_CALL_ORDER,
+                     CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainCalled), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_ADDRINT,
+                       INS_NextAddress(instruction), IARG_END);
+  }
+
+  // Call MainReturned() if a return instruction returns from main(). It runs
+  // after the other analysis routines of the return, which is still part of
+  // main().
+  // Pass the return address.
+  if (INS_IsRet(instruction)) {
+    INS_InsertIfCall(instruction, IPOINT_BEFORE,
+                     reinterpret_cast<AFUNPTR>(ReturnsFromMain),
+                     IARG_CALL_ORDER, CALL_ORDER_LAST, IARG_FAST_ANALYSIS_CALL,
+                     IARG_BRANCH_TARGET_ADDR, IARG_END);
+    INS_InsertThenCall(instruction, IPOINT_BEFORE,
+                       reinterpret_cast<AFUNPTR>(MainReturned), IARG_CALL_ORDER,
+                       CALL_ORDER_LAST, IARG_END);
   }
 
   /* Insert analysis calls for memory-related instructions. */
@@ -315,19 +523,39 @@ VOID OnInstruction(INS instruction, VOID *v) {
   UINT32 num_mem_operands = INS_MemoryOperandCount(instruction);
 
   // Create a new entry in the memory instruction map for instructions that read
-  // from/write to memory.
+  // from/write to memory. With -async, the instructions are assigned to the
+  // analysis threads round-robin.
+  MemoryInstructionInfo *info = nullptr;
+
   if (num_mem_operands > 0) {
     ADDRINT ins_addr = INS_Address(instruction);
 
-    PIN_MutexLock(&memory_instruction_infos_lock);
-    memory_instruction_infos.insert(
-        {ins_addr, MemoryInstructionInfo(ins_addr)});
-    PIN_MutexUnlock(&memory_instruction_infos_lock);
+    memory_instruction_infos_lock.lock();
+    const unsigned int shard =
+        KnobAsync.Value()
+            ? memory_instruction_infos.size() % async_analysis_threads()
+            : 0;
+    info = &memory_instruction_infos
+                .insert({ins_addr, MemoryInstructionInfo(ins_addr, shard)})
+                .first->second;
+    memory_instruction_infos_size.update(memory_instruction_infos.size());
+    memory_instruction_infos_lock.unlock();
+  }
+
+  // With sampling, only the memory accesses of sampled executions of the
+  // instruction are analysed.
+  if (num_mem_operands > 0)
+    insert_sample_countdown(instruction);
+
+  if (KnobAsync.Value()) {
+    InstrumentAsync(instruction, info, num_mem_operands);
+    return;
   }
 
   // Call MemoryAccessBefore() before every memory read/write
   // and MemoryAccessAfter() after every memory read/write (if supported).
-  // Pass the effective address and operand size as argument.
+  // Pass the effective address and operand size as argument, and use the
+  // instantiations that are specialized for the operand size.
   // Note that an instruction may have multiple memory operands.
   for (UINT32 mem_op = 0; mem_op < num_mem_operands; ++mem_op) {
     // Get the number of bytes of this memory operand.
@@ -339,37 +567,41 @@ VOID OnInstruction(INS instruction, VOID *v) {
     // instructions that are actually executed. This is important for
     // conditional moves and instructions with a REP prefix.
     if (INS_MemoryOperandIsRead(instruction, mem_op)) {
-      INS_InsertPredicatedCall(instruction, IPOINT_BEFORE,
-                               reinterpret_cast<AFUNPTR>(MemoryAccessBefore),
-                               IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL, false,
-                               IARG_UINT32, mem_op, IARG_MEMORYOP_EA, mem_op,
-                               IARG_ADDRINT, size, IARG_END);
+      IARGLIST args = IARGLIST_Alloc();
+      IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                            false, IARG_UINT32, mem_op, IARG_MEMORYOP_EA,
+                            mem_op, IARG_ADDRINT, size, IARG_END);
+      insert_sampled_call(instruction, IPOINT_BEFORE,
+                          SIZED_ROUTINE(MemoryAccessBefore, size), args);
     }
 
     if (INS_MemoryOperandIsWritten(instruction, mem_op)) {
-      INS_InsertPredicatedCall(instruction, IPOINT_BEFORE,
-                               reinterpret_cast<AFUNPTR>(MemoryAccessBefore),
-                               IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL, true,
-                               IARG_UINT32, mem_op, IARG_MEMORYOP_EA, mem_op,
-                               IARG_ADDRINT, size, IARG_END);
+      IARGLIST args = IARGLIST_Alloc();
+      IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                            true, IARG_UINT32, mem_op, IARG_MEMORYOP_EA,
+                            mem_op, IARG_ADDRINT, size, IARG_END);
+      insert_sampled_call(instruction, IPOINT_BEFORE,
+                          SIZED_ROUTINE(MemoryAccessBefore, size), args);
     }
 
     // MemoryAccessAfter()
     if (INS_IsValidForIpointAfter(instruction)) {
       if (INS_MemoryOperandIsRead(instruction, mem_op)) {
-        INS_InsertPredicatedCall(instruction, IPOINT_AFTER,
-                                 reinterpret_cast<AFUNPTR>(MemoryAccessAfter),
-                                 IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
-                                 false, IARG_UINT32, mem_op, IARG_ADDRINT, size,
-                                 IARG_END);
+        IARGLIST args = IARGLIST_Alloc();
+        IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                              false, IARG_UINT32, mem_op, IARG_ADDRINT, size,
+                              IARG_END);
+        insert_sampled_call(instruction, IPOINT_AFTER,
+                            SIZED_ROUTINE(MemoryAccessAfter, size), args);
       }
 
       if (INS_MemoryOperandIsWritten(instruction, mem_op)) {
-        INS_InsertPredicatedCall(instruction, IPOINT_AFTER,
-                                 reinterpret_cast<AFUNPTR>(MemoryAccessAfter),
-                                 IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL, true,
-                                 IARG_UINT32, mem_op, IARG_ADDRINT, size,
-                                 IARG_END);
+        IARGLIST args = IARGLIST_Alloc();
+        IARGLIST_AddArguments(args, IARG_THREAD_ID, IARG_INST_PTR, IARG_BOOL,
+                              true, IARG_UINT32, mem_op, IARG_ADDRINT, size,
+                              IARG_END);
+        insert_sampled_call(instruction, IPOINT_AFTER,
+                            SIZED_ROUTINE(MemoryAccessAfter, size), args);
       }
     }
   }
@@ -377,6 +609,8 @@ VOID OnInstruction(INS instruction, VOID *v) {
 
 // Instrumentation routine run for every image loaded.
 VOID OnImageLoad(IMG image, VOID *v) {
+  ScopedStatTimer timer(on_image_load_timer);
+
   // Find __libc_start_main so we can start analysis at main().
   RTN libcStartMainRoutine = RTN_FindByName(image, "__libc_start_main");
 
@@ -415,13 +649,14 @@ std::string get_filename(const std::string &path) {
   }
 }
 
-// Dump the list of read/written values in CSV format.
-void dump_csv_value_list(
-    std::ofstream &ofs,
+// Format the list of read/written values.
+std::string format_value_list(
     const std::map<std::vector<unsigned char>, unsigned int> &values) {
   std::ostringstream oss;
   oss << std::right << std::noshowbase << std::hex << std::setfill('0');
 
+  oss << '[';
+
   bool first = true;
 
   for (const auto &entry : values) {
@@ -439,18 +674,18 @@ void dump_csv_value_list(
       first_byte = false;
     }
 
-    oss << " (occurs " << std::dec << count << " time(s))";
+    oss << " (occurs " << std::dec << estimate_count(count) << " time(s))";
   }
 
-  ofs << "\"[";
-  ofs << oss.str();
-  ofs << "]\"";
+  oss << ']';
+
+  return oss.str();
 }
 
-// Dump the information for read/write info in CSV format.
-void dump_csv_readwrite_info(std::ofstream &ofs, const ReadWriteInfo &info) {
+// Dump the information for read/write info.
+void dump_readwrite_info(TableWriter &table, const ReadWriteInfo &info) {
   // {...}_values
-  dump_csv_value_list(ofs, info.values);
+  table << format_value_list(info.values);
 
   // Get the total amount of bytes read/written by this instruction.
   std::size_t total_count = 0;
@@ -472,57 +707,138 @@ void dump_csv_readwrite_info(std::ofstream &ofs, const ReadWriteInfo &info) {
 
   entropy = entropy / std::log2(static_cast<float>(256));
 
-  ofs << ',' << entropy;                    // {...}_values_entropy
-  ofs << ',' << total_count;                // num_bytes_{...}
-  ofs << ',' << info.byte_addresses.size(); // num_unique_byte_addresses_{...}
+  table << entropy                     // {...}_values_entropy
+        << estimate_count(total_count) // num_bytes_{...}
+        << info.byte_addresses.size(); // num_unique_byte_addresses_{...}
 }
 
-// Dump the information for memory instructions in CSV format.
-void dump_csv_memory_instructions(
-    std::ofstream &ofs, const std::map<ADDRINT, MemoryInstructionInfo> &map) {
-  // Print header.
-  ofs << "ip,image_name,full_image_name,section_name,image_offset,routine_name,"
-         "routine_offset,"
-         "read_values,read_values_entropy,num_bytes_read,num_unique_byte_"
-         "addresses_read,"
-         "written_values,written_values_entropy,num_bytes_written,num_unique_"
-         "byte_addresses_written,"
-         "num_executions\n";
-
-  // Print data.
+// The columns of the memory instructions table.
+static const std::vector<TableColumn> MEMORY_INSTRUCTIONS_COLUMNS = {
+    {"ip", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset", ColumnType::INT64},
+    {"read_values", ColumnType::STRING, true},
+    {"read_values_entropy", ColumnType::DOUBLE},
+    {"num_bytes_read", ColumnType::UINT64},
+    {"num_unique_byte_addresses_read", ColumnType::UINT64},
+    {"written_values", ColumnType::STRING, true},
+    {"written_values_entropy", ColumnType::DOUBLE},
+    {"num_bytes_written", ColumnType::UINT64},
+    {"num_unique_byte_addresses_written", ColumnType::UINT64},
+    {"num_executions", ColumnType::UINT64},
+};
+
+// The additional columns of the memory instructions table when sampling.
+static const std::vector<TableColumn> SAMPLING_COLUMNS = {
+    {"num_executions_ci_low", ColumnType::UINT64},
+    {"num_executions_ci_high", ColumnType::UINT64},
+};
+
+// The additional columns of the partial memory instructions table.
+static const std::vector<TableColumn> PARTIAL_COLUMNS = {
+    {"read_byte_counts", ColumnType::STRING, true},
+    {"read_byte_addresses", ColumnType::STRING, true},
+    {"read_value_history", ColumnType::STRING, true},
+    {"written_byte_counts", ColumnType::STRING, true},
+    {"written_byte_addresses", ColumnType::STRING, true},
+    {"written_value_history", ColumnType::STRING, true},
+    {"instruction_values_limit", ColumnType::UINT64},
+};
+
+// Dump the state of read/write info that is needed to merge it with the info
+// of other regions. All numbers except counts are hexadecimal.
+void dump_partial_readwrite_info(TableWriter &table,
+                                 const ReadWriteInfo &info) {
+  // {...}_byte_counts: '<byte>:<count>' for each byte value that occurs.
+  std::ostringstream counts;
+
+  for (std::size_t i = 0; i < 256; ++i) {
+    if (info.byte_counts[i] > 0) {
+      counts << (counts.tellp() > 0 ? " " : "") << std::hex << i << ':'
+             << std::dec << info.byte_counts[i];
+    }
+  }
+
+  // {...}_byte_addresses: '<first>-<last>' for each range of consecutive
+  // addresses.
+  std::ostringstream addresses;
+  addresses << std::hex;
+
+  for (auto it = info.byte_addresses.begin();
+       it != info.byte_addresses.end();) {
+    const ADDRINT first = *it;
+    ADDRINT last = first;
+
+    while (++it != info.byte_addresses.end() && *it == last + 1)
+      ++last;
+
+    addresses << (addresses.tellp() > 0 ? " " : "") << first << '-' << last;
+  }
+
+  // {...}_value_history: '<bytes>=<count>@<counts of earlier values>' for each
+  // value, in the order in which they first occurred.
+  std::ostringstream history;
+  history << std::setfill('0');
+
+  for (std::size_t i = 0; i < info.value_order.size(); ++i) {
+    const auto &value = info.value_order[i];
+
+    history << (i == 0 ? "" : " ") << std::hex;
+
+    for (const auto &byte : value)
+      history << std::setw(2) << static_cast<unsigned int>(byte);
+
+    history << std::dec << '=' << info.values.at(value) << '@';
+
+    for (std::size_t j = 0; j < info.value_history[i].size(); ++j)
+      history << (j == 0 ? "" : ",") << info.value_history[i][j];
+  }
+
+  table << counts.str() << addresses.str() << history.str();
+}
+
+// Dump the information for memory instructions.
+void dump_memory_instructions(
+    TableWriter &table, const std::map<ADDRINT, MemoryInstructionInfo> &map,
+    bool partial) {
+  // Print data. The offset columns are signed, so unknown offsets are -1.
   for (const auto &p : map) {
-    ofs << p.first                                          // ip
-        << ',' << get_filename(p.second.address.image_name) // image_name
-        << ',' << p.second.address.image_name               // full_image_name
-        << ',' << p.second.address.section_name             // section_name
-        << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.image_offset != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.image_offset << ','; // image_offset
-    else
-      ofs << -1 << ',';
-
-    ofs << p.second.address.routine_name // routine_name
-        << ',';
-
-    // Print "-1" for unknown offsets.
-    if (p.second.address.routine_offset != static_cast<ADDRINT>(-1))
-      ofs << p.second.address.routine_offset << ','; // routine_offset
-    else
-      ofs << -1 << ',';
+    const SymbolLocation &address = p.second.address;
+    const std::string &image_name = get_name(address.image_name);
 
-    // Print info for reads.
-    dump_csv_readwrite_info(ofs, p.second.read_info);
+    table << p.first                        // ip
+          << get_filename(image_name)       // image_name
+          << image_name                     // full_image_name
+          << get_name(address.section_name) // section_name
+          << address.image_offset           // image_offset
+          << get_name(address.routine_name) // routine_name
+          << address.routine_offset;        // routine_offset
 
-    ofs << ',';
+    // Print info for reads.
+    dump_readwrite_info(table, p.second.read_info);
 
     // Print info for writes.
-    dump_csv_readwrite_info(ofs, p.second.write_info);
+    dump_readwrite_info(table, p.second.write_info);
+
+    table << estimate_count(p.second.num_executions); // num_executions
 
-    ofs << ',' << p.second.num_executions; // num_executions
+    if (sampling_enabled()) {
+      UINT64 low, high;
+      estimate_confidence_interval(p.second.num_executions, low, high);
 
-    ofs << '\n';
+      table << low   // num_executions_ci_low
+            << high; // num_executions_ci_high
+    }
+
+    if (partial) {
+      dump_partial_readwrite_info(table, p.second.read_info);
+      dump_partial_readwrite_info(table, p.second.write_info);
+      table << KnobInstructionValuesLimit.Value(); // instruction_values_limit
+    }
   }
 }
 
@@ -532,12 +848,17 @@ void dump_csv_memory_instructions(
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
   // -----------------------
   // Machine parsable output
   // -----------------------
 
-  dump_csv_memory_instructions(csv_memory_instructions,
-                               memory_instruction_infos);
+  if (KnobAsync.Value())
+    finish_async_analysis();
+
+  dump_memory_instructions(*memory_instructions_table,
+                           memory_instruction_infos, KnobPartialOutput.Value());
 
   // -------
   // Cleanup
@@ -548,8 +869,14 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.close();
 
   // Flush and close the CSV file.
-  csv_memory_instructions.flush();
-  csv_memory_instructions.close();
+  memory_instructions_table->close();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -559,6 +886,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -588,6 +918,40 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Initialise the symbol tables.
+  init_symbols();
+
+  // Check the options.
+  TableFormat table_format;
+
+  if (!parse_table_format(KnobOutputFormat.Value(), table_format)) {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
+  if (!init_sampling(KnobSamplePeriod.Value(), KnobSampleSeed.Value())) {
+    std::cerr << "Invalid sample period '" << KnobSamplePeriod.Value()
+              << "', or no register available for sampling.\n\n";
+    return Usage();
+  }
+
+  // Estimates cannot be merged exactly.
+  if (sampling_enabled() && KnobPartialOutput.Value()) {
+    std::cerr << "-partial_output cannot be combined with sampling.\n\n";
+    return Usage();
+  }
+
+  if (KnobAsync.Value() && KnobAsyncThreads.Value() == 0) {
+    std::cerr << "The number of analysis threads must be at least 1.\n\n";
+    return Usage();
+  }
+
+  if (KnobAsync.Value() && KnobAsyncBufferSize.Value() < 4096) {
+    std::cerr << "The buffer size must be at least 4096 bytes.\n\n";
+    return Usage();
+  }
+
   // If we do not want to start at main() only, set 'main_reached' to true
   // already. This results in the entire executable being analysed.
   if (!KnobStartFromMain.Value())
@@ -604,8 +968,26 @@ int main(int argc, char *argv[]) {
   }
 
   // Open the CSV files.
-  csv_memory_instructions.open(
-      (csv_prefix + ".memory-instructions.csv").c_str());
+  if (KnobPartialOutput.Value()) {
+    std::vector<TableColumn> columns = MEMORY_INSTRUCTIONS_COLUMNS;
+    columns.insert(columns.end(), PARTIAL_COLUMNS.begin(),
+                   PARTIAL_COLUMNS.end());
+
+    memory_instructions_table =
+        open_table(csv_prefix + ".memory-instructions.partial", table_format,
+                   columns);
+  } else if (sampling_enabled()) {
+    std::vector<TableColumn> columns = MEMORY_INSTRUCTIONS_COLUMNS;
+    columns.insert(columns.end(), SAMPLING_COLUMNS.begin(),
+                   SAMPLING_COLUMNS.end());
+
+    memory_instructions_table = open_table(csv_prefix + ".memory-instructions",
+                                           table_format, columns);
+  } else {
+    memory_instructions_table =
+        open_table(csv_prefix + ".memory-instructions", table_format,
+                   MEMORY_INSTRUCTIONS_COLUMNS);
+  }
 
   // Register instruction callback.
   INS_AddInstrumentFunction(OnInstruction, nullptr);
@@ -613,19 +995,32 @@ int main(int argc, char *argv[]) {
   // Register image load callback.
   IMG_AddInstrumentFunction(OnImageLoad, nullptr);
 
+  // Start the asynchronous analysis.
+  if (KnobAsync.Value() &&
+      !init_async_analysis(
+          KnobAsyncThreads.Value(), KnobAsyncBufferSize.Value(),
+          analyse_async_records<MemoryAccessRecord, AnalyseRecord>)) {
+    std::cerr << "Could not start the asynchronous analysis!" << std::endl;
+    PIN_ExitProcess(1);
+    return EXIT_FAILURE;
+  }
+
   // Register finish callback.
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&memory_instruction_infos_lock);
-  PIN_MutexInit(&memory_operands_map_lock);
-
   // Start the program (never returns).
   PIN_StartProgram();
 
@@ -0,0 +1,41 @@
+// RUN: g++ %s -o %t.exe -masm=intel
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -sample_period 64 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+
+// The load of hot_load() is executed 100000 times. Sampling 1 in 64 of them
+// should estimate that within a few percent, and the confidence interval should
+// contain the estimate.
+// RUN: python3 -c "import csv; \
+// RUN:   row = next(r for r in csv.DictReader(open('%t.log.memory-instructions.csv')) if r['routine_name'] == 'hot_load' and int(r['routine_offset']) == 0); \
+// RUN:   n, low, high = (int(row[c]) for c in ('num_executions', 'num_executions_ci_low', 'num_executions_ci_high')); \
+// RUN:   assert 80000 <= n <= 120000, n; \
+// RUN:   assert low < n < high, (low, n, high)"
+
+// XFAIL: x86
+
+#include <cstdint>
+
+// Returns the value its argument points to.
+extern "C" std::int64_t hot_load(const std::int64_t *p);
+
+asm(R"(
+    .section        .text
+    .intel_syntax   noprefix
+    .globl          hot_load
+    .type           hot_load, @function
+
+hot_load:
+    mov             rax, QWORD PTR [rdi]
+    ret
+)");
+
+int main(int argc, char *argv[]) {
+  const std::int64_t value = 1;
+  std::int64_t n = 0;
+
+  for (int i = 0; i < 100000; ++i)
+    n += hot_load(&value);
+
+  return n == 100000 ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+// RUN: g++ %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe
+// RUN: %sde %toolarg -output %t.log -tool_stats 1 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: FileCheck %s < %t.log.toolstats.json
+
+// Without -tool_stats, no statistics are written.
+// RUN: rm -f %t.log.toolstats.json
+// RUN: %sde %toolarg -output %t.log -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: not test -e %t.log.toolstats.json
+
+int values[16];
+
+int main() {
+  for (int i = 1; i < 16; ++i)
+    values[i] = values[i - 1] + i;
+
+  return values[15] == 120 ? 0 : 1;
+}
+
+// CHECK:      "analysis_calls": {
+// CHECK:        "MemoryAccessBefore": {{[1-9][0-9]*}}
+// CHECK:      "locks": {
+// CHECK:        "memory_instruction_infos_lock": {"acquisitions": {{[1-9][0-9]*}}, "contended": {{[0-9]+}}}
+// CHECK:      "timers": {
+// CHECK:        "OnInstruction": {"calls": {{[1-9][0-9]*}}, "seconds": {{.*}}}
+// CHECK:        "OnFinish": {"calls": 1, "seconds": {{.*}}}
+// CHECK:      "peak_sizes": {
+// CHECK:        "memory_instruction_infos": {{[1-9][0-9]*}}
@@ -10,6 +10,10 @@
 // RUN: pretty-print-csvs.py --prefix=%t.limit.log --log_file=%t.limit.log | \
 // RUN: FileCheck %s -DEXE_PATH=%t.exe --check-prefixes CHECK,%arch,%arch-LIM
 
+// RUN: %sde %toolarg -output %t.async.log -async 1 -async_threads 3 -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: pretty-print-csvs.py --prefix=%t.async.log --log_file=%t.async.log | \
+// RUN: FileCheck %s -DEXE_PATH=%t.exe --check-prefixes CHECK,%arch,%arch-NOLIM
+
 #include "common/memcopy.h"
 
 int main() {
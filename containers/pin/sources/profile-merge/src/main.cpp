@@ -0,0 +1,671 @@
+// Merges the outputs of a Pin tool for the regions of a pinball, that were
+// replayed in parallel, into the output that a replay of the whole pinball
+// produces.
+//
+// Usage: ProfileMerge [-output_format csv|columnar] <tool> <output prefix>
+//                     <input prefix>...
+//
+// The inputs must be given in the order of the regions. For ins-counter, the
+// prefixes are the names of the output files of the tool instead.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "inputtable.h"
+#include "table.h"
+
+namespace {
+
+// =============================================================================
+// Helper functions
+// =============================================================================
+
+// Opens an input table. Prints an error if it cannot be opened.
+std::unique_ptr<InputTable> open_input(const std::string &path) {
+  std::unique_ptr<InputTable> table = open_input_table(path);
+
+  if (!table)
+    std::cerr << "Could not read '" << path << ".col' or '" << path
+              << ".csv'!\n";
+
+  return table;
+}
+
+// Looks up the columns with the given names in a table. Prints an error and
+// returns false if a column is missing.
+bool find_columns(const InputTable &table, const std::string &path,
+                  const std::vector<TableColumn> &names,
+                  std::vector<int> &columns) {
+  columns.clear();
+
+  for (const TableColumn &column : names) {
+    columns.push_back(table.find_column(column.name));
+
+    if (columns.back() < 0) {
+      std::cerr << "'" << path << "' has no column '" << column.name << "'!\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Closes an output table. Prints an error if it could not be written.
+bool close_output(TableWriter &table, const std::string &path) {
+  if (!table.close()) {
+    std::cerr << "Could not write '" << path << "'!\n";
+    return false;
+  }
+
+  return true;
+}
+
+// Splits a string in the items separated by a character. Empty items are
+// skipped.
+std::vector<std::string> split(const std::string &s, char separator) {
+  std::vector<std::string> result;
+  std::istringstream iss(s);
+  std::string item;
+
+  while (std::getline(iss, item, separator)) {
+    if (!item.empty())
+      result.push_back(item);
+  }
+
+  return result;
+}
+
+// =============================================================================
+// Basic blocks
+// =============================================================================
+
+// The columns of the basic blocks table of basic-block-profiler.
+const std::vector<TableColumn> BASIC_BLOCKS_COLUMNS = {
+    {"ip_begin", ColumnType::UINT64},
+    {"ip_end", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset_begin", ColumnType::INT64},
+    {"image_offset_end", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset_begin", ColumnType::INT64},
+    {"routine_offset_end", ColumnType::INT64},
+    {"num_executions", ColumnType::UINT64},
+};
+
+// A basic block. The location of the block is the same in all regions, so
+// only the number of executions is merged.
+struct BasicBlock {
+  std::string image_name;
+  std::string full_image_name;
+  std::string section_name;
+  std::int64_t image_offset_begin;
+  std::int64_t image_offset_end;
+  std::string routine_name;
+  std::int64_t routine_offset_begin;
+  std::int64_t routine_offset_end;
+  std::uint64_t num_executions = 0;
+};
+
+// Merge <prefix>.basic-blocks. Basic blocks are identified by their begin and
+// end address.
+bool merge_basic_blocks(const std::vector<std::string> &inputs,
+                        const std::string &output, TableFormat format) {
+  std::map<std::pair<std::uint64_t, std::uint64_t>, BasicBlock> blocks;
+
+  for (const std::string &input : inputs) {
+    const std::string path = input + ".basic-blocks";
+    auto table = open_input(path);
+    std::vector<int> c;
+
+    if (!table || !find_columns(*table, path, BASIC_BLOCKS_COLUMNS, c))
+      return false;
+
+    while (table->next_row()) {
+      const auto key =
+          std::make_pair(static_cast<std::uint64_t>(table->get_int64(c[0])),
+                         static_cast<std::uint64_t>(table->get_int64(c[1])));
+      auto it = blocks.find(key);
+
+      if (it == blocks.end()) {
+        BasicBlock block;
+        block.image_name = table->get_string(c[2]);
+        block.full_image_name = table->get_string(c[3]);
+        block.section_name = table->get_string(c[4]);
+        block.image_offset_begin = table->get_int64(c[5]);
+        block.image_offset_end = table->get_int64(c[6]);
+        block.routine_name = table->get_string(c[7]);
+        block.routine_offset_begin = table->get_int64(c[8]);
+        block.routine_offset_end = table->get_int64(c[9]);
+
+        it = blocks.emplace(key, block).first;
+      }
+
+      it->second.num_executions += table->get_int64(c[10]);
+    }
+  }
+
+  auto table =
+      open_table(output + ".basic-blocks", format, BASIC_BLOCKS_COLUMNS);
+
+  for (const auto &p : blocks) {
+    const BasicBlock &block = p.second;
+
+    *table << p.first.first << p.first.second << block.image_name
+           << block.full_image_name << block.section_name
+           << block.image_offset_begin << block.image_offset_end
+           << block.routine_name << block.routine_offset_begin
+           << block.routine_offset_end << block.num_executions;
+  }
+
+  return close_output(*table, output + ".basic-blocks");
+}
+
+// =============================================================================
+// Branches
+// =============================================================================
+
+// The columns of the branches table of branch-profiler.
+const std::vector<TableColumn> BRANCHES_COLUMNS = {
+    {"image_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"num_taken", ColumnType::UINT64},
+    {"num_not_taken", ColumnType::UINT64},
+};
+
+// A branch.
+struct Branch {
+  std::string image_name;
+  std::int64_t image_offset;
+  std::uint64_t num_taken = 0;
+  std::uint64_t num_not_taken = 0;
+};
+
+// Merge the partial outputs <prefix>.branches.partial. Branches are identified
+// by their address, which also determines the order of the output.
+bool merge_branches(const std::vector<std::string> &inputs,
+                    const std::string &output, TableFormat format) {
+  std::map<std::uint64_t, Branch> branches;
+
+  std::vector<TableColumn> partial_columns = {{"ip", ColumnType::UINT64}};
+  partial_columns.insert(partial_columns.end(), BRANCHES_COLUMNS.begin(),
+                         BRANCHES_COLUMNS.end());
+
+  for (const std::string &input : inputs) {
+    const std::string path = input + ".branches.partial";
+    auto table = open_input(path);
+    std::vector<int> c;
+
+    if (!table || !find_columns(*table, path, partial_columns, c))
+      return false;
+
+    while (table->next_row()) {
+      const auto ip = static_cast<std::uint64_t>(table->get_int64(c[0]));
+      auto it = branches.find(ip);
+
+      if (it == branches.end()) {
+        Branch branch;
+        branch.image_name = table->get_string(c[1]);
+        branch.image_offset = table->get_int64(c[2]);
+
+        it = branches.emplace(ip, branch).first;
+      }
+
+      it->second.num_taken += table->get_int64(c[3]);
+      it->second.num_not_taken += table->get_int64(c[4]);
+    }
+  }
+
+  auto table = open_table(output + ".branches", format, BRANCHES_COLUMNS);
+
+  for (const auto &p : branches) {
+    *table << p.second.image_name << p.second.image_offset
+           << p.second.num_taken << p.second.num_not_taken;
+  }
+
+  return close_output(*table, output + ".branches");
+}
+
+// =============================================================================
+// Memory instructions
+// =============================================================================
+
+// The columns of the memory instructions table of
+// memory-instructions-profiler.
+const std::vector<TableColumn> MEMORY_INSTRUCTIONS_COLUMNS = {
+    {"ip", ColumnType::UINT64},
+    {"image_name", ColumnType::STRING},
+    {"full_image_name", ColumnType::STRING},
+    {"section_name", ColumnType::STRING},
+    {"image_offset", ColumnType::INT64},
+    {"routine_name", ColumnType::STRING},
+    {"routine_offset", ColumnType::INT64},
+    {"read_values", ColumnType::STRING, true},
+    {"read_values_entropy", ColumnType::DOUBLE},
+    {"num_bytes_read", ColumnType::UINT64},
+    {"num_unique_byte_addresses_read", ColumnType::UINT64},
+    {"written_values", ColumnType::STRING, true},
+    {"written_values_entropy", ColumnType::DOUBLE},
+    {"num_bytes_written", ColumnType::UINT64},
+    {"num_unique_byte_addresses_written", ColumnType::UINT64},
+    {"num_executions", ColumnType::UINT64},
+};
+
+// The additional columns of the partial table.
+const std::vector<TableColumn> PARTIAL_MEMORY_INSTRUCTIONS_COLUMNS = {
+    {"read_byte_counts", ColumnType::STRING, true},
+    {"read_byte_addresses", ColumnType::STRING, true},
+    {"read_value_history", ColumnType::STRING, true},
+    {"written_byte_counts", ColumnType::STRING, true},
+    {"written_byte_addresses", ColumnType::STRING, true},
+    {"written_value_history", ColumnType::STRING, true},
+    {"instruction_values_limit", ColumnType::UINT64},
+};
+
+// A value in the history of a region.
+struct HistoryEntry {
+  // The bytes of the value.
+  std::vector<unsigned char> value;
+
+  // The number of times the value was counted in the region.
+  std::uint64_t count;
+
+  // The counts of the values before it when it first occurred.
+  std::vector<std::uint64_t> earlier_counts;
+};
+
+// The merged reads or writes of an instruction.
+struct ReadWriteInfo {
+  // The values, as counted by a replay of the regions so far.
+  std::map<std::vector<unsigned char>, std::uint64_t> values;
+
+  // The number of times each byte value was read/written.
+  std::uint64_t byte_counts[256] = {};
+
+  // The ranges of byte addresses, which are merged at the end.
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> byte_addresses;
+
+  // Adds the values of the next region. The tool counts values until it has
+  // seen 'limit' unique values. Find the value that reaches this limit when
+  // the region follows the previous regions, if any, and count the values of
+  // the region up to that point.
+  void merge_values(const std::vector<HistoryEntry> &history,
+                    std::size_t limit) {
+    if (values.size() >= limit)
+      return;
+
+    std::size_t num_unique = values.size();
+
+    for (std::size_t i = 0; i < history.size(); ++i) {
+      if (values.count(history[i].value) == 0)
+        ++num_unique;
+
+      if (num_unique == limit) {
+        // Counting stops after the first occurrence of this value.
+        for (std::size_t j = 0; j < i; ++j)
+          values[history[j].value] += history[i].earlier_counts[j];
+
+        values[history[i].value] += 1;
+        return;
+      }
+    }
+
+    // The limit is not reached, so all values of the region are counted.
+    for (const HistoryEntry &entry : history)
+      values[entry.value] += entry.count;
+  }
+
+  // Returns the number of unique byte addresses.
+  std::uint64_t num_unique_byte_addresses() {
+    std::sort(byte_addresses.begin(), byte_addresses.end());
+
+    std::uint64_t result = 0;
+    std::uint64_t next = 0; // The first address not counted yet.
+
+    for (const auto &range : byte_addresses) {
+      const std::uint64_t first = std::max(range.first, next);
+
+      if (range.second >= first) {
+        result += range.second - first + 1;
+        next = range.second + 1;
+      }
+    }
+
+    return result;
+  }
+};
+
+// A memory instruction.
+struct MemoryInstruction {
+  std::string image_name;
+  std::string full_image_name;
+  std::string section_name;
+  std::int64_t image_offset;
+  std::string routine_name;
+  std::int64_t routine_offset;
+  ReadWriteInfo read_info;
+  ReadWriteInfo write_info;
+  std::uint64_t num_executions = 0;
+};
+
+// Parses a value history. Returns false if it is invalid.
+bool parse_history(const std::string &s, std::vector<HistoryEntry> &history) {
+  history.clear();
+
+  for (const std::string &item : split(s, ' ')) {
+    const auto equals = item.find('=');
+    const auto at = item.find('@');
+
+    if (equals == std::string::npos || at == std::string::npos ||
+        at < equals || equals % 2 != 0)
+      return false;
+
+    HistoryEntry entry;
+
+    for (std::size_t i = 0; i < equals; i += 2) {
+      entry.value.push_back(static_cast<unsigned char>(
+          std::strtoul(item.substr(i, 2).c_str(), nullptr, 16)));
+    }
+
+    entry.count = std::strtoull(
+        item.substr(equals + 1, at - equals - 1).c_str(), nullptr, 10);
+
+    for (const std::string &count : split(item.substr(at + 1), ','))
+      entry.earlier_counts.push_back(std::strtoull(count.c_str(), nullptr, 10));
+
+    if (entry.earlier_counts.size() != history.size())
+      return false;
+
+    history.push_back(std::move(entry));
+  }
+
+  return true;
+}
+
+// Adds the partial reads or writes of an instruction in a region.
+bool merge_readwrite_info(ReadWriteInfo &info, const std::string &byte_counts,
+                          const std::string &byte_addresses,
+                          const std::string &value_history,
+                          std::size_t limit) {
+  for (const std::string &item : split(byte_counts, ' ')) {
+    const auto colon = item.find(':');
+    const unsigned long byte =
+        std::strtoul(item.substr(0, colon).c_str(), nullptr, 16);
+
+    if (colon == std::string::npos || byte > 255)
+      return false;
+
+    info.byte_counts[byte] +=
+        std::strtoull(item.substr(colon + 1).c_str(), nullptr, 10);
+  }
+
+  for (const std::string &item : split(byte_addresses, ' ')) {
+    const auto dash = item.find('-');
+
+    if (dash == std::string::npos)
+      return false;
+
+    info.byte_addresses.emplace_back(
+        std::strtoull(item.substr(0, dash).c_str(), nullptr, 16),
+        std::strtoull(item.substr(dash + 1).c_str(), nullptr, 16));
+  }
+
+  std::vector<HistoryEntry> history;
+
+  if (!parse_history(value_history, history))
+    return false;
+
+  info.merge_values(history, limit);
+  return true;
+}
+
+// Format the list of read/written values, like memory-instructions-profiler.
+std::string format_value_list(
+    const std::map<std::vector<unsigned char>, std::uint64_t> &values) {
+  std::ostringstream oss;
+  oss << std::right << std::noshowbase << std::hex << std::setfill('0');
+
+  oss << '[';
+
+  bool first = true;
+
+  for (const auto &entry : values) {
+    oss << (first ? "" : ", ");
+    first = false;
+
+    bool first_byte = true;
+
+    for (const auto &byte : entry.first) {
+      oss << std::hex << (first_byte ? "" : " ") << std::setw(2)
+          << static_cast<unsigned int>(byte);
+      first_byte = false;
+    }
+
+    oss << " (occurs " << std::dec << entry.second << " time(s))";
+  }
+
+  oss << ']';
+
+  return oss.str();
+}
+
+// Write the merged reads or writes of an instruction, like
+// memory-instructions-profiler.
+void write_readwrite_info(TableWriter &table, ReadWriteInfo &info) {
+  table << format_value_list(info.values);
+
+  std::uint64_t total_count = 0;
+  for (std::size_t i = 0; i < 256; ++i)
+    total_count += info.byte_counts[i];
+
+  // The byte Shannon entropy, computed in single precision like the tool.
+  float entropy = 0;
+
+  for (std::size_t i = 0; i < 256; ++i) {
+    auto count = info.byte_counts[i];
+
+    if (count > 0) {
+      float p = static_cast<float>(count) / static_cast<float>(total_count);
+      entropy -= p * std::log2(p);
+    }
+  }
+
+  entropy = entropy / std::log2(static_cast<float>(256));
+
+  table << entropy << total_count << info.num_unique_byte_addresses();
+}
+
+// Merge the partial outputs <prefix>.memory-instructions.partial. Instructions
+// are identified by their address, which also determines the order of the
+// output.
+bool merge_memory_instructions(const std::vector<std::string> &inputs,
+                               const std::string &output, TableFormat format) {
+  std::map<std::uint64_t, MemoryInstruction> instructions;
+
+  std::vector<TableColumn> partial_columns = MEMORY_INSTRUCTIONS_COLUMNS;
+  partial_columns.insert(partial_columns.end(),
+                         PARTIAL_MEMORY_INSTRUCTIONS_COLUMNS.begin(),
+                         PARTIAL_MEMORY_INSTRUCTIONS_COLUMNS.end());
+
+  for (const std::string &input : inputs) {
+    const std::string path = input + ".memory-instructions.partial";
+    auto table = open_input(path);
+    std::vector<int> c;
+
+    if (!table || !find_columns(*table, path, partial_columns, c))
+      return false;
+
+    while (table->next_row()) {
+      const auto ip = static_cast<std::uint64_t>(table->get_int64(c[0]));
+      auto it = instructions.find(ip);
+
+      if (it == instructions.end()) {
+        MemoryInstruction instruction;
+        instruction.image_name = table->get_string(c[1]);
+        instruction.full_image_name = table->get_string(c[2]);
+        instruction.section_name = table->get_string(c[3]);
+        instruction.image_offset = table->get_int64(c[4]);
+        instruction.routine_name = table->get_string(c[5]);
+        instruction.routine_offset = table->get_int64(c[6]);
+
+        it = instructions.emplace(ip, std::move(instruction)).first;
+      }
+
+      MemoryInstruction &instruction = it->second;
+      const auto limit = static_cast<std::size_t>(table->get_int64(c[22]));
+
+      instruction.num_executions += table->get_int64(c[15]);
+
+      if (!merge_readwrite_info(instruction.read_info, table->get_string(c[16]),
+                                table->get_string(c[17]),
+                                table->get_string(c[18]), limit) ||
+          !merge_readwrite_info(
+              instruction.write_info, table->get_string(c[19]),
+              table->get_string(c[20]), table->get_string(c[21]), limit)) {
+        std::cerr << "'" << path << "' has an invalid row for ip " << ip
+                  << "!\n";
+        return false;
+      }
+    }
+  }
+
+  auto table = open_table(output + ".memory-instructions", format,
+                          MEMORY_INSTRUCTIONS_COLUMNS);
+
+  for (auto &p : instructions) {
+    MemoryInstruction &instruction = p.second;
+
+    *table << p.first << instruction.image_name << instruction.full_image_name
+           << instruction.section_name << instruction.image_offset
+           << instruction.routine_name << instruction.routine_offset;
+
+    write_readwrite_info(*table, instruction.read_info);
+    write_readwrite_info(*table, instruction.write_info);
+
+    *table << instruction.num_executions;
+  }
+
+  return close_output(*table, output + ".memory-instructions");
+}
+
+// =============================================================================
+// Instruction counts
+// =============================================================================
+
+// Merge the result files of ins-counter, which contain a line '<image>,<count>'
+// per image, followed by 'TOTAL,<count>'.
+bool merge_instruction_counts(const std::vector<std::string> &inputs,
+                              const std::string &output) {
+  std::map<std::string, std::uint64_t> counts;
+  std::uint64_t total = 0;
+
+  for (const std::string &input : inputs) {
+    std::ifstream ifs(input.c_str());
+
+    if (!ifs) {
+      std::cerr << "Could not read '" << input << "'!\n";
+      return false;
+    }
+
+    std::string line;
+
+    while (std::getline(ifs, line)) {
+      const auto comma = line.rfind(',');
+
+      if (comma == std::string::npos)
+        continue;
+
+      const std::string image = line.substr(0, comma);
+      const std::uint64_t count =
+          std::strtoull(line.substr(comma + 1).c_str(), nullptr, 10);
+
+      if (image == "TOTAL")
+        total += count;
+      else
+        counts[image] += count;
+    }
+  }
+
+  std::ofstream ofs(output.c_str());
+
+  if (total > 0) {
+    for (const auto &c : counts)
+      ofs << c.first << "," << c.second << '\n';
+  }
+
+  ofs << "TOTAL" << "," << total << '\n';
+  ofs.close();
+
+  if (ofs.fail()) {
+    std::cerr << "Could not write '" << output << "'!\n";
+    return false;
+  }
+
+  return true;
+}
+
+int usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [-output_format csv|columnar] <tool> <output prefix> "
+               "<input prefix>...\n\n"
+               "Supported tools: basic-block-profiler, branch-profiler, "
+               "ins-counter, memory-instructions-profiler.\n";
+  return EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  TableFormat format = TableFormat::CSV;
+  std::vector<std::string> arguments;
+
+  // Parse the arguments.
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    if (arg == "-output_format" && i + 1 < argc) {
+      if (!parse_table_format(argv[++i], format)) {
+        std::cerr << "Invalid output format '" << argv[i] << "'.\n\n";
+        return usage(argv[0]);
+      }
+    } else if (!arg.empty() && arg[0] == '-') {
+      return usage(argv[0]);
+    } else {
+      arguments.push_back(arg);
+    }
+  }
+
+  if (arguments.size() < 3)
+    return usage(argv[0]);
+
+  const std::string &tool = arguments[0];
+  const std::string &output = arguments[1];
+  const std::vector<std::string> inputs(arguments.begin() + 2,
+                                        arguments.end());
+  bool success;
+
+  if (tool == "basic-block-profiler")
+    success = merge_basic_blocks(inputs, output, format);
+  else if (tool == "branch-profiler")
+    success = merge_branches(inputs, output, format);
+  else if (tool == "memory-instructions-profiler")
+    success = merge_memory_instructions(inputs, output, format);
+  else if (tool == "ins-counter")
+    success = merge_instruction_counts(inputs, output);
+  else
+    return usage(argv[0]);
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
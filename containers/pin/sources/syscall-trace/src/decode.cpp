@@ -0,0 +1,61 @@
+// Converts the binary output of the system call trace Pin tool (i.e. the tool
+// run with -output_format raw) to <prefix>.system-calls.csv.
+//
+// Usage: SyscallTraceDecode <prefix>.system-calls.bin <prefix>.system-calls.csv
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "syscallinfo.h"
+#include "syscallrecord.h"
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <prefix>.system-calls.bin <prefix>.system-calls.csv\n";
+    return EXIT_FAILURE;
+  }
+
+  std::ifstream ifs(argv[1], std::ios::binary);
+  if (!ifs) {
+    std::cerr << "Could not open '" << argv[1] << "'!\n";
+    return EXIT_FAILURE;
+  }
+
+  // Check the header.
+  SyscallTraceHeader header;
+  ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+  if (!ifs || !std::equal(std::begin(SYSCALL_TRACE_MAGIC),
+                          std::end(SYSCALL_TRACE_MAGIC), header.magic)) {
+    std::cerr << "'" << argv[1] << "' is not a system call trace!\n";
+    return EXIT_FAILURE;
+  }
+
+  if (header.address_size != sizeof(void *) ||
+      header.record_size != sizeof(SyscallRecord)) {
+    std::cerr << "'" << argv[1]
+              << "' was written by a version of the Pin tool for another "
+                 "architecture!\n";
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream ofs(argv[2]);
+  if (!ofs) {
+    std::cerr << "Could not open '" << argv[2] << "'!\n";
+    return EXIT_FAILURE;
+  }
+
+  // Format the records.
+  WriteCsvHeader(ofs);
+
+  SyscallRecord record;
+  while (ifs.read(reinterpret_cast<char *>(&record), sizeof(record)))
+    WriteCsvRecord(ofs, record);
+
+  return EXIT_SUCCESS;
+}
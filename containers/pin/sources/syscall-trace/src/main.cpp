@@ -1,28 +1,29 @@
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
-#include <set>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include "create_map.h"
+#include "syscallinfo.h"
+#include "syscallrecord.h"
+#include "toolstats.h"
 
 #include "pin.H"
 #include "sde-init.H"
 
-#include <sys/mman.h>
-#include <sys/syscall.h>
-
 // File stream used to write the human-readable log output to.
 static std::ofstream log_file;
 
-// File stream to write the CSV output to.
-static std::ofstream csv_system_calls;
-
-// Lock to control access to the csv_system_calls file.
-static PIN_MUTEX csv_system_calls_lock;
+// File stream to write the CSV or binary output to.
+static std::ofstream system_calls_file;
 
-// Mutex for sysCallIdMap.
-static PIN_MUTEX sysCallIdMapLock;
+// Whether the raw system calls are written to a binary file, instead of
+// formatting them as CSV.
+static bool raw_output = false;
 
 // Option (-o) to set the output filename.
 KNOB<std::string>
@@ -35,257 +36,266 @@ KNOB<std::string>
                   "Set the prefix used for the CSV output file. The output "
                   "file will be of the form <prefix>.system-calls.csv.");
 
-static constexpr std::size_t MAX_SYSCALL_ARGUMENTS = 6;
-
-// Contains all information for a syscall that can only be determined before the
-// syscall is executed.
-struct SyscallInfo {
-  ADDRINT number; // The system call number.
-  std::string
-      arguments[MAX_SYSCALL_ARGUMENTS]; // The arguments of the system call.
-  unsigned int threadId;
-  unsigned int syscallId;
+// Option (-output_format) to set the format of the output file.
+KNOB<std::string> KnobOutputFormat(
+    KNOB_MODE_WRITEONCE, "pintool", "output_format", "csv",
+    "Set the format of the output file. Valid values are 'csv', which writes "
+    "<prefix>.system-calls.csv, and 'raw', which writes the unformatted system "
+    "calls to <prefix>.system-calls.bin. Use SyscallTraceDecode to convert "
+    "the latter to CSV.");
+
+// Option (-ring_size) to set the size of the per-thread ring buffers.
+KNOB<UINT32>
+    KnobRingSize(KNOB_MODE_WRITEONCE, "pintool", "ring_size", "4096",
+                 "Set the number of system calls that can be buffered per "
+                 "thread before they are written to the output file.");
+
+// Option (-flush_interval) to set the interval of the flush thread.
+KNOB<UINT32> KnobFlushInterval(
+    KNOB_MODE_WRITEONCE, "pintool", "flush_interval", "100",
+    "Set the interval in milliseconds at which the buffered system calls are "
+    "written to the output file.");
+
+// Option (-tool_stats) to write statistics about the tool itself.
+KNOB<bool> KnobToolStats(
+    KNOB_MODE_WRITEONCE, "pintool", "tool_stats", "0",
+    "When true, write statistics about the tool itself, such as the number of "
+    "analysis calls and lock contention, to <prefix>.toolstats.json.");
+
+// Contains the system calls of a thread that have not been written yet.
+//
+// The ring buffer has a single producer, i.e. the thread itself, and is
+// consumed by the flush thread, or by the thread itself when the ring buffer
+// is full. Consumers hold flush_lock.
+struct ThreadData {
+  ThreadData(THREADID thread_id, unsigned int next_syscall_id,
+             std::size_t capacity)
+      : thread_id(thread_id), next_syscall_id(next_syscall_id),
+        records(new SyscallRecord[capacity]), capacity(capacity), head(0),
+        tail(0), exited(false) {}
+
+  // Pin's ID of the thread.
+  THREADID thread_id;
+
+  // The ID of the next system call of this thread.
+  unsigned int next_syscall_id;
+
+  // The ring buffer. The record at 'head' is filled in by the system call that
+  // is in progress, and is published when that system call returns.
+  std::unique_ptr<SyscallRecord[]> records;
+
+  // The number of records in the ring buffer.
+  std::size_t capacity;
+
+  // The number of records that were published.
+  std::atomic<UINT64> head;
+
+  // The number of records that were written to the output file.
+  std::atomic<UINT64> tail;
+
+  // Set when the thread exits, so the ring buffer can be freed once it is
+  // empty.
+  std::atomic<bool> exited;
 };
 
-typedef SyscallInfo ThreadData;
-
 // Key for accessing TLS storage in threads. Initialised once in main().
 static TLS_KEY tls_key = INVALID_TLS_KEY;
 
-// Keep track of how many times we executed any system call in each thread.
+// The ring buffers of all threads that have not been flushed completely yet.
+static std::vector<std::unique_ptr<ThreadData>> thread_datas;
+
+// Mutex for accessing thread_datas.
+static StatMutex thread_datas_lock("thread_datas_lock");
+
+// Mutex held while consuming ring buffers and writing to system_calls_file.
+static StatMutex flush_lock("flush_lock");
+
+// Keep track of how many times we executed any system call in each thread, for
+// threads that exited. Pin reuses the IDs of exited threads.
 static std::map<THREADID, unsigned int> sysCallIdMap;
 
+// Mutex for sysCallIdMap.
+static StatMutex sysCallIdMapLock("sysCallIdMapLock");
+
+// Unique ID of the flush thread.
+static PIN_THREAD_UID flush_thread_uid;
+
+// Set when the flush thread has to stop.
+static std::atomic<bool> flush_thread_stop(false);
+
+// Statistics for -tool_stats. FlushRing() always runs under flush_lock, so its
+// timer is not updated concurrently.
+static CallCounter on_syscall_entry_calls("OnSyscallEntry");
+static CallCounter on_syscall_exit_calls("OnSyscallExit");
+static StatTimer flush_ring_timer("FlushRing");
+static StatTimer on_finish_timer("OnFinish");
+static PeakSize thread_datas_size("thread_datas");
+static PeakSize sys_call_id_map_size("sysCallIdMap");
+
+// Path of the -tool_stats output, if enabled.
+static std::string tool_stats_path;
+
 // =============================================================================
-// Argument formatters
+// Output routines
 // =============================================================================
 
-typedef std::string (*Formatter)(ADDRINT);
+// Write the published records of a ring buffer to the output file. flush_lock
+// must be held when calling this function.
+void FlushRing(ThreadData *thread_data) {
+  ScopedStatTimer timer(flush_ring_timer);
 
-std::string FormatAsVoid(ADDRINT arg) { return "void"; }
+  const UINT64 head = thread_data->head.load(std::memory_order_acquire);
+  UINT64 tail = thread_data->tail.load(std::memory_order_relaxed);
 
-std::string FormatAsHex(ADDRINT arg) {
-  std::ostringstream oss;
-  oss << "0x" << std::noshowbase << std::hex << arg;
-  return oss.str();
-}
+  for (; tail != head; ++tail) {
+    const SyscallRecord &record =
+        thread_data->records[tail % thread_data->capacity];
 
-std::string FormatAsSigned(ADDRINT arg) {
-  std::ostringstream oss;
-#ifdef PIN_TARGET_ARCH_X64
-  oss << static_cast<INT64>(arg);
-#else
-  oss << static_cast<INT32>(arg);
-#endif
-  return oss.str();
-}
+    if (raw_output) {
+      system_calls_file.write(reinterpret_cast<const char *>(&record),
+                              sizeof(record));
+    } else {
+      WriteCsvRecord(system_calls_file, record);
+    }
+  }
 
-std::string FormatAsUnsigned(ADDRINT arg) {
-  std::ostringstream oss;
-  oss << arg;
-  return oss.str();
+  thread_data->tail.store(tail, std::memory_order_release);
 }
 
-void writeFlag(std::ostringstream &oss, ADDRINT arg, bool &firstFlag,
-               ADDRINT flag, const std::string &flagName) {
-  if ((arg & flag) == flag) {
-    oss << (firstFlag ? "" : "|") << flagName;
-    firstFlag = false;
-  }
-}
+// Write the published records of all ring buffers to the output file, and free
+// the ring buffers of exited threads.
+void FlushRings() {
+  flush_lock.lock();
+  thread_datas_lock.lock();
 
-std::string FormatAsProtection(ADDRINT arg) {
-  std::ostringstream oss;
+  for (auto it = thread_datas.begin(); it != thread_datas.end();) {
+    ThreadData *thread_data = it->get();
 
-  if (arg == 0) {
-    oss << "PROT_NONE";
-  } else {
-    bool firstFlag = true;
-
-    writeFlag(oss, arg, firstFlag, PROT_EXEC, "PROT_EXEC");
-    writeFlag(oss, arg, firstFlag, PROT_READ, "PROT_READ");
-    writeFlag(oss, arg, firstFlag, PROT_WRITE, "PROT_WRITE");
-    writeFlag(oss, arg, firstFlag, PROT_SEM, "PROT_SEM");
-    writeFlag(oss, arg, firstFlag, PROT_GROWSUP, "PROT_GROWSUP");
-    writeFlag(oss, arg, firstFlag, PROT_GROWSDOWN, "PROT_GROWSDOWN");
+    // Check 'exited' first, so no records are published after the flush.
+    const bool exited = thread_data->exited.load(std::memory_order_acquire);
+    FlushRing(thread_data);
+
+    if (exited)
+      it = thread_datas.erase(it);
+    else
+      ++it;
   }
 
-  return oss.str();
+  thread_datas_lock.unlock();
+  flush_lock.unlock();
 }
 
-std::string FormatAsFlags(ADDRINT arg) {
-  std::ostringstream oss;
-
-  bool firstFlag = true;
-
-  writeFlag(oss, arg, firstFlag, MAP_SHARED, "MAP_SHARED");
-  writeFlag(oss, arg, firstFlag, MAP_PRIVATE, "MAP_PRIVATE");
-  writeFlag(oss, arg, firstFlag, MAP_32BIT, "MAP_32BIT");
-  writeFlag(oss, arg, firstFlag, MAP_ANONYMOUS, "MAP_ANONYMOUS");
-  writeFlag(oss, arg, firstFlag, MAP_FIXED, "MAP_FIXED");
-  writeFlag(oss, arg, firstFlag, MAP_GROWSDOWN, "MAP_GROWSDOWN");
-  writeFlag(oss, arg, firstFlag, MAP_HUGETLB, "MAP_HUGETLB");
-  writeFlag(oss, arg, firstFlag, MAP_HUGE_2MB, "MAP_HUGE_2MB");
-  writeFlag(oss, arg, firstFlag, MAP_HUGE_1GB, "MAP_HUGE_1GB");
-  writeFlag(oss, arg, firstFlag, MAP_LOCKED, "MAP_LOCKED");
-  writeFlag(oss, arg, firstFlag, MAP_NONBLOCK, "MAP_NONBLOCK");
-  writeFlag(oss, arg, firstFlag, MAP_NORESERVE, "MAP_NORESERVE");
-  writeFlag(oss, arg, firstFlag, MAP_POPULATE, "MAP_POPULATE");
-  writeFlag(oss, arg, firstFlag, MAP_STACK, "MAP_STACK");
-  // NOTE: MAP_UNINITIALIZED is 0x0, so is always printed...
-  // writeFlag(oss, arg, firstFlag, MAP_UNINITIALIZED, "MAP_UNINITIALIZED");
-
-  return oss.str();
+// Internal thread that periodically writes the ring buffers to the output file.
+VOID FlushThread(VOID *arg) {
+  while (!flush_thread_stop.load() && !PIN_IsProcessExiting()) {
+    FlushRings();
+    PIN_Sleep(KnobFlushInterval.Value());
+  }
 }
 
 // =============================================================================
 // Other routines
 // =============================================================================
 
-struct SysCallInfo {
-  SysCallInfo(const std::string &name = "",
-              const Formatter &retValFormatter = FormatAsVoid)
-      : name(name), retValFormatter(retValFormatter) {}
-
-  SysCallInfo &addArg(const Formatter &f) {
-    argFormatters.emplace_back(f);
-    return *this;
-  }
-
-  std::string name;                     // Human-readable name
-  std::vector<Formatter> argFormatters; // Argument formatters
-  Formatter retValFormatter;            // Return value formatter
-};
-
-// Maps system calls to their name, and printers of their arguments and return
-// value.
-static const std::map<ADDRINT, SysCallInfo> SystemCalls =
-    create_map<ADDRINT, SysCallInfo> // SYSCALL_MAP_BEGIN
-    // clang-format off
-
-    (SYS_mmap, SysCallInfo("mmap", FormatAsHex) // void *mmap(
-            .addArg(FormatAsHex)         // void *addr,
-            .addArg(FormatAsUnsigned)    // size_t length,
-            .addArg(FormatAsProtection)  // int prot,
-            .addArg(FormatAsFlags)       // int flags,
-            .addArg(FormatAsSigned)      // int fd,
-            .addArg(FormatAsUnsigned)    // off_t offset)
-    )
-
-#ifdef TARGET_IA32
-    (SYS_mmap2, SysCallInfo("mmap2", FormatAsHex) // void *mmap2(
-            .addArg(FormatAsHex)         // void *addr,
-            .addArg(FormatAsUnsigned)    // size_t length,
-            .addArg(FormatAsProtection)  // int prot,
-            .addArg(FormatAsFlags)       // int flags,
-            .addArg(FormatAsSigned)      // int fd,
-            .addArg(FormatAsUnsigned)    // off_t pgoffset)
-    )
-#endif
-
-    (SYS_mprotect, SysCallInfo("mprotect", FormatAsSigned) // int mprotect(
-            .addArg(FormatAsHex)                 // void *addr,
-            .addArg(FormatAsUnsigned)            // size_t len,
-            .addArg(FormatAsProtection)          // int prot)
-    )
-
-    (SYS_munmap, SysCallInfo("munmap", FormatAsSigned) // int munmap(
-            .addArg(FormatAsHex)               // void *addr,
-            .addArg(FormatAsUnsigned)          // size_t length)
-    )
-
-    (SYS_brk, SysCallInfo("brk", FormatAsHex) // void *brk(
-            .addArg(FormatAsHex)         // void *addr)
-    )
-
-    (SYS_read, SysCallInfo("read", FormatAsSigned) // ssize_t read(
-                .addArg(FormatAsSigned) // int fildes,
-                .addArg(FormatAsHex) // void *buf,
-                .addArg(FormatAsUnsigned) // size_t nbyte)
-    )
-
-    // clang-format on
-    ; // SYSCALL_MAP_END
-
 // Callback that is executed before each system call.
 VOID OnSyscallEntry(THREADID threadId, CONTEXT *ctx, SYSCALL_STANDARD std,
                     VOID *v) {
-  PIN_MutexLock(&sysCallIdMapLock);
-  auto sysCallId = sysCallIdMap[threadId]++;
-  PIN_MutexUnlock(&sysCallIdMapLock);
+  on_syscall_entry_calls.count();
 
-  ADDRINT sysCallNo = PIN_GetSyscallNumber(ctx, std);
   ThreadData *thread_data =
       static_cast<ThreadData *>(PIN_GetThreadData(tls_key, threadId));
-  thread_data->number = sysCallNo;
-  thread_data->threadId = threadId;
-  thread_data->syscallId = sysCallId;
-
-  auto it = SystemCalls.find(sysCallNo);
-  if (it != SystemCalls.end()) {
-    const auto &argFormatters = it->second.argFormatters;
-    unsigned int numArguments = argFormatters.size();
-
-    for (unsigned int i = 0; i < numArguments; ++i) {
-      thread_data->arguments[i] =
-          argFormatters[i](PIN_GetSyscallArgument(ctx, std, i));
-    }
 
-    for (unsigned int i = numArguments; i < MAX_SYSCALL_ARGUMENTS; ++i) {
-      thread_data->arguments[i] = "";
-    }
+  const UINT64 head = thread_data->head.load(std::memory_order_relaxed);
+
+  // Write the ring buffer ourselves if it is full, rather than waiting for the
+  // flush thread.
+  if (head - thread_data->tail.load(std::memory_order_acquire) ==
+      thread_data->capacity) {
+    flush_lock.lock();
+    FlushRing(thread_data);
+    flush_lock.unlock();
   }
+
+  // Fill in the next record, which is published in OnSyscallExit(). Only the
+  // raw values are recorded, and formatted when the record is written.
+  SyscallRecord &record = thread_data->records[head % thread_data->capacity];
+  record.number = PIN_GetSyscallNumber(ctx, std);
+  record.thread_id = threadId;
+  record.syscall_id = thread_data->next_syscall_id++;
+
+  for (unsigned int i = 0; i < MAX_SYSCALL_ARGUMENTS; ++i)
+    record.arguments[i] = PIN_GetSyscallArgument(ctx, std, i);
 }
 
 // Callback that is executed after each system call.
 VOID OnSyscallExit(THREADID threadId, CONTEXT *ctx, SYSCALL_STANDARD std,
                    VOID *v) {
+  on_syscall_exit_calls.count();
+
   ThreadData *thread_data =
       static_cast<ThreadData *>(PIN_GetThreadData(tls_key, threadId));
 
-  ADDRINT sysCallNo = thread_data->number;
-  ADDRINT retVal = PIN_GetSyscallReturn(ctx, std);
-
-  auto it = SystemCalls.find(sysCallNo);
-  if (it != SystemCalls.end()) {
-    PIN_MutexLock(&csv_system_calls_lock);
-
-    const auto &numArguments = it->second.argFormatters.size();
-    const auto &retFormatter = it->second.retValFormatter;
+  const UINT64 head = thread_data->head.load(std::memory_order_relaxed);
 
-    csv_system_calls << it->second.name << ',' // name
-                     << numArguments << ',';   // num_arguments
+  SyscallRecord &record = thread_data->records[head % thread_data->capacity];
+  record.return_value = PIN_GetSyscallReturn(ctx, std);
 
-    for (unsigned int i = 0; i < MAX_SYSCALL_ARGUMENTS; ++i) {
-      csv_system_calls << thread_data->arguments[i] << ','; // argument_{N}
-    }
-
-    csv_system_calls << retFormatter(retVal)          // return_value
-                     << ',' << thread_data->threadId  // thread_id
-                     << ',' << thread_data->syscallId // syscall_id
-                     << '\n';
-
-    PIN_MutexUnlock(&csv_system_calls_lock);
-  }
+  thread_data->head.store(head + 1, std::memory_order_release);
 }
 
 // Callback that is called when a thread starts.
 VOID OnThreadStart(THREADID threadId, CONTEXT *ctx, INT32 flags, VOID *v) {
-  ThreadData *thread_data = new ThreadData();
+  // Continue the system call IDs of an exited thread with the same ID.
+  sysCallIdMapLock.lock();
+  const unsigned int next_syscall_id = sysCallIdMap[threadId];
+  sysCallIdMapLock.unlock();
+
+  ThreadData *thread_data =
+      new ThreadData(threadId, next_syscall_id, KnobRingSize.Value());
   if (!PIN_SetThreadData(tls_key, thread_data, threadId)) {
     std::cerr << "PIN_SetThreadData failed!\n" << std::endl;
     PIN_ExitProcess(1);
   }
+
+  // The ring buffer is freed by FlushRings() once it is empty.
+  thread_datas_lock.lock();
+  thread_datas.emplace_back(thread_data);
+  thread_datas_size.update(thread_datas.size());
+  thread_datas_lock.unlock();
 }
 
 // Callback that is called when a thread exits.
 VOID OnThreadFini(THREADID threadId, const CONTEXT *ctx, INT32 code, VOID *v) {
   ThreadData *thread_data =
       static_cast<ThreadData *>(PIN_GetThreadData(tls_key, threadId));
-  delete thread_data;
+
+  sysCallIdMapLock.lock();
+  sysCallIdMap[threadId] = thread_data->next_syscall_id;
+  sys_call_id_map_size.update(sysCallIdMap.size());
+  sysCallIdMapLock.unlock();
+
+  PIN_SetThreadData(tls_key, nullptr, threadId);
+  thread_data->exited.store(true, std::memory_order_release);
+}
+
+// Run before the application exits, while the internal threads still exist.
+VOID OnPrepareForFinish(VOID *v) {
+  // Stop the flush thread. The remaining records are written in OnFinish().
+  flush_thread_stop.store(true);
+  PIN_WaitForThreadTermination(flush_thread_uid, PIN_INFINITE_TIMEOUT,
+                               nullptr);
 }
 
 // Finalizer routine.
 VOID OnFinish(INT32 code, VOID *v) {
+  ScopedStatTimer timer(on_finish_timer);
+
+  // -----------------------
+  // Machine parsable output
+  // -----------------------
+
+  FlushRings();
+
   // -------
   // Cleanup
   // -------
@@ -294,9 +304,18 @@ VOID OnFinish(INT32 code, VOID *v) {
   log_file.flush();
   log_file.close();
 
-  // Flush and close the CSV file.
-  csv_system_calls.flush();
-  csv_system_calls.close();
+  // Flush and close the CSV or binary file.
+  flush_lock.lock();
+  system_calls_file.flush();
+  system_calls_file.close();
+  flush_lock.unlock();
+}
+
+// Writes the -tool_stats output. Runs after OnFinish(), so that its time is
+// included.
+VOID WriteToolStats(INT32 code, VOID *v) {
+  if (!write_tool_stats(tool_stats_path))
+    std::cerr << "Could not write " << tool_stats_path << ".\n";
 }
 
 // This function is run when signal 15 (SIGTERM) is sent to the application.
@@ -306,6 +325,9 @@ BOOL OnSigTerm(THREADID thread_id, INT32 signal, CONTEXT *context,
   // Write data to file.
   OnFinish(0, nullptr);
 
+  if (!tool_stats_path.empty())
+    WriteToolStats(0, nullptr);
+
   // Exit the application.
   PIN_ExitProcess(0);
 
@@ -332,6 +354,20 @@ int main(int argc, char *argv[]) {
   sde_pin_init(argc, argv);
   sde_init();
 
+  // Check the options.
+  if (KnobOutputFormat.Value() == "raw") {
+    raw_output = true;
+  } else if (KnobOutputFormat.Value() != "csv") {
+    std::cerr << "Invalid output format '" << KnobOutputFormat.Value()
+              << "'.\n\n";
+    return Usage();
+  }
+
+  if (KnobRingSize.Value() == 0) {
+    std::cerr << "The ring size must be at least 1.\n\n";
+    return Usage();
+  }
+
   // Initialise thread-local storage.
   tls_key = PIN_CreateThreadDataKey(nullptr);
   if (tls_key == INVALID_TLS_KEY) {
@@ -350,15 +386,23 @@ int main(int argc, char *argv[]) {
     csv_prefix = KnobOutputFile.Value();
   }
 
-  // Open the CSV files.
-  csv_system_calls.open((csv_prefix + ".system-calls.csv").c_str());
+  // Open the CSV or binary file, and write its header.
+  if (raw_output) {
+    system_calls_file.open((csv_prefix + ".system-calls.bin").c_str(),
+                           std::ios::binary);
+
+    SyscallTraceHeader header;
+    std::copy(std::begin(SYSCALL_TRACE_MAGIC), std::end(SYSCALL_TRACE_MAGIC),
+              header.magic);
+    header.address_size = sizeof(ADDRINT);
+    header.record_size = sizeof(SyscallRecord);
 
-  // Write the CSV header.
-  csv_system_calls << "name,num_arguments,";
-  for (unsigned int i = 0; i < MAX_SYSCALL_ARGUMENTS; ++i) {
-    csv_system_calls << "argument_" << i << ",";
+    system_calls_file.write(reinterpret_cast<const char *>(&header),
+                            sizeof(header));
+  } else {
+    system_calls_file.open((csv_prefix + ".system-calls.csv").c_str());
+    WriteCsvHeader(system_calls_file);
   }
-  csv_system_calls << "return_value,thread_id,syscall_id\n";
 
   // Register callbacks for system call entry and exit.
   PIN_AddSyscallEntryFunction(OnSyscallEntry, nullptr);
@@ -368,18 +412,30 @@ int main(int argc, char *argv[]) {
   PIN_AddThreadStartFunction(OnThreadStart, nullptr);
   PIN_AddThreadFiniFunction(OnThreadFini, nullptr);
 
-  // Register finish callback.
+  // Register finish callbacks.
+  PIN_AddPrepareForFiniFunction(OnPrepareForFinish, nullptr);
   PIN_AddFiniFunction(OnFinish, nullptr);
 
+  // Write the statistics about the tool after the output, if enabled.
+  if (KnobToolStats.Value()) {
+    enable_tool_stats();
+    tool_stats_path = csv_prefix + ".toolstats.json";
+    PIN_AddFiniFunction(WriteToolStats, nullptr);
+  }
+
   // Prevent the application from blocking SIGTERM.
   PIN_UnblockSignal(15, true);
 
   // Intercept SIGTERM so we can kill the application and still obtain results.
   PIN_InterceptSignal(15, OnSigTerm, nullptr);
 
-  // Initialise mutexes.
-  PIN_MutexInit(&csv_system_calls_lock);
-  PIN_MutexInit(&sysCallIdMapLock);
+  // Spawn the thread that writes the ring buffers to the output file.
+  if (PIN_SpawnInternalThread(FlushThread, nullptr, 0, &flush_thread_uid) ==
+      INVALID_THREADID) {
+    std::cerr << "Could not spawn the flush thread!" << std::endl;
+    PIN_ExitProcess(1);
+    return EXIT_FAILURE;
+  }
 
   // Start the program (never returns).
   PIN_StartProgram();
@@ -0,0 +1,182 @@
+#include <sstream>
+
+#include "create_map.h"
+#include "syscallinfo.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Pin's C runtime defines all flags in <sys/mman.h>, but glibc, which the
+// decoder is built against, only defines some of them there.
+#ifndef MAP_HUGE_2MB
+#include <linux/mman.h>
+#endif
+
+// =============================================================================
+// Argument formatters
+// =============================================================================
+
+std::string FormatAsVoid(std::uint64_t arg) { return "void"; }
+
+std::string FormatAsHex(std::uint64_t arg) {
+  std::ostringstream oss;
+  oss << "0x" << std::noshowbase << std::hex << arg;
+  return oss.str();
+}
+
+std::string FormatAsSigned(std::uint64_t arg) {
+  std::ostringstream oss;
+#ifdef TARGET_IA32
+  oss << static_cast<std::int32_t>(arg);
+#else
+  oss << static_cast<std::int64_t>(arg);
+#endif
+  return oss.str();
+}
+
+std::string FormatAsUnsigned(std::uint64_t arg) {
+  std::ostringstream oss;
+  oss << arg;
+  return oss.str();
+}
+
+void writeFlag(std::ostringstream &oss, std::uint64_t arg, bool &firstFlag,
+               std::uint64_t flag, const std::string &flagName) {
+  if ((arg & flag) == flag) {
+    oss << (firstFlag ? "" : "|") << flagName;
+    firstFlag = false;
+  }
+}
+
+std::string FormatAsProtection(std::uint64_t arg) {
+  std::ostringstream oss;
+
+  if (arg == 0) {
+    oss << "PROT_NONE";
+  } else {
+    bool firstFlag = true;
+
+    writeFlag(oss, arg, firstFlag, PROT_EXEC, "PROT_EXEC");
+    writeFlag(oss, arg, firstFlag, PROT_READ, "PROT_READ");
+    writeFlag(oss, arg, firstFlag, PROT_WRITE, "PROT_WRITE");
+    writeFlag(oss, arg, firstFlag, PROT_SEM, "PROT_SEM");
+    writeFlag(oss, arg, firstFlag, PROT_GROWSUP, "PROT_GROWSUP");
+    writeFlag(oss, arg, firstFlag, PROT_GROWSDOWN, "PROT_GROWSDOWN");
+  }
+
+  return oss.str();
+}
+
+std::string FormatAsFlags(std::uint64_t arg) {
+  std::ostringstream oss;
+
+  bool firstFlag = true;
+
+  writeFlag(oss, arg, firstFlag, MAP_SHARED, "MAP_SHARED");
+  writeFlag(oss, arg, firstFlag, MAP_PRIVATE, "MAP_PRIVATE");
+  writeFlag(oss, arg, firstFlag, MAP_32BIT, "MAP_32BIT");
+  writeFlag(oss, arg, firstFlag, MAP_ANONYMOUS, "MAP_ANONYMOUS");
+  writeFlag(oss, arg, firstFlag, MAP_FIXED, "MAP_FIXED");
+  writeFlag(oss, arg, firstFlag, MAP_GROWSDOWN, "MAP_GROWSDOWN");
+  writeFlag(oss, arg, firstFlag, MAP_HUGETLB, "MAP_HUGETLB");
+  writeFlag(oss, arg, firstFlag, MAP_HUGE_2MB, "MAP_HUGE_2MB");
+  writeFlag(oss, arg, firstFlag, MAP_HUGE_1GB, "MAP_HUGE_1GB");
+  writeFlag(oss, arg, firstFlag, MAP_LOCKED, "MAP_LOCKED");
+  writeFlag(oss, arg, firstFlag, MAP_NONBLOCK, "MAP_NONBLOCK");
+  writeFlag(oss, arg, firstFlag, MAP_NORESERVE, "MAP_NORESERVE");
+  writeFlag(oss, arg, firstFlag, MAP_POPULATE, "MAP_POPULATE");
+  writeFlag(oss, arg, firstFlag, MAP_STACK, "MAP_STACK");
+  // NOTE: MAP_UNINITIALIZED is 0x0, so is always printed...
+  // writeFlag(oss, arg, firstFlag, MAP_UNINITIALIZED, "MAP_UNINITIALIZED");
+
+  return oss.str();
+}
+
+// =============================================================================
+// System calls
+// =============================================================================
+
+const std::map<std::uint64_t, SysCallInfo> SystemCalls =
+    create_map<std::uint64_t, SysCallInfo> // SYSCALL_MAP_BEGIN
+    // clang-format off
+
+    (SYS_mmap, SysCallInfo("mmap", FormatAsHex) // void *mmap(
+            .addArg(FormatAsHex)         // void *addr,
+            .addArg(FormatAsUnsigned)    // size_t length,
+            .addArg(FormatAsProtection)  // int prot,
+            .addArg(FormatAsFlags)       // int flags,
+            .addArg(FormatAsSigned)      // int fd,
+            .addArg(FormatAsUnsigned)    // off_t offset)
+    )
+
+#ifdef TARGET_IA32
+    (SYS_mmap2, SysCallInfo("mmap2", FormatAsHex) // void *mmap2(
+            .addArg(FormatAsHex)         // void *addr,
+            .addArg(FormatAsUnsigned)    // size_t length,
+            .addArg(FormatAsProtection)  // int prot,
+            .addArg(FormatAsFlags)       // int flags,
+            .addArg(FormatAsSigned)      // int fd,
+            .addArg(FormatAsUnsigned)    // off_t pgoffset)
+    )
+#endif
+
+    (SYS_mprotect, SysCallInfo("mprotect", FormatAsSigned) // int mprotect(
+            .addArg(FormatAsHex)                 // void *addr,
+            .addArg(FormatAsUnsigned)            // size_t len,
+            .addArg(FormatAsProtection)          // int prot)
+    )
+
+    (SYS_munmap, SysCallInfo("munmap", FormatAsSigned) // int munmap(
+            .addArg(FormatAsHex)               // void *addr,
+            .addArg(FormatAsUnsigned)          // size_t length)
+    )
+
+    (SYS_brk, SysCallInfo("brk", FormatAsHex) // void *brk(
+            .addArg(FormatAsHex)         // void *addr)
+    )
+
+    (SYS_read, SysCallInfo("read", FormatAsSigned) // ssize_t read(
+                .addArg(FormatAsSigned) // int fildes,
+                .addArg(FormatAsHex) // void *buf,
+                .addArg(FormatAsUnsigned) // size_t nbyte)
+    )
+
+    // clang-format on
+    ; // SYSCALL_MAP_END
+
+// =============================================================================
+// CSV output
+// =============================================================================
+
+void WriteCsvHeader(std::ostream &os) {
+  os << "name,num_arguments,";
+  for (unsigned int i = 0; i < MAX_SYSCALL_ARGUMENTS; ++i) {
+    os << "argument_" << i << ",";
+  }
+  os << "return_value,thread_id,syscall_id\n";
+}
+
+void WriteCsvRecord(std::ostream &os, const SyscallRecord &record) {
+  auto it = SystemCalls.find(record.number);
+  if (it == SystemCalls.end())
+    return;
+
+  const auto &argFormatters = it->second.argFormatters;
+  const auto &retFormatter = it->second.retValFormatter;
+  const unsigned int numArguments = argFormatters.size();
+
+  os << it->second.name << ',' // name
+     << numArguments << ',';   // num_arguments
+
+  for (unsigned int i = 0; i < MAX_SYSCALL_ARGUMENTS; ++i) {
+    if (i < numArguments)
+      os << argFormatters[i](record.arguments[i]); // argument_{N}
+
+    os << ',';
+  }
+
+  os << retFormatter(record.return_value) // return_value
+     << ',' << record.thread_id           // thread_id
+     << ',' << record.syscall_id          // syscall_id
+     << '\n';
+}
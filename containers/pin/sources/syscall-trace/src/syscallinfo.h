@@ -0,0 +1,48 @@
+#ifndef SYSCALLINFO_H
+#define SYSCALLINFO_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "syscallrecord.h"
+
+// Formats a raw system call argument or return value.
+typedef std::string (*Formatter)(std::uint64_t);
+
+std::string FormatAsVoid(std::uint64_t arg);
+std::string FormatAsHex(std::uint64_t arg);
+std::string FormatAsSigned(std::uint64_t arg);
+std::string FormatAsUnsigned(std::uint64_t arg);
+std::string FormatAsProtection(std::uint64_t arg);
+std::string FormatAsFlags(std::uint64_t arg);
+
+struct SysCallInfo {
+  SysCallInfo(const std::string &name = "",
+              const Formatter &retValFormatter = FormatAsVoid)
+      : name(name), retValFormatter(retValFormatter) {}
+
+  SysCallInfo &addArg(const Formatter &f) {
+    argFormatters.emplace_back(f);
+    return *this;
+  }
+
+  std::string name;                     // Human-readable name
+  std::vector<Formatter> argFormatters; // Argument formatters
+  Formatter retValFormatter;            // Return value formatter
+};
+
+// Maps system calls to their name, and printers of their arguments and return
+// value.
+extern const std::map<std::uint64_t, SysCallInfo> SystemCalls;
+
+// Writes the header of <prefix>.system-calls.csv.
+void WriteCsvHeader(std::ostream &os);
+
+// Writes a system call as a line of <prefix>.system-calls.csv. System calls
+// without an entry in SystemCalls are skipped.
+void WriteCsvRecord(std::ostream &os, const SyscallRecord &record);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SYSCALLRECORD_H
+#define SYSCALLRECORD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Maximal number of arguments of a system call.
+static constexpr std::size_t MAX_SYSCALL_ARGUMENTS = 6;
+
+// Raw information of a single executed system call, as it is written to the
+// binary output file. Arguments and return values are zero-extended to 64
+// bits, so the layout is the same for the x86 and x64 versions of the tool.
+struct SyscallRecord {
+  // The system call number.
+  std::uint64_t number;
+
+  // The arguments of the system call. Unused arguments are unspecified.
+  std::uint64_t arguments[MAX_SYSCALL_ARGUMENTS];
+
+  // The return value of the system call.
+  std::uint64_t return_value;
+
+  // The ID of the thread that invoked the system call.
+  std::uint32_t thread_id;
+
+  // The ID of the system call within its thread.
+  std::uint32_t syscall_id;
+};
+
+// Magic number at the start of the binary output file.
+static constexpr char SYSCALL_TRACE_MAGIC[8] = {'T', 'R', 'E', 'X',
+                                                'S', 'Y', 'S', '1'};
+
+// Header of the binary output file, which is followed by SyscallRecords.
+struct SyscallTraceHeader {
+  // Equal to SYSCALL_TRACE_MAGIC.
+  char magic[8];
+
+  // The size of an address in bytes of the traced process (4 on x86, 8 on
+  // x64). System call numbers differ between both, so the trace has to be
+  // decoded by a decoder that is built for the same architecture.
+  std::uint32_t address_size;
+
+  // The size of a SyscallRecord in bytes.
+  std::uint32_t record_size;
+};
+
+#endif
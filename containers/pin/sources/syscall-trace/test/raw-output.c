@@ -0,0 +1,34 @@
+// RUN: gcc %s -o %t.exe
+
+// RUN: %sde -log -log:basename %t/pinball -- %t.exe >%t.appout
+// RUN: %sde %toolarg -csv_prefix %t -output_format raw -ring_size 2 \
+// RUN: -replay -replay:basename %t/pinball -replay:addr_trans -- nullapp
+// RUN: syscall-trace-decode %t.system-calls.bin %t.system-calls.csv
+// RUN: pretty-print-csvs.py --prefix=%t | \
+// RUN: FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int main() {
+  // CHECK:      brk(0x0) = 0x[[#%x,BRK_INIT:]]
+  // CHECK:      brk(0x0) = 0x[[#BRK_INIT]]
+  // CHECK:      brk(0x[[#%x,NEW_BREAK:]])
+  // CHECK-SAME: = 0x[[#NEW_BREAK]]
+  void *heap = malloc(4);
+  printf("heap address = %p\n", heap);
+
+  // A small ring size forces the application thread to write the ring buffer
+  // itself, which should not reorder or drop system calls.
+  // CHECK: mmap{{2?}}(0x0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0) = 0x[[#%x,ADDR:]]
+  // CHECK: munmap(0x[[#ADDR]], 4096) = 0
+  // CHECK: read(-1, 0x0, 0) = -9
+  void *p = mmap(NULL, 4096, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  munmap(p, 4096);
+  read(-1, NULL, 0);
+
+  return 0;
+}
@@ -16,6 +16,7 @@ popd
 
 for tool in sources/*/; do
     [[ "$tool" == "sources/cmake/" ]] && continue
+    [[ "$tool" == "sources/common/" ]] && continue
 
     echo "===================================================================="
     echo "Testing Pin tool: $tool"
@@ -36,6 +36,7 @@ class Core:
                 web_port
             )
             db_runner.startup()
+            cls._instance._db_runner = db_runner
             # Connect to database
             # Retry a couple of times, in case the database has not initialised completely
             max_num_retries = 9
@@ -70,6 +71,10 @@ class Core:
     def neo4j_import_directory(self) -> AnyStr:
         return self.get_subdirectory("import")
 
+    @property
+    def neo4j_runner(self) -> Neo4JRunner:
+        return self._db_runner
+
     @property
     def docker_client(self) -> DockerClient:
         return self._docker_client
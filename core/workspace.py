@@ -8,7 +8,7 @@ from neo4j.exceptions import ResultNotSingleError
 
 from neo4j_py2neo_bridge import Graph
 
-from containers.pin.sderunner import SDERecorder, get_tool_architecture
+from containers.pin.sderunner import SDEBulkImporter, SDERecorder, get_tool_architecture
 from core.core import Core
 
 
@@ -130,6 +130,61 @@ class Workspace:
             file_to_delete = os.path.join(Workspace.core.neo4j_import_directory, file)
             os.remove(file_to_delete)
 
+    def bulk_import(self, data_dependencies_prefix: Optional[str] = None, memory_buffers_prefix: Optional[str] = None,
+                    relationship_tag: str = '') -> None:
+        """
+        Import the output of Pin tools into the database with 'neo4j-admin database import', which is much faster than
+        the LOAD CSV queries of the modules. The database is recreated, so this is only possible for a workspace that
+        contains nothing but its workspace info, i.e. right after it has been created.
+
+        Run the modules with import_results=False first, and pass the prefixes of their output here.
+
+        @param data_dependencies_prefix: The prefix of the output of the data-dependencies Pin tool, if any.
+        @param memory_buffers_prefix: The prefix of the output of the memory-buffer Pin tool, if any.
+        @param relationship_tag: The tag of the DEPENDS_ON relationships.
+        """
+        if self.graph.run_evaluate('MATCH (n) WHERE NOT n:workspace_info RETURN count(n)') != 0:
+            raise ValueError(f"Workspace `{self.name}` is not empty, so it cannot be bulk imported")
+
+        # Convert the output of the Pin tools
+        output_name = 'bulk-import'
+        arguments = []
+        if data_dependencies_prefix is not None:
+            arguments += ['-data_dependencies', data_dependencies_prefix, '-tag', relationship_tag]
+        if memory_buffers_prefix is not None:
+            arguments += ['-memory_buffer', memory_buffers_prefix]
+
+        SDEBulkImporter(Core().docker_client, self.binary_path, arguments + [output_name]).run()
+
+        output_path = os.path.join(self.path, output_name)
+        with open(os.path.join(output_path, 'import.args')) as f:
+            import_arguments = f.read().split()
+
+        import_name = f'{self.name}-{output_name}'
+        import_path = os.path.join(Workspace.core.neo4j_import_directory, import_name)
+        shutil.rmtree(import_path, ignore_errors=True)
+        shutil.copytree(output_path, import_path)
+        run(['chmod', '-R', 'a+rX', import_path])
+
+        # Recreate the database from the import files
+        Workspace.core.db.system_graph.run(f"drop database `{self.name}` if exists wait")
+        Workspace.core.neo4j_runner.import_database(self.name, import_name, import_arguments)
+        Workspace.core.db.system_graph.run(f"create database `{self.name}` wait")
+        self.graph = Workspace.core.db[self.name]
+
+        self.graph.run(f'''
+                       MERGE (wsi:workspace_info {{binary_name: "{self.binary_name}", binary_is64_bit: {self.binary_is64bit}}})
+                       ''')
+
+        # Create the indices that the import queries of the modules create
+        self.graph.create_index("Instruction", ["image_name", "image_offset"])
+        self.graph.create_index("Instruction", ["ip"])
+        for node in ['MemoryBuffer', 'MemoryRegion']:
+            self.graph.create_index(node, ["id"])
+
+        shutil.rmtree(import_path)
+        shutil.rmtree(output_path)
+
     def create_recorder(self,
                         binary_params: Optional[str] = None,
                         pinball_suffix: Optional[str] = None,
@@ -3,7 +3,7 @@ import time
 
 from neo4j_py2neo_bridge import Graph
 
-from containers.pin.sderunner import get_tool_architecture, SDERecorder, SDEReplayer
+from containers.pin.sderunner import get_tool_architecture, SDEParallelReplayer, SDERecorder, SDEReplayer
 from core.core import Core
 from core.workspace import Workspace
 from modules.base_module import ConvenienceModule
@@ -13,15 +13,21 @@ class BasicBlockProfilerModule(ConvenienceModule):
     PREFIX: str = "basicblockprofiler"
 
     def __init__(self, binary_params: str, timeout: int, properties_prefix: str = '',
-                 recorder: Optional[SDERecorder] = None):
+                 recorder: Optional[SDERecorder] = None, num_regions: int = 1):
         super().__init__()
         self.binary_params = binary_params
         self.timeout = timeout
         self.pin_tool_name = 'basic-block-profiler'
         self.pin_tool_params = f"-csv_prefix {self.PREFIX}"
-        self.runner = SDEReplayer(Core().docker_client, self.binary_path, self.binary_params, self.pin_tool_name,
-                                  self.pin_tool_params, get_tool_architecture(self.binary_is64bit), self.timeout,
-                                  recorder)
+        if num_regions > 1:
+            # Replay regions of the pinball in parallel, and merge their output
+            self.runner = SDEParallelReplayer(Core().docker_client, self.binary_path, self.binary_params,
+                                              self.pin_tool_name, "", self.PREFIX, num_regions,
+                                              get_tool_architecture(self.binary_is64bit), self.timeout, recorder)
+        else:
+            self.runner = SDEReplayer(Core().docker_client, self.binary_path, self.binary_params, self.pin_tool_name,
+                                      self.pin_tool_params, get_tool_architecture(self.binary_is64bit), self.timeout,
+                                      recorder)
 
         # This can be used to run this Pin plugin with different input sizes, for example
         self.properties_prefix = properties_prefix
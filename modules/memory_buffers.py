@@ -22,10 +22,17 @@ class MemoryBuffersModule(ConvenienceModule):
                                   self.pin_tool_params, get_tool_architecture(self.binary_is64bit), self.timeout,
                                   recorder)
 
-    def run(self):
+    def run(self, import_results: bool = True):
+        """
+        Run the Pin tool, and import its output unless import_results is False, e.g. to load it with
+        Workspace.bulk_import instead.
+        """
         print("\n--- Memory buffers ---")
         self.runner.run()
 
+        if not import_results:
+            return
+
         print("\nImporting matches..")
         self.__import_results()
         print("\nMatches imported")